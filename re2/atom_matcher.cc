@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-19
+ * Description: Interface implementation in atom_matcher.h.
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "re2/atom_matcher.h"
+#include "regex-capi/include/regex_capi.h"
+
+namespace re2
+{
+  AtomMatcher::AtomMatcher(const std::vector<std::string> &atoms)
+      : num_atoms_(static_cast<int>(atoms.size()))
+  {
+    std::vector<const uint8_t *> ptrs;
+    std::vector<size_t> lengths;
+    for (size_t i = 0; i < atoms.size(); i++)
+    {
+      ptrs.push_back((const uint8_t *)atoms[i].data());
+      lengths.push_back(atoms[i].size());
+    }
+    matcher_ = rure_atoms_new(ptrs.data(), lengths.data(), atoms.size());
+  }
+
+  AtomMatcher::~AtomMatcher()
+  {
+    if (matcher_ != NULL)
+      rure_atoms_free(matcher_);
+  }
+
+  void AtomMatcher::Match(const StringPiece &text,
+                          std::vector<int> *atom_ids) const
+  {
+    if (matcher_ == NULL)
+    {
+      atom_ids->resize(num_atoms_);
+      for (int i = 0; i < num_atoms_; i++)
+        (*atom_ids)[i] = i;
+      return;
+    }
+
+    // A NULL text is matched as the empty text; the Rust side may not be
+    // given a NULL pointer, even for no bytes.
+    const char *data = text.data() != NULL ? text.data() : "";
+    atom_ids->resize(std::max<size_t>(atom_ids->capacity(), 16));
+    size_t n = rure_atoms_match(matcher_, (const uint8_t *)data,
+                                text.size(), atom_ids->data(),
+                                atom_ids->size());
+    if (n > atom_ids->size())
+    {
+      atom_ids->resize(n);
+      n = rure_atoms_match(matcher_, (const uint8_t *)data,
+                           text.size(), atom_ids->data(), atom_ids->size());
+    }
+    atom_ids->resize(n);
+  }
+} // namespace re2
@@ -0,0 +1,55 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-19
+ * Description: Case-insensitive search for the atoms of a FilteredRE2.
+ ******************************************************************************/
+
+#pragma once
+
+// AtomMatcher finds which of the atoms returned by FilteredRE2::Compile
+// occur in a text. The atoms are lowercased; the text is searched as is,
+// ignoring case, without being copied or lowercased first.
+//
+// The search is done by an Aho-Corasick automaton built by regex-capi;
+// see rure_atoms_new in regex_capi.h.
+
+#include <string>
+#include <vector>
+
+#include "re2/stringpiece.h"
+
+struct rure_atoms;
+
+namespace re2 {
+
+class AtomMatcher {
+ public:
+  explicit AtomMatcher(const std::vector<std::string>& atoms);
+  ~AtomMatcher();
+
+  // Sets atom_ids to the indices in atoms of the atoms that occur in
+  // text, in increasing order. This function is thread safe.
+  void Match(const StringPiece& text, std::vector<int>* atom_ids) const;
+
+  int num_atoms() const { return num_atoms_; }
+
+ private:
+  // The matcher, or NULL if it could not be built, in which case every
+  // atom is reported to occur.
+  rure_atoms* matcher_;
+  int num_atoms_;
+
+  AtomMatcher(const AtomMatcher&) = delete;
+  AtomMatcher& operator=(const AtomMatcher&) = delete;
+};
+
+}  // namespace re2
@@ -13,57 +13,143 @@
  * Description: Interface implementation in filtered_re2.h.
  ******************************************************************************/
 #include <iostream>
-#include <map>
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
 #include <utility>
 
 #include "re2/testing/util/util.h"
 #include "re2/testing/util/logging.h"
 #include "re2/filtered_re2.h"
-extern "C"
-{
+#include "re2/atom_matcher.h"
+#include "re2/index_file.h"
+#include "re2/prefilter.h"
+#include "re2/prefilter_tree.h"
+#include "re2/thread_pool.h"
 #include "regex-capi/include/regex_capi.h"
-}
 using namespace std;
 namespace re2
 {
+  struct FilteredRE2::Shard
+  {
+    // Bit j is set if regexp first + j is in the automaton, where first is
+    // the first regexp of the shard. regexps lists the same regexps in
+    // increasing order; pattern k of the automaton is regexps[k].
+    uint64_t members;
+    std::vector<int> regexps;
 
-  std::map<std::string, std::vector<std::string>> map_atoms;
+    // The automaton, built the first time a search needs it. NULL if it
+    // could not be built.
+    std::once_flag once;
+    rure_set *set;
 
-  class PrefilterTree
-  {
-  public:
-    PrefilterTree() : min_atom_len_(3){};
-    explicit PrefilterTree(int min_atom_len) : min_atom_len_(min_atom_len){};
-    ~PrefilterTree(){};
-    int getMinAtomLen()
+    Shard() : members(0), set(NULL) {}
+    ~Shard()
     {
-      return min_atom_len_;
+      if (set != NULL)
+        rure_set_free(set);
     }
-    bool get_is_latin_result() { return is_latin; };
-    void set_latin(bool x);
-    std::string get_latin_string() { return str_latin; };
-    void set_latin_str(std::string x);
 
-  private:
-    const int min_atom_len_;
-    bool is_latin;
-    std::string str_latin;
+    rure_set *GetSet(const FilteredRE2 &f)
+    {
+      std::call_once(once, [&]()
+                     {
+        std::vector<const uint8_t *> patterns;
+        std::vector<size_t> lengths;
+        for (size_t k = 0; k < regexps.size(); k++)
+        {
+          StringPiece pattern = f.RegexpPattern(regexps[k]);
+          patterns.push_back((const uint8_t *)pattern.data());
+          lengths.push_back(pattern.size());
+        }
+        rure_error *err = rure_error_new();
+        set = rure_compile_set(patterns.data(), lengths.data(), patterns.size(),
+                               RURE_DEFAULT_FLAGS, NULL, err);
+        rure_error_free(err); });
+      return set;
+    }
   };
-  void PrefilterTree::set_latin(bool x)
+
+  struct FilteredRE2::Adaptive
   {
-    is_latin = x;
-  }
-  void PrefilterTree::set_latin_str(std::string x)
+    // The regexps to verify first, best first, up to the first -1.
+    // Reorder writes them while FirstMatch reads them; a mix of the old
+    // and the new order is harmless, as any order gives a right answer.
+    static const int kMaxHot = 16;
+    std::atomic<int> hot[kMaxHot];
+
+    std::vector<int> priority;
+    bool one_priority;
+
+    // For each regexp, how often FirstMatch returned it, and the time
+    // spent verifying it on its own and how many times that was timed.
+    std::unique_ptr<std::atomic<uint32_t>[]> hits;
+    std::unique_ptr<std::atomic<uint64_t>[]> cost_ns;
+    std::unique_ptr<std::atomic<uint32_t>[]> verifies;
+
+    // The same over all regexps, for those that were never timed.
+    std::atomic<uint64_t> total_cost_ns;
+    std::atomic<uint64_t> total_verifies;
+
+    // The regexps FirstMatch returned lately, most recent last, wrapping
+    // around; -1 where none was. Reorder ranks only these and the hot
+    // ones, so that its cost does not grow with the number of regexps.
+    static const int kMaxRecent = 256;
+    std::atomic<int> recent[kMaxRecent];
+    std::atomic<uint32_t> next_recent;
+
+    std::atomic<uint64_t> calls;
+    std::mutex reorder_mu;
+
+    Adaptive(int n, const std::vector<int> &priorities)
+        : priority(n, 0),
+          one_priority(true),
+          hits(new std::atomic<uint32_t>[n]),
+          cost_ns(new std::atomic<uint64_t>[n]),
+          verifies(new std::atomic<uint32_t>[n]),
+          total_cost_ns(0),
+          total_verifies(0),
+          next_recent(0),
+          calls(0)
+    {
+      for (int k = 0; k < kMaxHot; k++)
+        hot[k].store(-1);
+      for (int k = 0; k < kMaxRecent; k++)
+        recent[k].store(-1);
+      for (int i = 0; i < n; i++)
+      {
+        if (i < static_cast<int>(priorities.size()))
+          priority[i] = priorities[i];
+        if (priority[i] != priority[0])
+          one_priority = false;
+        hits[i].store(0);
+        cost_ns[i].store(0);
+        verifies[i].store(0);
+      }
+    }
+
+    void Hit(int id)
+    {
+      hits[id].fetch_add(1, std::memory_order_relaxed);
+      recent[next_recent.fetch_add(1, std::memory_order_relaxed) % kMaxRecent]
+          .store(id, std::memory_order_relaxed);
+    }
+  };
+
+  // Whether a multi-pattern automaton compiled with RURE_DEFAULT_FLAGS
+  // matches the same texts as a regexp with these options does in
+  // PartialMatch.
+  static bool SameAsDefaultFlags(const RE2::Options &options)
   {
-    str_latin = x;
+    return options.encoding() == RE2::Options::EncodingUTF8 &&
+           !options.dot_nl() && !options.never_nl();
   }
-};
 
-namespace re2
-{
 
   FilteredRE2::FilteredRE2()
       : compiled_(false),
@@ -85,11 +171,20 @@ namespace re2
 
   FilteredRE2::FilteredRE2(FilteredRE2 &&other)
       : re2_vec_(std::move(other.re2_vec_)),
+        patterns_(std::move(other.patterns_)),
+        options_(std::move(other.options_)),
+        re2_once_(std::move(other.re2_once_)),
+        index_file_(std::move(other.index_file_)),
         compiled_(other.compiled_),
-        prefilter_tree_(std::move(other.prefilter_tree_))
+        prefilter_tree_(std::move(other.prefilter_tree_)),
+        atom_matcher_(std::move(other.atom_matcher_)),
+        shards_(std::move(other.shards_)),
+        adaptive_(std::move(other.adaptive_))
   {
     other.re2_vec_.clear();
     other.re2_vec_.shrink_to_fit();
+    other.patterns_.clear();
+    other.options_.clear();
     other.compiled_ = false;
     other.prefilter_tree_.reset(new PrefilterTree());
   }
@@ -104,19 +199,60 @@ namespace re2
   RE2::ErrorCode FilteredRE2::Add(const StringPiece &pattern,
                                   const RE2::Options &options, int *id)
   {
-    RE2 *re = new RE2(pattern, options);
-    RE2::ErrorCode code = re->error_code();
-    if (options.encoding() == RE2::Options::EncodingLatin1)
+    if (re2_once_ != NULL)
     {
-      prefilter_tree_->set_latin(true);
-      prefilter_tree_->set_latin_str(pattern.as_string());
+      LOG(ERROR) << "Add called after LoadIndex.";
+      return RE2::ErrorInternal;
     }
-    else
-      prefilter_tree_->set_latin(false);
+    return AddRE2(pattern, new RE2(pattern, options), id);
+  }
+
+  bool FilteredRE2::AddBatch(const std::vector<StringPiece> &patterns,
+                             const RE2::Options &options,
+                             std::vector<int> *ids,
+                             std::vector<RE2::ErrorCode> *errors,
+                             ThreadPool *pool)
+  {
+    const int n = static_cast<int>(patterns.size());
+    ids->assign(n, -1);
+    if (errors != NULL)
+      errors->assign(n, RE2::NoError);
+    if (re2_once_ != NULL)
+    {
+      LOG(ERROR) << "AddBatch called after LoadIndex.";
+      if (errors != NULL)
+        errors->assign(n, RE2::ErrorInternal);
+      return n == 0;
+    }
+
+    // Building an RE2 compiles its pattern, which is most of the cost of
+    // Add, and touches nothing shared, so the RE2 objects are built in
+    // parallel and then added one by one in the order of patterns.
+    std::vector<RE2 *> res(n);
+    if (pool == NULL)
+      pool = ThreadPool::Default();
+    pool->Run(n, [&](int i)
+              { res[i] = new RE2(patterns[i], options); });
+    bool ok = true;
+    for (int i = 0; i < n; i++)
+    {
+      RE2::ErrorCode code = AddRE2(patterns[i], res[i], &(*ids)[i]);
+      if (errors != NULL)
+        (*errors)[i] = code;
+      if (code != RE2::NoError)
+        ok = false;
+    }
+    return ok;
+  }
+
+  RE2::ErrorCode FilteredRE2::AddRE2(const StringPiece &pattern, RE2 *re,
+                                     int *id)
+  {
+    RE2::ErrorCode code = re->error_code();
 
     if (!re->ok())
     {
-      if (options.log_errors())
+      if (re->options().log_errors())
       {
         LOG(ERROR) << "Couldn't compile regular expression, skipping: "
                    << pattern << " due to error " << re->error();
@@ -134,7 +270,52 @@ namespace re2
 
   void FilteredRE2::Compile(std::vector<std::string> *atoms)
   {
-    map_atoms.clear();
+    Compile(atoms, NULL, 0);
+  }
+
+  // Appends the atoms under node to atoms.
+  static void CollectAtoms(const Prefilter *node,
+                           std::vector<std::string> *atoms)
+  {
+    if (node == NULL)
+      return;
+    if (node->op() == Prefilter::ATOM && !node->atom().empty())
+      atoms->push_back(node->atom());
+    for (size_t i = 0; i < node->subs().size(); i++)
+      CollectAtoms(node->subs()[i], atoms);
+  }
+
+  // Estimates the fraction of texts that contain each atom of prefilters
+  // from the sample corpus[0] to corpus[n - 1].
+  static void CountAtoms(const std::vector<Prefilter *> &prefilters,
+                         const StringPiece *corpus, int n,
+                         PrefilterTree::AtomFrequencies *frequencies)
+  {
+    std::vector<std::string> atoms;
+    for (size_t i = 0; i < prefilters.size(); i++)
+      CollectAtoms(prefilters[i], &atoms);
+    std::sort(atoms.begin(), atoms.end());
+    atoms.erase(std::unique(atoms.begin(), atoms.end()), atoms.end());
+
+    AtomMatcher matcher(atoms);
+    std::vector<int64_t> hits(atoms.size(), 0);
+    std::vector<int> matched;
+    for (int i = 0; i < n; i++)
+    {
+      matcher.Match(corpus[i], &matched);
+      for (size_t j = 0; j < matched.size(); j++)
+        hits[matched[j]]++;
+    }
+    // Add one hit and one miss, so that an atom missing from the sample
+    // is rare rather than never found.
+    for (size_t j = 0; j < atoms.size(); j++)
+      (*frequencies)[atoms[j]] =
+          static_cast<double>(hits[j] + 1) / static_cast<double>(n + 2);
+  }
+
+  void FilteredRE2::Compile(std::vector<std::string> *atoms,
+                            const StringPiece *corpus, int n)
+  {
     if (compiled_)
     {
       LOG(ERROR) << "Compile called already.";
@@ -146,47 +327,198 @@ namespace re2
       LOG(ERROR) << "Compile called before Add.";
       return;
     }
-    atoms->clear();
 
-    // 处理latin的情况
-    if (prefilter_tree_->get_is_latin_result())
-    {
-      std::string str = prefilter_tree_->get_latin_string();
-      std::vector<std::string> vec;
-      vec.push_back(str);
-      std::string str_low = str;
-      transform(str_low.begin(), str_low.end(), str_low.begin(), ::tolower);
-      atoms->push_back(str_low);
-      map_atoms.insert(map<std::string, std::vector<std::string>>::value_type(str, vec));
-      map_atoms.insert(map<std::string, std::vector<std::string>>::value_type("total", vec));
-      compiled_ = true;
-      return;
+    std::vector<Prefilter *> prefilters;
+    for (size_t i = 0; i < re2_vec_.size(); i++)
+      prefilters.push_back(Prefilter::FromRE2(re2_vec_[i]));
+    if (n > 0)
+    {
+      PrefilterTree::AtomFrequencies frequencies;
+      CountAtoms(prefilters, corpus, n, &frequencies);
+      prefilter_tree_->SetAtomFrequencies(frequencies);
     }
+    for (size_t i = 0; i < prefilters.size(); i++)
+      prefilter_tree_->Add(prefilters[i]);
+    atoms->clear();
+    prefilter_tree_->Compile(atoms);
+    atom_matcher_.reset(new AtomMatcher(*atoms));
+    BuildShards();
+    compiled_ = true;
+  }
 
+  void FilteredRE2::BuildShards()
+  {
+    shards_.clear();
     for (size_t i = 0; i < re2_vec_.size(); i++)
     {
-      // std::vector<std::string> my_atoms = MyCompile(re2_vec_[i]->pattern(), prefilter_tree_->getMinAtomLen());
-      const char *regex = re2_vec_[i]->pattern().c_str();
-      std::string regex_str = regex;
-      MyVec vec = rure_filter_compile((const uint8_t *)regex, strlen(regex), prefilter_tree_->getMinAtomLen());
-      int32_t len = vec.len;
-      std::vector<std::string> v;
-      for (int32_t i = 0; i < len; i++)
+      if (i % kShardSize == 0)
+        shards_.emplace_back(new Shard);
+      if (SameAsDefaultFlags(RegexpOptions(static_cast<int>(i))))
       {
-        atoms->push_back(vec.data[i].atom);
-        v.push_back(vec.data[i].atom);
+        shards_.back()->members |= uint64_t{1} << (i % kShardSize);
+        shards_.back()->regexps.push_back(static_cast<int>(i));
       }
-      map_atoms.insert(map<std::string, std::vector<std::string>>::value_type(regex_str, v));
     }
-    map_atoms.insert(map<std::string, std::vector<std::string>>::value_type("total", *atoms));
+  }
+
+  StringPiece FilteredRE2::RegexpPattern(int i) const
+  {
+    if (re2_once_ != NULL)
+      return patterns_[i];
+    return re2_vec_[i]->pattern();
+  }
+
+  const RE2::Options &FilteredRE2::RegexpOptions(int i) const
+  {
+    if (re2_once_ != NULL)
+      return options_[i];
+    return re2_vec_[i]->options();
+  }
+
+  const RE2 &FilteredRE2::GetRE2(int regexpid) const
+  {
+    if (re2_once_ != NULL)
+    {
+      std::call_once(re2_once_[regexpid], [&]()
+                     { re2_vec_[regexpid] = new RE2(patterns_[regexpid],
+                                                    options_[regexpid]); });
+    }
+    return *re2_vec_[regexpid];
+  }
+
+  // The options of a regexp in an index file, as bits.
+  enum
+  {
+    kIndexUTF8 = 1 << 0,
+    kIndexPosixSyntax = 1 << 1,
+    kIndexLongestMatch = 1 << 2,
+    kIndexLogErrors = 1 << 3,
+    kIndexLiteral = 1 << 4,
+    kIndexNeverNL = 1 << 5,
+    kIndexDotNL = 1 << 6,
+    kIndexNeverCapture = 1 << 7,
+    kIndexCaseSensitive = 1 << 8,
+    kIndexPerlClasses = 1 << 9,
+    kIndexWordBoundary = 1 << 10,
+    kIndexOneLine = 1 << 11,
+  };
+
+  static int32_t OptionBits(const RE2::Options &o)
+  {
+    int32_t bits = 0;
+    if (o.encoding() == RE2::Options::EncodingUTF8)
+      bits |= kIndexUTF8;
+    if (o.posix_syntax())
+      bits |= kIndexPosixSyntax;
+    if (o.longest_match())
+      bits |= kIndexLongestMatch;
+    if (o.log_errors())
+      bits |= kIndexLogErrors;
+    if (o.literal())
+      bits |= kIndexLiteral;
+    if (o.never_nl())
+      bits |= kIndexNeverNL;
+    if (o.dot_nl())
+      bits |= kIndexDotNL;
+    if (o.never_capture())
+      bits |= kIndexNeverCapture;
+    if (o.case_sensitive())
+      bits |= kIndexCaseSensitive;
+    if (o.perl_classes())
+      bits |= kIndexPerlClasses;
+    if (o.word_boundary())
+      bits |= kIndexWordBoundary;
+    if (o.one_line())
+      bits |= kIndexOneLine;
+    return bits;
+  }
+
+  static RE2::Options OptionsFromBits(int32_t bits, int64_t max_mem)
+  {
+    RE2::Options o;
+    o.set_encoding((bits & kIndexUTF8) ? RE2::Options::EncodingUTF8
+                                       : RE2::Options::EncodingLatin1);
+    o.set_posix_syntax((bits & kIndexPosixSyntax) != 0);
+    o.set_longest_match((bits & kIndexLongestMatch) != 0);
+    o.set_log_errors((bits & kIndexLogErrors) != 0);
+    o.set_literal((bits & kIndexLiteral) != 0);
+    o.set_never_nl((bits & kIndexNeverNL) != 0);
+    o.set_dot_nl((bits & kIndexDotNL) != 0);
+    o.set_never_capture((bits & kIndexNeverCapture) != 0);
+    o.set_case_sensitive((bits & kIndexCaseSensitive) != 0);
+    o.set_perl_classes((bits & kIndexPerlClasses) != 0);
+    o.set_word_boundary((bits & kIndexWordBoundary) != 0);
+    o.set_one_line((bits & kIndexOneLine) != 0);
+    o.set_max_mem(max_mem);
+    return o;
+  }
+
+  bool FilteredRE2::SaveIndex(const std::string &path) const
+  {
+    if (!compiled_)
+    {
+      LOG(ERROR) << "SaveIndex called before Compile.";
+      return false;
+    }
+    std::vector<StringPiece> patterns;
+    std::vector<int32_t> bits;
+    std::vector<int64_t> max_mem;
+    for (int i = 0; i < NumRegexps(); i++)
+    {
+      patterns.push_back(RegexpPattern(i));
+      bits.push_back(OptionBits(RegexpOptions(i)));
+      max_mem.push_back(RegexpOptions(i).max_mem());
+    }
+    IndexWriter writer;
+    writer.PutStrings(patterns);
+    writer.PutArray(bits);
+    writer.PutArray(max_mem);
+    prefilter_tree_->Save(&writer);
+    return writer.WriteFile(path);
+  }
+
+  bool FilteredRE2::LoadIndex(const std::string &path,
+                              std::vector<std::string> *strings_to_match)
+  {
+    strings_to_match->clear();
+    if (compiled_ || !re2_vec_.empty())
+    {
+      LOG(ERROR) << "LoadIndex called after Add or Compile.";
+      return false;
+    }
+
+    std::unique_ptr<MappedFile> file(MappedFile::Open(path));
+    if (file == NULL)
+      return false;
+    IndexReader reader(file->data(), file->size());
+    std::vector<StringPiece> patterns;
+    IndexArray<int32_t> bits;
+    IndexArray<int64_t> max_mem;
+    if (!reader.GetStrings(&patterns) || !reader.GetArray(&bits) ||
+        !reader.GetArray(&max_mem) || patterns.empty() ||
+        bits.size() != patterns.size() || max_mem.size() != patterns.size())
+      return false;
+    const int n = static_cast<int>(patterns.size());
+    if (!prefilter_tree_->Load(&reader, n, strings_to_match))
+      return false;
+
+    patterns_.swap(patterns);
+    for (int i = 0; i < n; i++)
+      options_.push_back(OptionsFromBits(bits[i], max_mem[i]));
+    re2_vec_.assign(n, NULL);
+    re2_once_.reset(new std::once_flag[n]);
+    index_file_ = std::move(file);
+    atom_matcher_.reset(new AtomMatcher(*strings_to_match));
+    BuildShards();
     compiled_ = true;
+    return true;
   }
 
   int FilteredRE2::SlowFirstMatch(const StringPiece &text) const
   {
     for (size_t i = 0; i < re2_vec_.size(); i++)
     {
-      if (RE2::PartialMatch(text, re2_vec_[i]->pattern()))
+      if (RE2::PartialMatch(text, RegexpPattern(static_cast<int>(i))))
       {
         return static_cast<int>(i);
       }
@@ -194,99 +526,383 @@ namespace re2
     return -1;
   }
 
-  void AtomsToRegexps(std::vector<RE2 *> re2_vec_, std::vector<int> atoms, std::vector<int> *regexps, int min_atom_len)
+  int FilteredRE2::FirstMatch(const StringPiece &text,
+                              const std::vector<int> &atoms) const
   {
-    // 根据atoms索引获取regexp索引的规则
-    /*
-     * 如果没有原子, 那么直接会把re加进去。
-     * 如果这个正则表达式有原子，那么要把该正则表达式的所有的原子的索引全加入，这个正则表达式才能加入成功。
-     */
-
-    std::vector<std::string> atoms_total = map_atoms["total"];
-    std::vector<std::string> atoms_tmp;
-    for (size_t i = 0; i < atoms.size(); i++)
+    if (!compiled_)
     {
-      atoms_tmp.push_back(atoms_total[atoms[i]]);
+      LOG(DFATAL) << "FirstMatch called before Compile.";
+      return -1;
     }
-    for (size_t i = 0; i < re2_vec_.size(); i++)
+    std::vector<int> regexps;
+    prefilter_tree_->RegexpsGivenStrings(atoms, &regexps);
+    if (adaptive_ != NULL)
+      return AdaptiveFirstMatch(text, &regexps);
+    return FirstMatchInOrder(text, regexps.data(),
+                             static_cast<int>(regexps.size()));
+  }
+
+  int FilteredRE2::FirstMatchInOrder(const StringPiece &text,
+                                     const int *candidates, int n) const
+  {
+    // The shards are checked in order, so the first one with a match has
+    // the first matching regexp.
+    for (int i = 0; i < n;)
     {
-      // std::vector<std::string> my_atoms = MyCompile(re2_vec_[i]->pattern(), min_atom_len);
-      std::string str = re2_vec_[i]->pattern();
-      std::vector<std::string> my_atoms = map_atoms[str];
-      if (my_atoms.size() == 0)
+      int shard = candidates[i] / kShardSize;
+      uint64_t mask = 0;
+      for (; i < n && candidates[i] / kShardSize == shard; i++)
+        mask |= uint64_t{1} << (candidates[i] % kShardSize);
+      uint64_t matched = VerifyShard(text, shard, mask);
+      if (matched != 0)
       {
-        regexps->push_back(i);
-        continue;
-      }
-      else
-      {
-        int count = 0;
-        for (size_t ii = 0; ii < my_atoms.size(); ii++)
+        int j = 0;
+        while ((matched & 1) == 0)
         {
-          for (size_t jj = 0; jj < atoms_tmp.size(); jj++)
-          {
-            if (my_atoms[ii] == atoms_tmp[jj])
-            {
-              count++;
-              break;
-            }
-          }
+          matched >>= 1;
+          j++;
         }
-        if (count == (int)my_atoms.size())
-          regexps->push_back(int(i));
+        return shard * kShardSize + j;
       }
     }
+    return -1;
   }
 
-  int FilteredRE2::FirstMatch(const StringPiece &text,
-                              const std::vector<int> &atoms) const
+  void FilteredRE2::EnableAdaptiveFirstMatch(const std::vector<int> &priorities)
   {
     if (!compiled_)
     {
-      LOG(DFATAL) << "FirstMatch called before Compile.";
-      return -1;
+      LOG(ERROR) << "EnableAdaptiveFirstMatch called before Compile.";
+      return;
     }
-    std::vector<int> regexps;
+    adaptive_.reset(new Adaptive(NumRegexps(), priorities));
+  }
 
-    AtomsToRegexps(re2_vec_, atoms, &regexps, prefilter_tree_->getMinAtomLen());
+  int FilteredRE2::AdaptiveFirstMatch(const StringPiece &text,
+                                      std::vector<int> *candidates) const
+  {
+    // How many calls go by between reorderings, and between the calls
+    // that time the verification of the hot regexps.
+    const uint64_t kReorderInterval = 4096;
+    const uint64_t kTimeInterval = 16;
 
-    for (size_t i = 0; i < regexps.size(); i++)
-      if (RE2::PartialMatch(text, *re2_vec_[regexps[i]]))
-        return static_cast<int>(i);
+    Adaptive *a = adaptive_.get();
+    uint64_t call = a->calls.fetch_add(1, std::memory_order_relaxed);
+    if (call % kReorderInterval == kReorderInterval - 1)
+      Reorder();
+    const bool timed = call % kTimeInterval == 0;
+
+    if (!a->one_priority)
+      std::stable_sort(candidates->begin(), candidates->end(),
+                       [a](int x, int y)
+                       { return a->priority[x] < a->priority[y]; });
+
+    // Each run of candidates of one priority is in increasing order.
+    // Verify the hot ones among them first, then the rest in order.
+    std::vector<int> rest;
+    const int *c = candidates->data();
+    const size_t n = candidates->size();
+    for (size_t begin = 0, end; begin < n; begin = end)
+    {
+      end = begin + 1;
+      while (end < n && a->priority[c[end]] == a->priority[c[begin]])
+        end++;
+
+      int failed[Adaptive::kMaxHot];
+      int nfailed = 0;
+      for (int k = 0; k < Adaptive::kMaxHot; k++)
+      {
+        int id = a->hot[k].load(std::memory_order_relaxed);
+        if (id < 0)
+          break;
+        if (!std::binary_search(c + begin, c + end, id))
+          continue;
+        std::chrono::steady_clock::time_point start;
+        if (timed)
+          start = std::chrono::steady_clock::now();
+        bool matched = VerifyShard(text, id / kShardSize,
+                                   uint64_t{1} << (id % kShardSize)) != 0;
+        if (timed)
+        {
+          std::chrono::nanoseconds elapsed =
+              std::chrono::steady_clock::now() - start;
+          a->cost_ns[id].fetch_add(elapsed.count(), std::memory_order_relaxed);
+          a->verifies[id].fetch_add(1, std::memory_order_relaxed);
+          a->total_cost_ns.fetch_add(elapsed.count(),
+                                     std::memory_order_relaxed);
+          a->total_verifies.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (matched)
+        {
+          a->Hit(id);
+          return id;
+        }
+        failed[nfailed++] = id;
+      }
+
+      rest.clear();
+      for (size_t i = begin; i < end; i++)
+        if (std::find(failed, failed + nfailed, c[i]) == failed + nfailed)
+          rest.push_back(c[i]);
+      int id = FirstMatchInOrder(text, rest.data(),
+                                 static_cast<int>(rest.size()));
+      if (id >= 0)
+      {
+        a->Hit(id);
+        return id;
+      }
+    }
     return -1;
   }
 
+  void FilteredRE2::Reorder() const
+  {
+    Adaptive *a = adaptive_.get();
+    std::unique_lock<std::mutex> lock(a->reorder_mu, std::try_to_lock);
+    if (!lock.owns_lock())
+      return;
+
+    // A regexp that has not been timed yet is taken to cost as much as
+    // the average one that has.
+    uint64_t total_verifies = a->total_verifies.load(std::memory_order_relaxed);
+    double default_cost =
+        total_verifies > 0
+            ? a->total_cost_ns.load(std::memory_order_relaxed) /
+                  static_cast<double>(total_verifies)
+            : 1;
+
+    // The hot regexps and those returned lately are the ones worth
+    // ranking; a regexp that has not matched for a while has lost
+    // its place anyway.
+    std::vector<int> ids;
+    for (int k = 0; k < Adaptive::kMaxHot; k++)
+      ids.push_back(a->hot[k].load(std::memory_order_relaxed));
+    for (int k = 0; k < Adaptive::kMaxRecent; k++)
+      ids.push_back(a->recent[k].exchange(-1, std::memory_order_relaxed));
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    // Rank by hits per nanosecond of verification, and halve the hits so
+    // that old traffic counts for less.
+    std::vector<std::pair<double, int>> ranked;
+    for (int i : ids)
+    {
+      if (i < 0)
+        continue;
+      uint32_t hits = a->hits[i].load(std::memory_order_relaxed);
+      if (hits == 0)
+        continue;
+      a->hits[i].store(hits / 2, std::memory_order_relaxed);
+      uint32_t verifies = a->verifies[i].load(std::memory_order_relaxed);
+      double cost =
+          verifies > 0
+              ? a->cost_ns[i].load(std::memory_order_relaxed) /
+                    static_cast<double>(verifies)
+              : default_cost;
+      ranked.emplace_back(-static_cast<double>(hits) / std::max(cost, 1.0), i);
+    }
+    size_t top = std::min(ranked.size(), static_cast<size_t>(Adaptive::kMaxHot));
+    std::partial_sort(ranked.begin(), ranked.begin() + top, ranked.end());
+    for (int k = 0; k < Adaptive::kMaxHot; k++)
+      a->hot[k].store(k < static_cast<int>(top) ? ranked[k].second : -1,
+                      std::memory_order_relaxed);
+  }
+
   bool FilteredRE2::AllMatches(
       const StringPiece &text,
       const std::vector<int> &atoms,
       std::vector<int> *matching_regexps) const
+  {
+    std::vector<int> regexps;
+    prefilter_tree_->RegexpsGivenStrings(atoms, &regexps);
+    VerifyCandidates(text, regexps, matching_regexps);
+    return !matching_regexps->empty();
+  }
+
+  void FilteredRE2::VerifyCandidates(const StringPiece &text,
+                                     const std::vector<int> &candidates,
+                                     std::vector<int> *matching_regexps) const
   {
     matching_regexps->clear();
 
-    std::vector<int> regexps;
-    AtomsToRegexps(re2_vec_, atoms, &regexps, prefilter_tree_->getMinAtomLen());
+    // Below this many candidates, handing them to other threads costs more
+    // than searching them here.
+    const int kMinParallel = 256;
+    const int kChunk = 64;
+    const int n = static_cast<int>(candidates.size());
+    ThreadPool *pool = n >= kMinParallel ? ThreadPool::Default() : NULL;
+    if (pool == NULL || pool->num_threads() == 1)
+    {
+      VerifyCandidateRange(text, candidates.data(), n, matching_regexps);
+      return;
+    }
 
-    for (size_t i = 0; i < re2_vec_.size(); i++)
-      if (RE2::PartialMatch(text, *re2_vec_[i]))
-        matching_regexps->push_back(i);
-    return !matching_regexps->empty();
+    // Threads take the candidates a chunk at a time; each chunk collects
+    // its own matches, which are concatenated in order at the end. If the
+    // pool is busy with another caller's candidates, or this is one of its
+    // tasks, the candidates are searched here rather than waiting for it.
+    const int nchunks = (n + kChunk - 1) / kChunk;
+    std::vector<std::vector<int>> chunk_matches(nchunks);
+    std::atomic<int> next_chunk(0);
+    if (!pool->TryRun(std::min(pool->num_threads(), nchunks), [&](int)
+                      {
+      for (int c; (c = next_chunk.fetch_add(1)) < nchunks;)
+      {
+        int begin = c * kChunk;
+        VerifyCandidateRange(text, candidates.data() + begin,
+                             std::min(kChunk, n - begin), &chunk_matches[c]);
+      } }))
+    {
+      VerifyCandidateRange(text, candidates.data(), n, matching_regexps);
+      return;
+    }
+    for (int c = 0; c < nchunks; c++)
+      matching_regexps->insert(matching_regexps->end(),
+                               chunk_matches[c].begin(),
+                               chunk_matches[c].end());
+  }
+
+  void FilteredRE2::VerifyCandidateRange(
+      const StringPiece &text, const int *candidates, int n,
+      std::vector<int> *matching_regexps) const
+  {
+    for (int i = 0; i < n;)
+    {
+      int shard = candidates[i] / kShardSize;
+      uint64_t mask = 0;
+      for (; i < n && candidates[i] / kShardSize == shard; i++)
+        mask |= uint64_t{1} << (candidates[i] % kShardSize);
+      uint64_t matched = VerifyShard(text, shard, mask);
+      for (int j = 0; matched != 0; j++, matched >>= 1)
+        if (matched & 1)
+          matching_regexps->push_back(shard * kShardSize + j);
+    }
+  }
+
+  uint64_t FilteredRE2::VerifyShard(const StringPiece &text, int i,
+                                    uint64_t mask) const
+  {
+    // Below this many candidates in the automaton, searching for them one
+    // by one is cheaper than one pass of the automaton.
+    const int kMinSetCandidates = 2;
+
+    const int first = i * kShardSize;
+    uint64_t matched = 0;
+    uint64_t rest = mask;
+    Shard *shard = shards_.empty() ? NULL : shards_[i].get();
+    if (shard != NULL)
+    {
+      uint64_t in_set = mask & shard->members;
+      int count = 0;
+      for (uint64_t m = in_set; m != 0; m &= m - 1)
+        count++;
+      rure_set *set = count >= kMinSetCandidates
+                          ? shard->GetSet(*this)
+                          : NULL;
+      if (set != NULL)
+      {
+        // A NULL text is searched as the empty text, as PartialMatch()
+        // searches it.
+        const char *data = text.data() != NULL ? text.data() : "";
+        int32_t ids[kShardSize];
+        size_t k = rure_set_matches_into(set, (const uint8_t *)data,
+                                         text.size(), 0, ids, kShardSize,
+                                         NULL);
+        for (size_t j = 0; j < k; j++)
+          matched |= uint64_t{1} << (shard->regexps[ids[j]] - first);
+        matched &= in_set;
+        rest &= ~in_set;
+      }
+    }
+    for (int j = 0; rest != 0; j++, rest >>= 1)
+      if ((rest & 1) && RE2::PartialMatch(text, GetRE2(first + j)))
+        matched |= uint64_t{1} << j;
+    return matched;
   }
 
   void FilteredRE2::AllPotentials(
       const std::vector<int> &atoms,
       std::vector<int> *potential_regexps) const
   {
-    AtomsToRegexps(re2_vec_, atoms, potential_regexps, prefilter_tree_->getMinAtomLen());
+    prefilter_tree_->RegexpsGivenStrings(atoms, potential_regexps);
+  }
+
+  bool FilteredRE2::Scan(const StringPiece &text,
+                         std::vector<int> *matching_regexps) const
+  {
+    matching_regexps->clear();
+    if (!compiled_)
+    {
+      LOG(DFATAL) << "Scan called before Compile.";
+      return false;
+    }
+
+    std::vector<int> atoms;
+    atom_matcher_->Match(text, &atoms);
+    std::vector<int> regexps;
+    prefilter_tree_->RegexpsGivenStrings(atoms, &regexps);
+    VerifyCandidates(text, regexps, matching_regexps);
+    return !matching_regexps->empty();
   }
 
-  void FilteredRE2::RegexpsGivenStrings(const std::vector<int>& matched_atoms,
-                                      std::vector<int>* passed_regexps) 
+  bool FilteredRE2::GetFilterInfo(int regexpid, FilterInfo *info) const
   {
-    // RegexpsGivenStrings为filtered_re2.h中定义的私有成员函数，re2-rust中并没有使用
+    info->prefilter.clear();
+    info->atoms.clear();
+    info->unfiltered = false;
+    if (!compiled_)
+    {
+      LOG(ERROR) << "GetFilterInfo called before Compile.";
+      return false;
+    }
+    info->prefilter = prefilter_tree_->PrefilterString(regexpid);
+    prefilter_tree_->RegexpAtoms(regexpid, &info->atoms);
+    info->unfiltered = info->atoms.empty();
+    return true;
   }
-  void FilteredRE2::PrintPrefilter(int regexpid) 
+
+  bool FilteredRE2::MeasureCorpus(const StringPiece *texts, int n,
+                                  CorpusStats *stats) const
+  {
+    stats->texts = 0;
+    stats->atom_hits.clear();
+    stats->candidates.assign(re2_vec_.size(), 0);
+    stats->matches.assign(re2_vec_.size(), 0);
+    if (!compiled_)
+    {
+      LOG(ERROR) << "MeasureCorpus called before Compile.";
+      return false;
+    }
+    stats->atom_hits.assign(atom_matcher_->num_atoms(), 0);
+
+    std::vector<int> atoms;
+    std::vector<int> regexps;
+    std::vector<int> matching;
+    for (int i = 0; i < n; i++)
+    {
+      atom_matcher_->Match(texts[i], &atoms);
+      for (size_t j = 0; j < atoms.size(); j++)
+        stats->atom_hits[atoms[j]]++;
+      prefilter_tree_->RegexpsGivenStrings(atoms, &regexps);
+      for (size_t j = 0; j < regexps.size(); j++)
+        stats->candidates[regexps[j]]++;
+      VerifyCandidates(texts[i], regexps, &matching);
+      for (size_t j = 0; j < matching.size(); j++)
+        stats->matches[matching[j]]++;
+      stats->texts++;
+    }
+    return true;
+  }
+
+  void FilteredRE2::RegexpsGivenStrings(const std::vector<int> &matched_atoms,
+                                        std::vector<int> *passed_regexps)
+  {
+    prefilter_tree_->RegexpsGivenStrings(matched_atoms, passed_regexps);
+  }
+
+  void FilteredRE2::PrintPrefilter(int regexpid)
   {
-    // PrintPrefilter为filtered_re2.h中定义的私有成员函数，re2-rust中并没有使用
+    prefilter_tree_->PrintPrefilter(regexpid);
   }
 
 } // namespace re2
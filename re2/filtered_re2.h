@@ -18,9 +18,15 @@
 // note that the caller has to do that in a case-insensitive way or
 // on a lowercased version of the search text. Then call FirstMatch
 // or AllMatches with a vector of indices of strings that were found
-// in the text to get the actual regexp matches.
+// in the text to get the actual regexp matches. Alternatively, call
+// Scan, which does the string matching with a built-in engine.
+//
+// A compiled FilteredRE2 can be saved to a file with SaveIndex, and
+// loaded with LoadIndex in place of Add and Compile.
 
+#include <stdint.h>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -28,7 +34,10 @@
 
 namespace re2 {
 
+class AtomMatcher;
+class MappedFile;
 class PrefilterTree;
+class ThreadPool;
 
 class FilteredRE2 {
  public:
@@ -50,6 +59,18 @@ class FilteredRE2 {
                      const RE2::Options& options,
                      int* id);
 
+  // Adds each of patterns as Add would, in order, so that the regexps get
+  // the ids that calls to Add would give them, but builds the RE2 objects
+  // on the threads of pool, or of ThreadPool::Default() if pool is NULL.
+  // Sets (*ids)[i] to the id of patterns[i], or to -1 if it does not
+  // compile, and, if errors is not NULL, (*errors)[i] to its error code.
+  // Returns true if every pattern compiled. Must not be called from a
+  // task running on the pool.
+  bool AddBatch(const std::vector<StringPiece>& patterns,
+                const RE2::Options& options, std::vector<int>* ids,
+                std::vector<RE2::ErrorCode>* errors,
+                ThreadPool* pool = NULL);
+
   // Prepares the regexps added by Add for filtering.  Returns a set
   // of strings that the caller should check for in candidate texts.
   // The returned strings are lowercased and distinct. When doing
@@ -58,6 +79,16 @@ class FilteredRE2 {
   // all Add calls are done.
   void Compile(std::vector<std::string>* strings_to_match);
 
+  // Like Compile, but chooses the strings by how often they occur in a
+  // sample of the texts to be searched, corpus[0] to corpus[n - 1],
+  // rather than by length alone. A string that is in most texts filters
+  // out little, while every text that contains it costs a pass through
+  // the filter, so the regexps that need several strings use only the
+  // rarest of them; a string shorter than min_atom_len is used if it is
+  // rare. The sample should be like the texts that will be searched.
+  void Compile(std::vector<std::string>* strings_to_match,
+               const StringPiece* corpus, int n);
+
   // Returns the index of the first matching regexp.
   // Returns -1 on no match. Can be called prior to Compile.
   // Does not do any filtering: simply tries to Match the
@@ -66,12 +97,33 @@ class FilteredRE2 {
 
   // Returns the index of the first matching regexp.
   // Returns -1 on no match. Compile has to be called before
-  // calling this.
+  // calling this. After EnableAdaptiveFirstMatch, "first" is as
+  // described there.
   int FirstMatch(const StringPiece& text,
                  const std::vector<int>& atoms) const;
 
+  // Makes FirstMatch learn which regexps match most often and verify
+  // those first, which pays when a few regexps account for most matches.
+  // Regexp i gets priority priorities[i], or 0 if priorities is shorter;
+  // a lower number comes first. FirstMatch then returns a matching regexp
+  // of the first priority that has one. Among the matching regexps of
+  // that priority it returns the one it verifies first, which is not
+  // always the one with the lowest index, so with distinct priorities in
+  // index order it returns what it would otherwise. Hit counts are kept
+  // with relaxed atomics, and every so many calls the order is recomputed
+  // from the hit counts, halved each time so that the order follows
+  // changes in traffic, and the cost of verifying each regexp, as timed
+  // on a sample of the calls. Only the regexps verified first so far and
+  // those that matched lately are ranked, so this takes the same time
+  // however many regexps there are.
+  // Call after Compile, before FirstMatch is used.
+  void EnableAdaptiveFirstMatch(const std::vector<int>& priorities);
+
   // Returns the indices of all matching regexps, after first clearing
-  // matched_regexps.
+  // matched_regexps. Only the regexps that pass the filter are searched;
+  // when there are many of them, they are searched on the threads of
+  // ThreadPool::Default(), so this must not be called from a task
+  // running on that pool.
   bool AllMatches(const StringPiece& text,
                   const std::vector<int>& atoms,
                   std::vector<int>* matching_regexps) const;
@@ -84,28 +136,154 @@ class FilteredRE2 {
   void AllPotentials(const std::vector<int>& atoms,
                      std::vector<int>* potential_regexps) const;
 
+  // Returns the indices of all matching regexps, after first clearing
+  // matching_regexps, like AllMatches. The atoms are found in text
+  // with a built-in case-insensitive matcher, so text need not be
+  // lowercased. Compile has to be called before calling this.
+  bool Scan(const StringPiece& text,
+            std::vector<int>* matching_regexps) const;
+
+  // How a regexp is filtered.
+  struct FilterInfo {
+    // The prefilter of the regexp, an AND-OR expression over atoms: a
+    // space joins the terms of an AND, and "(a|b)" is an OR. Empty if
+    // the regexp is unfiltered.
+    std::string prefilter;
+    // The indices (as returned by Compile) of the atoms in prefilter, in
+    // increasing order.
+    std::vector<int> atoms;
+    // Whether no atoms could be found for the regexp, so that it is a
+    // candidate for every text.
+    bool unfiltered;
+  };
+
+  // Describes how regexp regexpid is filtered. Returns false if Compile
+  // has not been called.
+  bool GetFilterInfo(int regexpid, FilterInfo* info) const;
+
+  // What the filter does over a sample of texts.
+  struct CorpusStats {
+    int64_t texts;
+    // For each atom, the number of texts that contain it.
+    std::vector<int64_t> atom_hits;
+    // For each regexp, the number of texts for which it was a candidate,
+    // and the number of those that it matched. The difference is the
+    // number of false positives of its prefilter.
+    std::vector<int64_t> candidates;
+    std::vector<int64_t> matches;
+  };
+
+  // Scans each of texts[0] to texts[n - 1] as Scan does, and counts the
+  // atoms, candidates and matches in *stats. Returns false if Compile has
+  // not been called.
+  bool MeasureCorpus(const StringPiece* texts, int n,
+                     CorpusStats* stats) const;
+
+  // Writes the compiled FilteredRE2 to an index file at path: the
+  // patterns and options of the regexps, the atoms and the prefilter
+  // tree. Returns false if Compile has not been called or the file cannot
+  // be written.
+  bool SaveIndex(const std::string& path) const;
+
+  // Loads an index file written by SaveIndex, in place of Add and
+  // Compile, and sets strings_to_match as Compile would. The file is
+  // mapped into memory, so the processes that load it share it; it must
+  // not be changed while in use, which SaveIndex does not do, as it
+  // replaces the file. The regexps are compiled the first time that a
+  // search needs them. Returns false, leaving the FilteredRE2 empty, if
+  // the file cannot be read, was written with another version of the
+  // format, or was built with another min_atom_len. The caller should
+  // then Add the regexps and Compile, and SaveIndex to replace the file.
+  bool LoadIndex(const std::string& path,
+                 std::vector<std::string>* strings_to_match);
+
   // The number of regexps added.
   int NumRegexps() const { return static_cast<int>(re2_vec_.size()); }
 
   // Get the individual RE2 objects.
-  const RE2& GetRE2(int regexpid) const { return *re2_vec_[regexpid]; }
+  const RE2& GetRE2(int regexpid) const;
 
  private:
   // Print prefilter.
   void PrintPrefilter(int regexpid);
 
+  // Adds re, built from pattern, or deletes it if it did not compile.
+  RE2::ErrorCode AddRE2(const StringPiece& pattern, RE2* re, int* id);
+
+  // The regexps are verified in shards of kShardSize consecutive
+  // regexps. A shard whose regexps have the same semantics as a
+  // multi-pattern automaton over them gets one, which checks all the
+  // candidates of the shard in one pass over the text.
+  struct Shard;
+  static const int kShardSize = 64;
+
+  // What EnableAdaptiveFirstMatch learns.
+  struct Adaptive;
+
+  // Returns the first of candidates[0] to candidates[n - 1] (indices in
+  // increasing order) that matches text, or -1.
+  int FirstMatchInOrder(const StringPiece& text, const int* candidates,
+                        int n) const;
+
+  // FirstMatch after EnableAdaptiveFirstMatch.
+  int AdaptiveFirstMatch(const StringPiece& text,
+                         std::vector<int>* candidates) const;
+
+  // Recomputes which regexps AdaptiveFirstMatch verifies first.
+  void Reorder() const;
+
+  // Sets matching_regexps to those of the candidate regexps (indices in
+  // increasing order) that match text.
+  void VerifyCandidates(const StringPiece& text,
+                        const std::vector<int>& candidates,
+                        std::vector<int>* matching_regexps) const;
+
+  // Appends those of candidates[0] to candidates[n - 1] that match text
+  // to matching_regexps.
+  void VerifyCandidateRange(const StringPiece& text, const int* candidates,
+                            int n, std::vector<int>* matching_regexps) const;
+
+  // Returns which of the regexps of shard i that are set in mask match
+  // text. Bit j stands for regexp i * kShardSize + j.
+  uint64_t VerifyShard(const StringPiece& text, int i, uint64_t mask) const;
+
   // Useful for testing and debugging.
   void RegexpsGivenStrings(const std::vector<int>& matched_atoms,
                            std::vector<int>* passed_regexps);
 
-  // All the regexps in the FilteredRE2.
-  std::vector<RE2*> re2_vec_;
+  // The pattern and options of regexp i, which need not be compiled yet.
+  StringPiece RegexpPattern(int i) const;
+  const RE2::Options& RegexpOptions(int i) const;
+
+  // Builds shards_. The regexps need not be compiled yet.
+  void BuildShards();
+
+  // All the regexps in the FilteredRE2. After LoadIndex, a regexp is
+  // NULL until GetRE2 compiles it from patterns_ and options_, once as
+  // re2_once_ sees to.
+  mutable std::vector<RE2*> re2_vec_;
+  std::vector<StringPiece> patterns_;
+  std::vector<RE2::Options> options_;
+  std::unique_ptr<std::once_flag[]> re2_once_;
+
+  // The file loaded by LoadIndex, which patterns_ and the prefilter tree
+  // point into.
+  std::unique_ptr<MappedFile> index_file_;
 
   // Has the FilteredRE2 been compiled using Compile()
   bool compiled_;
 
   // An AND-OR tree of string atoms used for filtering regexps.
   std::unique_ptr<PrefilterTree> prefilter_tree_;
+
+  // Finds the atoms in texts passed to Scan. Built by Compile.
+  std::unique_ptr<AtomMatcher> atom_matcher_;
+
+  // The shards of re2_vec_. Built by Compile.
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  // Set by EnableAdaptiveFirstMatch.
+  std::unique_ptr<Adaptive> adaptive_;
 };
 
 }  // namespace re2
@@ -0,0 +1,180 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-19
+ * Description: Interface implementation in index_file.h.
+ ******************************************************************************/
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "re2/index_file.h"
+
+namespace re2
+{
+  // Bump kIndexVersion whenever what SaveIndex writes changes, so that
+  // old files are rebuilt instead of misread.
+  static const char kIndexMagic[8] = {'R', 'E', '2', 'F', 'I', 'D', 'X', '\0'};
+  static const uint32_t kIndexVersion = 1;
+  static const uint32_t kIndexByteOrder = 0x01020304;
+  static const size_t kIndexHeaderSize =
+      sizeof kIndexMagic + sizeof kIndexVersion + sizeof kIndexByteOrder;
+
+  static size_t RoundUp8(size_t n)
+  {
+    return (n + 7) & ~static_cast<size_t>(7);
+  }
+
+  static std::string IndexHeader()
+  {
+    std::string header(kIndexMagic, sizeof kIndexMagic);
+    header.append(reinterpret_cast<const char *>(&kIndexVersion),
+                  sizeof kIndexVersion);
+    header.append(reinterpret_cast<const char *>(&kIndexByteOrder),
+                  sizeof kIndexByteOrder);
+    return header;
+  }
+
+  IndexWriter::IndexWriter()
+      : data_(IndexHeader())
+  {
+  }
+
+  void IndexWriter::PutRaw(const void *v, size_t size, size_t n)
+  {
+    uint64_t count = n;
+    data_.append(reinterpret_cast<const char *>(&count), sizeof count);
+    if (n > 0)
+      data_.append(static_cast<const char *>(v), size * n);
+    data_.resize(RoundUp8(data_.size()), '\0');
+  }
+
+  void IndexWriter::PutStrings(const std::vector<StringPiece> &v)
+  {
+    std::vector<uint64_t> offsets(1, 0);
+    std::string bytes;
+    for (size_t i = 0; i < v.size(); i++)
+    {
+      bytes.append(v[i].data(), v[i].size());
+      offsets.push_back(bytes.size());
+    }
+    PutArray(offsets);
+    PutRaw(bytes.data(), 1, bytes.size());
+  }
+
+  bool IndexWriter::WriteFile(const std::string &path) const
+  {
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL)
+      return false;
+    bool ok = fwrite(data_.data(), 1, data_.size(), f) == data_.size();
+    if (fclose(f) != 0)
+      ok = false;
+    if (ok && rename(tmp.c_str(), path.c_str()) != 0)
+      ok = false;
+    if (!ok)
+      unlink(tmp.c_str());
+    return ok;
+  }
+
+  IndexReader::IndexReader(const char *data, size_t size)
+      : data_(data),
+        size_(size),
+        pos_(kIndexHeaderSize),
+        ok_(false)
+  {
+    if (size >= kIndexHeaderSize &&
+        memcmp(data, IndexHeader().data(), kIndexHeaderSize) == 0)
+      ok_ = true;
+  }
+
+  bool IndexReader::GetRaw(size_t size, const void **data, size_t *n)
+  {
+    if (!ok_)
+      return false;
+    uint64_t count;
+    if (size_ - pos_ < sizeof count)
+    {
+      ok_ = false;
+      return false;
+    }
+    memcpy(&count, data_ + pos_, sizeof count);
+    size_t left = size_ - pos_ - sizeof count;
+    if (count > left / size)
+    {
+      ok_ = false;
+      return false;
+    }
+    *data = data_ + pos_ + sizeof count;
+    *n = static_cast<size_t>(count);
+    pos_ += std::min(RoundUp8(sizeof count + *n * size), size_ - pos_);
+    return true;
+  }
+
+  bool IndexReader::GetStrings(std::vector<StringPiece> *v)
+  {
+    IndexArray<uint64_t> offsets;
+    IndexArray<char> bytes;
+    if (!GetArray(&offsets) || !GetArray(&bytes))
+      return false;
+    if (offsets.empty() || offsets[0] != 0 ||
+        offsets[offsets.size() - 1] != bytes.size())
+    {
+      ok_ = false;
+      return false;
+    }
+    v->clear();
+    for (size_t i = 0; i + 1 < offsets.size(); i++)
+    {
+      if (offsets[i] > offsets[i + 1])
+      {
+        ok_ = false;
+        return false;
+      }
+      v->emplace_back(bytes.data() + offsets[i],
+                      static_cast<size_t>(offsets[i + 1] - offsets[i]));
+    }
+    return true;
+  }
+
+  MappedFile *MappedFile::Open(const std::string &path)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return NULL;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+      data = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ,
+                  MAP_SHARED, fd, 0);
+    // The mapping stays valid after the file is closed.
+    close(fd);
+    if (data == MAP_FAILED)
+      return NULL;
+    return new MappedFile(static_cast<const char *>(data),
+                          static_cast<size_t>(st.st_size));
+  }
+
+  MappedFile::~MappedFile()
+  {
+    munmap(const_cast<char *>(data_), size_);
+  }
+} // namespace re2
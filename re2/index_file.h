@@ -0,0 +1,154 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-19
+ * Description: Reading and writing the index files of FilteredRE2.
+ ******************************************************************************/
+
+#pragma once
+
+// FilteredRE2::SaveIndex writes a compiled FilteredRE2 to an index file,
+// which FilteredRE2::LoadIndex maps into memory, so that the processes that
+// load the same file share its pages.
+//
+// The file is a header followed by arrays. Each array is its number of
+// elements, as a uint64_t, followed by the elements, padded to a multiple
+// of 8 bytes; the arrays are read in place from the mapping. Numbers are
+// in the byte order of the machine that wrote the file. The header holds a
+// format version and the byte order, and a reader refuses a file whose
+// header differs from the one it would write.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "re2/stringpiece.h"
+
+namespace re2 {
+
+// A read-only array of T, which lives in a mapped index file or in a
+// std::vector owned by whoever holds the IndexArray.
+template <typename T>
+class IndexArray {
+ public:
+  IndexArray() : data_(NULL), size_(0) {}
+  IndexArray(const T* data, size_t size) : data_(data), size_(size) {}
+  explicit IndexArray(const std::vector<T>& v)
+      : data_(v.data()), size_(v.size()) {}
+
+  const T* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+  const T& operator[](size_t i) const { return data_[i]; }
+
+ private:
+  const T* data_;
+  size_t size_;
+};
+
+class IndexWriter {
+ public:
+  // Starts the file with its header.
+  IndexWriter();
+
+  template <typename T>
+  void PutArray(const T* v, size_t n) {
+    PutRaw(v, sizeof(T), n);
+  }
+  template <typename T>
+  void PutArray(const std::vector<T>& v) {
+    PutRaw(v.data(), sizeof(T), v.size());
+  }
+  template <typename T>
+  void PutArray(const IndexArray<T>& v) {
+    PutRaw(v.data(), sizeof(T), v.size());
+  }
+
+  // Puts strings as two arrays: the offsets of the strings, one more than
+  // there are strings, and then their bytes.
+  void PutStrings(const std::vector<StringPiece>& v);
+
+  // Writes the file to path. The file is written under a temporary name
+  // and renamed into place, so a process that has the old file mapped
+  // keeps it. Returns false if that fails.
+  bool WriteFile(const std::string& path) const;
+
+ private:
+  void PutRaw(const void* v, size_t size, size_t n);
+
+  std::string data_;
+
+  IndexWriter(const IndexWriter&) = delete;
+  IndexWriter& operator=(const IndexWriter&) = delete;
+};
+
+class IndexReader {
+ public:
+  // Reads the file in data[0] to data[size - 1], which must be aligned
+  // to 8 bytes, as a mapping is. Checks the header.
+  IndexReader(const char* data, size_t size);
+
+  // Whether the header was right and every Get so far succeeded.
+  bool ok() const { return ok_; }
+
+  // Gets the next array, which must be an array of T. Returns false if
+  // the file is too short or the reader is not ok.
+  template <typename T>
+  bool GetArray(IndexArray<T>* v) {
+    const void* data;
+    size_t n;
+    if (!GetRaw(sizeof(T), &data, &n))
+      return false;
+    *v = IndexArray<T>(static_cast<const T*>(data), n);
+    return true;
+  }
+
+  // Gets the strings put by IndexWriter::PutStrings. They point into the
+  // file.
+  bool GetStrings(std::vector<StringPiece>* v);
+
+ private:
+  bool GetRaw(size_t size, const void** data, size_t* n);
+
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  bool ok_;
+
+  IndexReader(const IndexReader&) = delete;
+  IndexReader& operator=(const IndexReader&) = delete;
+};
+
+// A file mapped read-only into memory.
+class MappedFile {
+ public:
+  // Maps the file at path. Returns NULL if it cannot be opened or is
+  // empty.
+  static MappedFile* Open(const std::string& path);
+  ~MappedFile();
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(const char* data, size_t size) : data_(data), size_(size) {}
+
+  const char* data_;
+  size_t size_;
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
+
+}  // namespace re2
@@ -0,0 +1,139 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: Interface implementation in prefilter.h.
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "re2/testing/util/logging.h"
+#include "re2/prefilter.h"
+#include "re2/re2.h"
+#include "regex-capi/include/regex_capi.h"
+
+namespace re2
+{
+  Prefilter::Prefilter(Op op)
+      : op_(op),
+        unique_id_(-1)
+  {
+  }
+
+  Prefilter::~Prefilter()
+  {
+    for (size_t i = 0; i < subs_.size(); i++)
+      delete subs_[i];
+  }
+
+  Prefilter *Prefilter::FromRurePrefilter(const rure_prefilter *pf, size_t node)
+  {
+    Prefilter *m = new Prefilter(static_cast<Op>(rure_prefilter_op(pf, node)));
+    if (m->op_ == ATOM)
+    {
+      const uint8_t *atom;
+      size_t n = rure_prefilter_atom(pf, node, &atom);
+      m->atom_.assign((const char *)atom, n);
+    }
+    else if (m->op_ == AND || m->op_ == OR)
+    {
+      const size_t *children;
+      size_t n = rure_prefilter_children(pf, node, &children);
+      for (size_t i = 0; i < n; i++)
+        m->subs_.push_back(FromRurePrefilter(pf, children[i]));
+    }
+    return m;
+  }
+
+  Prefilter *Prefilter::FromRE2(const RE2 *re2)
+  {
+    if (re2 == NULL || !re2->ok())
+      return NULL;
+
+    // As in RE2::Init(), Latin-1 patterns are handed over as UTF-8.
+    const std::string &pattern = re2->pattern();
+    bool latin1 = re2->options().encoding() == RE2::Options::EncodingLatin1;
+    std::string utf8;
+    if (latin1)
+    {
+      for (size_t i = 0; i < pattern.size(); i++)
+      {
+        unsigned char c = pattern[i];
+        if (c < 0x80)
+        {
+          utf8 += static_cast<char>(c);
+        }
+        else
+        {
+          utf8 += static_cast<char>(0xC0 | (c >> 6));
+          utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        }
+      }
+    }
+    else
+    {
+      utf8 = pattern;
+    }
+
+    uint32_t flags = RURE_FLAG_UNICODE;
+    if (re2->options().dot_nl())
+      flags |= RURE_FLAG_DOTNL;
+    rure_prefilter *pf = rure_prefilter_new((const uint8_t *)utf8.data(),
+                                            utf8.size(), flags, latin1);
+    if (pf == NULL)
+      return NULL;
+    Prefilter *m = FromRurePrefilter(pf, rure_prefilter_len(pf) - 1);
+    rure_prefilter_free(pf);
+    return m;
+  }
+
+  std::string Prefilter::DebugString() const
+  {
+    switch (op_)
+    {
+    default:
+      LOG(DFATAL) << "Bad op in Prefilter::DebugString: " << op_;
+      return "op" + std::to_string(op_);
+    case NONE:
+      return "*no-matches*";
+    case ATOM:
+      return atom_;
+    case ALL:
+      return "";
+    case AND:
+    {
+      std::string s = "";
+      for (size_t i = 0; i < subs_.size(); i++)
+      {
+        if (i > 0)
+          s += " ";
+        s += subs_[i]->DebugString();
+      }
+      return s;
+    }
+    case OR:
+    {
+      std::string s = "(";
+      for (size_t i = 0; i < subs_.size(); i++)
+      {
+        if (i > 0)
+          s += "|";
+        s += subs_[i]->DebugString();
+      }
+      s += ")";
+      return s;
+    }
+    }
+  }
+} // namespace re2
@@ -0,0 +1,78 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: String guards extracted from a regexp, for FilteredRE2.
+ ******************************************************************************/
+
+#pragma once
+
+// Prefilter is the class used to extract string guards from regexps.
+// Rather than using Prefilter class directly, use FilteredRE2.
+// See filtered_re2.h
+//
+// The guards are computed by regex-capi from the parsed pattern, following
+// RE2's prefilter.cc; see rure_prefilter_new in regex_capi.h.
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct rure_prefilter;
+
+namespace re2 {
+
+class RE2;
+
+class Prefilter {
+  // Instead of using Prefilter directly, use FilteredRE2; see filtered_re2.h
+ public:
+  enum Op {
+    ALL = 0,  // Everything matches
+    NONE,     // Nothing matches
+    ATOM,     // The string atom() must match
+    AND,      // All in subs() must match
+    OR,       // One of subs() must match
+  };
+
+  explicit Prefilter(Op op);
+  ~Prefilter();
+
+  Op op() const { return op_; }
+  const std::string& atom() const { return atom_; }
+  void set_unique_id(int id) { unique_id_ = id; }
+  int unique_id() const { return unique_id_; }
+
+  // The children of the Prefilter node. The node owns them.
+  std::vector<Prefilter*>* subs() { return &subs_; }
+  const std::vector<Prefilter*>& subs() const { return subs_; }
+
+  // Given a RE2, return a Prefilter. The caller takes ownership of
+  // the Prefilter and should deallocate it. Returns NULL if Prefilter
+  // cannot be formed.
+  static Prefilter* FromRE2(const RE2* re2);
+
+  std::string DebugString() const;
+
+ private:
+  // Builds the Prefilter for the given node of pf and its descendants.
+  static Prefilter* FromRurePrefilter(const rure_prefilter* pf, size_t node);
+
+  Op op_;
+  std::vector<Prefilter*> subs_;
+  std::string atom_;
+  int unique_id_;
+
+  Prefilter(const Prefilter&) = delete;
+  Prefilter& operator=(const Prefilter&) = delete;
+};
+
+}  // namespace re2
@@ -0,0 +1,751 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: Interface implementation in prefilter_tree.h.
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "re2/testing/util/logging.h"
+#include "re2/prefilter.h"
+#include "re2/prefilter_tree.h"
+
+namespace re2
+{
+  PrefilterTree::PrefilterTree()
+      : num_regexps_(0),
+        min_atom_len_(3),
+        compiled_(false)
+  {
+  }
+
+  PrefilterTree::PrefilterTree(int min_atom_len)
+      : num_regexps_(0),
+        min_atom_len_(min_atom_len),
+        compiled_(false)
+  {
+  }
+
+  PrefilterTree::~PrefilterTree()
+  {
+    for (size_t i = 0; i < prefilter_vec_.size(); i++)
+      delete prefilter_vec_[i];
+  }
+
+  void PrefilterTree::Add(Prefilter *prefilter)
+  {
+    if (compiled_)
+    {
+      LOG(DFATAL) << "Add called after Compile.";
+      return;
+    }
+    double frequency;
+    bool keep = atom_frequencies_.empty()
+                    ? KeepNode(prefilter)
+                    : SelectNode(prefilter, &frequency);
+    if (prefilter != NULL && !keep)
+    {
+      delete prefilter;
+      prefilter = NULL;
+    }
+
+    prefilter_vec_.push_back(prefilter);
+    num_regexps_++;
+  }
+
+  void PrefilterTree::Compile(std::vector<std::string> *atom_vec)
+  {
+    if (compiled_)
+    {
+      LOG(DFATAL) << "Compile called already.";
+      return;
+    }
+
+    // Some legacy users of PrefilterTree call Compile() before
+    // adding any regexps and expect Compile() to have no effect.
+    if (prefilter_vec_.empty())
+      return;
+
+    compiled_ = true;
+    NodeMap nodes;
+    std::vector<Entry> entries;
+    std::vector<int32_t> atom_index_to_id;
+    AssignUniqueIds(&nodes, &entries, &atom_index_to_id, atom_vec);
+    atom_frequencies_.clear();
+
+    // Flatten the entries, so that a tree read by Load is searched by the
+    // same code.
+    std::vector<int32_t> counts;
+    std::vector<int32_t> parent_begin(1, 0);
+    std::vector<int32_t> parents;
+    std::vector<int32_t> regexp_begin(1, 0);
+    std::vector<int32_t> regexps;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      counts.push_back(entries[i].propagate_up_at_count);
+      parents.insert(parents.end(), entries[i].parents.begin(),
+                     entries[i].parents.end());
+      parent_begin.push_back(static_cast<int32_t>(parents.size()));
+      regexps.insert(regexps.end(), entries[i].regexps.begin(),
+                     entries[i].regexps.end());
+      regexp_begin.push_back(static_cast<int32_t>(regexps.size()));
+    }
+    std::vector<int32_t> unfiltered;
+    for (size_t i = 0; i < prefilter_vec_.size(); i++)
+      if (prefilter_vec_[i] == NULL)
+        unfiltered.push_back(static_cast<int32_t>(i));
+
+    propagate_up_at_count_ = Own(&counts);
+    parent_begin_ = Own(&parent_begin);
+    parents_ = Own(&parents);
+    regexp_begin_ = Own(&regexp_begin);
+    regexps_ = Own(&regexps);
+    atom_index_to_id_ = Own(&atom_index_to_id);
+    unfiltered_ = Own(&unfiltered);
+  }
+
+  IndexArray<int32_t> PrefilterTree::Own(std::vector<int32_t> *v)
+  {
+    // Moving a vector keeps its elements where they are, so the arrays
+    // stay valid as storage_ grows.
+    storage_.push_back(std::move(*v));
+    return IndexArray<int32_t>(storage_.back());
+  }
+
+  bool PrefilterTree::KeepNode(Prefilter *node) const
+  {
+    if (node == NULL)
+      return false;
+
+    switch (node->op())
+    {
+    default:
+      LOG(DFATAL) << "Unexpected op in KeepNode: " << node->op();
+      return false;
+
+    case Prefilter::ALL:
+    case Prefilter::NONE:
+      return false;
+
+    case Prefilter::ATOM:
+      return node->atom().size() >= static_cast<size_t>(min_atom_len_);
+
+    case Prefilter::AND:
+    {
+      // An AND still filters with any of its children left.
+      std::vector<Prefilter *> *subs = node->subs();
+      size_t j = 0;
+      for (size_t i = 0; i < subs->size(); i++)
+      {
+        if (KeepNode((*subs)[i]))
+          (*subs)[j++] = (*subs)[i];
+        else
+          delete (*subs)[i];
+      }
+      subs->resize(j);
+      return j > 0;
+    }
+
+    case Prefilter::OR:
+      // An OR needs every one of its children.
+      for (size_t i = 0; i < node->subs()->size(); i++)
+        if (!KeepNode((*node->subs())[i]))
+          return false;
+      return true;
+    }
+  }
+
+  void PrefilterTree::SetAtomFrequencies(const AtomFrequencies &frequencies)
+  {
+    if (!prefilter_vec_.empty())
+    {
+      LOG(DFATAL) << "SetAtomFrequencies called after Add.";
+      return;
+    }
+    atom_frequencies_ = frequencies;
+  }
+
+  bool PrefilterTree::SelectNode(Prefilter *node, double *frequency) const
+  {
+    // Verifying a candidate regexp costs about this many times as much as
+    // passing a match up one edge of the tree.
+    const double kVerifyCost = 100.0;
+    // An atom shorter than min_atom_len_ is kept only if it is in fewer
+    // texts than this, as the sample may not show how common it is.
+    const double kMaxShortAtomFrequency = 0.01;
+
+    *frequency = 1.0;
+    if (node == NULL)
+      return false;
+
+    switch (node->op())
+    {
+    default:
+      LOG(DFATAL) << "Unexpected op in SelectNode: " << node->op();
+      return false;
+
+    case Prefilter::ALL:
+    case Prefilter::NONE:
+      return false;
+
+    case Prefilter::ATOM:
+    {
+      if (node->atom().empty())
+        return false;
+      AtomFrequencies::const_iterator it = atom_frequencies_.find(node->atom());
+      if (it != atom_frequencies_.end())
+        *frequency = it->second;
+      if (node->atom().size() >= static_cast<size_t>(min_atom_len_))
+        return true;
+      return *frequency < kMaxShortAtomFrequency;
+    }
+
+    case Prefilter::AND:
+    {
+      std::vector<Prefilter *> *subs = node->subs();
+      std::vector<std::pair<double, Prefilter *>> kept;
+      for (size_t i = 0; i < subs->size(); i++)
+      {
+        double f;
+        if (SelectNode((*subs)[i], &f))
+          kept.emplace_back(f, (*subs)[i]);
+        else
+          delete (*subs)[i];
+      }
+      std::stable_sort(kept.begin(), kept.end(),
+                       [](const std::pair<double, Prefilter *> &a,
+                          const std::pair<double, Prefilter *> &b)
+                       { return a.first < b.first; });
+      // Take the rarest child, then each next rarest while the
+      // verifications that it saves outweigh the matches that it passes
+      // up, taking the children to be independent.
+      subs->clear();
+      for (size_t i = 0; i < kept.size(); i++)
+      {
+        double f = kept[i].first;
+        if (i == 0 ||
+            *frequency * (1.0 - f) * kVerifyCost > f)
+        {
+          subs->push_back(kept[i].second);
+          *frequency *= f;
+        }
+        else
+        {
+          delete kept[i].second;
+        }
+      }
+      return !subs->empty();
+    }
+
+    case Prefilter::OR:
+    {
+      // An OR needs every one of its children.
+      double sum = 0.0;
+      for (size_t i = 0; i < node->subs()->size(); i++)
+      {
+        double f;
+        if (!SelectNode((*node->subs())[i], &f))
+          return false;
+        sum += f;
+      }
+      *frequency = std::min(1.0, sum);
+      return true;
+    }
+    }
+  }
+
+  std::string PrefilterTree::NodeString(Prefilter *node) const
+  {
+    // Adding the operation disambiguates AND/OR/atom nodes.
+    std::string s = std::to_string(node->op()) + ":";
+    if (node->op() == Prefilter::ATOM)
+    {
+      s += node->atom();
+    }
+    else
+    {
+      for (size_t i = 0; i < node->subs()->size(); i++)
+      {
+        if (i > 0)
+          s += ',';
+        s += std::to_string((*node->subs())[i]->unique_id());
+      }
+    }
+    return s;
+  }
+
+  Prefilter *PrefilterTree::CanonicalNode(NodeMap *nodes, Prefilter *node)
+  {
+    std::string node_string = NodeString(node);
+    NodeMap::iterator it = nodes->find(node_string);
+    if (it == nodes->end())
+      return NULL;
+    return it->second;
+  }
+
+  void PrefilterTree::AssignUniqueIds(NodeMap *nodes,
+                                      std::vector<Entry> *entries,
+                                      std::vector<int32_t> *atom_index_to_id,
+                                      std::vector<std::string> *atom_vec)
+  {
+    atom_vec->clear();
+    size_t num_unfiltered = 0;
+
+    // Build vector of all filter nodes, sorted topologically
+    // from top to bottom in v.
+    std::vector<Prefilter *> v;
+
+    // Add the top level nodes of each regexp prefilter.
+    for (size_t i = 0; i < prefilter_vec_.size(); i++)
+    {
+      Prefilter *f = prefilter_vec_[i];
+      if (f == NULL)
+        num_unfiltered++;
+
+      // We push NULL also on to v, so that we maintain the
+      // mapping of index==regexpid for level=0 prefilter nodes.
+      v.push_back(f);
+    }
+
+    // Now add all the descendant nodes.
+    for (size_t i = 0; i < v.size(); i++)
+    {
+      Prefilter *f = v[i];
+      if (f == NULL)
+        continue;
+      if (f->op() == Prefilter::AND || f->op() == Prefilter::OR)
+      {
+        const std::vector<Prefilter *> &subs = *f->subs();
+        for (size_t j = 0; j < subs.size(); j++)
+          v.push_back(subs[j]);
+      }
+    }
+
+    // Identify unique nodes. Children come after their parents in v,
+    // so walking it backwards numbers every child before its parents.
+    int unique_id = 0;
+    for (int i = static_cast<int>(v.size()) - 1; i >= 0; i--)
+    {
+      Prefilter *node = v[i];
+      if (node == NULL)
+        continue;
+      node->set_unique_id(-1);
+      Prefilter *canonical = CanonicalNode(nodes, node);
+      if (canonical == NULL)
+      {
+        // Any further nodes that have the same node string
+        // will find this node as the canonical node.
+        nodes->emplace(NodeString(node), node);
+        if (node->op() == Prefilter::ATOM)
+        {
+          atom_vec->push_back(node->atom());
+          atoms_.push_back(node->atom());
+          atom_index_to_id->push_back(unique_id);
+        }
+        node->set_unique_id(unique_id++);
+      }
+      else
+      {
+        node->set_unique_id(canonical->unique_id());
+      }
+    }
+    entries->resize(unique_id);
+
+    // Fill the entries.
+    for (int i = static_cast<int>(v.size()) - 1; i >= 0; i--)
+    {
+      Prefilter *prefilter = v[i];
+      if (prefilter == NULL)
+        continue;
+      if (CanonicalNode(nodes, prefilter) != prefilter)
+        continue;
+      int id = prefilter->unique_id();
+      switch (prefilter->op())
+      {
+      default:
+        LOG(DFATAL) << "Unexpected op: " << prefilter->op();
+        return;
+
+      case Prefilter::ATOM:
+        (*entries)[id].propagate_up_at_count = 1;
+        break;
+
+      case Prefilter::OR:
+      case Prefilter::AND:
+      {
+        // For each child, we append our id to the child's list of
+        // parent ids... unless we happen to have done so already.
+        // The number of appends is the number of unique children,
+        // which allows correct upward propagation from AND nodes.
+        int up_count = 0;
+        for (size_t j = 0; j < prefilter->subs()->size(); j++)
+        {
+          int child_id = (*prefilter->subs())[j]->unique_id();
+          std::vector<int> &parents = (*entries)[child_id].parents;
+          if (parents.empty() || parents.back() != id)
+          {
+            parents.push_back(id);
+            up_count++;
+          }
+        }
+        (*entries)[id].propagate_up_at_count =
+            prefilter->op() == Prefilter::AND ? up_count : 1;
+        break;
+      }
+      }
+    }
+
+    // For top level nodes, populate regexp id.
+    for (size_t i = 0; i < prefilter_vec_.size(); i++)
+    {
+      if (prefilter_vec_[i] == NULL)
+        continue;
+      int id = CanonicalNode(nodes, prefilter_vec_[i])->unique_id();
+      DCHECK_LE(0, id);
+      (*entries)[id].regexps.push_back(static_cast<int>(i));
+    }
+
+    // Lastly, using probability-based heuristics, we identify nodes
+    // that trigger too many parents and then we try to prune edges.
+    // We use logarithms below to avoid the likelihood of underflow.
+    // The number of parents stands in for how often a node matches; when
+    // the frequencies of the atoms are known, SelectNode has already
+    // pruned by them.
+    if (!atom_frequencies_.empty())
+      return;
+    double log_num_regexps =
+        std::log(static_cast<double>(prefilter_vec_.size() - num_unfiltered));
+    // Hoisted this above the loop so that we don't thrash the heap.
+    std::vector<std::pair<size_t, int>> entries_by_num_edges;
+    for (int i = static_cast<int>(v.size()) - 1; i >= 0; i--)
+    {
+      Prefilter *prefilter = v[i];
+      // Pruning applies only to AND nodes because it "just" reduces
+      // precision; applied to OR nodes, it would break correctness.
+      if (prefilter == NULL || prefilter->op() != Prefilter::AND)
+        continue;
+      if (CanonicalNode(nodes, prefilter) != prefilter)
+        continue;
+      int id = prefilter->unique_id();
+
+      // Sort the current node's children by the numbers of parents.
+      entries_by_num_edges.clear();
+      for (size_t j = 0; j < prefilter->subs()->size(); j++)
+      {
+        int child_id = (*prefilter->subs())[j]->unique_id();
+        const std::vector<int> &parents = (*entries)[child_id].parents;
+        entries_by_num_edges.emplace_back(parents.size(), child_id);
+      }
+      std::stable_sort(entries_by_num_edges.begin(),
+                       entries_by_num_edges.end());
+
+      // A running estimate of how many regexps will be triggered by
+      // pruning the remaining children's edges to the current node.
+      // Our nominal target is one, so the threshold is log(1) == 0;
+      // pruning occurs iff the child has more than nine edges left.
+      // The node always keeps at least one child.
+      double log_num_triggered = log_num_regexps;
+      for (size_t j = 0; j < entries_by_num_edges.size(); j++)
+      {
+        int child_id = entries_by_num_edges[j].second;
+        std::vector<int> &parents = (*entries)[child_id].parents;
+        if (log_num_triggered > 0.)
+        {
+          log_num_triggered += std::log(static_cast<double>(parents.size()));
+          log_num_triggered -= log_num_regexps;
+        }
+        else if (parents.size() > 9 &&
+                 (*entries)[id].propagate_up_at_count > 1)
+        {
+          std::vector<int>::iterator it =
+              std::find(parents.begin(), parents.end(), id);
+          if (it != parents.end())
+          {
+            parents.erase(it);
+            (*entries)[id].propagate_up_at_count--;
+          }
+        }
+      }
+    }
+  }
+
+  void PrefilterTree::RegexpsGivenStrings(
+      const std::vector<int> &matched_atoms,
+      std::vector<int> *regexps) const
+  {
+    regexps->clear();
+    if (!compiled_)
+    {
+      // Some legacy users of PrefilterTree call Compile() before
+      // adding any regexps and expect Compile() to have no effect.
+      if (prefilter_vec_.empty())
+        return;
+
+      LOG(ERROR) << "RegexpsGivenStrings called before Compile.";
+      for (size_t i = 0; i < prefilter_vec_.size(); i++)
+        regexps->push_back(static_cast<int>(i));
+      return;
+    }
+
+    std::vector<int> matched_atom_ids;
+    for (size_t j = 0; j < matched_atoms.size(); j++)
+    {
+      int atom = matched_atoms[j];
+      if (atom >= 0 && atom < static_cast<int>(atom_index_to_id_.size()))
+        matched_atom_ids.push_back(atom_index_to_id_[atom]);
+    }
+    PropagateMatch(matched_atom_ids, regexps);
+    regexps->insert(regexps->end(), unfiltered_.begin(), unfiltered_.end());
+    std::sort(regexps->begin(), regexps->end());
+  }
+
+  bool PrefilterTree::IsUnfiltered(int regexpid) const
+  {
+    return std::binary_search(unfiltered_.begin(), unfiltered_.end(),
+                              regexpid);
+  }
+
+  std::string PrefilterTree::PrefilterString(int regexpid) const
+  {
+    if (prefilter_vec_.empty())
+    {
+      if (regexpid < 0 || regexpid >= static_cast<int>(prefilter_strings_.size()))
+        return "";
+      return prefilter_strings_[regexpid].ToString();
+    }
+    const Prefilter *prefilter = prefilter_vec_[regexpid];
+    if (prefilter == NULL)
+      return "";
+    return prefilter->DebugString();
+  }
+
+  void PrefilterTree::RegexpAtoms(int regexpid, std::vector<int> *atoms) const
+  {
+    atoms->clear();
+    if (!compiled_)
+    {
+      LOG(DFATAL) << "RegexpAtoms called before Compile.";
+      return;
+    }
+    if (prefilter_vec_.empty())
+    {
+      atoms->assign(regexp_atoms_.begin() + regexp_atom_begin_[regexpid],
+                    regexp_atoms_.begin() + regexp_atom_begin_[regexpid + 1]);
+      return;
+    }
+    const Prefilter *prefilter = prefilter_vec_[regexpid];
+    if (prefilter == NULL)
+      return;
+    CollectAtoms(prefilter, atoms);
+    std::sort(atoms->begin(), atoms->end());
+    atoms->erase(std::unique(atoms->begin(), atoms->end()), atoms->end());
+  }
+
+  void PrefilterTree::CollectAtoms(const Prefilter *node,
+                                   std::vector<int> *atoms) const
+  {
+    if (node->op() == Prefilter::ATOM)
+    {
+      const int32_t *it =
+          std::lower_bound(atom_index_to_id_.begin(), atom_index_to_id_.end(),
+                           node->unique_id());
+      DCHECK(it != atom_index_to_id_.end() && *it == node->unique_id());
+      atoms->push_back(static_cast<int>(it - atom_index_to_id_.begin()));
+      return;
+    }
+    for (size_t i = 0; i < node->subs().size(); i++)
+      CollectAtoms(node->subs()[i], atoms);
+  }
+
+  void PrefilterTree::PrintPrefilter(int regexpid) const
+  {
+    if (IsUnfiltered(regexpid))
+      LOG(ERROR) << regexpid << ": unfiltered";
+    else
+      LOG(ERROR) << regexpid << ": " << PrefilterString(regexpid);
+  }
+
+  void PrefilterTree::Save(IndexWriter *writer) const
+  {
+    if (!compiled_)
+    {
+      LOG(DFATAL) << "Save called before Compile.";
+      return;
+    }
+    const int32_t sizes[] = {min_atom_len_, num_regexps_};
+    writer->PutArray(sizes, 2);
+    writer->PutStrings(atoms_);
+    writer->PutArray(propagate_up_at_count_);
+    writer->PutArray(parent_begin_);
+    writer->PutArray(parents_);
+    writer->PutArray(regexp_begin_);
+    writer->PutArray(regexps_);
+    writer->PutArray(atom_index_to_id_);
+    writer->PutArray(unfiltered_);
+
+    std::vector<std::string> strings(num_regexps_);
+    std::vector<int32_t> regexp_atom_begin(1, 0);
+    std::vector<int32_t> regexp_atoms;
+    std::vector<int> atoms;
+    for (int i = 0; i < num_regexps_; i++)
+    {
+      strings[i] = PrefilterString(i);
+      RegexpAtoms(i, &atoms);
+      regexp_atoms.insert(regexp_atoms.end(), atoms.begin(), atoms.end());
+      regexp_atom_begin.push_back(static_cast<int32_t>(regexp_atoms.size()));
+    }
+    writer->PutStrings(std::vector<StringPiece>(strings.begin(), strings.end()));
+    writer->PutArray(regexp_atom_begin);
+    writer->PutArray(regexp_atoms);
+  }
+
+  // Whether every element of a is in [0, limit).
+  static bool InRange(const IndexArray<int32_t> &a, size_t limit)
+  {
+    for (size_t i = 0; i < a.size(); i++)
+      if (a[i] < 0 || static_cast<size_t>(a[i]) >= limit)
+        return false;
+    return true;
+  }
+
+  // Whether begin indexes an array of size elements for n items, as
+  // parent_begin_ does parents_.
+  static bool ValidBegin(const IndexArray<int32_t> &begin, size_t n,
+                         size_t size)
+  {
+    if (begin.size() != n + 1 || begin[0] != 0 ||
+        static_cast<size_t>(begin[n]) != size)
+      return false;
+    for (size_t i = 0; i < n; i++)
+      if (begin[i] > begin[i + 1])
+        return false;
+    return true;
+  }
+
+  bool PrefilterTree::Load(IndexReader *reader, int num_regexps,
+                           std::vector<std::string> *atom_vec)
+  {
+    if (compiled_ || !prefilter_vec_.empty())
+    {
+      LOG(DFATAL) << "Load called after Add or Compile.";
+      return false;
+    }
+
+    IndexArray<int32_t> sizes;
+    std::vector<StringPiece> atoms;
+    IndexArray<int32_t> counts;
+    IndexArray<int32_t> parent_begin;
+    IndexArray<int32_t> parents;
+    IndexArray<int32_t> regexp_begin;
+    IndexArray<int32_t> regexps;
+    IndexArray<int32_t> atom_index_to_id;
+    IndexArray<int32_t> unfiltered;
+    std::vector<StringPiece> strings;
+    IndexArray<int32_t> regexp_atom_begin;
+    IndexArray<int32_t> regexp_atoms;
+    if (!reader->GetArray(&sizes) || !reader->GetStrings(&atoms) ||
+        !reader->GetArray(&counts) || !reader->GetArray(&parent_begin) ||
+        !reader->GetArray(&parents) || !reader->GetArray(&regexp_begin) ||
+        !reader->GetArray(&regexps) || !reader->GetArray(&atom_index_to_id) ||
+        !reader->GetArray(&unfiltered) || !reader->GetStrings(&strings) ||
+        !reader->GetArray(&regexp_atom_begin) ||
+        !reader->GetArray(&regexp_atoms))
+      return false;
+
+    // Check everything that searching relies on, so that a damaged file
+    // is refused instead of crashing a search.
+    size_t n = counts.size();
+    if (sizes.size() != 2 || sizes[0] != min_atom_len_ ||
+        sizes[1] != num_regexps || num_regexps <= 0 ||
+        !ValidBegin(parent_begin, n, parents.size()) || !InRange(parents, n) ||
+        !ValidBegin(regexp_begin, n, regexps.size()) ||
+        !InRange(regexps, num_regexps) ||
+        atom_index_to_id.size() != atoms.size() ||
+        !InRange(atom_index_to_id, n) ||
+        !std::is_sorted(atom_index_to_id.begin(), atom_index_to_id.end()) ||
+        !InRange(unfiltered, num_regexps) ||
+        !std::is_sorted(unfiltered.begin(), unfiltered.end()) ||
+        strings.size() != static_cast<size_t>(num_regexps) ||
+        !ValidBegin(regexp_atom_begin, num_regexps, regexp_atoms.size()) ||
+        !InRange(regexp_atoms, atoms.size()))
+      return false;
+    for (size_t i = 0; i < n; i++)
+      if (counts[i] < 1)
+        return false;
+
+    propagate_up_at_count_ = counts;
+    parent_begin_ = parent_begin;
+    parents_ = parents;
+    regexp_begin_ = regexp_begin;
+    regexps_ = regexps;
+    atom_index_to_id_ = atom_index_to_id;
+    unfiltered_ = unfiltered;
+    atoms_.swap(atoms);
+    prefilter_strings_.swap(strings);
+    regexp_atom_begin_ = regexp_atom_begin;
+    regexp_atoms_ = regexp_atoms;
+    num_regexps_ = num_regexps;
+    compiled_ = true;
+
+    atom_vec->clear();
+    for (size_t i = 0; i < atoms_.size(); i++)
+      atom_vec->push_back(atoms_[i].ToString());
+    return true;
+  }
+
+  void PrefilterTree::PropagateMatch(const std::vector<int> &atom_ids,
+                                     std::vector<int> *regexps) const
+  {
+    // count holds how many children of each AND node have triggered so
+    // far; work holds the nodes that have triggered, and grows while it
+    // is being walked.
+    const int n = static_cast<int>(propagate_up_at_count_.size());
+    IntMap count(n);
+    IntMap work(n);
+    for (size_t i = 0; i < atom_ids.size(); i++)
+      work.set(atom_ids[i], 1);
+    for (IntMap::iterator it = work.begin(); it != work.end(); ++it)
+    {
+      const int id = it->index();
+      // Record regexps triggered. Every regexp hangs off exactly one
+      // node and every node is visited once, so there are no duplicates.
+      regexps->insert(regexps->end(), regexps_.begin() + regexp_begin_[id],
+                      regexps_.begin() + regexp_begin_[id + 1]);
+      // Pass trigger up to parents.
+      for (int32_t i = parent_begin_[id]; i < parent_begin_[id + 1]; i++)
+      {
+        int j = parents_[i];
+        const int up_count = propagate_up_at_count_[j];
+        // Delay until all the children have succeeded.
+        if (up_count > 1)
+        {
+          int c;
+          if (count.has_index(j))
+            c = ++count.get_existing(j);
+          else
+            count.set_new(j, c = 1);
+          if (c < up_count)
+            continue;
+        }
+        // Trigger the parent.
+        work.set(j, 1);
+      }
+    }
+  }
+} // namespace re2
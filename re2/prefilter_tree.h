@@ -0,0 +1,220 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: The prefilters of all the regexps of a FilteredRE2.
+ ******************************************************************************/
+
+#pragma once
+
+// The PrefilterTree class is used to form an AND-OR tree of strings
+// that would trigger each regexp. The 'prefilter' of each regexp is
+// added to PrefilterTree, and then PrefilterTree is used to find all
+// the unique strings across the prefilters. During search, by using
+// matches from a string matching engine, PrefilterTree deduces the
+// set of regexps that are to be triggered. The 'string matching
+// engine' itself is outside of this class, and the caller can use any
+// favorite engine. PrefilterTree provides a set of strings (called
+// atoms) that the user of this class should use to do the string
+// matching.
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "re2/index_file.h"
+#include "re2/prefilter.h"
+#include "re2/sparse_array.h"
+#include "re2/stringpiece.h"
+
+namespace re2 {
+
+class PrefilterTree {
+ public:
+  PrefilterTree();
+  explicit PrefilterTree(int min_atom_len);
+  ~PrefilterTree();
+
+  // The estimated fraction of texts that contain each atom.
+  typedef std::unordered_map<std::string, double> AtomFrequencies;
+
+  // Makes Add choose the atoms of each prefilter by how often they occur
+  // in texts, not by length alone: an AND keeps its rarest children, only
+  // as many as pay for themselves, and an atom shorter than min_atom_len
+  // is kept if it is rare. Atoms missing from frequencies are taken to be
+  // in every text. Call before Add.
+  void SetAtomFrequencies(const AtomFrequencies& frequencies);
+
+  // Adds the prefilter for the next regexp. Note that we need to add
+  // prefilters for all regexps added to FilteredRE2, even NULL ones, so
+  // that the ids line up. PrefilterTree takes ownership of prefilter.
+  void Add(Prefilter* prefilter);
+
+  // The Compile returns a vector of string in atom_vec.
+  // Call this after all the prefilters are added through Add.
+  // No changes can be made through Add after Compile.
+  // The caller should use the returned set of strings to do string matching.
+  // Each time a string matches, the corresponding index then has to be
+  // and passed to RegexpsGivenStrings below.
+  void Compile(std::vector<std::string>* atom_vec);
+
+  // Given the indices of the atoms that matched, returns the indexes
+  // of regexps that should be searched, in increasing order. The
+  // matched_atoms should contain all the ids of string atoms that were
+  // found to match the content. The caller can use any string match
+  // engine to perform this function. This function is thread safe.
+  // It only visits the nodes that the matched atoms trigger, so its cost
+  // does not grow with the number of regexps.
+  void RegexpsGivenStrings(const std::vector<int>& matched_atoms,
+                           std::vector<int>* regexps) const;
+
+  // Returns the prefilter of regexpid as Prefilter::DebugString() shows
+  // it, after the parts that cannot be used for filtering have been
+  // removed. Returns the empty string if regexpid is unfiltered, that is,
+  // returned by every call to RegexpsGivenStrings.
+  std::string PrefilterString(int regexpid) const;
+
+  // Sets atoms to the indices (as returned by Compile) of the atoms that
+  // the prefilter of regexpid uses, in increasing order. Compile has to be
+  // called before calling this.
+  void RegexpAtoms(int regexpid, std::vector<int>* atoms) const;
+
+  // Logs the prefilter of regexpid, for debugging.
+  void PrintPrefilter(int regexpid) const;
+
+  // Writes the compiled tree, atoms included, for FilteredRE2::SaveIndex.
+  void Save(IndexWriter* writer) const;
+
+  // Reads a tree of num_regexps regexps written by Save, in place of Add
+  // and Compile, and sets atom_vec as Compile would. The tree uses the
+  // arrays where they are, so the file must outlive it. Returns false,
+  // leaving the tree as it was, if the file does not hold such a tree or
+  // the tree was built with another min_atom_len.
+  bool Load(IndexReader* reader, int num_regexps,
+            std::vector<std::string>* atom_vec);
+
+ private:
+  typedef SparseArray<int> IntMap;
+  typedef std::unordered_map<std::string, Prefilter*> NodeMap;
+
+  // Each unique node has a corresponding Entry that helps in
+  // passing the matching trigger information along the tree.
+  struct Entry {
+   public:
+    // How many children should match before this node triggers the
+    // parent. For an atom and an OR node, this is 1 and for an AND
+    // node, it is the number of unique children.
+    int propagate_up_at_count;
+
+    // When this node is ready to trigger the parent, what are the indices
+    // of the parent nodes to trigger. The reason there may be more than
+    // one is because of sharing. For example (abc | def) and (xyz | def)
+    // are two different nodes, but they share the atom 'def'. So when
+    // 'def' matches, it triggers two parents, corresponding to the two
+    // different OR nodes.
+    std::vector<int> parents;
+
+    // When this node is ready to trigger the parent, what are the
+    // regexps that are triggered.
+    std::vector<int> regexps;
+  };
+
+  // Removes the parts of node that cannot be used for filtering: atoms
+  // shorter than min_atom_len_, and ALL and NONE nodes. Returns false if
+  // nothing usable is left, in which case the regexp is unfiltered.
+  bool KeepNode(Prefilter* node) const;
+
+  // KeepNode when atom_frequencies_ is set. Sets *frequency to the
+  // estimated fraction of texts that node, as kept, passes.
+  bool SelectNode(Prefilter* node, double* frequency) const;
+
+  // This function assigns unique ids to various parts of the
+  // prefilter, by looking at if these nodes are already in the
+  // PrefilterTree. Sets entries, indexed by unique id, and the unique id
+  // of each atom.
+  void AssignUniqueIds(NodeMap* nodes, std::vector<Entry>* entries,
+                       std::vector<int32_t>* atom_index_to_id,
+                       std::vector<std::string>* atom_vec);
+
+  // Moves v into storage_ and returns it.
+  IndexArray<int32_t> Own(std::vector<int32_t>* v);
+
+  // Whether regexpid is unfiltered.
+  bool IsUnfiltered(int regexpid) const;
+
+  // Given the matching atoms, find the regexps to be triggered.
+  void PropagateMatch(const std::vector<int>& atom_ids,
+                      std::vector<int>* regexps) const;
+
+  // Returns the prefilter node that has the same NodeString as this
+  // node. For the canonical node, returns node.
+  Prefilter* CanonicalNode(NodeMap* nodes, Prefilter* node);
+
+  // A string that uniquely identifies the node. Assumes that the
+  // children of node have already been assigned unique ids.
+  std::string NodeString(Prefilter* node) const;
+
+  // Appends the atom indices of the atoms under node to atoms.
+  void CollectAtoms(const Prefilter* node, std::vector<int>* atoms) const;
+
+  // The entries of the unique nodes, flattened into arrays indexed by
+  // unique id. The parents of node i are parents_[parent_begin_[i]] to
+  // parents_[parent_begin_[i + 1] - 1], and the regexps that it triggers
+  // are in regexps_ in the same way. The arrays are in storage_ after
+  // Compile, or in the index file after Load.
+  IndexArray<int32_t> propagate_up_at_count_;
+  IndexArray<int32_t> parent_begin_;
+  IndexArray<int32_t> parents_;
+  IndexArray<int32_t> regexp_begin_;
+  IndexArray<int32_t> regexps_;
+
+  // Unique id of each atom, in the order that Compile() returned them.
+  // Atoms are numbered in the same order as their unique ids, so this is
+  // increasing.
+  IndexArray<int32_t> atom_index_to_id_;
+
+  // The regexps that are always triggered, in increasing order.
+  IndexArray<int32_t> unfiltered_;
+
+  // The atoms, which point into the prefilters or the index file.
+  std::vector<StringPiece> atoms_;
+
+  // What PrefilterString and RegexpAtoms return for a tree read by Load.
+  // regexp_atom_begin_ indexes regexp_atoms_ as parent_begin_ does parents_.
+  std::vector<StringPiece> prefilter_strings_;
+  IndexArray<int32_t> regexp_atom_begin_;
+  IndexArray<int32_t> regexp_atoms_;
+
+  // The arrays of a tree built by Compile.
+  std::vector<std::vector<int32_t>> storage_;
+
+  // Set by SetAtomFrequencies until Compile.
+  AtomFrequencies atom_frequencies_;
+
+  // The prefilter of each regexp, or NULL if it is unfiltered. Empty for
+  // a tree read by Load.
+  std::vector<Prefilter*> prefilter_vec_;
+
+  // The number of regexps.
+  int num_regexps_;
+
+  // Strings less than this length are not stored as atoms.
+  const int min_atom_len_;
+
+  // Has the prefilter tree been compiled.
+  bool compiled_;
+
+  PrefilterTree(const PrefilterTree&) = delete;
+  PrefilterTree& operator=(const PrefilterTree&) = delete;
+};
+
+}  // namespace re2
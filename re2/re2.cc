@@ -289,11 +289,14 @@ namespace re2
     // for Consume and FindAndConsume
     suffix_regexp_ = (re2::Regexp *)rure_new((const uint8_t *)pattern.data(), pattern.size());
     // for FullMatch
+    // The empty group at the end counts the groups of the pattern: the
+    // Rust parser drops the groups of a repetition like (a){0}, and the
+    // regex then reports only as many groups as the last one it kept.
     if (rure_str != "")
     {
       std::string FullMatch_rure_str = rure_str;
       FullMatch_rure_str.insert(0, "^(");
-      FullMatch_rure_str.append(")$");
+      FullMatch_rure_str.append(")()$");
       entire_regexp_ = (re2::Regexp *)rure_compile((const uint8_t *)FullMatch_rure_str.c_str(), strlen(FullMatch_rure_str.c_str()), flags, NULL, err);
     }
     else
@@ -304,6 +307,12 @@ namespace re2
     // 获取捕获组的数量, 并对num_captures_其进行赋值
     rure_captures *caps = rure_captures_new(re);
     size_t captures_len = rure_captures_len(caps) - 1;
+    if (entire_regexp_ != NULL && entire_regexp_ != (re2::Regexp *)prog_)
+    {
+      rure_captures *entire_caps = rure_captures_new((rure *)entire_regexp_);
+      captures_len = rure_captures_len(entire_caps) - 3;
+      rure_captures_free(entire_caps);
+    }
     if (!options_.never_capture())
     {
       num_captures_ = (int)captures_len;
@@ -321,6 +330,13 @@ namespace re2
 
   RE2::~RE2()
   {
+    // entire_regexp_ is prog_ itself when the pattern is empty.
+    if (entire_regexp_ != NULL && entire_regexp_ != (re2::Regexp *)prog_)
+      rure_free((rure *)entire_regexp_);
+    if (suffix_regexp_ != NULL)
+      rure_free((rure *)suffix_regexp_);
+    if (prog_ != NULL)
+      rure_free((rure *)prog_);
     if (error_ != empty_string)
       delete error_;
     if (named_groups_ != NULL && named_groups_ != empty_named_groups)
@@ -459,6 +475,10 @@ namespace re2
     const char *str_rure = rure_replace(re_rure, (const uint8_t *)str->c_str(), strlen(str->c_str()),
                                         (const uint8_t *)rure_rewrite, strlen(rure_rewrite));
     *str = str_rure;
+    // rure_replace和rure_rewrite_str_convert返回的字符串以及编译的rure都需要释放
+    rure_cstring_free(const_cast<char *>(str_rure));
+    rure_cstring_free(const_cast<char *>(rure_rewrite));
+    rure_free(re_rure);
 
     return true;
   }
@@ -487,9 +507,11 @@ namespace re2
       const char *str_rure = rure_replace_all(rure_re, (const uint8_t *)str->c_str(), strlen(str->c_str()),
                                               (const uint8_t *)rure_rewrite, strlen(rure_rewrite));
       *str = str_rure;
-      return count;
+      rure_cstring_free(const_cast<char *>(str_rure));
+      rure_cstring_free(const_cast<char *>(rure_rewrite));
     }
-    return 0;
+    rure_free(rure_re);
+    return count;
   }
 
   bool RE2::Extract(const StringPiece &text,
@@ -554,6 +576,41 @@ namespace re2
 
   /***** Actual matching and rewriting code *****/
 
+  // Sets submatch[i] from group i + shift of caps, whose offsets count
+  // from byte base of text.
+  // Latin-1 text was converted to UTF-8 for the search.
+  static void SetSubmatches(rure_captures *caps,
+                            int shift,
+                            size_t base,
+                            bool utf8,
+                            const StringPiece &text,
+                            StringPiece *submatch,
+                            int nsubmatch)
+  {
+    rure_match match;
+    for (int i = 0; i < nsubmatch; i++)
+    {
+      bool result = rure_captures_at(caps, i + shift, &match);
+      if (result)
+      {
+        size_t start = base + match.start;
+        size_t len = match.end - match.start;
+        if (utf8)
+        {
+          submatch[i] = StringPiece(text.data() + start, static_cast<size_t>(len));
+        }
+        else
+        {
+          submatch[i] = StringPiece(text.data() + start, static_cast<size_t>(len / 2));
+        }
+      }
+      else
+      {
+        submatch[i] = StringPiece();
+      }
+    }
+  }
+
   bool RE2::Match(const StringPiece &text,
                   size_t startpos,
                   size_t endpos,
@@ -563,6 +620,8 @@ namespace re2
   {
     if (text.size() == 0 && pattern() == "")
     {
+      for (int i = 0; i < nsubmatch; i++)
+        submatch[i] = i == 0 ? StringPiece(text.data(), 0) : StringPiece();
       return true;
     }
     if (!ok())
@@ -581,63 +640,75 @@ namespace re2
                    << "text size: " << text.size() << "]";
       return false;
     }
-    // 对null和empty进行处理
-    if (text.data() == NULL)
-    {
-      for (int i = 0; i < nsubmatch; i++)
-      {
-        submatch[i] = NULL;
-      }
-      return true;
-    }
+    // A NULL text is searched as the empty text it stands for; rure
+    // needs a pointer even for no bytes.
+    static const char kEmptyText[] = "";
+    const char *text_data = text.data() != NULL ? text.data() : kEmptyText;
 
+    rure *re = (rure *)prog_;
+    // rure *re1 = (rure *)rprog_;
+    rure_match match = {0};
     std::string haystack;
-    if (text.data() == NULL || text[0] == '\0')
+    const uint8_t *data;
+    size_t length;
+    size_t start = 0;
+    if (options_.encoding() == RE2::Options::EncodingUTF8 && !options_.never_nl())
     {
-      haystack = "";
+      // UTF-8 text is searched where it is, from startpos to endpos, with
+      // the text before startpos as the context of ^ and \b. Copying it
+      // made each call cost as much as the whole text, and a loop over the
+      // matches of a text quadratic.
+      data = (const uint8_t *)text_data;
+      length = endpos;
+      start = startpos;
     }
     else
     {
-      haystack = text.ToString();
-    }
+      if (text.empty() || text[0] == '\0')
+      {
+        haystack = "";
+      }
+      else
+      {
+        haystack = text.ToString();
+      }
 
-    // Latin-1编码转换
-    if (options_.encoding() == RE2::Options::EncodingLatin1)
-    {
-      ConvertLatin1ToUTF8(text, &haystack);
-      // haystack = encodingLatin1ToUTF8(text.as_string());
-    }
-    rure *re = (rure *)prog_;
-    // rure *re1 = (rure *)rprog_;
-    rure_match match = {0};
-    size_t length = strlen(haystack.c_str());
-    if (options_.never_nl())
-    {
-      std::string strs = haystack + '\n';
-      size_t pos = strs.find('\n');
-      bool flag = false;
-      while (pos != strs.npos)
+      // Latin-1编码转换
+      if (options_.encoding() == RE2::Options::EncodingLatin1)
       {
-        std::string temp = strs.substr(0, pos);
-        bool matched = rure_is_match(re, (const uint8_t *)temp.c_str(), strlen(temp.c_str()), 0);
-        if (matched && !nsubmatch)
+        ConvertLatin1ToUTF8(text, &haystack);
+        // haystack = encodingLatin1ToUTF8(text.as_string());
+      }
+      length = strlen(haystack.c_str());
+      if (options_.never_nl())
+      {
+        std::string strs = haystack + '\n';
+        size_t pos = strs.find('\n');
+        bool flag = false;
+        while (pos != strs.npos)
         {
-          return true;
+          std::string temp = strs.substr(0, pos);
+          bool matched = rure_is_match(re, (const uint8_t *)temp.c_str(), strlen(temp.c_str()), 0);
+          if (matched && !nsubmatch)
+          {
+            return true;
+          }
+          if (matched && nsubmatch)
+          {
+            haystack = temp;
+            length = strlen(haystack.c_str());
+            flag = true;
+            break;
+          }
+          strs = strs.substr(pos + 1, length + 1);
+          pos = strs.find('\n');
         }
-        if (matched && nsubmatch)
+        if (!flag)
         {
-          haystack = temp;
-          length = strlen(haystack.c_str());
-          flag = true;
-          break;
+          return false;
         }
-        strs = strs.substr(pos + 1, length + 1);
-        pos = strs.find('\n');
-      }
-      if (!flag)
-      {
-        return false;
       }
+      data = (const uint8_t *)haystack.c_str();
     }
     // bool matched = rure_find(re, (const uint8_t *)haystack, strlen(haystack), 0, &match);
     // 这里没有 if(re_anchor == ANCHOR_START)原因是因为：
@@ -646,7 +717,7 @@ namespace re2
     if (re_anchor == UNANCHORED)
     {
       // bool matched = rure_find(re, (const uint8_t *)haystack.c_str(), length, 0, &match);
-      bool matched = rure_is_match(re, (const uint8_t *)haystack.c_str(), length, 0);
+      bool matched = rure_is_match(re, data, length, start);
       if (!matched)
       {
         return false;
@@ -658,50 +729,46 @@ namespace re2
     }
     else if (re_anchor == ANCHOR_BOTH)
     {
-
-      bool matched = rure_find(re, (const uint8_t *)haystack.c_str(), length, 0, &match);
-      if (!matched || match.start != 0 || match.end != length)
-      {
-        return false;
-      }
-      else if (!nsubmatch)
+      // The leftmost-first match of the pattern need not be the one that
+      // spans the text: "a|ab" matches "ab" in full, but its first choice
+      // is "a". entire_regexp_, ^(pattern)()$, finds the one that does, so
+      // it searches from start on, and its group i + 1 is group i.
+      if (entire_regexp_ == (re2::Regexp *)prog_)
       {
+        // The empty pattern matches only the empty text.
+        if (start != length)
+          return false;
+        for (int i = 0; i < nsubmatch; i++)
+          submatch[i] = i == 0 ? StringPiece(text.data() + start, 0) : StringPiece();
         return true;
       }
+      rure *entire = (rure *)entire_regexp_;
+      if (!nsubmatch)
+        return rure_is_match(entire, data + start, length - start, 0);
+      rure_captures *caps = rure_captures_new(entire);
+      bool matched = rure_find_captures(entire, data + start, length - start, 0, caps);
+      if (matched)
+        SetSubmatches(caps, 1, start, options_.encoding() == RE2::Options::EncodingUTF8,
+                      text, submatch, nsubmatch);
+      rure_captures_free(caps);
+      return matched;
     }
 
     // Demo  获取捕获组内容，存储到submatch数组中
     rure_captures *caps = rure_captures_new(re);
-    rure_find_captures(re, (const uint8_t *)haystack.c_str(),
-                       length, 0, caps);
+    bool matched = rure_find_captures(re, data, length, start, caps);
     // size_t captures_len = num_captures_ + 1;
 
     rure_captures_at(caps, 0, &match);
-    if (re_anchor == ANCHOR_START && match.start != 0)
-      return false;
-
-    for (int i = 0; i < nsubmatch; i++)
+    if (!matched || (re_anchor == ANCHOR_START && match.start != start))
     {
-      bool result = rure_captures_at(caps, i, &match);
-      if (result)
-      {
-        size_t start = match.start;
-        size_t end = match.end;
-        size_t len = end - start;
-        if (options_.encoding() == RE2::Options::EncodingUTF8)
-        {
-          submatch[i] = StringPiece(text.data() + start, static_cast<size_t>(len));
-        }
-        else
-        {
-          submatch[i] = StringPiece(text.data() + start, static_cast<size_t>(len / 2));
-        }
-      }
-      else
-      {
-        submatch[i] = StringPiece();
-      }
+      rure_captures_free(caps);
+      return false;
     }
+
+    SetSubmatches(caps, 0, 0, options_.encoding() == RE2::Options::EncodingUTF8,
+                  text, submatch, nsubmatch);
+    rure_captures_free(caps);
     return true;
   }
 
@@ -17,16 +17,21 @@
 
 #include <iostream>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <utility>
 #include <map>
+#include <vector>
 
 #include "re2/testing/util/util.h"
 #include "re2/testing/util/logging.h"
 #include "re2/re2.h"
 #include "re2/set.h"
 #include "re2/stringpiece.h"
+#include "re2/thread_pool.h"
 #include "regex_internal.h"
 #include "regex-capi/include/regex_capi.h"
 
@@ -34,6 +39,9 @@ using namespace std;
 
 namespace re2
 {
+  // The default size limit of a compiled regex in the regex crate.
+  static const size_t kMinSizeLimit = 10 << 20;
+
   RE2::Set::Set(const RE2::Options &options, RE2::Anchor anchor)
       : options_(options),
         anchor_(anchor),
@@ -45,6 +53,10 @@ namespace re2
 
   RE2::Set::~Set()
   {
+    // prog_ holds a rure_set, which has to be released by the C API.
+    rure_set *re = (rure_set *)prog_.release();
+    if (re != NULL)
+      rure_set_free(re);
     size_ = 0;
     elem_.clear();
   }
@@ -52,7 +64,9 @@ namespace re2
   RE2::Set::Set(Set &&other)
       : options_(other.options_),
         anchor_(other.anchor_),
+        elem_(std::move(other.elem_)),
         compiled_(other.compiled_),
+        size_(other.size_),
         prog_(std::move(other.prog_))
   {
     other.elem_.clear();
@@ -69,19 +83,29 @@ namespace re2
     return *this;
   }
 
-  int RE2::Set::Add(const StringPiece &pattern, std::string *error)
+  // Returns pattern with the anchors that anchor asks for.
+  static std::string AnchoredPattern(const StringPiece &pattern,
+                                     RE2::Anchor anchor)
   {
-    int place_num = size_;
     std::string rure_pattern = pattern.as_string();
-    if (anchor_ == RE2::ANCHOR_START)
+    if (anchor == RE2::ANCHOR_START)
     { // 处理RE2::ANCHOR_START的情况
       rure_pattern.insert(0, "^");
     }
-    else if (anchor_ == RE2::ANCHOR_BOTH)
+    else if (anchor == RE2::ANCHOR_BOTH)
     { // 处理RE2::ANCHOR_BOTH的情况
       rure_pattern.insert(0, "^");
       rure_pattern.append("$");
     }
+    return rure_pattern;
+  }
+
+  // Returns whether rure_pattern, made from pattern, compiles. If not and
+  // error is not NULL, sets *error to the message of the parser.
+  static bool CheckPattern(const StringPiece &pattern,
+                           const std::string &rure_pattern,
+                           std::string *error)
+  {
     rure_error *err = rure_error_new();
     rure *re = rure_compile((const uint8_t *)rure_pattern.c_str(), strlen(rure_pattern.c_str()), RURE_DEFAULT_FLAGS, NULL, err);
     if (re == NULL)
@@ -92,44 +116,108 @@ namespace re2
         error->assign(msg);
         LOG(ERROR) << "Regexp Error '" << pattern.data() << "':" << msg << "'";
       }
-      // rure_free(re);
-      return -1;
+      rure_error_free(err);
+      return false;
     }
-    else
+    // The pattern was only compiled to validate it.
+    rure_free(re);
+    rure_error_free(err);
+    return true;
+  }
+
+  int RE2::Set::Add(const StringPiece &pattern, std::string *error)
+  {
+    int place_num = size_;
+    std::string rure_pattern = AnchoredPattern(pattern, anchor_);
+    if (!CheckPattern(pattern, rure_pattern, error))
+      return -1;
+    elem_.push_back(pair<std::string, re2::Regexp *>(rure_pattern, (re2::Regexp *)nullptr));
+    size_++;
+    return place_num;
+  }
+
+  bool RE2::Set::AddBatch(const std::vector<StringPiece> &patterns,
+                          std::vector<int> *indices,
+                          std::vector<std::string> *errors,
+                          ThreadPool *pool)
+  {
+    const int n = static_cast<int>(patterns.size());
+    std::vector<std::string> rure_patterns(n);
+    std::vector<std::string> messages(errors != NULL ? n : 0);
+    std::unique_ptr<bool[]> valid(new bool[n]);
+    if (pool == NULL)
+      pool = ThreadPool::Default();
+    pool->Run(n, [&](int i)
+              {
+      rure_patterns[i] = AnchoredPattern(patterns[i], anchor_);
+      valid[i] = CheckPattern(patterns[i], rure_patterns[i],
+                              errors != NULL ? &messages[i] : NULL); });
+
+    // The indices are given out in order, as Add would give them.
+    bool ok = true;
+    indices->assign(n, -1);
+    for (int i = 0; i < n; i++)
     {
-      elem_.push_back(pair<std::string, re2::Regexp *>(rure_pattern, (re2::Regexp *)nullptr));
-      size_++;
-      // rure_free(re);
-      return place_num;
+      if (!valid[i])
+      {
+        ok = false;
+        continue;
+      }
+      elem_.push_back(pair<std::string, re2::Regexp *>(std::move(rure_patterns[i]), (re2::Regexp *)nullptr));
+      (*indices)[i] = size_++;
     }
+    if (errors != NULL)
+      errors->swap(messages);
+    return ok;
   }
 
   bool RE2::Set::Compile()
+  {
+    return Compile(NULL);
+  }
+
+  bool RE2::Set::Compile(std::string *error)
   {
     if (compiled_)
     {
       LOG(ERROR) << "RE2::Set::Compile() called more than once";
+      if (error != NULL)
+        error->assign("RE2::Set::Compile() called more than once");
       return false;
     }
     compiled_ = true;
     const size_t PAT_COUNT = elem_.size();
-    const char *patterns[PAT_COUNT];
-    size_t patterns_lengths[PAT_COUNT];
+    // Dictionary sets can hold millions of patterns, too many for the stack.
+    std::vector<const char *> patterns(PAT_COUNT);
+    std::vector<size_t> patterns_lengths(PAT_COUNT);
     for (size_t i = 0; i < elem_.size(); i++)
     {
       patterns[i] = elem_[i].first.c_str();
       patterns_lengths[i] = elem_[i].first.length();
     }
 
+    // As in RE2, max_mem bounds the memory used by the DFA state cache,
+    // and the compiled program too; that limit is never set below the
+    // default of the regex crate, which is larger than kDefaultMaxMem.
+    rure_options *options = rure_options_new();
+    rure_options_dfa_size_limit(options, options_.max_mem());
+    rure_options_size_limit(options, std::max<size_t>(options_.max_mem(), kMinSizeLimit));
+    // The flags are those that Add checked the patterns with, so that
+    // Compile accepts every pattern that Add did.
     rure_error *err = rure_error_new();
-    rure_set *re = rure_compile_set((const uint8_t **)patterns,
-                                    patterns_lengths, PAT_COUNT, 0, NULL, err);
+    rure_set *re = rure_compile_set((const uint8_t **)patterns.data(),
+                                    patterns_lengths.data(), PAT_COUNT,
+                                    RURE_DEFAULT_FLAGS, options, err);
+    rure_options_free(options);
     if (re == NULL)
     {
+      if (error != NULL)
+        error->assign(rure_error_message(err));
+      rure_error_free(err);
       compiled_ = false;
-      rure_set_free(re);
       return false;
     }
+    rure_error_free(err);
     prog_.reset((Prog *)re);
     compiled_ = true;
     return true;
@@ -151,29 +239,114 @@ namespace re2
       return false;
     }
 
-    const char *pat_str = text.data();
-    size_t length = strlen(pat_str);
+    rure_set *re = (rure_set *)prog_.get();
+    const char *pat_str = text.data() == NULL ? "" : text.data();
+    size_t length = text.size();
+    if (v == NULL && error_info == NULL)
+      return rure_set_is_match(re, (const uint8_t *)pat_str, length, 0);
+
+    // The indices are written straight into v; if it is too small, the
+    // search is repeated once v has grown to fit them.
+    bool gave_up = false;
+    size_t n;
     if (v == NULL)
     {
-      bool result = rure_set_is_match((rure_set *)prog_.get(),
-                                      (const uint8_t *)pat_str, length, 0);
-      return result;
+      n = rure_set_matches_into(re, (const uint8_t *)pat_str, length, 0,
+                                NULL, 0, &gave_up);
     }
     else
     {
-      v->clear();
-      bool matches[elem_.size()];
-      bool result = rure_set_matches((rure_set *)prog_.get(),
-                                     (const uint8_t *)pat_str, length, 0, matches);
-      if (!result)
-        return false;
-      for (size_t i = 0; i < elem_.size(); i++)
+      v->resize(std::max<size_t>(v->capacity(), 8));
+      n = rure_set_matches_into(re, (const uint8_t *)pat_str, length, 0,
+                                v->data(), v->size(), &gave_up);
+      if (n > v->size())
       {
-        if (matches[i])
-          v->push_back(i);
+        v->resize(n);
+        n = rure_set_matches_into(re, (const uint8_t *)pat_str, length, 0,
+                                  v->data(), v->size(), &gave_up);
       }
-      return true;
+      v->resize(n);
+    }
+    if (error_info != NULL)
+      error_info->kind = gave_up ? kOutOfMemory : kNoError;
+    return n > 0;
+  }
+
+  int RE2::Set::MatchFirst(const StringPiece &text) const
+  {
+    if (!compiled_)
+    {
+      LOG(ERROR) << "RE2::Set::MatchFirst() called before compiling";
+      return -1;
+    }
+    const char *pat_str = text.data() == NULL ? "" : text.data();
+    return rure_set_match_first((rure_set *)prog_.get(),
+                                (const uint8_t *)pat_str, text.size(), 0);
+  }
+
+  bool RE2::Set::MatchMany(const StringPiece *texts, int n,
+                           MatchManyResults *results, ThreadPool *pool) const
+  {
+    results->offsets.assign(1, 0);
+    results->indices.clear();
+    if (!compiled_)
+    {
+      LOG(ERROR) << "RE2::Set::MatchMany() called before compiling";
+      return false;
     }
+    if (n <= 0)
+      return true;
+    if (pool == NULL)
+      pool = ThreadPool::Default();
+
+    // Threads take the texts a chunk at a time; each chunk collects its own
+    // indices, which are concatenated in order at the end.
+    const int kChunk = 64;
+    const int nchunks = (n + kChunk - 1) / kChunk;
+    std::vector<size_t> counts(n);
+    std::vector<std::vector<int>> chunk_indices(nchunks);
+    std::atomic<int> next_chunk(0);
+    rure_set *re = (rure_set *)prog_.get();
+    pool->Run(std::min(pool->num_threads(), nchunks), [&](int)
+              {
+      rure_set_cache *cache = rure_set_cache_acquire(re);
+      for (int c; (c = next_chunk.fetch_add(1)) < nchunks;)
+      {
+        std::vector<int> &out = chunk_indices[c];
+        for (int i = c * kChunk; i < n && i < (c + 1) * kChunk; i++)
+        {
+          const char *text = texts[i].data() == NULL ? "" : texts[i].data();
+          const uint32_t *ids;
+          size_t k = rure_set_matches_ids(re, cache, (const uint8_t *)text,
+                                          texts[i].size(), 0, &ids);
+          out.insert(out.end(), ids, ids + k);
+          counts[i] = k;
+        }
+      }
+      rure_set_cache_release(re, cache); });
+
+    results->offsets.resize(n + 1);
+    for (int i = 0; i < n; i++)
+      results->offsets[i + 1] = results->offsets[i] + counts[i];
+    results->indices.reserve(results->offsets[n]);
+    for (int c = 0; c < nchunks; c++)
+      results->indices.insert(results->indices.end(), chunk_indices[c].begin(),
+                              chunk_indices[c].end());
+    return true;
+  }
+
+  bool RE2::Set::GetStats(Stats *stats) const
+  {
+    memset(stats, 0, sizeof *stats);
+    if (!compiled_)
+      return false;
+    rure_set_stats counters;
+    rure_set_get_stats((rure_set *)prog_.get(), &counters);
+    stats->searches = counters.searches;
+    stats->dfa_fallbacks = counters.dfa_fallbacks;
+    stats->cache_clears = counters.cache_clears;
+    stats->cache_bytes = counters.cache_bytes;
+    stats->caches = counters.caches;
     return true;
   }
 } // namespace re2
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <memory>
 #include <string>
 #include <utility>
@@ -14,6 +15,7 @@
 namespace re2 {
 class Prog;
 class Regexp;
+class ThreadPool;
 }  // namespace re2
 
 namespace re2 {
@@ -33,6 +35,25 @@ class RE2::Set {
     ErrorKind kind;
   };
 
+  // Counters of the searches run by Match(), MatchFirst() and MatchMany(),
+  // summed over every thread. A set compiled to a hash table of literals
+  // (see Compile()) runs no searches and reports zeros.
+  struct Stats {
+    int64_t searches;       // automaton searches run
+    int64_t dfa_fallbacks;  // searches the lazy DFA gave up on (kOutOfMemory)
+    int64_t cache_clears;   // times a lazy DFA cache filled up and was reset
+    int64_t cache_bytes;    // memory held by the search caches now
+    int64_t caches;         // number of search caches now
+  };
+
+  // The output of MatchMany(). The indices of the regexps that matched
+  // texts[i] are indices[offsets[i]] to indices[offsets[i + 1] - 1], in
+  // increasing order.
+  struct MatchManyResults {
+    std::vector<size_t> offsets;
+    std::vector<int> indices;
+  };
+
   Set(const RE2::Options& options, RE2::Anchor anchor);
   ~Set();
 
@@ -51,12 +72,34 @@ class RE2::Set {
   // the error message from the parser.
   int Add(const StringPiece& pattern, std::string* error);
 
+  // Adds each of patterns as Add would, in order, so that the regexps get
+  // the indices that calls to Add would give them, but parses them on the
+  // threads of pool, or of ThreadPool::Default() if pool is NULL. Sets
+  // (*indices)[i] to the index of patterns[i], or to -1 if it cannot be
+  // parsed, and, if errors is not NULL, (*errors)[i] to its error message
+  // (empty if it parsed). Returns true if every pattern parsed. Must not
+  // be called from a task running on the pool.
+  bool AddBatch(const std::vector<StringPiece>& patterns,
+                std::vector<int>* indices, std::vector<std::string>* errors,
+                ThreadPool* pool = NULL);
+
   // Compiles the set in preparation for matching.
-  // Returns false if the compiler runs out of memory.
+  // Returns false if the compiler runs out of memory: the compiled set
+  // may take options.max_mem() bytes, or 10 MB if that is more, so large
+  // sets need a larger max_mem.
   // Add() must not be called again after Compile().
   // Compile() must be called before Match().
+  // If every regexp is a literal string and the set is anchored at both
+  // ends (by ANCHOR_BOTH or by ^ and $ in each regexp), the set is compiled
+  // to a hash table of the strings instead of an automaton, and matching
+  // costs one lookup of the whole text.
   bool Compile();
 
+  // Like Compile(), but if it fails and error is not NULL, sets *error to
+  // the reason: the message of the compiler, which names the size limit
+  // that was exceeded or the pattern that it rejected.
+  bool Compile(std::string* error);
+
   // Returns true if text matches at least one of the regexps in the set.
   // Fills v (if not NULL) with the indices of the matching regexps.
   // Callers must not expect v to be sorted.
@@ -65,9 +108,30 @@ class RE2::Set {
   // As above, but populates error_info (if not NULL) when none of the regexps
   // in the set matched. This can inform callers when DFA execution fails, for
   // example, because they might wish to handle that case differently.
+  // If the lazy DFA ran out of memory, error_info reports kOutOfMemory; the
+  // result is still exact, because the NFA finishes such searches.
   bool Match(const StringPiece& text, std::vector<int>* v,
              ErrorInfo* error_info) const;
 
+  // Returns the smallest index of the regexps in the set that match text,
+  // or -1 if none of them match (or the set has not been compiled).
+  // Cheaper than Match() when only the highest-priority regexp matters:
+  // matching stops as soon as no regexp with a smaller index can still match.
+  int MatchFirst(const StringPiece& text) const;
+
+  // Matches each of texts[0] to texts[n - 1] as Match() would, and stores
+  // the results in *results. The texts are spread over the threads of pool,
+  // or of ThreadPool::Default() if pool is NULL; each thread keeps its own
+  // search cache for the whole batch.
+  // Returns false if the set has not been compiled.
+  bool MatchMany(const StringPiece* texts, int n, MatchManyResults* results,
+                 ThreadPool* pool = NULL) const;
+
+  // Fills *stats with a snapshot of the counters, read while matching goes
+  // on. The counters are read one by one, not all at the same instant.
+  // Returns false, and zeroes *stats, if the set has not been compiled.
+  bool GetStats(Stats* stats) const;
+
  private:
   typedef std::pair<std::string, re2::Regexp*> Elem;
 
@@ -0,0 +1,113 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: Map from small integers to values with constant-time clear.
+ ******************************************************************************/
+
+#pragma once
+
+// A SparseArray<Value> maps some of the integers in [0, max_size) to
+// values. Creating one, testing an index and setting one all take constant
+// time however large max_size is, so a SparseArray sized for a whole
+// PrefilterTree can be used to handle one match that touches a few nodes.
+//
+// This is the sparse set of Briggs and Torczon, as in RE2's sparse_array.h:
+// dense_ holds the (index, value) pairs in insertion order and sparse_[i]
+// is the position of index i in dense_. sparse_ is never initialized; an
+// index is present only if sparse_ and dense_ agree about it.
+// Iteration visits the pairs in insertion order, including the pairs added
+// while iterating.
+
+#include <memory>
+
+#include "re2/testing/util/logging.h"
+
+namespace re2 {
+
+template <typename Value>
+class SparseArray {
+ public:
+  class IndexValue {
+   public:
+    int index() const { return index_; }
+    Value& value() { return value_; }
+    const Value& value() const { return value_; }
+
+   private:
+    friend class SparseArray;
+    int index_;
+    Value value_;
+  };
+
+  typedef IndexValue* iterator;
+  typedef const IndexValue* const_iterator;
+
+  explicit SparseArray(int max_size)
+      : size_(0),
+        max_size_(max_size),
+        sparse_(new int[max_size]),
+        dense_(new IndexValue[max_size]) {}
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  int max_size() const { return max_size_; }
+
+  iterator begin() { return dense_.get(); }
+  iterator end() { return dense_.get() + size_; }
+  const_iterator begin() const { return dense_.get(); }
+  const_iterator end() const { return dense_.get() + size_; }
+
+  // Forgets every index.
+  void clear() { size_ = 0; }
+
+  bool has_index(int i) const {
+    DCHECK_LE(0, i);
+    DCHECK_LT(i, max_size_);
+    // Unsigned comparison also rejects whatever garbage sparse_[i] holds.
+    unsigned d = static_cast<unsigned>(sparse_[i]);
+    return d < static_cast<unsigned>(size_) && dense_[d].index_ == i;
+  }
+
+  // Returns the value of i, which must be present.
+  Value& get_existing(int i) {
+    DCHECK(has_index(i));
+    return dense_[sparse_[i]].value_;
+  }
+
+  // Sets the value of i, adding i if it is not present.
+  void set(int i, const Value& v) {
+    if (has_index(i))
+      get_existing(i) = v;
+    else
+      set_new(i, v);
+  }
+
+  // Adds i, which must not be present, with value v.
+  void set_new(int i, const Value& v) {
+    DCHECK(!has_index(i));
+    sparse_[i] = size_;
+    dense_[size_].index_ = i;
+    dense_[size_].value_ = v;
+    size_++;
+  }
+
+ private:
+  int size_;
+  const int max_size_;
+  std::unique_ptr<int[]> sparse_;
+  std::unique_ptr<IndexValue[]> dense_;
+
+  SparseArray(const SparseArray&) = delete;
+  SparseArray& operator=(const SparseArray&) = delete;
+};
+
+}  // namespace re2
@@ -0,0 +1,625 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// The reference backtracker of the exhaustive and random tests; see
+// backtrack.h. The regexp is parsed into a tree of Nodes, which the
+// Matcher walks in continuation-passing style: matching a node at a
+// position calls a continuation with each position where the node can
+// end, in order of preference, until one of them leads to a match.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "re2/testing/backtrack.h"
+#include "re2/testing/util/logging.h"
+
+namespace re2 {
+
+// Decodes UTF-8 s into characters, with the offset of each and, last, the
+// size of s in offsets. A byte that does not start a valid sequence is a
+// character of its own, U+FFFD.
+static void DecodeUTF8(const StringPiece& s, std::vector<int>* runes,
+                       std::vector<size_t>* offsets) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+  size_t n = s.size();
+  size_t i = 0;
+  while (i < n) {
+    offsets->push_back(i);
+    int c = p[i];
+    int len = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+    if (len == 0 || i + len > n) {
+      runes->push_back(0xFFFD);
+      i++;
+      continue;
+    }
+    int r = len == 1 ? c : c & (0x3F >> (len - 1));
+    bool valid = true;
+    for (int j = 1; j < len; j++) {
+      if ((p[i + j] & 0xC0) != 0x80)
+        valid = false;
+      r = (r << 6) | (p[i + j] & 0x3F);
+    }
+    if (!valid) {
+      runes->push_back(0xFFFD);
+      i++;
+      continue;
+    }
+    runes->push_back(r);
+    i += len;
+  }
+  offsets->push_back(n);
+}
+
+static bool IsWordChar(int r) {
+  return ('a' <= r && r <= 'z') || ('A' <= r && r <= 'Z') ||
+         ('0' <= r && r <= '9') || r == '_';
+}
+
+struct Backtracker::Node {
+  enum Op {
+    kEmpty,
+    kLiteral,
+    kClass,  // ranges, or not ranges if negated; . is [^\n]
+    kBeginText,
+    kEndText,
+    kWordBoundary,
+    kNoWordBoundary,
+    kConcat,
+    kAlternate,
+    kRepeat,  // min to max (-1 for no limit) of subs[0]
+    kCapture,  // group cap around subs[0]
+  };
+
+  explicit Node(Op op)
+      : op(op), rune(0), negated(false), min(0), max(0), greedy(true),
+        cap(0) {}
+
+  bool InClass(int r) const {
+    bool in = false;
+    for (size_t i = 0; i < ranges.size(); i++) {
+      if (ranges[i].first <= r && r <= ranges[i].second) {
+        in = true;
+        break;
+      }
+    }
+    return in != negated;
+  }
+
+  Op op;
+  int rune;
+  std::vector<std::pair<int, int>> ranges;
+  bool negated;
+  std::vector<Node*> subs;
+  int min;
+  int max;
+  bool greedy;
+  int cap;
+};
+
+// A recursive descent parser of the subset. Each Parse function returns
+// NULL if the regexp is outside it.
+class Backtracker::Parser {
+ public:
+  Parser(const std::vector<int>& runes, Backtracker* b)
+      : r_(runes), i_(0), b_(b) {}
+
+  Node* Parse() {
+    Node* n = ParseAlternate();
+    if (n == NULL || i_ != r_.size())
+      return NULL;
+    return n;
+  }
+
+ private:
+  Node* New(Node::Op op) {
+    b_->nodes_.emplace_back(new Node(op));
+    return b_->nodes_.back().get();
+  }
+
+  bool More() const { return i_ < r_.size(); }
+  int Peek() const { return r_[i_]; }
+
+  Node* ParseAlternate() {
+    Node* alt = New(Node::kAlternate);
+    for (;;) {
+      Node* n = ParseConcat();
+      if (n == NULL)
+        return NULL;
+      alt->subs.push_back(n);
+      if (!More() || Peek() != '|')
+        break;
+      i_++;
+    }
+    return alt->subs.size() == 1 ? alt->subs[0] : alt;
+  }
+
+  Node* ParseConcat() {
+    Node* cat = New(Node::kConcat);
+    while (More() && Peek() != '|' && Peek() != ')') {
+      Node* n = ParseRepeat();
+      if (n == NULL)
+        return NULL;
+      cat->subs.push_back(n);
+    }
+    if (cat->subs.empty())
+      return New(Node::kEmpty);
+    return cat->subs.size() == 1 ? cat->subs[0] : cat;
+  }
+
+  // Parses a decimal number, or returns -1.
+  int ParseInt() {
+    int n = -1;
+    while (More() && '0' <= Peek() && Peek() <= '9') {
+      n = (n < 0 ? 0 : n * 10) + (Peek() - '0');
+      if (n > 1000)
+        return -1;
+      i_++;
+    }
+    return n;
+  }
+
+  Node* ParseRepeat() {
+    Node* n = ParseAtom();
+    if (n == NULL)
+      return NULL;
+    // One repetition operator, as RE2 allows no more.
+    if (!More())
+      return n;
+    int min, max;
+    switch (Peek()) {
+      case '*':
+        min = 0, max = -1;
+        i_++;
+        break;
+      case '+':
+        min = 1, max = -1;
+        i_++;
+        break;
+      case '?':
+        min = 0, max = 1;
+        i_++;
+        break;
+      case '{': {
+        size_t save = i_;
+        i_++;
+        min = ParseInt();
+        max = min;
+        if (More() && Peek() == ',') {
+          i_++;
+          max = More() && Peek() == '}' ? -1 : ParseInt();
+          if (max == -1 && (!More() || Peek() != '}'))
+            return NULL;
+        }
+        if (min < 0 || !More() || Peek() != '}' ||
+            (max != -1 && max < min)) {
+          // Not a repetition: RE2 takes a { that does not start one as a
+          // literal, but the backtracker keeps out of it.
+          i_ = save;
+          return NULL;
+        }
+        i_++;
+        break;
+      }
+      default:
+        return n;
+    }
+    if ((max == -1 || max > 1) && Nullable(n))
+      return NULL;  // see backtrack.h
+    Node* rep = New(Node::kRepeat);
+    rep->subs.push_back(n);
+    rep->min = min;
+    rep->max = max;
+    if (More() && Peek() == '?') {
+      rep->greedy = false;
+      i_++;
+    }
+    if (More() && (Peek() == '*' || Peek() == '+' || Peek() == '?' ||
+                   Peek() == '{'))
+      return NULL;
+    return rep;
+  }
+
+  // Reports whether n can match the empty string.
+  static bool Nullable(const Node* n) {
+    switch (n->op) {
+      case Node::kLiteral:
+      case Node::kClass:
+        return false;
+      case Node::kConcat:
+        for (size_t i = 0; i < n->subs.size(); i++) {
+          if (!Nullable(n->subs[i]))
+            return false;
+        }
+        return true;
+      case Node::kAlternate:
+        for (size_t i = 0; i < n->subs.size(); i++) {
+          if (Nullable(n->subs[i]))
+            return true;
+        }
+        return false;
+      case Node::kRepeat:
+        return n->min == 0 || Nullable(n->subs[0]);
+      case Node::kCapture:
+        return Nullable(n->subs[0]);
+      default:
+        return true;  // the empty-width ops
+    }
+  }
+
+  // Parses a \x escape after the x: \xHH or \x{H...}.
+  int ParseHex() {
+    int r = 0;
+    if (More() && Peek() == '{') {
+      i_++;
+      int digits = 0;
+      while (More() && Peek() != '}') {
+        int d = HexDigit(Peek());
+        if (d < 0 || ++digits > 6)
+          return -1;
+        r = r * 16 + d;
+        i_++;
+      }
+      if (!More() || digits == 0)
+        return -1;
+      i_++;
+      return r <= 0x10FFFF ? r : -1;
+    }
+    for (int k = 0; k < 2; k++) {
+      if (!More() || HexDigit(Peek()) < 0)
+        return -1;
+      r = r * 16 + HexDigit(Peek());
+      i_++;
+    }
+    return r;
+  }
+
+  static int HexDigit(int c) {
+    if ('0' <= c && c <= '9')
+      return c - '0';
+    if ('a' <= c && c <= 'f')
+      return c - 'a' + 10;
+    if ('A' <= c && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+  // Adds the ranges of the Perl class \d \w \s (or its negation, for
+  // \D \W \S) to n; returns false for any other letter.
+  static bool AddPerlClass(int c, Node* n) {
+    std::vector<std::pair<int, int>> ranges;
+    switch (c | 0x20) {
+      case 'd':
+        ranges = {{'0', '9'}};
+        break;
+      case 'w':
+        ranges = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+        break;
+      case 's':
+        // \v too, as in Perl and the Rust engines RE2 runs here.
+        ranges = {{'\t', '\r'}, {' ', ' '}};
+        break;
+      default:
+        return false;
+    }
+    if (c >= 'a') {
+      n->ranges.insert(n->ranges.end(), ranges.begin(), ranges.end());
+      return true;
+    }
+    // The complement, in order.
+    int lo = 0;
+    for (size_t i = 0; i < ranges.size(); i++) {
+      if (lo < ranges[i].first)
+        n->ranges.push_back({lo, ranges[i].first - 1});
+      lo = ranges[i].second + 1;
+    }
+    n->ranges.push_back({lo, 0x10FFFF});
+    return true;
+  }
+
+  // Parses one character of a class or an escape, or returns -1.
+  int ParseClassChar() {
+    if (!More())
+      return -1;
+    int c = Peek();
+    i_++;
+    if (c != '\\')
+      return c;
+    if (!More())
+      return -1;
+    c = Peek();
+    i_++;
+    switch (c) {
+      case 'x':
+        return ParseHex();
+      case 'n':
+        return '\n';
+      case 't':
+        return '\t';
+      case 'r':
+        return '\r';
+      case 'f':
+        return '\f';
+      case 'v':
+        return '\v';
+      case 'a':
+        return '\a';
+      default:
+        if (c < 0x80 && !IsWordChar(c))
+          return c;  // escaped punctuation
+        return -1;
+    }
+  }
+
+  Node* ParseClass() {
+    Node* n = New(Node::kClass);
+    if (More() && Peek() == '^') {
+      n->negated = true;
+      i_++;
+    }
+    bool first = true;
+    while (More() && (Peek() != ']' || first)) {
+      first = false;
+      if (Peek() == '\\' && i_ + 1 < r_.size() &&
+          AddPerlClass(r_[i_ + 1], n)) {
+        i_ += 2;
+        continue;
+      }
+      if (Peek() == '[')
+        return NULL;  // [:alpha:] and the like
+      int lo = ParseClassChar();
+      if (lo < 0)
+        return NULL;
+      int hi = lo;
+      if (More() && Peek() == '-' && i_ + 1 < r_.size() &&
+          r_[i_ + 1] != ']') {
+        i_++;
+        hi = ParseClassChar();
+        if (hi < lo)
+          return NULL;
+      }
+      n->ranges.push_back({lo, hi});
+    }
+    if (!More())
+      return NULL;
+    i_++;  // ]
+    return n;
+  }
+
+  Node* ParseAtom() {
+    int c = Peek();
+    switch (c) {
+      case '(': {
+        i_++;
+        Node* group = NULL;
+        if (More() && Peek() == '?') {
+          if (i_ + 1 >= r_.size() || r_[i_ + 1] != ':')
+            return NULL;  // flags and named groups
+          i_ += 2;
+        } else {
+          group = New(Node::kCapture);
+          group->cap = ++b_->ncap_;
+        }
+        Node* n = ParseAlternate();
+        if (n == NULL || !More() || Peek() != ')')
+          return NULL;
+        i_++;
+        if (group == NULL)
+          return n;
+        group->subs.push_back(n);
+        return group;
+      }
+      case ')':
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        return NULL;
+      case '[':
+        i_++;
+        return ParseClass();
+      case '.': {
+        i_++;
+        Node* n = New(Node::kClass);
+        n->negated = true;
+        n->ranges.push_back({'\n', '\n'});
+        return n;
+      }
+      case '^':
+        i_++;
+        return New(Node::kBeginText);
+      case '$':
+        i_++;
+        return New(Node::kEndText);
+      case '\\': {
+        if (i_ + 1 >= r_.size())
+          return NULL;
+        int e = r_[i_ + 1];
+        Node::Op op;
+        switch (e) {
+          case 'b':
+            op = Node::kWordBoundary;
+            break;
+          case 'B':
+            op = Node::kNoWordBoundary;
+            break;
+          case 'A':
+            op = Node::kBeginText;
+            break;
+          case 'z':
+            op = Node::kEndText;
+            break;
+          default: {
+            Node* n = New(Node::kClass);
+            if (AddPerlClass(e, n)) {
+              i_ += 2;
+              return n;
+            }
+            int r = ParseClassChar();
+            if (r < 0)
+              return NULL;
+            n = New(Node::kLiteral);
+            n->rune = r;
+            return n;
+          }
+        }
+        i_ += 2;
+        return New(op);
+      }
+      default: {
+        i_++;
+        Node* n = New(Node::kLiteral);
+        n->rune = c;
+        return n;
+      }
+    }
+  }
+
+  const std::vector<int>& r_;
+  size_t i_;
+  Backtracker* b_;
+};
+
+Backtracker::Backtracker(const StringPiece& regexp) : root_(NULL), ncap_(0) {
+  std::vector<int> runes;
+  std::vector<size_t> offsets;
+  DecodeUTF8(regexp, &runes, &offsets);
+  root_ = Parser(runes, this).Parse();
+}
+
+Backtracker::~Backtracker() {}
+
+// Matches the tree against the characters of a text.
+class Backtracker::Matcher {
+ public:
+  typedef std::function<bool(size_t)> Cont;
+
+  Matcher(const std::vector<int>& text, int ncap)
+      : text_(text), caps_(ncap + 1, std::make_pair(-1, -1)), steps_(0),
+        gave_up_(false) {}
+
+  bool gave_up() const { return gave_up_; }
+  std::vector<std::pair<int, int>>* caps() { return &caps_; }
+
+  // Calls k with each end of a match of n at i, in order of preference,
+  // until k returns true.
+  bool Match(const Node* n, size_t i, const Cont& k) {
+    if (gave_up_ || ++steps_ > kMaxSteps) {
+      gave_up_ = true;
+      return false;
+    }
+    switch (n->op) {
+      case Node::kEmpty:
+        return k(i);
+      case Node::kLiteral:
+        return i < text_.size() && text_[i] == n->rune && k(i + 1);
+      case Node::kClass:
+        return i < text_.size() && n->InClass(text_[i]) && k(i + 1);
+      case Node::kBeginText:
+        return i == 0 && k(i);
+      case Node::kEndText:
+        return i == text_.size() && k(i);
+      case Node::kWordBoundary:
+      case Node::kNoWordBoundary: {
+        bool before = i > 0 && IsWordChar(text_[i - 1]);
+        bool after = i < text_.size() && IsWordChar(text_[i]);
+        return ((before != after) == (n->op == Node::kWordBoundary)) && k(i);
+      }
+      case Node::kConcat:
+        return MatchConcat(n, 0, i, k);
+      case Node::kAlternate:
+        for (size_t j = 0; j < n->subs.size(); j++) {
+          if (Match(n->subs[j], i, k))
+            return true;
+        }
+        return false;
+      case Node::kRepeat:
+        return MatchRepeat(n, 0, i, k);
+      case Node::kCapture:
+        return Match(n->subs[0], i, [&](size_t j) {
+          std::pair<int, int> old = caps_[n->cap];
+          caps_[n->cap] = std::make_pair(static_cast<int>(i),
+                                         static_cast<int>(j));
+          if (k(j))
+            return true;
+          caps_[n->cap] = old;
+          return false;
+        });
+    }
+    return false;
+  }
+
+ private:
+  static const int64_t kMaxSteps = 1000000;
+
+  bool MatchConcat(const Node* n, size_t sub, size_t i, const Cont& k) {
+    if (sub == n->subs.size())
+      return k(i);
+    return Match(n->subs[sub], i,
+                 [&](size_t j) { return MatchConcat(n, sub + 1, j, k); });
+  }
+
+  // Matches n->subs[0] the rest of the times after count times.
+  bool MatchRepeat(const Node* n, int count, size_t i, const Cont& k) {
+    auto again = [&]() {
+      if (n->max != -1 && count >= n->max)
+        return false;
+      return Match(n->subs[0], i, [&](size_t j) {
+        return MatchRepeat(n, count + 1, j, k);
+      });
+    };
+    auto stop = [&]() { return count >= n->min && k(i); };
+    return n->greedy ? again() || stop() : stop() || again();
+  }
+
+  const std::vector<int>& text_;
+  std::vector<std::pair<int, int>> caps_;
+  int64_t steps_;
+  bool gave_up_;
+};
+
+Backtracker::Result Backtracker::Search(const StringPiece& text,
+                                        RE2::Anchor anchor,
+                                        StringPiece* submatch,
+                                        int nsubmatch) {
+  CHECK(ok());
+  std::vector<int> runes;
+  std::vector<size_t> offsets;
+  DecodeUTF8(text, &runes, &offsets);
+  Matcher m(runes, ncap_);
+  size_t end = 0;
+  for (size_t start = 0; start <= runes.size(); start++) {
+    bool matched = m.Match(root_, start, [&](size_t j) {
+      if (anchor == RE2::ANCHOR_BOTH && j != runes.size())
+        return false;
+      end = j;
+      return true;
+    });
+    if (m.gave_up())
+      return kGaveUp;
+    if (matched) {
+      std::vector<std::pair<int, int>>& caps = *m.caps();
+      caps[0] = std::make_pair(static_cast<int>(start),
+                               static_cast<int>(end));
+      for (int i = 0; i < nsubmatch; i++) {
+        if (i > ncap_ || caps[i].first < 0) {
+          submatch[i] = StringPiece();
+          continue;
+        }
+        size_t b = offsets[caps[i].first];
+        size_t e = offsets[caps[i].second];
+        submatch[i] = StringPiece(text.data() + b, e - b);
+      }
+      return kMatch;
+    }
+    if (anchor != RE2::UNANCHORED)
+      break;
+  }
+  return kNoMatch;
+}
+
+}  // namespace re2
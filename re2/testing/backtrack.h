@@ -0,0 +1,67 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+// A backtracking matcher for a subset of the RE2 syntax, the reference
+// that the exhaustive and random tests check RE2 against. RE2 here runs
+// the Rust regex engines, so the tests cannot compare it with another of
+// its own engines as upstream RE2 does; this matcher shares no code with
+// them and is simple enough to be checked by reading it.
+//
+// It understands literals, ., character classes, the escapes \b \B \A
+// \z \d \D \w \W \s \S \x and escaped punctuation, ^ and $, capturing
+// and (?: ) groups, alternation and the greedy and non-greedy forms of
+// * + ? {n} {n,} {n,m}, all without flags. Its matches are leftmost-first
+// like RE2's. It leaves out the repetitions, other than ?, of expressions
+// that can match empty, like (a|)* or (?:\b|a)+: engines differ on where
+// their matches end, and Perl, RE2 and Rust each choose differently.
+// It works on UTF-8 characters, and its \b \d \w \s are ASCII, so the
+// tests keep them to ASCII texts. It gives up on searches that take too
+// many steps, since backtracking can take exponential time.
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "re2/re2.h"
+#include "re2/stringpiece.h"
+
+namespace re2 {
+
+class Backtracker {
+ public:
+  explicit Backtracker(const StringPiece& regexp);
+  ~Backtracker();
+
+  // Whether the regexp is in the subset that the backtracker parses.
+  bool ok() const { return root_ != NULL; }
+  int NumberOfCapturingGroups() const { return ncap_; }
+
+  enum Result {
+    kNoMatch,
+    kMatch,
+    kGaveUp,  // the search took more than the step limit
+  };
+
+  // Searches text as RE2::Match(text, 0, text.size(), anchor, submatch,
+  // nsubmatch) does, setting the submatches on a match.
+  Result Search(const StringPiece& text, RE2::Anchor anchor,
+                StringPiece* submatch, int nsubmatch);
+
+ private:
+  struct Node;
+  class Parser;
+  class Matcher;
+
+  Node* root_;
+  int ncap_;
+  std::vector<std::unique_ptr<Node>> nodes_;  // owns every node
+
+  Backtracker(const Backtracker&) = delete;
+  Backtracker& operator=(const Backtracker&) = delete;
+};
+
+}  // namespace re2
@@ -0,0 +1,255 @@
+// Copyright 2006-2008 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Torture tests for the lazy DFA underneath RE2: regexps whose automata
+// have exponentially many states, run over texts big enough to thrash
+// the DFA cache. Each one is timed at growing text sizes against a
+// regexp with a tiny automaton, and checked against a plain C++
+// predicate on random texts and on texts with a planted match.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "re2/re2.h"
+#include "re2/stringpiece.h"
+#include "re2/testing/regexp_generator.h"
+#include "re2/testing/util/logging.h"
+#include "re2/testing/util/strutil.h"
+#include "re2/testing/util/test.h"
+
+namespace re2 {
+
+// A regexp whose DFA blows up and what to test it with.
+struct CliffCase {
+  const char* name;
+  const char* regexp;
+  // The characters of the texts; a text never matches if separator
+  // comes at least every gap characters.
+  std::vector<std::string> alphabet;
+  std::string separator;
+  int gap;
+  // A match, to plant in the texts.
+  std::string planted;
+  // Reports whether the regexp matches a text, the slow way.
+  bool (*predicate)(const std::vector<std::string>& text);
+  // How many times as long as the baseline's the search may take;
+  // kCliffRatio for a case with no known cliff.
+  int max_ratio;
+};
+
+static bool InRange(const std::string& c, char lo, char hi) {
+  return c.size() == 1 && lo <= c[0] && c[0] <= hi;
+}
+
+// [a-q][^u-z]{13}x
+static bool ThirteenBack(const std::vector<std::string>& t) {
+  for (size_t i = 0; i + 14 < t.size(); i++) {
+    if (!InRange(t[i], 'a', 'q') || t[i + 14] != "x")
+      continue;
+    bool ok = true;
+    for (size_t j = i + 1; j < i + 14; j++) {
+      if (InRange(t[j], 'u', 'z'))
+        ok = false;
+    }
+    if (ok)
+      return true;
+  }
+  return false;
+}
+
+// (a|b)*a(a|b){20}
+static bool TwentyBack(const std::vector<std::string>& t) {
+  for (size_t i = 0; i + 20 < t.size(); i++) {
+    if (t[i] != "a")
+      continue;
+    bool ok = true;
+    for (size_t j = i + 1; j <= i + 20; j++) {
+      if (t[j] != "a" && t[j] != "b")
+        ok = false;
+    }
+    if (ok)
+      return true;
+  }
+  return false;
+}
+
+// \w{50}z, where the only non-word characters in the texts are spaces;
+// \w is Unicode-aware here, so Cyrillic letters are word characters.
+static bool FiftyWords(const std::vector<std::string>& t) {
+  int run = 0;
+  for (size_t i = 0; i < t.size(); i++) {
+    if (t[i] == "z" && run >= 50)
+      return true;
+    run = t[i] == " " ? 0 : run + 1;
+  }
+  return false;
+}
+
+// The search takes this many times as long as the baseline's, or less,
+// where there is no cliff.
+static const int kCliffRatio = 20;
+
+static std::vector<CliffCase> CliffCases() {
+  std::vector<CliffCase> v;
+  // A known cliff, at about 21 times the baseline: the lazy DFA has a
+  // state for every set of the last 14 characters that could have begun
+  // a match, more than fit in its cache, so it keeps clearing the cache
+  // and building states again.
+  v.push_back({"ThirteenBack", "[a-q][^u-z]{13}x",
+               Split("", "abcdefghijklmnopqrstvwx"), "u", 12,
+               "a" + std::string(13, 'b') + "x", ThirteenBack, 60});
+  v.push_back({"TwentyBack", "(a|b)*a(a|b){20}",
+               Split("", "ab"), "c", 16,
+               "ca" + std::string(20, 'b') + "c", TwentyBack, kCliffRatio});
+  // A known cliff, at about 90 times the baseline: Unicode \w makes the
+  // states of the lazy DFA so many and so big that it gives up on them,
+  // and the search falls back to a much slower engine.
+  v.push_back({"FiftyWords", "\\w{50}z",
+               Split(" ", "a b c z \xd0\x96 \xd1\x8f"), " ", 40,
+               " " + std::string(25, 'a') +
+                   "\xd0\x96\xd0\x96\xd0\x96\xd0\x96\xd0\x96"
+                   "\xd0\x96\xd0\x96\xd0\x96\xd0\x96\xd0\x96"
+                   "\xd0\x96\xd0\x96\xd0\x96\xd0\x96\xd0\x96"
+                   "\xd0\x96\xd0\x96\xd0\x96\xd0\x96\xd0\x96"
+                   "\xd0\x96\xd0\x96\xd0\x96\xd0\x96\xd0\x96z",
+               FiftyWords, 300});
+  return v;
+}
+
+// Makes a text of about nbytes random characters that the case's regexp
+// cannot match, with the separator every so often.
+static std::string NoMatchText(const CliffCase& c, int64_t nbytes,
+                               std::minstd_rand0* rng) {
+  std::uniform_int_distribution<int> letter(
+      0, static_cast<int>(c.alphabet.size()) - 1);
+  std::uniform_int_distribution<int> gap(1, c.gap);
+  std::string s;
+  int next = gap(*rng);
+  while (static_cast<int64_t>(s.size()) < nbytes) {
+    if (--next == 0) {
+      s += c.separator;
+      next = gap(*rng);
+    } else {
+      s += c.alphabet[letter(*rng)];
+    }
+  }
+  return s;
+}
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the fastest of a few PartialMatch calls of re over text, in ns.
+static int64_t TimeSearch(const RE2& re, const StringPiece& text) {
+  int64_t best = INT64_MAX;
+  for (int i = 0; i < 3; i++) {
+    int64_t t0 = NowNs();
+    bool matched = RE2::PartialMatch(text, re);
+    best = std::min(best, NowNs() - t0);
+    CHECK(!matched);
+  }
+  return std::max<int64_t>(best, 1);
+}
+
+// The baseline has a two-state DFA and no literal to skip ahead to, and
+// no text here matches it: the DFA steps through every byte, as a search
+// with no cliff does. A search that takes more than kCliffRatio times as
+// long as the baseline's is a cliff, and fails the test if it takes more
+// than the max_ratio of its case. The cost per byte of the search must
+// not grow by more than kSuperlinearRatio between the smallest and
+// largest text: RE2 guarantees linear time, however many states the DFA
+// has.
+static const char kBaseline[] = "[a-z][0-9]";
+static const int kSuperlinearRatio = 8;
+
+TEST(DFA, Cliffs) {
+  std::minstd_rand0 rng(301);
+  std::vector<CliffCase> cases = CliffCases();
+  for (size_t i = 0; i < cases.size(); i++) {
+    const CliffCase& c = cases[i];
+    RE2 re(c.regexp);
+    RE2 baseline(kBaseline);
+    ASSERT_TRUE(re.ok());
+    ASSERT_TRUE(baseline.ok());
+
+    double first_ns_per_byte = 0;
+    double last_ns_per_byte = 0;
+    for (int64_t nbytes = 64 << 10; nbytes <= 4 << 20; nbytes <<= 2) {
+      std::string text = NoMatchText(c, nbytes, &rng);
+      int64_t ns = TimeSearch(re, text);
+      int64_t base_ns = TimeSearch(baseline, text);
+      double ns_per_byte = static_cast<double>(ns) / text.size();
+      double ratio = static_cast<double>(ns) / base_ns;
+      if (first_ns_per_byte == 0)
+        first_ns_per_byte = ns_per_byte;
+      last_ns_per_byte = ns_per_byte;
+      printf("%s %s: %7d KB %8.2f ns/byte %8.2f MB/s %7.1fx baseline\n",
+             ratio > kCliffRatio ? "CLIFF" : "     ", c.name,
+             static_cast<int>(text.size() >> 10), ns_per_byte,
+             1e3 / ns_per_byte, ratio);
+      EXPECT_LE(ratio, c.max_ratio);
+
+      // Plant a match at the end, where the DFA has done the most work.
+      text += c.planted;
+      StringPiece m;
+      ASSERT_TRUE(re.Match(text, 0, text.size(), RE2::UNANCHORED, &m, 1));
+      StringPiece want = c.planted;
+      if (c.planted[0] == c.separator[0])
+        want.remove_prefix(c.separator.size());
+      if (c.planted.back() == c.separator.back())
+        want.remove_suffix(c.separator.size());
+      ASSERT_EQ(m, want);
+      ASSERT_EQ(m.data() - text.data(),
+                static_cast<ptrdiff_t>(text.size() - c.planted.size() +
+                                       (want.data() - c.planted.data())));
+    }
+    EXPECT_LE(last_ns_per_byte, kSuperlinearRatio * first_ns_per_byte);
+  }
+}
+
+TEST(DFA, CliffAnswers) {
+  std::minstd_rand0 rng(302);
+  std::vector<CliffCase> cases = CliffCases();
+  for (size_t i = 0; i < cases.size(); i++) {
+    const CliffCase& c = cases[i];
+    RE2 re(c.regexp);
+    ASSERT_TRUE(re.ok());
+    // Short texts with rare separators, so that about half match.
+    std::vector<std::string> alphabet = c.alphabet;
+    alphabet.push_back(c.separator);
+    alphabet.push_back(Split("", c.planted).back());
+    std::uniform_int_distribution<int> letter(
+        0, static_cast<int>(alphabet.size()) - 1);
+    std::uniform_int_distribution<int> len(0, 120);
+    int matches = 0;
+    for (int j = 0; j < 2000; j++) {
+      std::vector<std::string> t(len(rng));
+      std::string text;
+      for (size_t k = 0; k < t.size(); k++) {
+        t[k] = alphabet[letter(rng)];
+        // Keep separators rare, or nothing would ever match.
+        if (t[k] == c.separator && letter(rng) % 4 != 0)
+          t[k] = c.alphabet[0];
+        text += t[k];
+      }
+      bool want = c.predicate(t);
+      if (RE2::PartialMatch(text, re) != want) {
+        LOG(FATAL) << c.regexp << " on \"" << CEscape(text)
+                   << "\": PartialMatch = " << !want;
+      }
+      matches += want;
+    }
+    printf("%s: %d of 2000 random texts match\n", c.name, matches);
+  }
+}
+
+}  // namespace re2
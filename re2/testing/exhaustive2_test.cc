@@ -0,0 +1,57 @@
+// Copyright 2008 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Exhaustive testing of regular expression matching.
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "re2/testing/exhaustive_tester.h"
+#include "re2/testing/util/test.h"
+
+namespace re2 {
+
+// Test empty string matches (aka "(?:)")
+TEST(EmptyString, Exhaustive) {
+  ExhaustiveTest(2, 2, Split(" ", "(?:) a"),
+                 RegexpGenerator::EgrepOps(),
+                 5, Split("", "ab"), "", "");
+}
+
+// Test escaped versions of regexp syntax.
+TEST(Punctuation, Literals) {
+  std::vector<std::string> alphabet = Explode("()*+?{}[]\\^$.");
+  std::vector<std::string> escaped = alphabet;
+  for (size_t i = 0; i < escaped.size(); i++)
+    escaped[i] = "\\" + escaped[i];
+  ExhaustiveTest(1, 1, escaped, RegexpGenerator::EgrepOps(),
+                 2, alphabet, "", "");
+}
+
+// Test ^ $ . \A \z in presence of line endings.
+// The empty-width ones are wrapped in (?:) so that they can be repeated.
+TEST(LineEnds, Exhaustive) {
+  ExhaustiveTest(2, 2, Split(" ", "(?:^) (?:$) . a \\n (?:\\A) (?:\\z)"),
+                 RegexpGenerator::EgrepOps(),
+                 4, Explode("ab\n"), "", "");
+}
+
+// Test what does and does not match \n.
+// The rule chosen for RE2 is that by default, like Perl,
+// dot does not match \n but negated character classes [^a] do.
+TEST(Newlines, Exhaustive) {
+  ExhaustiveTest(1, 1, Split(" ", "\\n . a [^a]"),
+                 RegexpGenerator::EgrepOps(),
+                 4, Explode("a\n"), "", "");
+}
+
+// Test \b and \B next to words and non-words.
+TEST(WordBoundaries, Exhaustive) {
+  ExhaustiveTest(2, 2, Split(" ", "(?:\\b) (?:\\B) a -"),
+                 RegexpGenerator::EgrepOps(),
+                 4, Explode("a- "), "", "");
+}
+
+}  // namespace re2
@@ -0,0 +1,94 @@
+// Copyright 2008 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Exhaustive testing of regular expression matching.
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "re2/testing/exhaustive_tester.h"
+#include "re2/testing/util/strutil.h"
+#include "re2/testing/util/test.h"
+
+namespace re2 {
+
+// Returns a vector of "interesting" UTF8 characters.
+// Unicode is now too big to just return all of them,
+// so UTF8Characters return a set likely to be good test cases.
+static const std::vector<std::string>& InterestingUTF8() {
+  static bool init;
+  static std::vector<std::string> v;
+
+  if (init)
+    return v;
+
+  init = true;
+  // All the Latin1 equivalents are interesting.
+  for (int i = 1; i < 256; i++) {
+    if (i < 0x80) {
+      v.push_back(std::string(1, static_cast<char>(i)));
+    } else {
+      char buf[2] = {static_cast<char>(0xC0 | (i >> 6)),
+                     static_cast<char>(0x80 | (i & 0x3F))};
+      v.push_back(std::string(buf, 2));
+    }
+  }
+
+  // Some of the Unicode ones.
+  v.push_back("\xe2\x98\xba");      // U+263A
+  v.push_back("\xef\xbf\xbd");      // U+FFFD
+  v.push_back("\xf0\x9f\x98\x80");  // U+1F600
+
+  return v;
+}
+
+// Test escapes of every byte and a few characters beyond.
+// The backtracker and RE2 read each of them the same way.
+TEST(InterestingUTF8, SingleOps) {
+  std::vector<std::string> atoms;
+  for (size_t i = 0; i < InterestingUTF8().size(); i++) {
+    const std::string& c = InterestingUTF8()[i];
+    int r = static_cast<unsigned char>(c[0]);
+    if (c.size() > 1) {
+      // Decode the 2-, 3- and 4-byte sequences above.
+      r &= 0x3F >> (c.size() - 1);
+      for (size_t j = 1; j < c.size(); j++)
+        r = (r << 6) | (c[j] & 0x3F);
+    }
+    atoms.push_back(StringPrintf("\\x{%x}", r));
+  }
+  std::vector<std::string> ops;  // no ops
+  ExhaustiveTest(1, 0, atoms, ops,
+                 1, InterestingUTF8(), "", "");
+  ExhaustiveTest(1, 0, atoms, ops,
+                 2, Split(" ", "a \xe2\x98\xba"), "", "");
+}
+
+// Test character classes
+TEST(CharacterClasses, Exhaustive) {
+  std::vector<std::string> atoms = Split(" ",
+    "[a] [b] [ab] [^bc] [b-d] [^b-d] []a] [-a] [a-] [^-a] [a-b-c] a b .");
+  ExhaustiveTest(2, 1, atoms, RegexpGenerator::EgrepOps(),
+                 5, Explode("ab"), "", "");
+}
+
+// Test character classes with Unicode
+TEST(CharacterClasses, UTF8) {
+  std::vector<std::string> atoms = Split(" ",
+    "[\\x{263a}] [a\\x{263a}] [^\\x{263a}] [a-\\x{263a}] "
+    "\\x{263a} . a");
+  ExhaustiveTest(2, 2, atoms, RegexpGenerator::EgrepOps(),
+                 4, Explode("a\xe2\x98\xba"), "", "");
+}
+
+// Test Perl character classes
+TEST(PerlClasses, Exhaustive) {
+  std::vector<std::string> atoms = Split(" ",
+    "\\d \\D \\w \\W \\s \\S [\\d-] [^\\w]");
+  ExhaustiveTest(2, 1, atoms, RegexpGenerator::EgrepOps(),
+                 4, Explode("a1 -_"), "", "");
+}
+
+}  // namespace re2
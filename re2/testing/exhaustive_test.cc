@@ -0,0 +1,45 @@
+// Copyright 2008 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Exhaustive testing of regular expression matching.
+
+#include "re2/testing/exhaustive_tester.h"
+#include "re2/testing/util/test.h"
+
+namespace re2 {
+
+// Test very simple expressions.
+TEST(EgrepLiterals, Lowercase) {
+  EgrepTest(3, 2, "abc.", 3, "abc", "");
+}
+
+// Test bigger expressions over a smaller alphabet.
+// Some of these run into the reverse suffix bug of the Rust regex engine
+// underneath, which the tester reports as a known engine bug.
+TEST(EgrepLiterals, Bigger) {
+  ExhaustiveTest(4, 3, Explode("ab."), RegexpGenerator::EgrepOps(),
+                 4, Explode("ab"), "", "");
+}
+
+// Test mixed-case expressions.
+TEST(EgrepLiterals, MixedCase) {
+  EgrepTest(3, 2, "AaBb.", 2, "AaBb", "");
+}
+
+// Test mixed-case in case-insensitive mode.
+// The backtracker has no flags, so (?i) is spelled out as classes.
+TEST(EgrepLiterals, FoldCase) {
+  ExhaustiveTest(3, 2, Split(" ", "[Aa] [Bb] ."),
+                 RegexpGenerator::EgrepOps(),
+                 2, Explode("AaBb"), "", "");
+}
+
+// Test very simple expressions with captures.
+TEST(EgrepLiterals, Captures) {
+  ExhaustiveTest(3, 2, Split(" ", "a (a) b (b|)"),
+                 RegexpGenerator::EgrepOps(),
+                 3, Explode("ab"), "(%s)", "");
+}
+
+}  // namespace re2
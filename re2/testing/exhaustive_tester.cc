@@ -0,0 +1,338 @@
+// Copyright 2008 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Exhaustive testing of regular expression matching.
+
+// Each test picks an alphabet (e.g., "abc"), a maximum string length,
+// a maximum regular expression length, and a maximum number of letters
+// that can appear in the regular expression.  Given these parameters,
+// it tries every possible regular expression and string, verifying that
+// RE2 and the reference Backtracker agree about the location of the
+// match and the values of the submatches.  It times every call to RE2
+// on the way, and reports the slowest ones.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "re2/testing/exhaustive_tester.h"
+#include "re2/testing/util/logging.h"
+#include "re2/testing/util/strutil.h"
+#include "re2/testing/util/test.h"
+
+namespace re2 {
+
+static const int kMaxFailuresShown = 20;
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* AnchorName(RE2::Anchor anchor) {
+  switch (anchor) {
+    case RE2::UNANCHORED:
+      return "unanchored";
+    case RE2::ANCHOR_START:
+      return "anchor_start";
+    case RE2::ANCHOR_BOTH:
+      return "anchor_both";
+  }
+  return "?";
+}
+
+// Formats text for a report, telling a NULL StringPiece from an empty one.
+static std::string FormatText(const StringPiece& text) {
+  if (text.data() == NULL)
+    return "NULL";
+  return "\"" + CEscape(text) + "\"";
+}
+
+// Formats a submatch as its offsets into text, or "-" if unset.
+static std::string FormatSubmatch(const StringPiece& text,
+                                  const StringPiece& sub) {
+  if (sub.data() == NULL && (text.data() != NULL || sub.size() != 0))
+    return "-";
+  if (sub.data() == NULL)
+    return "(0,0)";
+  size_t b = sub.data() - text.data();
+  return StringPrintf("(%d,%d)", static_cast<int>(b),
+                      static_cast<int>(b + sub.size()));
+}
+
+void CallTimes::Add(int64_t ns, const std::string& regexp,
+                    const StringPiece& text, RE2::Anchor anchor) {
+  ns_.push_back(static_cast<int32_t>(std::min<int64_t>(ns, INT32_MAX)));
+  if (static_cast<int>(worst_.size()) == kWorst && ns <= worst_.back().ns)
+    return;
+  Call c;
+  c.ns = ns;
+  c.regexp = regexp;
+  c.text = std::string(text.data(), text.size());
+  c.null_text = text.data() == NULL;
+  c.anchor = anchor;
+  auto it = std::upper_bound(
+      worst_.begin(), worst_.end(), c,
+      [](const Call& a, const Call& b) { return a.ns > b.ns; });
+  worst_.insert(it, c);
+  if (static_cast<int>(worst_.size()) > kWorst)
+    worst_.pop_back();
+}
+
+int CallTimes::Report(const char* name) {
+  if (ns_.empty())
+    return 0;
+  std::vector<int32_t> sorted = ns_;
+  std::sort(sorted.begin(), sorted.end());
+  int64_t median = sorted[sorted.size() / 2];
+  int64_t p99 = sorted[sorted.size() * 99 / 100];
+  printf("%s: %d calls, median %lld ns, p99 %lld ns, worst %lld ns\n",
+         name, static_cast<int>(sorted.size()),
+         static_cast<long long>(median), static_cast<long long>(p99),
+         static_cast<long long>(sorted.back()));
+
+  // The first call to a fresh RE2 pays for setting up its caches, so the
+  // slowest calls are timed again, warm, and the fastest of a few kept.
+  int cliffs = 0;
+  for (size_t i = 0; i < worst_.size(); i++) {
+    const Call& c = worst_[i];
+    RE2::Options opt;
+    opt.set_log_errors(false);
+    RE2 re(c.regexp, opt);
+    StringPiece text = c.null_text ? StringPiece() : StringPiece(c.text);
+    std::vector<StringPiece> sub(1 + re.NumberOfCapturingGroups());
+    int64_t best = INT64_MAX;
+    for (int j = 0; j < 6; j++) {
+      int64_t t0 = NowNs();
+      re.Match(text, 0, text.size(), c.anchor, sub.data(),
+               static_cast<int>(sub.size()));
+      int64_t t = NowNs() - t0;
+      if (j > 0)
+        best = std::min(best, t);
+    }
+    bool cliff = best >= kCliffFactor * median && best >= kCliffFloorNs;
+    if (cliff)
+      cliffs++;
+    printf("  %s%lld ns (first %lld ns) %s %s on %s\n",
+           cliff ? "CLIFF " : "", static_cast<long long>(best),
+           static_cast<long long>(c.ns), AnchorName(c.anchor),
+           CEscape(c.regexp).c_str(), FormatText(text).c_str());
+  }
+  return cliffs;
+}
+
+// Reports whether an unanchored match got, where the leftmost match is
+// want, is the reverse suffix bug of the Rust regex engine underneath
+// (regex-automata 0.4.9): for a regexp that ends in a literal, such as
+// (?:aa)*.c, it finds the first occurrence of the literal ("baacc") and
+// searches backwards from there for the start of a match, so it can report
+// a match ("ac") that starts later than the leftmost one ("aacc") and ends
+// no later than it. The bug is recognized only if RE2 itself, searching
+// with both ends anchored, confirms that want is a match.
+static bool IsReverseSuffixBug(RE2* re, const StringPiece& text,
+                               const StringPiece& got,
+                               const StringPiece& want) {
+  if (got.data() == NULL || want.data() == NULL)
+    return false;
+  if (got.data() <= want.data() ||
+      got.data() + got.size() > want.data() + want.size())
+    return false;
+  size_t start = want.data() - text.data();
+  StringPiece m;
+  return re->Match(text, start, start + want.size(), RE2::ANCHOR_BOTH,
+                   &m, 1) &&
+         m.data() == want.data() && m.size() == want.size();
+}
+
+void ExhaustiveTester::Fail(const std::string& regexp,
+                            const StringPiece& text,
+                            const std::string& what) {
+  if (++failures_ <= kMaxFailuresShown)
+    printf("FAIL %s on %s: %s\n", CEscape(regexp).c_str(),
+           FormatText(text).c_str(), what.c_str());
+}
+
+// Processes a single generated regexp.
+// Compiles it with RE2 and the Backtracker and checks the two
+// against each other on every string the StringGenerator makes.
+void ExhaustiveTester::HandleRegexp(const std::string& const_regexp) {
+  regexps_++;
+  std::string regexp = const_regexp;
+  if (!topwrapper_.empty())
+    regexp = StringPrintf(topwrapper_.c_str(), regexp.c_str());
+  if (!wrapper_.empty())
+    regexp = StringPrintf(wrapper_.c_str(), regexp.c_str());
+
+  Backtracker bt(regexp);
+  if (!bt.ok()) {
+    skipped_++;
+    return;
+  }
+  RE2::Options opt;
+  opt.set_log_errors(false);
+  RE2 re(regexp, opt);
+  if (!re.ok()) {
+    Fail(regexp, StringPiece(), "RE2 cannot compile it: " + re.error());
+    return;
+  }
+  if (re.NumberOfCapturingGroups() != bt.NumberOfCapturingGroups()) {
+    Fail(regexp, StringPiece(),
+         StringPrintf("RE2 counts %d groups, want %d",
+                      re.NumberOfCapturingGroups(),
+                      bt.NumberOfCapturingGroups()));
+    return;
+  }
+
+  // Try all strings.
+  strgen_.Reset();
+  strgen_.GenerateNULL();
+  if (randomstrings_)
+    strgen_.Random(stringseed_, stringcount_);
+  int bad_inputs = 0;
+  while (strgen_.HasNext()) {
+    const StringPiece& s = strgen_.Next();
+    tests_++;
+    if (!TestInput(&re, &bt, regexp, s)) {
+      // Stop after a few failing inputs; one regexp going wrong on
+      // every string would drown out the rest.
+      if (++bad_inputs >= 3)
+        break;
+    }
+  }
+}
+
+bool ExhaustiveTester::TestInput(RE2* re, Backtracker* bt,
+                                 const std::string& regexp,
+                                 const StringPiece& text) {
+  static const RE2::Anchor kAnchors[] = {
+    RE2::UNANCHORED,
+    RE2::ANCHOR_START,
+    RE2::ANCHOR_BOTH,
+  };
+  int nsub = 1 + re->NumberOfCapturingGroups();
+  std::vector<StringPiece> want(nsub);
+  std::vector<StringPiece> got(nsub);
+  bool ok = true;
+  bool matched[arraysize(kAnchors)];
+  for (size_t a = 0; a < arraysize(kAnchors); a++) {
+    RE2::Anchor anchor = kAnchors[a];
+    Backtracker::Result r = bt->Search(text, anchor, want.data(), nsub);
+    if (r == Backtracker::kGaveUp) {
+      skipped_++;
+      return true;
+    }
+    matched[a] = r == Backtracker::kMatch;
+
+    std::fill(got.begin(), got.end(), StringPiece());
+    int64_t t0 = NowNs();
+    bool m = re->Match(text, 0, text.size(), anchor, got.data(), nsub);
+    times_.Add(NowNs() - t0, regexp, text, anchor);
+    if (m != matched[a]) {
+      Fail(regexp, text, StringPrintf("%s Match = %d, want %d",
+                                      AnchorName(anchor), m, matched[a]));
+      ok = false;
+      continue;
+    }
+    if (m) {
+      for (int i = 0; i < nsub; i++) {
+        std::string g = FormatSubmatch(text, got[i]);
+        std::string w = FormatSubmatch(text, want[i]);
+        if (g != w && i == 0 && anchor == RE2::UNANCHORED &&
+            IsReverseSuffixBug(re, text, got[0], want[0])) {
+          // The groups of the wrong match are wrong too.
+          if (++known_bugs_ <= kMaxFailuresShown)
+            printf("KNOWN ENGINE BUG %s on %s: unanchored submatch 0 = "
+                   "%s, want %s\n", CEscape(regexp).c_str(),
+                   FormatText(text).c_str(), g.c_str(), w.c_str());
+          break;
+        }
+        if (g != w) {
+          Fail(regexp, text, StringPrintf("%s submatch %d = %s, want %s",
+                                          AnchorName(anchor), i, g.c_str(),
+                                          w.c_str()));
+          ok = false;
+          break;
+        }
+      }
+    }
+
+    // Asking for fewer submatches must not change the answer.
+    if (re->Match(text, 0, text.size(), anchor, NULL, 0) != m) {
+      Fail(regexp, text, StringPrintf("%s Match with no submatches = %d",
+                                      AnchorName(anchor), !m));
+      ok = false;
+    }
+  }
+
+  // The matching functions are Match underneath.
+  if (RE2::PartialMatch(text, *re) != matched[0]) {
+    Fail(regexp, text, StringPrintf("PartialMatch = %d", !matched[0]));
+    ok = false;
+  }
+  if (RE2::FullMatch(text, *re) != matched[2]) {
+    Fail(regexp, text, StringPrintf("FullMatch = %d", !matched[2]));
+    ok = false;
+  }
+  if (nsub > 1) {
+    StringPiece g;
+    bt->Search(text, RE2::ANCHOR_BOTH, want.data(), 2);
+    if (RE2::FullMatch(text, *re, &g) != matched[2]) {
+      Fail(regexp, text, StringPrintf("FullMatch with a group = %d",
+                                      !matched[2]));
+      ok = false;
+    } else if (matched[2] && FormatSubmatch(text, g) !=
+                             FormatSubmatch(text, want[1])) {
+      Fail(regexp, text, StringPrintf(
+          "FullMatch group 1 = %s, want %s",
+          FormatSubmatch(text, g).c_str(),
+          FormatSubmatch(text, want[1]).c_str()));
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Runs an exhaustive test on the given parameters.
+void ExhaustiveTest(int maxatoms, int maxops,
+                    const std::vector<std::string>& alphabet,
+                    const std::vector<std::string>& ops,
+                    int maxstrlen,
+                    const std::vector<std::string>& stralphabet,
+                    const std::string& wrapper,
+                    const std::string& topwrapper) {
+  ExhaustiveTester t(maxatoms, maxops, alphabet, ops,
+                     maxstrlen, stralphabet, wrapper, topwrapper);
+  t.Generate();
+  printf("%d regexps, %d tests, %d failures, %d known engine bugs, "
+         "%d skipped [%d/%d str]\n",
+         t.regexps(), t.tests(), t.failures(), t.known_bugs(), t.skipped(),
+         maxstrlen, static_cast<int>(stralphabet.size()));
+  EXPECT_EQ(0, t.times()->Report(topwrapper.empty() ? "%s"
+                                                   : topwrapper.c_str()));
+  EXPECT_EQ(0, t.failures());
+}
+
+// Runs an exhaustive test using the given parameters and
+// the basic egrep operators.
+void EgrepTest(int maxatoms, int maxops, const std::string& alphabet,
+               int maxstrlen, const std::string& stralphabet,
+               const std::string& wrapper) {
+  const char* tops[] = { "", "^(?:%s)", "(?:%s)$", "^(?:%s)$" };
+
+  for (size_t i = 0; i < arraysize(tops); i++) {
+    ExhaustiveTest(maxatoms, maxops,
+                   Split("", alphabet),
+                   RegexpGenerator::EgrepOps(),
+                   maxstrlen,
+                   Split("", stralphabet),
+                   wrapper,
+                   tops[i]);
+  }
+}
+
+}  // namespace re2
@@ -0,0 +1,145 @@
+// Copyright 2009 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+// Exhaustive testing of regular expression matching: checks RE2 against
+// the reference Backtracker (backtrack.h) on every regexp that a
+// RegexpGenerator makes and every string that a StringGenerator makes,
+// and times every call to RE2 on the way, so that the tests report the
+// slowest calls along with the wrong ones.
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "re2/re2.h"
+#include "re2/stringpiece.h"
+#include "re2/testing/backtrack.h"
+#include "re2/testing/regexp_generator.h"
+#include "re2/testing/string_generator.h"
+
+namespace re2 {
+
+// The time of every call to RE2::Match that a tester makes, and the
+// slowest of them. A slow call is a cliff if, timed again once RE2 has
+// warmed up, it still takes kCliffFactor times the median call and at
+// least kCliffFloorNs: a lazy DFA thrashing its cache, say, or a search
+// that falls back to a slower engine.
+class CallTimes {
+ public:
+  static const int kWorst = 5;
+  static const int kCliffFactor = 100;
+  static const int64_t kCliffFloorNs = 10000;
+
+  CallTimes() {}
+
+  void Add(int64_t ns, const std::string& regexp, const StringPiece& text,
+           RE2::Anchor anchor);
+
+  // Prints the median, 99th percentile and worst call, then times the
+  // slowest calls again and prints them, flagging the cliffs.
+  // Returns the number of cliffs.
+  int Report(const char* name);
+
+ private:
+  struct Call {
+    int64_t ns;
+    std::string regexp;
+    std::string text;
+    bool null_text;
+    RE2::Anchor anchor;
+  };
+
+  std::vector<int32_t> ns_;   // every call, in ns
+  std::vector<Call> worst_;   // the slowest calls, slowest first
+
+  CallTimes(const CallTimes&) = delete;
+  CallTimes& operator=(const CallTimes&) = delete;
+};
+
+// Generates every regexp within the parameters and checks RE2 against
+// the Backtracker on every string within the parameters.
+class ExhaustiveTester : public RegexpGenerator {
+ public:
+  ExhaustiveTester(int maxatoms, int maxops,
+                   const std::vector<std::string>& alphabet,
+                   const std::vector<std::string>& ops,
+                   int maxstrlen,
+                   const std::vector<std::string>& stralphabet,
+                   const std::string& wrapper,
+                   const std::string& topwrapper)
+      : RegexpGenerator(maxatoms, maxops, alphabet, ops),
+        strgen_(maxstrlen, stralphabet),
+        wrapper_(wrapper),
+        topwrapper_(topwrapper),
+        regexps_(0), tests_(0), failures_(0), known_bugs_(0), skipped_(0),
+        randomstrings_(false), stringseed_(0), stringcount_(0) {}
+
+  int regexps() { return regexps_; }
+  int tests() { return tests_; }
+  int failures() { return failures_; }
+  int known_bugs() { return known_bugs_; }
+  int skipped() { return skipped_; }
+  CallTimes* times() { return &times_; }
+
+  // Processes a single generated regexp.
+  // Checks it against every string the StringGenerator makes.
+  void HandleRegexp(const std::string& regexp);
+
+  // Causes testing to generate random input strings.
+  void RandomStrings(int32_t seed, int32_t count) {
+    randomstrings_ = true;
+    stringseed_ = seed;
+    stringcount_ = count;
+  }
+
+ private:
+  // Checks RE2 against the Backtracker on text; returns false on a
+  // mismatch, after printing it.
+  bool TestInput(RE2* re, Backtracker* bt, const std::string& regexp,
+                 const StringPiece& text);
+
+  // Notes a mismatch, printing the first few.
+  void Fail(const std::string& regexp, const StringPiece& text,
+            const std::string& what);
+
+  StringGenerator strgen_;
+  std::string wrapper_;      // Regexp wrapper - either empty or has one %s.
+  std::string topwrapper_;   // Regexp top-level wrapper.
+  int regexps_;   // Number of HandleRegexp calls
+  int tests_;     // Number of regexp tests.
+  int failures_;  // Number of tests failed.
+  int known_bugs_;  // Number of mismatches due to known engine bugs.
+  int skipped_;   // Number of tests the Backtracker gave up on.
+
+  bool randomstrings_;  // Whether to use random strings
+  int32_t stringseed_;  // If so, the seed.
+  int stringcount_;     // If so, how many to generate.
+
+  CallTimes times_;
+
+  ExhaustiveTester(const ExhaustiveTester&) = delete;
+  ExhaustiveTester& operator=(const ExhaustiveTester&) = delete;
+};
+
+// Runs an exhaustive test on the given parameters, printing the counts
+// and the timing report, and fails on any cliff and on any mismatch that
+// is not a known bug of the engine underneath RE2.
+void ExhaustiveTest(int maxatoms, int maxops,
+                    const std::vector<std::string>& alphabet,
+                    const std::vector<std::string>& ops,
+                    int maxstrlen,
+                    const std::vector<std::string>& stralphabet,
+                    const std::string& wrapper,
+                    const std::string& topwrapper);
+
+// Runs an exhaustive test using the given parameters and
+// the basic egrep operators, with the regexps unanchored and
+// anchored at the start, the end and both ends.
+void EgrepTest(int maxatoms, int maxops, const std::string& alphabet,
+               int maxstrlen, const std::string& stralphabet,
+               const std::string& wrapper);
+
+}  // namespace re2
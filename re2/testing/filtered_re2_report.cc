@@ -0,0 +1,180 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Reports how well FilteredRE2 filters a set of rules over a sample corpus.
+//
+//   filtered_re2_report [-min_atom_len=N] [-top_atoms=N] [-select_atoms]
+//                       [-train=SAMPLE] RULES CORPUS
+//
+// RULES holds one regexp per line and CORPUS one text per line; empty
+// lines are skipped. The report is tab-separated. For each regexp it gives
+// whether it is unfiltered (a candidate for every text), how often it is a
+// candidate, how often a candidate that it then does not match (a false
+// positive), its prefilter and its pattern. Then it lists the atoms that
+// occur in the most texts. Lines that start with '#' are summaries and
+// column headings.
+//
+// With -select_atoms, the atoms are chosen by how often they occur in
+// CORPUS, as FilteredRE2::Compile does when given a sample; -train=SAMPLE
+// chooses them from the texts in SAMPLE instead, so that the report is
+// not measured on the texts the atoms were chosen from.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "re2/filtered_re2.h"
+#include "re2/re2.h"
+
+namespace {
+
+bool ReadLines(const char* path, std::vector<std::string>* lines) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty())
+      lines->push_back(line);
+  }
+  return true;
+}
+
+double Ratio(int64_t a, int64_t b) {
+  return b == 0 ? 0.0 : static_cast<double>(a) / static_cast<double>(b);
+}
+
+void Usage() {
+  fprintf(stderr,
+          "usage: filtered_re2_report [-min_atom_len=N] [-top_atoms=N] "
+          "[-select_atoms] [-train=SAMPLE] RULES CORPUS\n");
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int min_atom_len = 3;
+  int top_atoms = 50;
+  bool select_atoms = false;
+  const char* train = NULL;
+  std::vector<const char*> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "-min_atom_len=", 14) == 0)
+      min_atom_len = atoi(argv[i] + 14);
+    else if (strncmp(argv[i], "-top_atoms=", 11) == 0)
+      top_atoms = atoi(argv[i] + 11);
+    else if (strcmp(argv[i], "-select_atoms") == 0)
+      select_atoms = true;
+    else if (strncmp(argv[i], "-train=", 7) == 0)
+      train = argv[i] + 7;
+    else if (argv[i][0] == '-')
+      Usage();
+    else
+      paths.push_back(argv[i]);
+  }
+  if (paths.size() != 2)
+    Usage();
+
+  std::vector<std::string> rules;
+  std::vector<std::string> corpus;
+  if (!ReadLines(paths[0], &rules)) {
+    fprintf(stderr, "cannot read %s\n", paths[0]);
+    return 1;
+  }
+  if (!ReadLines(paths[1], &corpus)) {
+    fprintf(stderr, "cannot read %s\n", paths[1]);
+    return 1;
+  }
+  std::vector<std::string> sample;
+  if (train != NULL && !ReadLines(train, &sample)) {
+    fprintf(stderr, "cannot read %s\n", train);
+    return 1;
+  }
+
+  re2::FilteredRE2 f(min_atom_len);
+  RE2::Options options;
+  options.set_log_errors(false);
+  // Rules that do not compile are left out; ids maps the regexp ids of f
+  // back to indices in rules.
+  std::vector<int> ids;
+  for (size_t i = 0; i < rules.size(); i++) {
+    int id;
+    if (f.Add(rules[i], options, &id) == RE2::NoError)
+      ids.push_back(static_cast<int>(i));
+    else
+      fprintf(stderr, "skipping rule %zu: %s\n", i + 1, rules[i].c_str());
+  }
+  if (ids.empty()) {
+    fprintf(stderr, "no rules\n");
+    return 1;
+  }
+  std::vector<re2::StringPiece> texts(corpus.begin(), corpus.end());
+  std::vector<std::string> atoms;
+  if (train != NULL) {
+    std::vector<re2::StringPiece> pieces(sample.begin(), sample.end());
+    f.Compile(&atoms, pieces.data(), static_cast<int>(pieces.size()));
+  } else if (select_atoms) {
+    f.Compile(&atoms, texts.data(), static_cast<int>(texts.size()));
+  } else {
+    f.Compile(&atoms);
+  }
+  re2::FilteredRE2::CorpusStats stats;
+  f.MeasureCorpus(texts.data(), static_cast<int>(texts.size()), &stats);
+
+  int unfiltered = 0;
+  int64_t candidates = 0;
+  int64_t matches = 0;
+  std::vector<re2::FilteredRE2::FilterInfo> infos(ids.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    f.GetFilterInfo(static_cast<int>(i), &infos[i]);
+    if (infos[i].unfiltered)
+      unfiltered++;
+    candidates += stats.candidates[i];
+    matches += stats.matches[i];
+  }
+
+  printf("# %zu regexps, %zu atoms, %lld texts, min_atom_len %d, "
+         "atoms chosen by %s\n",
+         ids.size(), atoms.size(), static_cast<long long>(stats.texts),
+         min_atom_len,
+         train != NULL ? train : select_atoms ? "corpus" : "length");
+  printf("# %d unfiltered regexps\n", unfiltered);
+  printf("# %.2f candidates and %.2f matches per text\n",
+         Ratio(candidates, stats.texts), Ratio(matches, stats.texts));
+  printf("# rule\tunfiltered\tcandidate_rate\tfalse_positive_rate\t"
+         "prefilter\tpattern\n");
+  for (size_t i = 0; i < ids.size(); i++) {
+    printf("%d\t%d\t%.4f\t%.4f\t%s\t%s\n", ids[i] + 1,
+           infos[i].unfiltered ? 1 : 0,
+           Ratio(stats.candidates[i], stats.texts),
+           Ratio(stats.candidates[i] - stats.matches[i],
+                 stats.candidates[i]),
+           infos[i].prefilter.c_str(), rules[ids[i]].c_str());
+  }
+
+  // The atoms that occur most often make the most regexps candidates.
+  std::vector<int> uses(atoms.size(), 0);
+  for (size_t i = 0; i < infos.size(); i++)
+    for (size_t j = 0; j < infos[i].atoms.size(); j++)
+      uses[infos[i].atoms[j]]++;
+  std::vector<std::pair<int64_t, int>> by_hits;
+  for (size_t i = 0; i < atoms.size(); i++)
+    by_hits.emplace_back(-stats.atom_hits[i], static_cast<int>(i));
+  std::sort(by_hits.begin(), by_hits.end());
+  printf("# atom\thit_rate\tregexps\n");
+  for (size_t i = 0; i < by_hits.size() && static_cast<int>(i) < top_atoms;
+       i++) {
+    int a = by_hits[i].second;
+    printf("%s\t%.4f\t%d\n", atoms[a].c_str(),
+           Ratio(stats.atom_hits[a], stats.texts), uses[a]);
+  }
+  return 0;
+}
@@ -3,9 +3,11 @@
 // license that can be found in the LICENSE file.
 #include <iostream>
 #include <stddef.h>
+#include <stdio.h>
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <utility>
 
@@ -13,6 +15,7 @@
 #include "re2/testing/util/logging.h"
 #include "re2/filtered_re2.h"
 #include "re2/re2.h"
+#include "re2/thread_pool.h"
 
 namespace re2 {
 
@@ -130,6 +133,19 @@ AtomTest atom_tests[] = {
       "xbcdea", "xbcdeb",
       "ybcdea", "ybcdeb"
     }
+  }, {
+    // Test that atoms are found through nested groups and escapes, and
+    // that a repetition keeps the atoms of what it repeats.
+    "NestedGroupsAndEscapes", {
+      "((abc|xyz)def)+\\.ghi",
+      "foo\\d+bar\\[baz\\]",
+      "(?:hello(?:world|there)){2}",
+    }, {
+      "abcdef", "xyzdef", ".ghi",
+      "foo", "bar[baz]",
+      "helloworldhelloworld", "helloworldhellothere",
+      "hellotherehelloworld", "hellotherehellothere",
+    }
   },{
     // Test upper/lower of non-ASCII.
     "UnicodeLower", {
@@ -356,6 +372,459 @@ TEST(FilteredRE2Test, SlowFirstMatch) {
 
 }
 
+TEST(FilteredRE2Test, AndOrTree) {
+  FilterTestVars v;
+  int id;
+  v.f.Add("abc\\d+", v.opts, &id);
+  v.f.Add("xyz.*(def|ghi)", v.opts, &id);
+  v.f.Add("(?i)XYZ\\s+", v.opts, &id);
+  v.f.Add("\\d+", v.opts, &id);
+  v.f.Compile(&v.atoms);
+  EXPECT_EQ(4, v.atoms.size());
+
+  // The last regexp has no atoms, so it is always a candidate; the others
+  // need all of the atoms under an AND, and any one of those under an OR.
+  std::vector<std::string> atoms;
+  std::vector<int> potentials;
+  atoms.push_back("xyz");
+  FindAtomIndices(v.atoms, atoms, &v.atom_indices);
+  v.f.AllPotentials(v.atom_indices, &potentials);
+  EXPECT_EQ(2, potentials.size());
+  EXPECT_EQ(2, potentials[0]);
+  EXPECT_EQ(3, potentials[1]);
+
+  atoms.push_back("ghi");
+  FindAtomIndices(v.atoms, atoms, &v.atom_indices);
+  v.f.AllPotentials(v.atom_indices, &potentials);
+  EXPECT_EQ(3, potentials.size());
+  EXPECT_EQ(1, potentials[0]);
+
+  // FirstMatch() returns the index of the regexp, not of the candidate.
+  EXPECT_EQ(1, v.f.FirstMatch("xyz ghi", v.atom_indices));
+  EXPECT_EQ(2, v.f.FirstMatch("xyz 123", v.atom_indices));
+  EXPECT_EQ(3, v.f.FirstMatch("xy 123", v.atom_indices));
+}
+
+TEST(FilteredRE2Test, SharedNodes) {
+  FilterTestVars v;
+  int id;
+  v.f.Add("abc.*def", v.opts, &id);
+  v.f.Add("abc.*def", v.opts, &id);
+  v.f.Add("(abc|zzz)", v.opts, &id);
+  v.f.Add("def\\d+abc", v.opts, &id);
+  v.f.Compile(&v.atoms);
+  // Atoms and nodes that occur in several regexps are stored once, and
+  // a match triggers every regexp that uses them.
+  EXPECT_EQ(3, v.atoms.size());
+
+  std::vector<std::string> atoms;
+  std::vector<int> potentials;
+  atoms.push_back("def");
+  FindAtomIndices(v.atoms, atoms, &v.atom_indices);
+  v.f.AllPotentials(v.atom_indices, &potentials);
+  EXPECT_EQ(0, potentials.size());
+
+  atoms.push_back("abc");
+  FindAtomIndices(v.atoms, atoms, &v.atom_indices);
+  v.f.AllPotentials(v.atom_indices, &potentials);
+  ASSERT_EQ(4, potentials.size());
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ(i, potentials[i]);
+
+  atoms.clear();
+  atoms.push_back("abc");
+  FindAtomIndices(v.atoms, atoms, &v.atom_indices);
+  v.f.AllPotentials(v.atom_indices, &potentials);
+  ASSERT_EQ(1, potentials.size());
+  EXPECT_EQ(2, potentials[0]);
+}
+
+TEST(FilteredRE2Test, Scan) {
+  FilterTestVars v;
+  int id;
+  v.f.Add("abc\\d+", v.opts, &id);
+  v.f.Add("(?i)\xc3\x89" "COLE\\d", v.opts, &id);
+  v.f.Add("xyz.*(def|ghi)", v.opts, &id);
+  v.f.Add("\\d+", v.opts, &id);
+  v.f.Compile(&v.atoms);
+
+  // The text is not lowercased: "ABC1" and "XYZ GHI" contain atoms of
+  // regexps that do not match it, and the lowercased atom of the second
+  // regexp has to be found with an uppercase E WITH ACUTE.
+  std::vector<int> matching;
+  EXPECT_TRUE(v.f.Scan("ABC1 abc23 \xc3\x89" "cole9 XYZ GHI", &matching));
+  ASSERT_EQ(3, matching.size());
+  EXPECT_EQ(0, matching[0]);
+  EXPECT_EQ(1, matching[1]);
+  EXPECT_EQ(3, matching[2]);
+
+  EXPECT_TRUE(v.f.Scan("XYZ xyz-def", &matching));
+  ASSERT_EQ(1, matching.size());
+  EXPECT_EQ(2, matching[0]);
+
+  EXPECT_FALSE(v.f.Scan("ecole", &matching));
+  EXPECT_EQ(0, matching.size());
+}
+
+TEST(FilteredRE2Test, ManyCandidates) {
+  // Enough unfiltered regexps for AllMatches() to split them into chunks
+  // and search those on several threads if it can.
+  FilterTestVars v;
+  int id;
+  for (int i = 1; i <= 600; i++)
+    v.f.Add("\\d{" + std::to_string(i) + "}", v.opts, &id);
+  v.f.Compile(&v.atoms);
+  EXPECT_EQ(0, v.atoms.size());
+
+  std::vector<int> matching;
+  EXPECT_TRUE(v.f.AllMatches(std::string(450, '7'), v.atom_indices,
+                             &matching));
+  ASSERT_EQ(450, matching.size());
+  for (int i = 0; i < 450; i++)
+    EXPECT_EQ(i, matching[i]);
+}
+
+TEST(FilteredRE2Test, ManyCandidatesConcurrently) {
+  // Callers that find the default pool busy with another caller's
+  // candidates search their own rather than wait for it.
+  FilterTestVars v;
+  int id;
+  for (int i = 1; i <= 600; i++)
+    v.f.Add("\\d{" + std::to_string(i) + "}", v.opts, &id);
+  v.f.Compile(&v.atoms);
+
+  std::vector<int> bad(4, 0);
+  std::vector<std::thread> callers;
+  for (int t = 0; t < 4; t++) {
+    callers.emplace_back([&v, &bad, t]() {
+      const int len = 300 + 50 * t;
+      for (int i = 0; i < 5; i++) {
+        std::vector<int> matching;
+        v.f.AllMatches(std::string(len, '7'), v.atom_indices, &matching);
+        if (matching.size() != static_cast<size_t>(len) ||
+            matching.back() != len - 1)
+          bad[t]++;
+      }
+    });
+  }
+  for (size_t i = 0; i < callers.size(); i++)
+    callers[i].join();
+  for (int t = 0; t < 4; t++)
+    EXPECT_EQ(0, bad[t]);
+}
+
+TEST(FilteredRE2Test, VerifyMatchesPartialMatch) {
+  // Candidates are verified a shard of regexps at a time, with one
+  // automaton for the regexps of a shard that have the default options.
+  // The results have to be those of PartialMatch() on each regexp.
+  FilterTestVars v;
+  RE2::Options dot_nl;
+  dot_nl.set_dot_nl(true);
+  RE2::Options latin1;
+  latin1.set_encoding(RE2::Options::EncodingLatin1);
+  int id;
+  for (int i = 0; i < 200; i++) {
+    std::string n = std::to_string(i);
+    switch (i % 5) {
+      case 0: v.f.Add("abc" + n + "\\d", v.opts, &id); break;
+      case 1: v.f.Add("x.y", dot_nl, &id); break;
+      case 2: v.f.Add("(abc|def)" + n, v.opts, &id); break;
+      case 3: v.f.Add("\\xe9" + n, latin1, &id); break;
+      default: v.f.Add("^d", v.opts, &id); break;
+    }
+  }
+  v.f.Compile(&v.atoms);
+
+  const std::string texts[] = {
+      "abc17 abc171 def32 abc1",
+      "x\ny d abc7",
+      "dx\nyz",
+      std::string("\xe9" "8 abc157 ", 9) + std::string("\0abc01", 6),
+      "",
+  };
+  for (const std::string& text : texts) {
+    std::vector<int> expected;
+    for (int i = 0; i < v.f.NumRegexps(); i++)
+      if (RE2::PartialMatch(text, v.f.GetRE2(i)))
+        expected.push_back(i);
+
+    std::vector<int> all;
+    for (int i = 0; i < static_cast<int>(v.atoms.size()); i++)
+      all.push_back(i);
+    std::vector<int> matching;
+    v.f.AllMatches(text, all, &matching);
+    EXPECT_EQ(expected, matching) << text;
+    v.f.Scan(text, &matching);
+    EXPECT_EQ(expected, matching) << text;
+    EXPECT_EQ(expected.empty() ? -1 : expected[0], v.f.FirstMatch(text, all))
+        << text;
+  }
+}
+
+TEST(FilteredRE2Test, VerifyNullText) {
+  // A NULL text is the empty text, in the shard automaton as in
+  // PartialMatch().
+  FilterTestVars v;
+  int id;
+  const char* regexps[] = {"a*", "b+", "^$", "c", "x?"};
+  for (const char* re : regexps)
+    v.f.Add(re, v.opts, &id);
+  v.f.Compile(&v.atoms);
+
+  std::vector<int> expected;
+  for (int i = 0; i < v.f.NumRegexps(); i++)
+    if (RE2::PartialMatch(StringPiece(), v.f.GetRE2(i)))
+      expected.push_back(i);
+  EXPECT_EQ(std::vector<int>({0, 2, 4}), expected);
+
+  std::vector<int> matching;
+  v.f.AllMatches(StringPiece(), v.atom_indices, &matching);
+  EXPECT_EQ(expected, matching);
+  v.f.Scan(StringPiece(), &matching);
+  EXPECT_EQ(expected, matching);
+}
+
+TEST(FilteredRE2Test, FilterInfoAndCorpusStats) {
+  FilterTestVars v;
+  int id;
+  v.f.Add("abc\\d+", v.opts, &id);
+  v.f.Add("xyz.*(def|ghi)", v.opts, &id);
+  v.f.Add("\\d+", v.opts, &id);
+
+  FilteredRE2::FilterInfo info;
+  EXPECT_FALSE(v.f.GetFilterInfo(0, &info));
+  v.f.Compile(&v.atoms);
+
+  ASSERT_TRUE(v.f.GetFilterInfo(1, &info));
+  EXPECT_EQ("xyz (def|ghi)", info.prefilter);
+  EXPECT_FALSE(info.unfiltered);
+  std::vector<std::string> atoms;
+  for (int a : info.atoms)
+    atoms.push_back(v.atoms[a]);
+  std::sort(atoms.begin(), atoms.end());
+  EXPECT_EQ(std::vector<std::string>({"def", "ghi", "xyz"}), atoms);
+
+  ASSERT_TRUE(v.f.GetFilterInfo(2, &info));
+  EXPECT_EQ("", info.prefilter);
+  EXPECT_TRUE(info.unfiltered);
+  EXPECT_TRUE(info.atoms.empty());
+
+  const StringPiece texts[] = {"abc1", "ABC xyz def", "xyzghi"};
+  FilteredRE2::CorpusStats stats;
+  ASSERT_TRUE(v.f.MeasureCorpus(texts, 3, &stats));
+  EXPECT_EQ(3, stats.texts);
+  EXPECT_EQ(std::vector<int64_t>({2, 2, 3}), stats.candidates);
+  EXPECT_EQ(std::vector<int64_t>({1, 2, 1}), stats.matches);
+  for (size_t a = 0; a < v.atoms.size(); a++) {
+    int64_t expected = v.atoms[a] == "abc" || v.atoms[a] == "xyz" ? 2 : 1;
+    EXPECT_EQ(expected, stats.atom_hits[a]) << v.atoms[a];
+  }
+}
+
+TEST(FilteredRE2Test, AddBatch) {
+  std::vector<std::string> storage;
+  for (int i = 0; i < 200; i++)
+    storage.push_back(i % 17 == 5 ? "a[" : "word" + std::to_string(i) + "x+");
+  std::vector<StringPiece> patterns(storage.begin(), storage.end());
+  RE2::Options options;
+  options.set_log_errors(false);
+
+  FilteredRE2 one;
+  std::vector<int> want;
+  std::vector<RE2::ErrorCode> want_errors;
+  for (size_t i = 0; i < patterns.size(); i++) {
+    int id = -1;
+    want_errors.push_back(one.Add(patterns[i], options, &id));
+    want.push_back(id);
+  }
+
+  ThreadPool pool(4);
+  FilteredRE2 batch;
+  std::vector<int> ids;
+  std::vector<RE2::ErrorCode> errors;
+  EXPECT_FALSE(batch.AddBatch(patterns, options, &ids, &errors, &pool));
+  EXPECT_EQ(want, ids);
+  EXPECT_EQ(want_errors, errors);
+  ASSERT_EQ(one.NumRegexps(), batch.NumRegexps());
+  for (int i = 0; i < one.NumRegexps(); i++)
+    EXPECT_EQ(one.GetRE2(i).pattern(), batch.GetRE2(i).pattern());
+
+  std::vector<std::string> atoms;
+  batch.Compile(&atoms);
+  std::vector<int> matching;
+  EXPECT_TRUE(batch.Scan("a word42xx", &matching));
+  ASSERT_EQ(1, matching.size());
+  EXPECT_EQ(want[42], matching[0]);
+}
+
+TEST(FilteredRE2Test, AdaptiveFirstMatch) {
+  FilterTestVars plain;
+  FilterTestVars in_order;
+  FilterTestVars any_order;
+  FilterTestVars first_rule_first;
+  FilterTestVars* vs[] = {&plain, &in_order, &any_order, &first_rule_first};
+  std::vector<int> index_order;
+  int id;
+  for (int i = 0; i < 200; i++) {
+    for (FilterTestVars* v : vs)
+      v->f.Add("k" + std::to_string(i) + "x", v->opts, &id);
+    index_order.push_back(i);
+  }
+  for (FilterTestVars* v : vs)
+    v->f.Compile(&v->atoms);
+  std::vector<int> all;
+  for (int i = 0; i < static_cast<int>(plain.atoms.size()); i++)
+    all.push_back(i);
+  in_order.f.EnableAdaptiveFirstMatch(index_order);
+  any_order.f.EnableAdaptiveFirstMatch(std::vector<int>());
+  std::vector<int> priorities(200, 1);
+  priorities[1] = 0;
+  first_rule_first.f.EnableAdaptiveFirstMatch(priorities);
+
+  // Regexp 150 matches most texts; regexp 1 some of them.
+  for (int i = 0; i < 10000; i++) {
+    std::string text = "k150x";
+    if (i % 10 == 0)
+      text += " k1x";
+    if (i % 100 == 0)
+      text = "k" + std::to_string(i % 200) + "x";
+    int want = plain.f.FirstMatch(text, all);
+    EXPECT_EQ(want, in_order.f.FirstMatch(text, all)) << text;
+    int got = any_order.f.FirstMatch(text, all);
+    EXPECT_TRUE(got >= 0 && RE2::PartialMatch(text, any_order.f.GetRE2(got)))
+        << text;
+    EXPECT_EQ(text.find("k1x") != std::string::npos ? 1 : want,
+              first_rule_first.f.FirstMatch(text, all)) << text;
+  }
+  // By now regexp 150 is verified first.
+  EXPECT_EQ(1, plain.f.FirstMatch("k150x k1x", all));
+  EXPECT_EQ(1, in_order.f.FirstMatch("k150x k1x", all));
+  EXPECT_EQ(150, any_order.f.FirstMatch("k150x k1x", all));
+  EXPECT_EQ(1, first_rule_first.f.FirstMatch("k150x k1x", all));
+  EXPECT_EQ(-1, any_order.f.FirstMatch("nothing", all));
+}
+
+TEST(FilteredRE2Test, CompileWithCorpus) {
+  const char* regexps[] = {"http.*abcdef", "\\bqz\\d+", "(www|ftp)\\.xyz"};
+  std::vector<std::string> texts;
+  for (int i = 0; i < 200; i++)
+    texts.push_back("GET http://www.example.com/" + std::to_string(i));
+  std::vector<StringPiece> corpus(texts.begin(), texts.end());
+  FilterTestVars by_length;
+  FilterTestVars by_corpus;
+  int id;
+  for (const char* regexp : regexps) {
+    by_length.f.Add(regexp, by_length.opts, &id);
+    by_corpus.f.Add(regexp, by_corpus.opts, &id);
+  }
+  by_length.f.Compile(&by_length.atoms);
+  by_corpus.f.Compile(&by_corpus.atoms, corpus.data(),
+                      static_cast<int>(corpus.size()));
+
+  // "http" is in every text, so only "abcdef" is used; "qz" is too short
+  // to be used by length, but it is in no text. An OR needs all of its
+  // strings, however common.
+  FilteredRE2::FilterInfo info;
+  ASSERT_TRUE(by_length.f.GetFilterInfo(0, &info));
+  EXPECT_EQ("http abcdef", info.prefilter);
+  ASSERT_TRUE(by_corpus.f.GetFilterInfo(0, &info));
+  EXPECT_EQ("abcdef", info.prefilter);
+  ASSERT_TRUE(by_length.f.GetFilterInfo(1, &info));
+  EXPECT_TRUE(info.unfiltered);
+  ASSERT_TRUE(by_corpus.f.GetFilterInfo(1, &info));
+  EXPECT_EQ("qz", info.prefilter);
+  ASSERT_TRUE(by_corpus.f.GetFilterInfo(2, &info));
+  EXPECT_EQ("(ftp.xyz|www.xyz)", info.prefilter);
+
+  const char* tests[] = {"http://abcdef", "abcdef", "qz12", "xqz12",
+                         "www.xyz", "http://www.example.com/"};
+  std::vector<int> matches;
+  for (const char* text : tests) {
+    by_length.f.Scan(text, &by_length.matches);
+    by_corpus.f.Scan(text, &matches);
+    EXPECT_TRUE(by_length.matches == matches) << text;
+  }
+  std::vector<int> potentials;
+  by_corpus.f.AllPotentials(std::vector<int>(), &potentials);
+  EXPECT_TRUE(potentials.empty());
+}
+
+TEST(FilteredRE2Test, SaveAndLoadIndex) {
+  FilterTestVars v;
+  int id;
+  v.f.Add("abc\\d+", v.opts, &id);
+  v.f.Add("xyz.*(def|ghi)", v.opts, &id);
+  v.f.Add("\\d+", v.opts, &id);
+  RE2::Options dot_nl;
+  dot_nl.set_dot_nl(true);
+  v.f.Add("foo.bar", dot_nl, &id);
+  RE2::Options latin1;
+  latin1.set_encoding(RE2::Options::EncodingLatin1);
+  v.f.Add("caf\xe9", latin1, &id);
+
+  const std::string path = testing::TempDir() + "filtered_re2_test.index";
+  EXPECT_FALSE(v.f.SaveIndex(path));
+  v.f.Compile(&v.atoms);
+  ASSERT_TRUE(v.f.SaveIndex(path));
+
+  FilterTestVars loaded;
+  ASSERT_TRUE(loaded.f.LoadIndex(path, &loaded.atoms));
+  EXPECT_TRUE(v.atoms == loaded.atoms);
+  ASSERT_EQ(v.f.NumRegexps(), loaded.f.NumRegexps());
+  EXPECT_EQ(RE2::ErrorInternal, loaded.f.Add("x", v.opts, &id));
+
+  const char* texts[] = {"abc12", "ABC12", "xyz and GHI", "foo\nbar",
+                         "caf\xe9", "nothing here", ""};
+  std::vector<int> matches;
+  for (const char* text : texts) {
+    v.f.Scan(text, &v.matches);
+    loaded.f.Scan(text, &matches);
+    EXPECT_TRUE(v.matches == matches) << text;
+  }
+  for (int i = 0; i < v.f.NumRegexps(); i++) {
+    FilteredRE2::FilterInfo want, got;
+    ASSERT_TRUE(v.f.GetFilterInfo(i, &want));
+    ASSERT_TRUE(loaded.f.GetFilterInfo(i, &got));
+    EXPECT_EQ(want.prefilter, got.prefilter);
+    EXPECT_TRUE(want.atoms == got.atoms);
+    EXPECT_EQ(want.unfiltered, got.unfiltered);
+    EXPECT_EQ(v.f.GetRE2(i).pattern(), loaded.f.GetRE2(i).pattern());
+    EXPECT_EQ(v.f.GetRE2(i).options().dot_nl(),
+              loaded.f.GetRE2(i).options().dot_nl());
+    EXPECT_EQ(v.f.GetRE2(i).options().encoding(),
+              loaded.f.GetRE2(i).options().encoding());
+  }
+
+  // A loaded index can be saved again, and moved.
+  ASSERT_TRUE(loaded.f.SaveIndex(path));
+  FilteredRE2 moved(std::move(loaded.f));
+  EXPECT_TRUE(moved.Scan("xyz def", &matches));
+  EXPECT_TRUE(std::vector<int>({1}) == matches);
+
+  // An index built with another min_atom_len is refused.
+  FilterTestVars other(5);
+  EXPECT_FALSE(other.f.LoadIndex(path, &other.atoms));
+  EXPECT_EQ(0, other.f.NumRegexps());
+
+  // So is one with another format version, after which the FilteredRE2
+  // can still be built as usual.
+  FILE* file = fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(file != NULL);
+  fseek(file, 8, SEEK_SET);
+  fputc(0xff, file);
+  fclose(file);
+  FilterTestVars rebuilt;
+  EXPECT_FALSE(rebuilt.f.LoadIndex(path, &rebuilt.atoms));
+  EXPECT_EQ(RE2::NoError, rebuilt.f.Add("abc\\d+", v.opts, &id));
+  rebuilt.f.Compile(&rebuilt.atoms);
+  EXPECT_TRUE(rebuilt.f.Scan("abc12", &matches));
+
+  EXPECT_FALSE(rebuilt.f.LoadIndex(path, &rebuilt.atoms));
+  FilterTestVars missing;
+  EXPECT_FALSE(missing.f.LoadIndex(path + ".missing", &missing.atoms));
+  remove(path.c_str());
+}
+
 TEST(FilteredRE2Test, AllPotentials) {
   FilterTestVars v;
   AtomTest* t = &atom_tests[1];
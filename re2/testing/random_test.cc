@@ -0,0 +1,97 @@
+// Copyright 2008 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Random testing of regular expression matching.
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "re2/testing/exhaustive_tester.h"
+#include "re2/testing/util/test.h"
+
+namespace re2 {
+
+static const int32_t kRegexpSeed = 404;
+static const int kRegexpCount = 100;
+static const int32_t kStringSeed = 200;
+static const int kStringCount = 100;
+
+// Runs a random test on the given parameters and returns the number of
+// failures; fails the test on a cliff.
+// (Always uses the same random seeds for reproducibility.
+// Can give different seeds by editing the constants above.)
+static int RandomTest(int maxatoms, int maxops,
+                      const std::vector<std::string>& alphabet,
+                      const std::vector<std::string>& ops,
+                      int maxstrlen,
+                      const std::vector<std::string>& stralphabet,
+                      const std::string& wrapper) {
+  ExhaustiveTester t(maxatoms, maxops, alphabet, ops,
+                     maxstrlen, stralphabet, wrapper, "");
+  t.RandomStrings(kStringSeed, kStringCount);
+  t.GenerateRandom(kRegexpSeed, kRegexpCount);
+  printf("%d regexps, %d tests, %d failures, %d known engine bugs, "
+         "%d skipped [%d/%d str]\n",
+         t.regexps(), t.tests(), t.failures(), t.known_bugs(), t.skipped(),
+         maxstrlen, static_cast<int>(stralphabet.size()));
+  EXPECT_EQ(0, t.times()->Report("random"));
+  return t.failures();
+}
+
+// Tests random small regexps involving literals and egrep operators.
+TEST(Random, SmallEgrepLiterals) {
+  int failures = RandomTest(5, 5, Explode("abc."),
+                            RegexpGenerator::EgrepOps(),
+                            15, Explode("abc"), "");
+  EXPECT_EQ(0, failures);
+}
+
+// Tests random bigger regexps involving literals and egrep operators.
+TEST(Random, BigEgrepLiterals) {
+  int failures = RandomTest(10, 10, Explode("abc."),
+                            RegexpGenerator::EgrepOps(),
+                            50, Explode("abc"), "");
+  EXPECT_EQ(0, failures);
+}
+
+// Tests random small regexps involving literals, capturing parens,
+// and egrep operators.
+TEST(Random, SmallEgrepCaptures) {
+  int failures = RandomTest(5, 5, Split(" ", "a (b) ."),
+                            RegexpGenerator::EgrepOps(),
+                            15, Explode("abc"), "");
+  EXPECT_EQ(0, failures);
+}
+
+// Tests random bigger regexps involving literals, capturing parens,
+// and egrep operators.
+TEST(Random, BigEgrepCaptures) {
+  int failures = RandomTest(10, 10, Split(" ", "a (b) ."),
+                            RegexpGenerator::EgrepOps(),
+                            50, Explode("abc"), "");
+  EXPECT_EQ(0, failures);
+}
+
+// Tests random large complicated expressions, using all the possible
+// operators, some really complicated character classes, and much
+// longer strings.
+TEST(Random, Complicated) {
+  std::vector<std::string> ops = Split(" ",
+    "%s%s %s|%s %s* %s*? %s+ %s+? %s? %s?? "
+    "%s{0} %s{0,} %s{1} %s{1,} %s{0,1} %s{0,2} %s{1,2} "
+    "%s{2} %s{2,} %s{3,4} %s{4,5}");
+
+  // Use (?:\b) and (?:\B) instead of \b and \B,
+  // because the parser rejects \b* but accepts (?:\b)*.
+  // Ditto ^ and $.
+  std::vector<std::string> atoms = Split(" ",
+    ". (?:^) (?:$) \\a \\f \\n \\r \\t \\v "
+    "\\d \\D \\s \\S \\w \\W (?:\\b) (?:\\B) "
+    "a (a) b c - \\\\");
+  std::vector<std::string> alphabet = Explode("abc123\001\002\003\t\r\n\v\f\a");
+  EXPECT_EQ(0, RandomTest(10, 10, atoms, ops, 20, alphabet, ""));
+}
+
+}  // namespace re2
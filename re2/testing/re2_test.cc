@@ -95,6 +95,33 @@ TEST(RE2, DecimalTests) {
 #undef ASSERT_DECIMAL
 }
 
+// Found by the exhaustive tests.
+TEST(RE2, MatchAnchors) {
+  StringPiece group[2];
+
+  // A full match need not be the leftmost-first match.
+  RE2 re("(a|ab)");
+  StringPiece s = "ab";
+  ASSERT_TRUE(re.Match(s, 0, s.size(), RE2::ANCHOR_BOTH, group, 2));
+  ASSERT_EQ(group[0], "ab");
+  ASSERT_EQ(group[1], "ab");
+  std::string sub;
+  ASSERT_TRUE(RE2::FullMatch("ab", re, &sub));
+  ASSERT_EQ(sub, "ab");
+
+  // No match at all is no match at the start either.
+  s = "b";
+  ASSERT_FALSE(RE2("a").Match(s, 0, s.size(), RE2::ANCHOR_START, group, 1));
+
+  // A NULL text is an empty one.
+  ASSERT_FALSE(RE2("a").Match(StringPiece(), 0, 0, RE2::UNANCHORED, group, 1));
+  ASSERT_TRUE(RE2("a*").Match(StringPiece(), 0, 0, RE2::UNANCHORED, group, 1));
+
+  // Groups that can never match still count.
+  ASSERT_EQ(RE2("(a){0}").NumberOfCapturingGroups(), 1);
+  ASSERT_EQ(RE2("(a)(b){0}").NumberOfCapturingGroups(), 2);
+}
+
 TEST(RE2, Replace) {
   struct ReplaceTest {
     const char *regexp;
@@ -368,6 +395,29 @@ TEST(RE2, Match) {
   ASSERT_EQ(port, 9000);
 }
 
+TEST(RE2, MatchStartEnd) {
+  // Only text[startpos, endpos) is searched, but the text before startpos
+  // is the context of ^ and \b.
+  RE2 re("\\d+");
+  StringPiece s = "a1 b22 c333";
+  StringPiece m;
+  ASSERT_TRUE(re.Match(s, 0, s.size(), RE2::UNANCHORED, &m, 1));
+  ASSERT_EQ(m, "1");
+  ASSERT_TRUE(re.Match(s, 2, s.size(), RE2::UNANCHORED, &m, 1));
+  ASSERT_EQ(m, "22");
+  ASSERT_TRUE(re.Match(s, 2, 5, RE2::UNANCHORED, &m, 1));
+  ASSERT_EQ(m, "2");
+  ASSERT_FALSE(re.Match(s, 11, 11, RE2::UNANCHORED, &m, 1));
+
+  s = "ab b";
+  ASSERT_TRUE(RE2("\\bb").Match(s, 1, s.size(), RE2::UNANCHORED, &m, 1));
+  ASSERT_EQ(m.data() - s.data(), 3);
+  ASSERT_FALSE(RE2("^b").Match(s, 1, s.size(), RE2::UNANCHORED, NULL, 0));
+
+  // The text does not end at a NUL byte.
+  ASSERT_TRUE(RE2::PartialMatch(StringPiece("a\0b", 3), "b"));
+}
+
 static void TestRecursion(int size, const char* pattern) {
   // Fill up a string repeating the pattern given
   std::string domain;
@@ -4,13 +4,24 @@
 
 // Benchmarks for regular expression implementations.
 
+#include <malloc.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <iostream>
 #include <fstream>
@@ -19,8 +30,12 @@
 #include "re2/testing/util/benchmark.h"
 #include "re2/testing/util/test.h"
 #include "re2/testing/util/logging.h"
+#include "re2/testing/util/malloc_counter.h"
+#include "re2/filtered_re2.h"
 #include "re2/re2.h"
 #include "re2/set.h"
+#include "re2/thread_pool.h"
+#include "re2/versioned_set.h"
 
 extern "C"
 {
@@ -60,6 +75,42 @@ std::string RandomText(int64_t nbytes) {
   return text->substr(0, nbytes);
 }
 
+// The sample text re2/testing/text_re2_1KB.txt, repeated to nbytes. It is
+// looked for under the current directory and the directories above the
+// binary, so the benchmarks can be run from the top of the tree (as make
+// benchlog does) or from any of the obj test directories.
+std::string SampleText(int64_t nbytes) {
+  static const std::string* const sample = []() {
+    static const char kSample[] = "re2/testing/text_re2_1KB.txt";
+    std::vector<std::string> dirs = {"."};
+    char exe[4096];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof exe - 1);
+    if (n > 0) {
+      std::string dir(exe, n);
+      for (int i = 0; i < 4 && dir.rfind('/') != std::string::npos; i++) {
+        dir.erase(dir.rfind('/'));
+        dirs.push_back(dir);
+      }
+    }
+    for (const std::string& dir : dirs) {
+      std::ifstream in(dir + "/" + kSample);
+      if (!in)
+        continue;
+      std::stringstream buffer;
+      buffer << in.rdbuf();
+      if (!buffer.str().empty())
+        return new std::string(buffer.str());
+    }
+    LOG(FATAL) << "cannot find " << kSample;
+    return new std::string;
+  }();
+  std::string text;
+  text.reserve(nbytes);
+  while (static_cast<int64_t>(text.size()) < nbytes)
+    text.append(*sample, 0, nbytes - text.size());
+  return text;
+}
+
 // Benchmark: FindAndConsume
 void FindAndConsume(benchmark::State& state) {
   std::string s = RandomText(state.range(0));
@@ -75,8 +126,10 @@ void FindAndConsume(benchmark::State& state) {
 }
 // BENCHMARK_RANGE(FindAndConsume, 8, 16)->ThreadRange(1, NumCPUs());
 
+// The benchmarks run with ->ThreadRange() share one RE2 between their
+// threads, as a server does.
 void EmptyPartialMatchRE2(benchmark::State& state) {
-  RE2 re("");
+  static const RE2 re("");
   for (auto _ : state) {
     RE2::PartialMatch("", re);
   }
@@ -84,20 +137,17 @@ void EmptyPartialMatchRE2(benchmark::State& state) {
 BENCHMARK(EmptyPartialMatchRE2)->ThreadRange(1, NumCPUs());
 
 void EmptyPartialMatchRE2_text_re2_1KB(benchmark::State& state) {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string s = buffer.str();
+  std::string s = SampleText(state.range(0));
   RE2 re("");
   for (auto _ : state) {
-    RE2::PartialMatch(s.substr(0, state.range(0)), re);
+    RE2::PartialMatch(s, re);
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(EmptyPartialMatchRE2_text_re2_1KB, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(EmptyPartialMatchRE2_text_re2_1KB, 16, 16 << 20)->RangeMultiplier(4);
 
 void SimplePartialMatchRE2(benchmark::State& state) {
-  RE2 re("abcdefg");
+  static const RE2 re("abcdefg");
   for (auto _ : state) {
     RE2::PartialMatch("abcdefg", re);
   }
@@ -110,7 +160,7 @@ static std::string http_text =
 
 void HTTPPartialMatchRE2(benchmark::State& state) {
   StringPiece a;
-  RE2 re("(?-s)^(?:GET|POST) +([^ ]+) HTTP");
+  static const RE2 re("(?-s)^(?:GET|POST) +([^ ]+) HTTP");
   for (auto _ : state) {
     RE2::PartialMatch(http_text, re, &a);
   }
@@ -122,7 +172,7 @@ static std::string smallhttp_text =
 
 void SmallHTTPPartialMatchRE2(benchmark::State& state) {
   StringPiece a;
-  RE2 re("(?-s)^(?:GET|POST) +([^ ]+) HTTP");
+  static const RE2 re("(?-s)^(?:GET|POST) +([^ ]+) HTTP");
   for (auto _ : state) {
     RE2::PartialMatch(smallhttp_text, re, &a);
   }
@@ -131,7 +181,7 @@ BENCHMARK(SmallHTTPPartialMatchRE2)->ThreadRange(1, NumCPUs());
 
 void DotMatchRE2(benchmark::State& state) {
   StringPiece a;
-  RE2 re("(?-s)^(.+)");
+  static const RE2 re("(?-s)^(.+)");
   for (auto _ : state) {
     RE2::PartialMatch(http_text, re, &a);
   }
@@ -140,7 +190,7 @@ BENCHMARK(DotMatchRE2)->ThreadRange(1, NumCPUs());
 
 void ASCIIMatchRE2(benchmark::State& state) {
   StringPiece a;
-  RE2 re("(?-s)^([ -~]+)");
+  static const RE2 re("(?-s)^([ -~]+)");
   for (auto _ : state) {
     RE2::PartialMatch(http_text, re, &a);
   }
@@ -148,24 +198,18 @@ void ASCIIMatchRE2(benchmark::State& state) {
 BENCHMARK(ASCIIMatchRE2)->ThreadRange(1, NumCPUs());
 
 void ASCIIMatchRE2_text_re2_1KB(benchmark::State& state) {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string s = buffer.str();
+  std::string s = SampleText(state.range(0));
   RE2 re("(?-s)^([ -~]+)");
   for (auto _ : state) {
-    RE2::PartialMatch(s.substr(0, state.range(0)), re);
+    RE2::PartialMatch(s, re);
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(ASCIIMatchRE2_text_re2_1KB, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(ASCIIMatchRE2_text_re2_1KB, 16, 16 << 20)->RangeMultiplier(4);
 
 void Set_Match_UNANCHORED_NULL_RE2(benchmark::State& state)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string str = buffer.str().substr(0, state.range(0));
+  std::string str = SampleText(state.range(0));
   RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
   s.Add("(?s).*", NULL);
   s.Add("(?s).*$", NULL);
@@ -178,14 +222,11 @@ void Set_Match_UNANCHORED_NULL_RE2(benchmark::State& state)
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(Set_Match_UNANCHORED_NULL_RE2, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(Set_Match_UNANCHORED_NULL_RE2, 16, 16 << 20)->RangeMultiplier(4);
 
 void Set_Match_UNANCHORED_RE2(benchmark::State& state)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string str = buffer.str().substr(0, state.range(0));
+  std::string str = SampleText(state.range(0));
   RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
   s.Add("(?s).*", NULL);
   s.Add("(?s).*$", NULL);
@@ -199,14 +240,11 @@ void Set_Match_UNANCHORED_RE2(benchmark::State& state)
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(Set_Match_UNANCHORED_RE2, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(Set_Match_UNANCHORED_RE2, 16, 16 << 20)->RangeMultiplier(4);
 
 void Set_Match_ANCHOR_BOTH_NULL_RE2(benchmark::State& state)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string str = buffer.str().substr(0, state.range(0));
+  std::string str = SampleText(state.range(0));
   RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
   s.Add("(?s).*", NULL);
   s.Add("(?s).*$", NULL);
@@ -219,14 +257,11 @@ void Set_Match_ANCHOR_BOTH_NULL_RE2(benchmark::State& state)
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(Set_Match_ANCHOR_BOTH_NULL_RE2, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(Set_Match_ANCHOR_BOTH_NULL_RE2, 16, 16 << 20)->RangeMultiplier(4);
 
 void Set_Match_ANCHOR_BOTH_RE2(benchmark::State& state)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string str = buffer.str().substr(0, state.range(0));
+  std::string str = SampleText(state.range(0));
   RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
   s.Add("(?s).*", NULL);
   s.Add("(?s).*$", NULL);
@@ -240,14 +275,11 @@ void Set_Match_ANCHOR_BOTH_RE2(benchmark::State& state)
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(Set_Match_ANCHOR_BOTH_RE2, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(Set_Match_ANCHOR_BOTH_RE2, 16, 16 << 20)->RangeMultiplier(4);
 
 void Set_Match_ANCHOR_START_NULL_RE2(benchmark::State& state)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string str = buffer.str().substr(0, state.range(0));
+  std::string str = SampleText(state.range(0));
   RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_START);
   s.Add("(?s).*", NULL);
   s.Add("(?s).*$", NULL);
@@ -260,14 +292,11 @@ void Set_Match_ANCHOR_START_NULL_RE2(benchmark::State& state)
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(Set_Match_ANCHOR_START_NULL_RE2, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(Set_Match_ANCHOR_START_NULL_RE2, 16, 16 << 20)->RangeMultiplier(4);
 
 void Set_Match_ANCHOR_START_RE2(benchmark::State& state)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string str = buffer.str().substr(0, state.range(0));
+  std::string str = SampleText(state.range(0));
   RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_START);
   s.Add("(?s).*", NULL);
   s.Add("(?s).*$", NULL);
@@ -281,14 +310,682 @@ void Set_Match_ANCHOR_START_RE2(benchmark::State& state)
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
-BENCHMARK_RANGE(Set_Match_ANCHOR_START_RE2, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(Set_Match_ANCHOR_START_RE2, 16, 16 << 20)->RangeMultiplier(4);
+
+// Benchmark: routing table of 5k URL patterns, where only the first
+// (highest-priority) matching route matters. The table is built once and
+// shared, since the harness times the whole benchmark function.
+static const int kNumRoutes = 5000;
+
+static const RE2::Set& RouteSet() {
+  static const RE2::Set* const routes = []() {
+    RE2::Set* s = new RE2::Set(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+    static const char* const kinds[] = {"users", "items", "orders", "files"};
+    for (int i = 0; i < kNumRoutes - 1; i++) {
+      std::string route = "/api/v" + std::to_string(i % 3 + 1) + "/svc" +
+                          std::to_string(i / 4) + "/" + kinds[i % 4];
+      switch (i % 4) {
+        case 0: route += "/[0-9]+"; break;
+        case 1: route += "/[0-9]+/(?:detail|history)"; break;
+        case 2: route += "/[a-z0-9-]+(?:\\?.*)?"; break;
+        case 3: route += "/.+"; break;
+      }
+      CHECK_EQ(s->Add(route, NULL), i);
+    }
+    CHECK_EQ(s->Add("/.*", NULL), kNumRoutes - 1);  // catch-all
+    CHECK(s->Compile());
+    return s;
+  }();
+  return *routes;
+}
+
+static const std::vector<std::string>& RouteRequests() {
+  static const std::vector<std::string>* const requests = []() {
+    std::vector<std::string>* v = new std::vector<std::string>;
+    static const char* const kinds[] = {"users", "items", "orders", "files"};
+    static const char* const tails[] = {"/12345", "/678/history",
+                                        "/abc-42?x=1", "/a/b/c.txt"};
+    srand(1);
+    for (int j = 0; j < 1024; j++) {
+      int i = rand() % kNumRoutes;
+      // Every eighth request misses the table and falls through to the
+      // catch-all, which is the worst case for priority matching.
+      std::string svc = j % 8 == 0 ? "x" : std::to_string(i / 4);
+      v->push_back("/api/v" + std::to_string(i % 3 + 1) + "/svc" + svc +
+                   "/" + kinds[i % 4] + tails[i % 4]);
+    }
+    return v;
+  }();
+  return *requests;
+}
+
+void Set_MatchFirst_Routes_RE2(benchmark::State& state) {
+  const RE2::Set& s = RouteSet();
+  const std::vector<std::string>& requests = RouteRequests();
+  size_t i = 0;
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    const std::string& r = requests[i++ % requests.size()];
+    CHECK_GE(s.MatchFirst(r), 0);
+    bytes += r.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(Set_MatchFirst_Routes_RE2);
+
+// The same lookup done by computing every match and taking the smallest index.
+void Set_Match_Routes_RE2(benchmark::State& state) {
+  const RE2::Set& s = RouteSet();
+  const std::vector<std::string>& requests = RouteRequests();
+  std::vector<int> v;
+  size_t i = 0;
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    const std::string& r = requests[i++ % requests.size()];
+    CHECK(s.Match(r, &v));
+    CHECK_GE(*std::min_element(v.begin(), v.end()), 0);
+    bytes += r.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(Set_Match_Routes_RE2);
+
+// Returns a pool of nthreads threads. The pools are kept across runs so
+// that starting threads is not timed.
+static ThreadPool* BenchmarkPool(int nthreads) {
+  static std::mutex mu;
+  static std::map<int, ThreadPool*> pools;
+  std::lock_guard<std::mutex> l(mu);
+  ThreadPool*& pool = pools[nthreads];
+  if (pool == NULL)
+    pool = new ThreadPool(nthreads);
+  return pool;
+}
+
+// The same requests in batches of 10k through MatchMany(), on 1 to 8 threads.
+void Set_MatchMany_Routes_RE2(benchmark::State& state) {
+  ThreadPool* pool = BenchmarkPool(state.range(0));
+  const RE2::Set& s = RouteSet();
+  const std::vector<std::string>& requests = RouteRequests();
+  std::vector<StringPiece> batch;
+  int64_t batch_bytes = 0;
+  for (int i = 0; i < 10000; i++) {
+    batch.push_back(requests[i % requests.size()]);
+    batch_bytes += batch.back().size();
+  }
+  RE2::Set::MatchManyResults results;
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    CHECK(s.MatchMany(batch.data(), batch.size(), &results, pool));
+    bytes += batch_bytes;
+  }
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK_RANGE(Set_MatchMany_Routes_RE2, 1, 8);
+
+// Benchmark: ANCHOR_BOTH sets that are dictionaries of hostnames. A set of
+// literals is compiled to a hash table; adding a single non-literal pattern
+// makes the same set use the automaton, for comparison; beyond 8K hostnames
+// that automaton exceeds its default size limit and the set fails to compile.
+// Building the set is not timed. The label reports the heap used by
+// Compile().
+static std::string Hostname(int i) {
+  static const char* const tlds[] = {"com", "net", "org", "io", "co.uk"};
+  return "host" + std::to_string(i * 7919 % 1000003) + ".zone" +
+         std::to_string(i % 613) + ".example." + tlds[i % 5];
+}
+
+struct HostnameSet {
+  RE2::Set set;
+  size_t compile_bytes;
+
+  HostnameSet(int n, bool literal)
+      : set(RE2::DefaultOptions, RE2::ANCHOR_BOTH), compile_bytes(0) {
+    for (int i = 0; i < n; i++)
+      CHECK_EQ(set.Add(RE2::QuoteMeta(Hostname(i)), NULL), i);
+    if (!literal) {
+      CHECK_EQ(set.Add("x+\\.invalid", NULL), n);
+    }
+    size_t before = HeapInUse();
+    CHECK(set.Compile());
+    compile_bytes = HeapInUse() - before;
+  }
+
+  // Bytes allocated by malloc, including the chunks it mmaps directly.
+  static size_t HeapInUse() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+  }
+};
+
+static const HostnameSet& Hostnames(int n, bool literal) {
+  static std::mutex mu;
+  static std::map<std::pair<int, bool>, HostnameSet*> sets;
+  std::lock_guard<std::mutex> l(mu);
+  HostnameSet*& s = sets[std::make_pair(n, literal)];
+  if (s == NULL)
+    s = new HostnameSet(n, literal);
+  return *s;
+}
+
+static void Set_Match_Hostnames(benchmark::State& state, bool literal) {
+  const int n = state.range(0);
+  StopBenchmarkTiming();
+  const HostnameSet& s = Hostnames(n, literal);
+  // Half of the lookups hit the dictionary.
+  std::vector<std::string> texts;
+  for (int i = 0; i < 1024; i++)
+    texts.push_back(i % 2 == 0 ? Hostname(i * 131 % n) : Hostname(n + i));
+  StartBenchmarkTiming();
+  size_t i = 0;
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    const std::string& t = texts[i % texts.size()];
+    CHECK_EQ(s.set.Match(t, NULL), i % 2 == 0);
+    bytes += t.size();
+    i++;
+  }
+  state.SetBytesProcessed(bytes);
+  char buf[100];
+  snprintf(buf, sizeof buf, "compiled set %zu KB", s.compile_bytes >> 10);
+  state.SetLabel(buf);
+}
+
+void Set_Match_Hostnames_Literal_RE2(benchmark::State& state) {
+  Set_Match_Hostnames(state, true);
+}
+void Set_Match_Hostnames_Automaton_RE2(benchmark::State& state) {
+  Set_Match_Hostnames(state, false);
+}
+BENCHMARK_RANGE(Set_Match_Hostnames_Literal_RE2, 1 << 10, 1 << 19);
+BENCHMARK_RANGE(Set_Match_Hostnames_Automaton_RE2, 1 << 10, 1 << 13);
+
+// Benchmark: MatchFirst() latency while another thread keeps replacing the
+// rules. Each generation is a 1k-route table that differs from the previous
+// one, so every update compiles a new set from scratch.
+static std::vector<std::string> UpdateRules(int generation) {
+  std::vector<std::string> rules;
+  for (int i = 0; i < 1000; i++)
+    rules.push_back("/api/v1/svc" + std::to_string(i) + "/gen" +
+                    std::to_string(generation % 7) + "/[0-9]+");
+  rules.push_back("/.*");
+  return rules;
+}
+
+static int64_t NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void VersionedSet_MatchFirst_DuringUpdates_RE2(benchmark::State& state) {
+  VersionedSet vs(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+  CHECK(vs.Update(UpdateRules(0), NULL));
+  std::atomic<bool> done(false);
+  std::atomic<int> updates(0);
+  std::thread updater([&]() {
+    for (int g = 1; !done.load(); g++) {
+      CHECK(vs.Update(UpdateRules(g), NULL));
+      updates++;
+    }
+  });
+  std::string text = "/api/v1/svc999/gen0/12345";
+  for (auto _ : state) {
+    int64_t t = NowNanos();
+    CHECK_GE(vs.MatchFirst(text), 0);
+    state.AddLatency(NowNanos() - t);
+  }
+  done = true;
+  updater.join();
+  state.SetLabel(std::to_string(updates.load()) + " updates");
+}
+BENCHMARK(VersionedSet_MatchFirst_DuringUpdates_RE2);
+
+// The same workload with the external locking that a plain RE2::Set needs:
+// the new set is compiled outside the lock, but installing it (and freeing
+// the old one) happens while matchers wait.
+void LockedSet_MatchFirst_DuringUpdates_RE2(benchmark::State& state) {
+  std::mutex mu;
+  std::unique_ptr<RE2::Set> set(
+      new RE2::Set(RE2::DefaultOptions, RE2::ANCHOR_BOTH));
+  for (const std::string& rule : UpdateRules(0))
+    set->Add(rule, NULL);
+  CHECK(set->Compile());
+  std::atomic<bool> done(false);
+  std::atomic<int> updates(0);
+  std::thread updater([&]() {
+    for (int g = 1; !done.load(); g++) {
+      RE2::Set next(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+      for (const std::string& rule : UpdateRules(g))
+        next.Add(rule, NULL);
+      CHECK(next.Compile());
+      std::lock_guard<std::mutex> l(mu);
+      *set = std::move(next);
+      updates++;
+    }
+  });
+  std::string text = "/api/v1/svc999/gen0/12345";
+  for (auto _ : state) {
+    int64_t t = NowNanos();
+    {
+      std::lock_guard<std::mutex> l(mu);
+      CHECK_GE(set->MatchFirst(text), 0);
+    }
+    state.AddLatency(NowNanos() - t);
+  }
+  done = true;
+  updater.join();
+  state.SetLabel(std::to_string(updates.load()) + " updates");
+}
+BENCHMARK(LockedSet_MatchFirst_DuringUpdates_RE2);
+
+// Benchmark: FilteredRE2 over a synthetic rule corpus. The rules are built
+// from a vocabulary of made-up words, in the shapes that log and intrusion
+// detection rules take: alternations, small classes, escapes, nested groups
+// and case folding. The texts are log lines over the same vocabulary; every
+// fourth one carries a match of some rule. Finding the atoms in the texts
+// is not timed. The label reports the average number of candidate regexps
+// per text, the regexps that have no atoms, and the number of atoms.
+static std::string FilterWord(int i) {
+  static const char* const syllables[] = {
+      "ka", "lo", "mi", "ne", "ru", "ta", "vo", "zi",
+      "pe", "sha", "dor", "gun", "bex", "qua", "wil", "fyn"};
+  std::string w;
+  uint32_t x = static_cast<uint32_t>(i) * 2654435761u;
+  for (int k = 0; k < 3 + i % 2; k++) {
+    w += syllables[x & 15];
+    x >>= 4;
+  }
+  return w;
+}
+
+static std::string FilterRule(int i) {
+  std::string a = FilterWord(3 * i);
+  std::string b = FilterWord(3 * i + 1);
+  std::string c = FilterWord(3 * i + 2);
+  switch (i % 8) {
+    case 0: return a + "\\d+" + b;
+    case 1: return "(" + a + "|" + b + ")[-_]" + c;
+    case 2: return a + ".*" + b + "\\." + c;
+    case 3: return "(?i)" + a + "\\s+" + b;
+    case 4: return "\\b" + a + "(s|es)?\\b";
+    case 5: return "[a-z]+" + a + "=[0-9a-f]{8}";
+    case 6: return "(" + a + "(" + b + "|" + c + "))+";
+    default: return a + "\\[\\d+\\]";
+  }
+}
+
+// A piece of text that FilterRule(i) matches.
+static std::string FilterRuleMatch(int i) {
+  std::string a = FilterWord(3 * i);
+  std::string b = FilterWord(3 * i + 1);
+  std::string c = FilterWord(3 * i + 2);
+  switch (i % 8) {
+    case 0: return a + "42" + b;
+    case 1: return b + "_" + c;
+    case 2: return a + " and " + b + "." + c;
+    case 3: return a + "  " + b;
+    case 4: return a + "es";
+    case 5: return "x" + a + "=deadbeef";
+    case 6: return a + c + a + b;
+    default: return a + "[7]";
+  }
+}
+
+struct FilterCorpus {
+  FilteredRE2 f;
+  std::vector<std::string> atoms;
+  std::vector<std::string> texts;
+  std::vector<std::vector<int>> matched_atoms;  // per text
+  int unfiltered;
+
+  explicit FilterCorpus(int n) {
+    RE2::Options opts;
+    for (int i = 0; i < n; i++) {
+      int id;
+      CHECK_EQ(f.Add(FilterRule(i), opts, &id), RE2::NoError);
+    }
+    f.Compile(&atoms);
+    std::vector<int> always;
+    f.AllPotentials(std::vector<int>(), &always);
+    unfiltered = static_cast<int>(always.size());
+
+    srand(1);
+    for (int j = 0; j < 256; j++) {
+      std::string text = "ts=" + std::to_string(1000 + j) + " host=web" +
+                         std::to_string(j % 7) + " msg=";
+      for (int k = 0; k < 10; k++)
+        text += FilterWord(rand() % (6 * n)) + " ";
+      if (j % 4 == 0)
+        text += FilterRuleMatch(rand() % n);
+      texts.push_back(text);
+
+      std::string lower = text;
+      for (char& c : lower)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+      std::vector<int> matched;
+      for (size_t k = 0; k < atoms.size(); k++)
+        if (lower.find(atoms[k]) != std::string::npos)
+          matched.push_back(static_cast<int>(k));
+      matched_atoms.push_back(matched);
+    }
+  }
+};
+
+static const FilterCorpus& FilterRules(int n) {
+  static std::mutex mu;
+  static std::map<int, FilterCorpus*> corpora;
+  std::lock_guard<std::mutex> l(mu);
+  FilterCorpus*& c = corpora[n];
+  if (c == NULL)
+    c = new FilterCorpus(n);
+  return *c;
+}
+
+static void FilteredRE2_AllPotentials(benchmark::State& state, int n) {
+  StopBenchmarkTiming();
+  const FilterCorpus& c = FilterRules(n);
+  StartBenchmarkTiming();
+  std::vector<int> potentials;
+  size_t i = 0;
+  int64_t candidates = 0;
+  for (auto _ : state) {
+    c.f.AllPotentials(c.matched_atoms[i % c.texts.size()], &potentials);
+    candidates += potentials.size();
+    i++;
+  }
+  char buf[100];
+  snprintf(buf, sizeof buf, "%.1f candidates/text\t%d unfiltered\t%zu atoms",
+           i == 0 ? 0.0 : (double)candidates / i, c.unfiltered,
+           c.atoms.size());
+  state.SetLabel(buf);
+}
+
+void FilteredRE2_AllPotentials_10K(benchmark::State& state) {
+  FilteredRE2_AllPotentials(state, 10000);
+}
+BENCHMARK(FilteredRE2_AllPotentials_10K);
+
+void FilteredRE2_AllPotentials_50K(benchmark::State& state) {
+  FilteredRE2_AllPotentials(state, 50000);
+}
+BENCHMARK(FilteredRE2_AllPotentials_50K);
+
+// The atoms of each text are found beforehand, as a caller with its own
+// string matcher would; about one text in four matches a rule.
+static void FilteredRE2_AllMatches(benchmark::State& state, int n) {
+  StopBenchmarkTiming();
+  const FilterCorpus& c = FilterRules(n);
+  StartBenchmarkTiming();
+  std::vector<int> matching;
+  size_t i = 0;
+  int64_t matches = 0;
+  for (auto _ : state) {
+    size_t j = i % c.texts.size();
+    c.f.AllMatches(c.texts[j], c.matched_atoms[j], &matching);
+    matches += matching.size();
+    i++;
+  }
+  char buf[100];
+  snprintf(buf, sizeof buf, "%.2f matches/text",
+           i == 0 ? 0.0 : (double)matches / i);
+  state.SetLabel(buf);
+}
+
+void FilteredRE2_AllMatches_10K(benchmark::State& state) {
+  FilteredRE2_AllMatches(state, 10000);
+}
+BENCHMARK(FilteredRE2_AllMatches_10K);
+
+// Every regexp is a candidate, as when the atoms filter nothing out.
+static void FilteredRE2_AllMatches_AllCandidates(benchmark::State& state,
+                                                 int n) {
+  StopBenchmarkTiming();
+  const FilterCorpus& c = FilterRules(n);
+  std::vector<int> all;
+  for (size_t k = 0; k < c.atoms.size(); k++)
+    all.push_back(static_cast<int>(k));
+  StartBenchmarkTiming();
+  std::vector<int> matching;
+  size_t i = 0;
+  for (auto _ : state) {
+    c.f.AllMatches(c.texts[i % c.texts.size()], all, &matching);
+    i++;
+  }
+}
+
+void FilteredRE2_AllMatches_AllCandidates_1K(benchmark::State& state) {
+  FilteredRE2_AllMatches_AllCandidates(state, 1000);
+}
+BENCHMARK(FilteredRE2_AllMatches_AllCandidates_1K);
+
+static void FilteredRE2_Scan(benchmark::State& state, int n) {
+  StopBenchmarkTiming();
+  const FilterCorpus& c = FilterRules(n);
+  StartBenchmarkTiming();
+  std::vector<int> matching;
+  size_t i = 0;
+  int64_t matches = 0;
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    const std::string& text = c.texts[i % c.texts.size()];
+    c.f.Scan(text, &matching);
+    matches += matching.size();
+    bytes += text.size();
+    i++;
+  }
+  state.SetBytesProcessed(bytes);
+  char buf[100];
+  snprintf(buf, sizeof buf, "%.2f matches/text",
+           i == 0 ? 0.0 : (double)matches / i);
+  state.SetLabel(buf);
+}
+
+void FilteredRE2_Scan_10K(benchmark::State& state) {
+  FilteredRE2_Scan(state, 10000);
+}
+BENCHMARK(FilteredRE2_Scan_10K);
+
+// Skewed traffic for FirstMatch: nine texts in ten carry a match of one of
+// a few hot rules, most often the first of them; the rest carry a match of
+// any rule. The hot rules come late in the rule list, behind the rules that
+// are candidates for every text, as they would when rules are added in the
+// order they were written.
+struct SkewedTraffic {
+  std::vector<std::string> texts;
+  std::vector<std::vector<int>> matched_atoms;  // per text
+  FilteredRE2 adaptive;
+
+  explicit SkewedTraffic(int n) {
+    const FilterCorpus& c = FilterRules(n);
+    RE2::Options opts;
+    for (int i = 0; i < n; i++) {
+      int id;
+      CHECK_EQ(adaptive.Add(FilterRule(i), opts, &id), RE2::NoError);
+    }
+    std::vector<std::string> atoms;
+    adaptive.Compile(&atoms);
+    adaptive.EnableAdaptiveFirstMatch(std::vector<int>());
+
+    srand(2);
+    for (int j = 0; j < 1024; j++) {
+      std::string text = "ts=" + std::to_string(1000 + j) + " msg=";
+      for (int k = 0; k < 10; k++)
+        text += FilterWord(rand() % (6 * n)) + " ";
+      if (j % 10 != 0) {
+        // Rule n - 8 * 37 with probability 1/2, the next one 1/4, and
+        // so on.
+        int hot = 0;
+        while (hot < 7 && rand() % 2 == 0)
+          hot++;
+        text += FilterRuleMatch(n - (8 - hot) * 37);
+      } else {
+        text += FilterRuleMatch(rand() % n);
+      }
+      texts.push_back(text);
+
+      std::string lower = text;
+      for (char& ch : lower)
+        ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+      std::vector<int> matched;
+      for (size_t k = 0; k < c.atoms.size(); k++)
+        if (lower.find(c.atoms[k]) != std::string::npos)
+          matched.push_back(static_cast<int>(k));
+      matched_atoms.push_back(matched);
+    }
+  }
+};
+
+static SkewedTraffic* SkewedTexts(int n) {
+  static std::mutex mu;
+  static std::map<int, SkewedTraffic*> traffic;
+  std::lock_guard<std::mutex> l(mu);
+  SkewedTraffic*& t = traffic[n];
+  if (t == NULL)
+    t = new SkewedTraffic(n);
+  return t;
+}
+
+static void FilteredRE2_FirstMatch_Skewed(benchmark::State& state, int n,
+                                          bool adaptive) {
+  StopBenchmarkTiming();
+  const FilterCorpus& c = FilterRules(n);
+  SkewedTraffic* t = SkewedTexts(n);
+  const FilteredRE2& f = adaptive ? t->adaptive : c.f;
+  StartBenchmarkTiming();
+  size_t i = 0;
+  int64_t matched = 0;
+  for (auto _ : state) {
+    size_t j = i % t->texts.size();
+    if (f.FirstMatch(t->texts[j], t->matched_atoms[j]) >= 0)
+      matched++;
+    i++;
+  }
+  char buf[100];
+  snprintf(buf, sizeof buf, "%.2f matched",
+           i == 0 ? 0.0 : (double)matched / i);
+  state.SetLabel(buf);
+}
+
+void FilteredRE2_FirstMatch_Skewed_10K(benchmark::State& state) {
+  FilteredRE2_FirstMatch_Skewed(state, 10000, false);
+}
+BENCHMARK(FilteredRE2_FirstMatch_Skewed_10K);
+
+void FilteredRE2_FirstMatch_Skewed_Adaptive_10K(benchmark::State& state) {
+  FilteredRE2_FirstMatch_Skewed(state, 10000, true);
+}
+BENCHMARK(FilteredRE2_FirstMatch_Skewed_Adaptive_10K);
+
+// Starting up with the rules: building them with Add and Compile, against
+// loading an index saved by SaveIndex. The label of the LoadIndex runs
+// includes the time of the first Scan, which compiles the regexps that it
+// needs.
+static void FilteredRE2_Build(benchmark::State& state, int n) {
+  StopBenchmarkTiming();
+  std::vector<std::string> rules;
+  for (int i = 0; i < n; i++)
+    rules.push_back(FilterRule(i));
+  RE2::Options opts;
+  StartBenchmarkTiming();
+  for (auto _ : state) {
+    FilteredRE2 f;
+    for (int i = 0; i < n; i++) {
+      int id;
+      f.Add(rules[i], opts, &id);
+    }
+    std::vector<std::string> atoms;
+    f.Compile(&atoms);
+  }
+}
+
+void FilteredRE2_Build_10K(benchmark::State& state) {
+  FilteredRE2_Build(state, 10000);
+}
+BENCHMARK(FilteredRE2_Build_10K);
+
+// The same startup with AddBatch on 1 to 8 threads, and the rules added to
+// an RE2::Set with AddBatch.
+void FilteredRE2_AddBatch_10K(benchmark::State& state) {
+  StopBenchmarkTiming();
+  ThreadPool* pool = BenchmarkPool(state.range(0));
+  std::vector<std::string> rules;
+  for (int i = 0; i < 10000; i++)
+    rules.push_back(FilterRule(i));
+  std::vector<StringPiece> patterns(rules.begin(), rules.end());
+  RE2::Options opts;
+  StartBenchmarkTiming();
+  for (auto _ : state) {
+    FilteredRE2 f;
+    std::vector<int> ids;
+    CHECK(f.AddBatch(patterns, opts, &ids, NULL, pool));
+    std::vector<std::string> atoms;
+    f.Compile(&atoms);
+  }
+}
+BENCHMARK_RANGE(FilteredRE2_AddBatch_10K, 1, 8);
+
+void Set_AddBatch_10K(benchmark::State& state) {
+  StopBenchmarkTiming();
+  ThreadPool* pool = BenchmarkPool(state.range(0));
+  std::vector<std::string> rules;
+  for (int i = 0; i < 10000; i++)
+    rules.push_back(FilterRule(i));
+  std::vector<StringPiece> patterns(rules.begin(), rules.end());
+  StartBenchmarkTiming();
+  for (auto _ : state) {
+    RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+    std::vector<int> indices;
+    CHECK(s.AddBatch(patterns, &indices, NULL, pool));
+  }
+}
+BENCHMARK_RANGE(Set_AddBatch_10K, 1, 8);
+
+// Returns the path of a new, empty file of its own in $TMPDIR (or /tmp),
+// so that runs of the benchmark do not collide or litter the tree.
+static std::string TempIndexPath() {
+  const char* dir = getenv("TMPDIR");
+  std::string path = std::string(dir != NULL && *dir != '\0' ? dir : "/tmp") +
+                     "/regexp_benchmark.index.XXXXXX";
+  int fd = mkstemp(&path[0]);
+  CHECK_GE(fd, 0) << "cannot create " << path;
+  close(fd);
+  return path;
+}
+
+static void FilteredRE2_LoadIndex(benchmark::State& state, int n) {
+  StopBenchmarkTiming();
+  const FilterCorpus& c = FilterRules(n);
+  const std::string path = TempIndexPath();
+  CHECK(c.f.SaveIndex(path));
+  StartBenchmarkTiming();
+  int64_t first_scan_ns = 0;
+  int64_t iters = 0;
+  for (auto _ : state) {
+    FilteredRE2 f;
+    std::vector<std::string> atoms;
+    CHECK(f.LoadIndex(path, &atoms));
+    int64_t t = NowNanos();
+    std::vector<int> matching;
+    f.Scan(c.texts[0], &matching);
+    first_scan_ns += NowNanos() - t;
+    iters++;
+  }
+  unlink(path.c_str());
+  char buf[100];
+  snprintf(buf, sizeof buf, "%.1fus first scan",
+           iters == 0 ? 0.0 : first_scan_ns / 1e3 / iters);
+  state.SetLabel(buf);
+}
+
+void FilteredRE2_LoadIndex_10K(benchmark::State& state) {
+  FilteredRE2_LoadIndex(state, 10000);
+}
+BENCHMARK(FilteredRE2_LoadIndex_10K);
 
 void Rure_Find_RE2(benchmark::State& state, const char *regexp)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string s = buffer.str().substr(0, state.range(0));
+  std::string s = SampleText(state.range(0));
   rure_error *err = rure_error_new();
   rure *re1 = rure_compile((const uint8_t *)regexp, strlen(regexp), RURE_DEFAULT_FLAGS, NULL, err);
   rure_match match = {0};
@@ -301,10 +998,7 @@ void Rure_Find_RE2(benchmark::State& state, const char *regexp)
 
 void Rure_is_Match_RE2(benchmark::State& state, const char *regexp)
 {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string s = buffer.str().substr(0, state.range(0));
+  std::string s = SampleText(state.range(0));
   rure_error *err = rure_error_new();
   rure *re1 = rure_compile((const uint8_t *)regexp, strlen(regexp), RURE_DEFAULT_FLAGS, NULL, err);
   for (auto _ : state) {
@@ -354,18 +1048,15 @@ void FullMatch_DotStar_CachedRE2(benchmark::State& state)  { FullMatchRE2(state,
 void FullMatch_DotStarDollar_CachedRE2(benchmark::State& state)  { FullMatchRE2(state, "(?s).*$"); }
 void FullMatch_DotStarCapture_CachedRE2(benchmark::State& state)  { FullMatchRE2(state, "(?s)((.*)()()($))"); }
 
-BENCHMARK_RANGE(FullMatch_DotStar_CachedRE2,  2 << 6, 2 << 9);
-BENCHMARK_RANGE(FullMatch_DotStarDollar_CachedRE2,  2 << 6, 2 << 9);
-BENCHMARK_RANGE(FullMatch_DotStarCapture_CachedRE2,  2 << 6, 2 << 9);
+BENCHMARK_RANGE(FullMatch_DotStar_CachedRE2, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(FullMatch_DotStarDollar_CachedRE2, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(FullMatch_DotStarCapture_CachedRE2, 16, 16 << 20)->RangeMultiplier(4);
 
 void FullMatchRE2_text_re2_1KB(benchmark::State& state, const char *regexp) {
-  std::ifstream in("../../re2/testing/text_re2_1KB.txt");
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  std::string s = buffer.str();
+  std::string s = SampleText(state.range(0));
   RE2 re(regexp, RE2::Latin1);
   for (auto _ : state) {
-    CHECK(RE2::FullMatch(s.substr(0, state.range(0)), re));
+    CHECK(RE2::FullMatch(s, re));
   }
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
@@ -375,9 +1066,9 @@ void FullMatch_RE2_DotStar_text_re2_1KB(benchmark::State& state)  { FullMatchRE2
 void FullMatch_RE2_DotStarDollar_text_re2_1KB(benchmark::State& state)  { FullMatchRE2_text_re2_1KB(state, "(?s).*$"); }
 void FullMatch_RE2_DotStarCapture_text_re2_1KB(benchmark::State& state)  { FullMatchRE2_text_re2_1KB(state, "(?s)((.*)()()($))"); }
 
-BENCHMARK_RANGE(FullMatch_RE2_DotStar_text_re2_1KB, 2 << 6, 2 << 9);
-BENCHMARK_RANGE(FullMatch_RE2_DotStarDollar_text_re2_1KB, 2 << 6, 2 << 9);
-BENCHMARK_RANGE(FullMatch_RE2_DotStarCapture_text_re2_1KB, 2 << 6, 2 << 9);
+BENCHMARK_RANGE(FullMatch_RE2_DotStar_text_re2_1KB, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(FullMatch_RE2_DotStarDollar_text_re2_1KB, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(FullMatch_RE2_DotStarCapture_text_re2_1KB, 16, 16 << 20)->RangeMultiplier(4);
 
 void FullMatchRE2_text_dotnl_10(benchmark::State& state, const char *regexp) {
   const char * s = "aaa\nbbb\nccc\nddd\neee\naaa\nbbb\nccc\nddd\neee\nppp\n";
@@ -420,4 +1111,1051 @@ BENCHMARK_RANGE(FullMatch_RE2_text_dotnl_10, 2 << 9, 2 << 9);
 BENCHMARK_RANGE(FullMatch_RE2_text_dotnl_30, 2 << 9, 2 << 9);
 BENCHMARK_RANGE(FullMatch_RE2_text_dotnl_90, 2 << 9, 2 << 9);
 
+// Size sweeps: each kind of match call over 16 bytes to 16MB of random
+// text, in steps of 4x, with the only match at the very end of the text
+// (_Hit) and with no match (_NoHit). After the sizes of a sweep the
+// harness prints its fit (see FitSweep in benchmark.cc): the fixed cost
+// of a call, which is mostly that of crossing into Rust and setting up
+// the search, and the MB/s of the scan once that cost no longer counts.
+enum SweepCall {
+  kSweepPartialMatch,
+  kSweepPartialMatchCapture,
+  kSweepFullMatch,
+  kSweepSetMatch,
+};
+
+static const char kSweepNeedle[] = "ABCDEFGHIJ";
+
+static void SweepMatch(benchmark::State& state, SweepCall call, bool hit) {
+  StopBenchmarkTiming();
+  int64_t n = state.range(0);
+  int64_t needle = sizeof kSweepNeedle - 1;
+  std::string text = hit ? RandomText(n - needle) + kSweepNeedle
+                         : RandomText(n);
+  RE2 literal(kSweepNeedle);
+  RE2 capture("(ABC[D-F]+)GHIJ");
+  RE2 dotstar("(?s).*ABCDEFGHIJ");
+  RE2::Set set(RE2::DefaultOptions, RE2::UNANCHORED);
+  CHECK_EQ(set.Add(kSweepNeedle, NULL), 0);
+  CHECK_EQ(set.Add("KLMNOPQRST", NULL), 1);
+  CHECK_EQ(set.Add("abc[0-9]{8}xyz", NULL), 2);
+  CHECK(set.Compile());
+  std::vector<int> v;
+  StringPiece m;
+  StartBenchmarkTiming();
+  switch (call) {
+    case kSweepPartialMatch:
+      for (auto _ : state)
+        CHECK_EQ(RE2::PartialMatch(text, literal), hit);
+      break;
+    case kSweepPartialMatchCapture:
+      for (auto _ : state)
+        CHECK_EQ(RE2::PartialMatch(text, capture, &m), hit);
+      break;
+    case kSweepFullMatch:
+      for (auto _ : state)
+        CHECK_EQ(RE2::FullMatch(text, dotstar), hit);
+      break;
+    case kSweepSetMatch:
+      for (auto _ : state)
+        CHECK_EQ(set.Match(text, &v), hit);
+      break;
+  }
+  state.SetBytesProcessed(state.iterations() * n);
+}
+
+void Sweep_PartialMatch_Hit(benchmark::State& state)  { SweepMatch(state, kSweepPartialMatch, true); }
+void Sweep_PartialMatch_NoHit(benchmark::State& state)  { SweepMatch(state, kSweepPartialMatch, false); }
+void Sweep_PartialMatchCapture_Hit(benchmark::State& state)  { SweepMatch(state, kSweepPartialMatchCapture, true); }
+void Sweep_PartialMatchCapture_NoHit(benchmark::State& state)  { SweepMatch(state, kSweepPartialMatchCapture, false); }
+void Sweep_FullMatch_Hit(benchmark::State& state)  { SweepMatch(state, kSweepFullMatch, true); }
+void Sweep_FullMatch_NoHit(benchmark::State& state)  { SweepMatch(state, kSweepFullMatch, false); }
+void Sweep_SetMatch_Hit(benchmark::State& state)  { SweepMatch(state, kSweepSetMatch, true); }
+void Sweep_SetMatch_NoHit(benchmark::State& state)  { SweepMatch(state, kSweepSetMatch, false); }
+
+BENCHMARK_RANGE(Sweep_PartialMatch_Hit, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(Sweep_PartialMatch_NoHit, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(Sweep_PartialMatchCapture_Hit, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(Sweep_PartialMatchCapture_NoHit, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(Sweep_FullMatch_Hit, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(Sweep_FullMatch_NoHit, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(Sweep_SetMatch_Hit, 16, 16 << 20)->RangeMultiplier(4);
+BENCHMARK_RANGE(Sweep_SetMatch_NoHit, 16, 16 << 20)->RangeMultiplier(4);
+
+// The regexps of the regex-performance suite, whose results are quoted in
+// test-results.txt and README.md, over a corpus like its 3200.txt (the
+// works of Mark Twain, 16 MB) that is generated here: wrapped lines of
+// sentences of English words, with the names, -ing words, quotes and
+// symbols that the regexps look for, chosen by a fixed pseudo-random
+// sequence. The corpus is the same on every machine and at every commit,
+// so the times can be compared across commits (see make benchcmp).
+// Generating it is not timed. Each benchmark counts the matches in the
+// whole corpus, as regex-performance does, either with FindAndConsume or
+// with Match from the end of the last match; the label gives the count.
+static const int kCorpusSize = 16 << 20;
+
+static const std::string& EnglishCorpus() {
+  static const std::string* const corpus = []() {
+    static const char* const common[] = {
+        "the", "and", "of", "to", "a", "in", "was", "he", "that", "it",
+        "his", "her", "you", "with", "I", "had", "for", "on", "at", "as",
+        "but", "him", "said", "she", "not", "they", "be", "all", "so",
+        "were", "there", "would", "out", "up", "them", "we", "one", "what",
+        "by", "when", "from", "about", "been", "could", "down", "then",
+        "no", "if", "time", "old", "man", "now", "got", "my", "little",
+        "very", "know", "over", "here", "day", "way", "came", "went",
+        "come", "see", "more", "before", "never", "which", "house",
+        "water", "boys", "night", "good", "long", "away", "back", "just",
+        "because", "right", "great", "around", "other", "some", "people",
+        "town", "woods", "morning", "nothing", "something", "going",
+        "thing", "being", "looking", "coming", "saying", "thinking",
+        "evening", "anything", "everything", "next", "six", "box", "fox",
+        "explain", "examine", "extra", "exactly", "wax", "mixed",
+    };
+    static const char* const rare[] = {
+        "Tom", "Sawyer", "Huck", "Huckleberry", "Finn", "Twain", "Jim",
+        "Becky", "Polly", "Joe", "Injun", "river", "raft", "island",
+        "Mississippi", "shore", "steamboat", "lawyer", "inn", "Penn",
+        "Ann", "washing", "fishing", "wishing", "rushing", "pushing",
+        "splashing", "dashing", "finishing", "laughing", "whispering",
+        "TOM", "tom", "Twain's", "bawling", "yawning",
+    };
+    static const char* const symbols[] = {
+        "+", "=", "<", ">", "|", "~", "\xc2\xb1", "\xc3\x97", "\xc3\xb7",
+        "\xe2\x88\x9e", "\xe2\x9c\x93",
+    };
+    std::string* text = new std::string;
+    text->reserve(kCorpusSize + 1024);
+    uint64_t x = 88172645463325252ull;
+    auto next = [&x](uint32_t n) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      return static_cast<uint32_t>((x >> 16) % n);
+    };
+    size_t column = 0;
+    auto add_word = [&](const std::string& w) {
+      if (column > 0 && column + 1 + w.size() > 70) {
+        *text += '\n';
+        column = 0;
+      } else if (column > 0) {
+        *text += ' ';
+        column++;
+      }
+      *text += w;
+      column += w.size();
+    };
+    while (static_cast<int>(text->size()) < kCorpusSize) {
+      // One sentence in ten is a short quoted remark.
+      bool quoted = next(10) == 0;
+      int nwords = quoted ? 2 + next(5) : 4 + next(20);
+      std::string sentence;
+      for (int i = 0; i < nwords; i++) {
+        std::string w;
+        uint32_t r = next(1000);
+        if (r < 20)
+          w = rare[next(arraysize(rare))];
+        else if (r == 20 && next(20) == 0)
+          w = symbols[next(arraysize(symbols))];
+        else
+          w = common[next(arraysize(common))];
+        if (i == 0 && w[0] >= 'a' && w[0] <= 'z')
+          w[0] = static_cast<char>(w[0] - 'a' + 'A');
+        if (i + 1 < nwords && next(6) == 0)
+          w += ',';
+        if (i + 1 == nwords)
+          w += ".?!"[next(5) < 3 ? 0 : 1 + next(2)];
+        if (quoted && i == 0)
+          w = "\"" + w;
+        if (quoted && i + 1 == nwords)
+          w += '"';
+        add_word(w);
+      }
+      if (next(8) == 0) {
+        *text += "\n\n";
+        column = 0;
+      }
+    }
+    text->resize(text->rfind('\n', kCorpusSize) + 1);
+    return text;
+  }();
+  return *corpus;
+}
+
+static void CorpusFindAndConsume(benchmark::State& state, const char* regexp) {
+  StopBenchmarkTiming();
+  const std::string& text = EnglishCorpus();
+  RE2 re(regexp);
+  CHECK(re.ok());
+  StartBenchmarkTiming();
+  int64_t matches = 0;
+  for (auto _ : state) {
+    matches = 0;
+    StringPiece input(text);
+    while (RE2::FindAndConsume(&input, re))
+      matches++;
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+  state.SetLabel(std::to_string(matches) + " matches");
+}
+
+static void CorpusMatch(benchmark::State& state, const char* regexp) {
+  StopBenchmarkTiming();
+  const std::string& text = EnglishCorpus();
+  RE2 re(regexp);
+  CHECK(re.ok());
+  StartBenchmarkTiming();
+  int64_t matches = 0;
+  for (auto _ : state) {
+    matches = 0;
+    size_t pos = 0;
+    StringPiece m;
+    while (pos <= text.size() &&
+           re.Match(text, pos, text.size(), RE2::UNANCHORED, &m, 1)) {
+      matches++;
+      size_t end = m.data() + m.size() - text.data();
+      pos = end > pos ? end : pos + 1;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+  state.SetLabel(std::to_string(matches) + " matches");
+}
+
+void Corpus_Twain_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "Twain"); }
+void Corpus_TwainNoCase_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "(?i)Twain"); }
+void Corpus_LetterShing_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "[a-z]shing"); }
+void Corpus_HuckSaw_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "Huck[a-zA-Z]+|Saw[a-zA-Z]+"); }
+void Corpus_WordNn_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "\\b\\w+nn\\b"); }
+void Corpus_AqX_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "[a-q][^u-z]{13}x"); }
+void Corpus_Names_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "Tom|Sawyer|Huckleberry|Finn"); }
+void Corpus_NamesNoCase_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "(?i)Tom|Sawyer|Huckleberry|Finn"); }
+void Corpus_Dot0to2Names_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, ".{0,2}(Tom|Sawyer|Huckleberry|Finn)"); }
+void Corpus_Dot2to4Names_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, ".{2,4}(Tom|Sawyer|Huckleberry|Finn)"); }
+void Corpus_TomRiver_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "Tom.{10,25}river|river.{10,25}Tom"); }
+void Corpus_LettersIng_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "[a-zA-Z]+ing"); }
+void Corpus_SpaceIng_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "\\s[a-zA-Z]{0,12}ing\\s"); }
+void Corpus_AwyerInn_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "([A-Za-z]awyer|[A-Za-z]inn)\\s"); }
+void Corpus_Quote_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "[\"'][^\"']{0,30}[?!\\.][\"']"); }
+void Corpus_InfinityCheck_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "\xe2\x88\x9e|\xe2\x9c\x93"); }
+void Corpus_MathSymbol_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "\\p{Sm}"); }
+void Corpus_Commas13Z_FindAndConsume(benchmark::State& state)  { CorpusFindAndConsume(state, "(.*?,){13}z"); }
+
+void Corpus_Twain_Match(benchmark::State& state)  { CorpusMatch(state, "Twain"); }
+void Corpus_TwainNoCase_Match(benchmark::State& state)  { CorpusMatch(state, "(?i)Twain"); }
+void Corpus_LetterShing_Match(benchmark::State& state)  { CorpusMatch(state, "[a-z]shing"); }
+void Corpus_HuckSaw_Match(benchmark::State& state)  { CorpusMatch(state, "Huck[a-zA-Z]+|Saw[a-zA-Z]+"); }
+void Corpus_WordNn_Match(benchmark::State& state)  { CorpusMatch(state, "\\b\\w+nn\\b"); }
+void Corpus_AqX_Match(benchmark::State& state)  { CorpusMatch(state, "[a-q][^u-z]{13}x"); }
+void Corpus_Names_Match(benchmark::State& state)  { CorpusMatch(state, "Tom|Sawyer|Huckleberry|Finn"); }
+void Corpus_NamesNoCase_Match(benchmark::State& state)  { CorpusMatch(state, "(?i)Tom|Sawyer|Huckleberry|Finn"); }
+void Corpus_Dot0to2Names_Match(benchmark::State& state)  { CorpusMatch(state, ".{0,2}(Tom|Sawyer|Huckleberry|Finn)"); }
+void Corpus_Dot2to4Names_Match(benchmark::State& state)  { CorpusMatch(state, ".{2,4}(Tom|Sawyer|Huckleberry|Finn)"); }
+void Corpus_TomRiver_Match(benchmark::State& state)  { CorpusMatch(state, "Tom.{10,25}river|river.{10,25}Tom"); }
+void Corpus_LettersIng_Match(benchmark::State& state)  { CorpusMatch(state, "[a-zA-Z]+ing"); }
+void Corpus_SpaceIng_Match(benchmark::State& state)  { CorpusMatch(state, "\\s[a-zA-Z]{0,12}ing\\s"); }
+void Corpus_AwyerInn_Match(benchmark::State& state)  { CorpusMatch(state, "([A-Za-z]awyer|[A-Za-z]inn)\\s"); }
+void Corpus_Quote_Match(benchmark::State& state)  { CorpusMatch(state, "[\"'][^\"']{0,30}[?!\\.][\"']"); }
+void Corpus_InfinityCheck_Match(benchmark::State& state)  { CorpusMatch(state, "\xe2\x88\x9e|\xe2\x9c\x93"); }
+void Corpus_MathSymbol_Match(benchmark::State& state)  { CorpusMatch(state, "\\p{Sm}"); }
+void Corpus_Commas13Z_Match(benchmark::State& state)  { CorpusMatch(state, "(.*?,){13}z"); }
+
+BENCHMARK(Corpus_Twain_FindAndConsume);
+BENCHMARK(Corpus_TwainNoCase_FindAndConsume);
+BENCHMARK(Corpus_LetterShing_FindAndConsume);
+BENCHMARK(Corpus_HuckSaw_FindAndConsume);
+BENCHMARK(Corpus_WordNn_FindAndConsume);
+BENCHMARK(Corpus_AqX_FindAndConsume);
+BENCHMARK(Corpus_Names_FindAndConsume);
+BENCHMARK(Corpus_NamesNoCase_FindAndConsume);
+BENCHMARK(Corpus_Dot0to2Names_FindAndConsume);
+BENCHMARK(Corpus_Dot2to4Names_FindAndConsume);
+BENCHMARK(Corpus_TomRiver_FindAndConsume);
+BENCHMARK(Corpus_LettersIng_FindAndConsume);
+BENCHMARK(Corpus_SpaceIng_FindAndConsume);
+BENCHMARK(Corpus_AwyerInn_FindAndConsume);
+BENCHMARK(Corpus_Quote_FindAndConsume);
+BENCHMARK(Corpus_InfinityCheck_FindAndConsume);
+BENCHMARK(Corpus_MathSymbol_FindAndConsume);
+BENCHMARK(Corpus_Commas13Z_FindAndConsume);
+
+BENCHMARK(Corpus_Twain_Match);
+BENCHMARK(Corpus_TwainNoCase_Match);
+BENCHMARK(Corpus_LetterShing_Match);
+BENCHMARK(Corpus_HuckSaw_Match);
+BENCHMARK(Corpus_WordNn_Match);
+BENCHMARK(Corpus_AqX_Match);
+BENCHMARK(Corpus_Names_Match);
+BENCHMARK(Corpus_NamesNoCase_Match);
+BENCHMARK(Corpus_Dot0to2Names_Match);
+BENCHMARK(Corpus_Dot2to4Names_Match);
+BENCHMARK(Corpus_TomRiver_Match);
+BENCHMARK(Corpus_LettersIng_Match);
+BENCHMARK(Corpus_SpaceIng_Match);
+BENCHMARK(Corpus_AwyerInn_Match);
+BENCHMARK(Corpus_Quote_Match);
+BENCHMARK(Corpus_InfinityCheck_Match);
+BENCHMARK(Corpus_MathSymbol_Match);
+BENCHMARK(Corpus_Commas13Z_Match);
+
+// Memory report, printed by regexp_benchmark --memory: what each compiled
+// object keeps allocated, and what each kind of call allocates once its
+// object is warm. The counts come from the malloc replacement in
+// malloc_counter.cc, which sees the Rust allocations too; the Rust share
+// is only known if regex-capi was built with its count-alloc feature
+// (make CAPI_FEATURES=count-alloc), and is "-" otherwise.
+struct HeapSnapshot {
+  testing::MallocCounts c;
+  rure_alloc_counts rust;
+  bool has_rust;
+};
+
+static HeapSnapshot TakeHeapSnapshot() {
+  HeapSnapshot s;
+  s.c = testing::GetMallocCounts();
+  s.has_rust = rure_get_alloc_counts(&s.rust);
+  return s;
+}
+
+static std::string RustColumn(bool has_rust, const char* format, double v) {
+  if (!has_rust)
+    return "-";
+  char buf[40];
+  snprintf(buf, sizeof buf, format, v);
+  return buf;
+}
+
+// Reports the heap that build() leaves allocated, which is the size of
+// the object that it returns. The object is then deleted.
+template <typename T>
+static void ReportObjectMemory(const char* name, T* (*build)()) {
+  HeapSnapshot before = TakeHeapSnapshot();
+  T* obj = build();
+  HeapSnapshot after = TakeHeapSnapshot();
+  printf("%s\t%lld\t%s\t%lld\n", name,
+         (long long)(after.c.bytes_in_use - before.c.bytes_in_use),
+         RustColumn(after.has_rust, "%.0f",
+                    (double)(after.rust.bytes_in_use -
+                             before.rust.bytes_in_use)).c_str(),
+         (long long)(after.c.allocs - before.c.allocs));
+  delete obj;
+}
+
+// Reports the allocations per call of call(i), after warming up.
+static void ReportCallMemory(const char* name,
+                             const std::function<void(int)>& call) {
+  const int kWarmup = 100;
+  const int kCalls = 10000;
+  for (int i = 0; i < kWarmup; i++)
+    call(i);
+  HeapSnapshot before = TakeHeapSnapshot();
+  for (int i = 0; i < kCalls; i++)
+    call(i);
+  HeapSnapshot after = TakeHeapSnapshot();
+  printf("%s\t%.2f\t%.1f\t%s\n", name,
+         (double)(after.c.allocs - before.c.allocs) / kCalls,
+         (double)(after.c.bytes_allocated - before.c.bytes_allocated) / kCalls,
+         RustColumn(after.has_rust, "%.2f",
+                    (double)(after.rust.allocs - before.rust.allocs) / kCalls)
+             .c_str());
+}
+
+static const char kHTTPRegexp[] = "(?-s)^(?:GET|POST) +([^ ]+) HTTP";
+
+static RE2* BuildLiteralRE2() { return new RE2("abcdefg"); }
+static RE2* BuildHTTPRE2() { return new RE2(kHTTPRegexp); }
+static RE2* BuildUnicodeRE2() { return new RE2("\\p{L}+\\d{3,5}"); }
+static RE2* BuildAlternationRE2() {
+  std::string alt;
+  for (int i = 0; i < 1000; i++)
+    alt += (i == 0 ? "" : "|") + FilterWord(i);
+  return new RE2(alt);
+}
+static RE2::Set* BuildRouteSet() {
+  RE2::Set* s = new RE2::Set(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+  for (const std::string& rule : UpdateRules(0))
+    s->Add(rule, NULL);
+  CHECK(s->Compile());
+  return s;
+}
+static FilteredRE2* BuildFilteredRE2() {
+  FilteredRE2* f = new FilteredRE2;
+  RE2::Options opts;
+  for (int i = 0; i < 1000; i++) {
+    int id;
+    f->Add(FilterRule(i), opts, &id);
+  }
+  std::vector<std::string> atoms;
+  f->Compile(&atoms);
+  return f;
+}
+
+// Compile cost: building RE2s, an RE2::Set and a FilteredRE2 from 1, 1K
+// and more patterns of four shapes, and one RE2 of a large alternation.
+// The patterns of a collection are all different, and the time includes
+// deleting what was built, as a reload does. The label gives the memory
+// of one build, measured once outside the timed loop: the heap that the
+// built object holds, the heap allocated while building it and in how
+// many blocks, and the Rust share of the first if regex-capi counts it.
+// The largest collections are what fits in a few GB and a few minutes:
+// an RE2 holds 30 to 500 KB, and compiling a Set grows faster than its
+// size (100K alternations take minutes).
+enum CompileShape {
+  kCompileLiteral,
+  kCompileAlternation,
+  kCompileUnicodeClass,
+  kCompileCountedRepetition,
+};
+
+static std::vector<std::string> CompilePatterns(CompileShape shape, int n) {
+  std::vector<std::string> patterns;
+  for (int i = 0; i < n; i++) {
+    std::string id = std::to_string(i);
+    switch (shape) {
+      case kCompileLiteral:
+        patterns.push_back(FilterWord(i) + id + "value");
+        break;
+      case kCompileAlternation: {
+        std::string alt;
+        for (int k = 0; k < 16; k++)
+          alt += (k == 0 ? "" : "|") + FilterWord(16 * i + k);
+        patterns.push_back("(?:" + alt + ")" + id);
+        break;
+      }
+      case kCompileUnicodeClass:
+        patterns.push_back("\\p{Greek}+" + id + "[\\p{Lu}\\p{Nd}]{2}");
+        break;
+      case kCompileCountedRepetition:
+        patterns.push_back("id" + id + "=[0-9a-f]{8,16}-[a-z]{3}");
+        break;
+    }
+  }
+  return patterns;
+}
+
+// Builds what the benchmark times, with malloc counting on, and returns
+// the label. Each benchmark measures it only the first time it runs.
+template <typename T>
+static std::string CompileMemoryLabel(const std::string& key,
+                                      const std::function<T*()>& build) {
+  static std::mutex mu;
+  static std::map<std::string, std::string> labels;
+  std::lock_guard<std::mutex> l(mu);
+  std::string& label = labels[key];
+  if (!label.empty())
+    return label;
+
+  testing::SetMallocCounting(true);
+  HeapSnapshot before = TakeHeapSnapshot();
+  T* obj = build();
+  HeapSnapshot after = TakeHeapSnapshot();
+  delete obj;
+  testing::SetMallocCounting(false);
+  char buf[200];
+  snprintf(buf, sizeof buf, "%.0f KB live (rust %s), %.0f KB in %lld allocs",
+           (after.c.bytes_in_use - before.c.bytes_in_use) / 1024.0,
+           RustColumn(after.has_rust, "%.0f KB",
+                      (after.rust.bytes_in_use - before.rust.bytes_in_use) /
+                          1024.0).c_str(),
+           (after.c.bytes_allocated - before.c.bytes_allocated) / 1024.0,
+           (long long)(after.c.allocs - before.c.allocs));
+  label = buf;
+  return label;
+}
+
+typedef std::vector<std::unique_ptr<RE2>> RE2List;
+
+static RE2List* BuildRE2List(const std::vector<std::string>& patterns) {
+  RE2List* list = new RE2List;
+  list->reserve(patterns.size());
+  for (const std::string& pattern : patterns)
+    list->emplace_back(new RE2(pattern));
+  return list;
+}
+
+// A large Set needs a large max_mem; see RE2::Set::Compile.
+static RE2::Set* BuildCompileSet(const std::vector<std::string>& patterns) {
+  RE2::Options opts;
+  opts.set_max_mem(int64_t{2} << 30);
+  RE2::Set* s = new RE2::Set(opts, RE2::UNANCHORED);
+  for (const std::string& pattern : patterns)
+    CHECK_GE(s->Add(pattern, NULL), 0);
+  CHECK(s->Compile());
+  return s;
+}
+
+static FilteredRE2* BuildCompileFilteredRE2(
+    const std::vector<std::string>& patterns) {
+  FilteredRE2* f = new FilteredRE2;
+  RE2::Options opts;
+  for (const std::string& pattern : patterns) {
+    int id;
+    f->Add(pattern, opts, &id);
+  }
+  std::vector<std::string> atoms;
+  f->Compile(&atoms);
+  return f;
+}
+
+static void CompileRE2s(benchmark::State& state,
+                        const std::vector<std::string>& patterns,
+                        const std::string& key) {
+  state.SetLabel(CompileMemoryLabel<RE2List>(
+      key, [&]() { return BuildRE2List(patterns); }));
+  for (auto _ : state)
+    std::unique_ptr<RE2List> list(BuildRE2List(patterns));
+}
+
+static void CompileRE2s(benchmark::State& state, CompileShape shape, int n) {
+  StopBenchmarkTiming();
+  std::vector<std::string> patterns = CompilePatterns(shape, n);
+  StartBenchmarkTiming();
+  CompileRE2s(state, patterns,
+              "RE2/" + std::to_string(shape) + "/" + std::to_string(n));
+}
+
+static void CompileSet(benchmark::State& state, CompileShape shape, int n) {
+  StopBenchmarkTiming();
+  std::vector<std::string> patterns = CompilePatterns(shape, n);
+  state.SetLabel(CompileMemoryLabel<RE2::Set>(
+      "Set/" + std::to_string(shape) + "/" + std::to_string(n),
+      [&]() { return BuildCompileSet(patterns); }));
+  StartBenchmarkTiming();
+  for (auto _ : state)
+    std::unique_ptr<RE2::Set> s(BuildCompileSet(patterns));
+}
+
+static void CompileFilteredRE2(benchmark::State& state, CompileShape shape,
+                               int n) {
+  StopBenchmarkTiming();
+  std::vector<std::string> patterns = CompilePatterns(shape, n);
+  state.SetLabel(CompileMemoryLabel<FilteredRE2>(
+      "FilteredRE2/" + std::to_string(shape) + "/" + std::to_string(n),
+      [&]() { return BuildCompileFilteredRE2(patterns); }));
+  StartBenchmarkTiming();
+  for (auto _ : state)
+    std::unique_ptr<FilteredRE2> f(BuildCompileFilteredRE2(patterns));
+}
+
+void Compile_RE2_Literal_1(benchmark::State& state) {
+  CompileRE2s(state, kCompileLiteral, 1);
+}
+BENCHMARK(Compile_RE2_Literal_1);
+
+void Compile_RE2_Alternation_1(benchmark::State& state) {
+  CompileRE2s(state, kCompileAlternation, 1);
+}
+BENCHMARK(Compile_RE2_Alternation_1);
+
+void Compile_RE2_UnicodeClass_1(benchmark::State& state) {
+  CompileRE2s(state, kCompileUnicodeClass, 1);
+}
+BENCHMARK(Compile_RE2_UnicodeClass_1);
+
+void Compile_RE2_CountedRepetition_1(benchmark::State& state) {
+  CompileRE2s(state, kCompileCountedRepetition, 1);
+}
+BENCHMARK(Compile_RE2_CountedRepetition_1);
+
+// One RE2 of 1000 alternatives, the words of the alternation patterns.
+void Compile_RE2_LargeAlternation_1(benchmark::State& state) {
+  StopBenchmarkTiming();
+  std::string alt;
+  for (int i = 0; i < 1000; i++)
+    alt += (i == 0 ? "" : "|") + FilterWord(i);
+  StartBenchmarkTiming();
+  CompileRE2s(state, std::vector<std::string>{alt}, "RE2/large_alternation");
+}
+BENCHMARK(Compile_RE2_LargeAlternation_1);
+
+void Compile_RE2_Literal_1K(benchmark::State& state) {
+  CompileRE2s(state, kCompileLiteral, 1000);
+}
+BENCHMARK(Compile_RE2_Literal_1K);
+
+void Compile_RE2_Alternation_1K(benchmark::State& state) {
+  CompileRE2s(state, kCompileAlternation, 1000);
+}
+BENCHMARK(Compile_RE2_Alternation_1K);
+
+void Compile_RE2_UnicodeClass_1K(benchmark::State& state) {
+  CompileRE2s(state, kCompileUnicodeClass, 1000);
+}
+BENCHMARK(Compile_RE2_UnicodeClass_1K);
+
+void Compile_RE2_CountedRepetition_1K(benchmark::State& state) {
+  CompileRE2s(state, kCompileCountedRepetition, 1000);
+}
+BENCHMARK(Compile_RE2_CountedRepetition_1K);
+
+void Compile_RE2_Literal_10K(benchmark::State& state) {
+  CompileRE2s(state, kCompileLiteral, 10000);
+}
+BENCHMARK(Compile_RE2_Literal_10K);
+
+void Compile_RE2_CountedRepetition_10K(benchmark::State& state) {
+  CompileRE2s(state, kCompileCountedRepetition, 10000);
+}
+BENCHMARK(Compile_RE2_CountedRepetition_10K);
+
+void Compile_Set_Literal_1(benchmark::State& state) {
+  CompileSet(state, kCompileLiteral, 1);
+}
+BENCHMARK(Compile_Set_Literal_1);
+
+void Compile_Set_Alternation_1(benchmark::State& state) {
+  CompileSet(state, kCompileAlternation, 1);
+}
+BENCHMARK(Compile_Set_Alternation_1);
+
+void Compile_Set_UnicodeClass_1(benchmark::State& state) {
+  CompileSet(state, kCompileUnicodeClass, 1);
+}
+BENCHMARK(Compile_Set_UnicodeClass_1);
+
+void Compile_Set_CountedRepetition_1(benchmark::State& state) {
+  CompileSet(state, kCompileCountedRepetition, 1);
+}
+BENCHMARK(Compile_Set_CountedRepetition_1);
+
+void Compile_Set_Literal_1K(benchmark::State& state) {
+  CompileSet(state, kCompileLiteral, 1000);
+}
+BENCHMARK(Compile_Set_Literal_1K);
+
+void Compile_Set_Alternation_1K(benchmark::State& state) {
+  CompileSet(state, kCompileAlternation, 1000);
+}
+BENCHMARK(Compile_Set_Alternation_1K);
+
+void Compile_Set_UnicodeClass_1K(benchmark::State& state) {
+  CompileSet(state, kCompileUnicodeClass, 1000);
+}
+BENCHMARK(Compile_Set_UnicodeClass_1K);
+
+void Compile_Set_CountedRepetition_1K(benchmark::State& state) {
+  CompileSet(state, kCompileCountedRepetition, 1000);
+}
+BENCHMARK(Compile_Set_CountedRepetition_1K);
+
+void Compile_Set_Alternation_10K(benchmark::State& state) {
+  CompileSet(state, kCompileAlternation, 10000);
+}
+BENCHMARK(Compile_Set_Alternation_10K);
+
+void Compile_Set_Literal_100K(benchmark::State& state) {
+  CompileSet(state, kCompileLiteral, 100000);
+}
+BENCHMARK(Compile_Set_Literal_100K);
+
+void Compile_Set_CountedRepetition_100K(benchmark::State& state) {
+  CompileSet(state, kCompileCountedRepetition, 100000);
+}
+BENCHMARK(Compile_Set_CountedRepetition_100K);
+
+void Compile_FilteredRE2_Literal_1(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileLiteral, 1);
+}
+BENCHMARK(Compile_FilteredRE2_Literal_1);
+
+void Compile_FilteredRE2_Alternation_1(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileAlternation, 1);
+}
+BENCHMARK(Compile_FilteredRE2_Alternation_1);
+
+void Compile_FilteredRE2_UnicodeClass_1(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileUnicodeClass, 1);
+}
+BENCHMARK(Compile_FilteredRE2_UnicodeClass_1);
+
+void Compile_FilteredRE2_CountedRepetition_1(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileCountedRepetition, 1);
+}
+BENCHMARK(Compile_FilteredRE2_CountedRepetition_1);
+
+void Compile_FilteredRE2_Literal_1K(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileLiteral, 1000);
+}
+BENCHMARK(Compile_FilteredRE2_Literal_1K);
+
+void Compile_FilteredRE2_Alternation_1K(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileAlternation, 1000);
+}
+BENCHMARK(Compile_FilteredRE2_Alternation_1K);
+
+void Compile_FilteredRE2_UnicodeClass_1K(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileUnicodeClass, 1000);
+}
+BENCHMARK(Compile_FilteredRE2_UnicodeClass_1K);
+
+void Compile_FilteredRE2_CountedRepetition_1K(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileCountedRepetition, 1000);
+}
+BENCHMARK(Compile_FilteredRE2_CountedRepetition_1K);
+
+void Compile_FilteredRE2_Literal_10K(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileLiteral, 10000);
+}
+BENCHMARK(Compile_FilteredRE2_Literal_10K);
+
+void Compile_FilteredRE2_CountedRepetition_10K(benchmark::State& state) {
+  CompileFilteredRE2(state, kCompileCountedRepetition, 10000);
+}
+BENCHMARK(Compile_FilteredRE2_CountedRepetition_10K);
+
+// Rewriting and parsing: Replace, GlobalReplace, Extract, Rewrite,
+// QuoteMeta and the Arg parsers, the calls that sanitizers and extractors
+// make. The inputs are the 1KB sample and the first 1MB and 16MB of the
+// English corpus above; the dense regexp matches every few bytes of both,
+// the sparse one a few times per 10KB of the corpus and nowhere in the
+// sample, whose sparse variants time the failed search. Replace and
+// GlobalReplace rewrite their input in place, so the time includes
+// copying it for each call. Extract stops at the first match, so it
+// reports no MB/s. The label gives the matches in the input and
+// the heap allocated by one call, measured once outside the timed loop.
+static const char kDenseRegexp[] = "([aeiou])([a-z])";
+static const char kSparseRegexp[] = "(T)(wain)";
+
+static std::string RewriteText(int64_t nbytes) {
+  if (nbytes == 1 << 10)
+    return SampleText(nbytes);
+  return EnglishCorpus().substr(0, nbytes);
+}
+
+// Calls call(&s) on a copy s of text once to warm up and once more with
+// malloc counting on, and returns the label. Each benchmark measures it
+// only the first time it runs.
+static std::string CallMemoryLabel(
+    const std::string& key, const std::string& text,
+    const std::function<void(std::string*)>& call) {
+  static std::mutex mu;
+  static std::map<std::string, std::string> labels;
+  std::lock_guard<std::mutex> l(mu);
+  std::string& label = labels[key];
+  if (!label.empty())
+    return label;
+
+  std::string s = text;
+  call(&s);
+  s = text;
+  testing::SetMallocCounting(true);
+  HeapSnapshot before = TakeHeapSnapshot();
+  call(&s);
+  HeapSnapshot after = TakeHeapSnapshot();
+  testing::SetMallocCounting(false);
+  char buf[100];
+  snprintf(buf, sizeof buf, "%lld allocs, %.1f KB per call",
+           (long long)(after.c.allocs - before.c.allocs),
+           (after.c.bytes_allocated - before.c.bytes_allocated) / 1024.0);
+  label = buf;
+  return label;
+}
+
+static int64_t CountMatches(const std::string& text, const RE2& re) {
+  int64_t matches = 0;
+  StringPiece input(text);
+  while (RE2::FindAndConsume(&input, re))
+    matches++;
+  return matches;
+}
+
+enum RewriteCall {
+  kReplace,
+  kGlobalReplace,
+  kExtract,
+};
+
+static void RewriteBenchmark(benchmark::State& state, RewriteCall which,
+                             const char* regexp, int64_t nbytes) {
+  StopBenchmarkTiming();
+  std::string text = RewriteText(nbytes);
+  RE2 re(regexp);
+  CHECK(re.ok());
+  static const char kRewrite[] = "<\\2\\1>";
+  std::function<void(std::string*)> call;
+  switch (which) {
+    case kReplace:
+      call = [&](std::string* s) { RE2::Replace(s, re, kRewrite); };
+      break;
+    case kGlobalReplace:
+      call = [&](std::string* s) { RE2::GlobalReplace(s, re, kRewrite); };
+      break;
+    case kExtract:
+      call = [&](std::string* s) {
+        std::string out;
+        RE2::Extract(*s, re, kRewrite, &out);
+      };
+      break;
+  }
+  std::string label =
+      std::to_string(CountMatches(text, re)) + " matches, " +
+      CallMemoryLabel(std::to_string(which) + "/" + regexp + "/" +
+                          std::to_string(nbytes),
+                      text, call);
+  StartBenchmarkTiming();
+  if (which == kExtract) {
+    for (auto _ : state)
+      call(&text);
+  } else {
+    for (auto _ : state) {
+      std::string s = text;
+      call(&s);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+  }
+  state.SetLabel(label);
+}
+
+void Replace_Dense_1KB(benchmark::State& state)  { RewriteBenchmark(state, kReplace, kDenseRegexp, 1 << 10); }
+void Replace_Dense_1MB(benchmark::State& state)  { RewriteBenchmark(state, kReplace, kDenseRegexp, 1 << 20); }
+void Replace_Dense_16MB(benchmark::State& state)  { RewriteBenchmark(state, kReplace, kDenseRegexp, 16 << 20); }
+void Replace_Sparse_1KB(benchmark::State& state)  { RewriteBenchmark(state, kReplace, kSparseRegexp, 1 << 10); }
+void Replace_Sparse_1MB(benchmark::State& state)  { RewriteBenchmark(state, kReplace, kSparseRegexp, 1 << 20); }
+void Replace_Sparse_16MB(benchmark::State& state)  { RewriteBenchmark(state, kReplace, kSparseRegexp, 16 << 20); }
+
+void GlobalReplace_Dense_1KB(benchmark::State& state)  { RewriteBenchmark(state, kGlobalReplace, kDenseRegexp, 1 << 10); }
+void GlobalReplace_Dense_1MB(benchmark::State& state)  { RewriteBenchmark(state, kGlobalReplace, kDenseRegexp, 1 << 20); }
+void GlobalReplace_Dense_16MB(benchmark::State& state)  { RewriteBenchmark(state, kGlobalReplace, kDenseRegexp, 16 << 20); }
+void GlobalReplace_Sparse_1KB(benchmark::State& state)  { RewriteBenchmark(state, kGlobalReplace, kSparseRegexp, 1 << 10); }
+void GlobalReplace_Sparse_1MB(benchmark::State& state)  { RewriteBenchmark(state, kGlobalReplace, kSparseRegexp, 1 << 20); }
+void GlobalReplace_Sparse_16MB(benchmark::State& state)  { RewriteBenchmark(state, kGlobalReplace, kSparseRegexp, 16 << 20); }
+
+void Extract_Dense_1KB(benchmark::State& state)  { RewriteBenchmark(state, kExtract, kDenseRegexp, 1 << 10); }
+void Extract_Dense_1MB(benchmark::State& state)  { RewriteBenchmark(state, kExtract, kDenseRegexp, 1 << 20); }
+void Extract_Dense_16MB(benchmark::State& state)  { RewriteBenchmark(state, kExtract, kDenseRegexp, 16 << 20); }
+void Extract_Sparse_1KB(benchmark::State& state)  { RewriteBenchmark(state, kExtract, kSparseRegexp, 1 << 10); }
+void Extract_Sparse_1MB(benchmark::State& state)  { RewriteBenchmark(state, kExtract, kSparseRegexp, 1 << 20); }
+void Extract_Sparse_16MB(benchmark::State& state)  { RewriteBenchmark(state, kExtract, kSparseRegexp, 16 << 20); }
+
+BENCHMARK(Replace_Dense_1KB);
+BENCHMARK(Replace_Dense_1MB);
+BENCHMARK(Replace_Dense_16MB);
+BENCHMARK(Replace_Sparse_1KB);
+BENCHMARK(Replace_Sparse_1MB);
+BENCHMARK(Replace_Sparse_16MB);
+
+BENCHMARK(GlobalReplace_Dense_1KB);
+BENCHMARK(GlobalReplace_Dense_1MB);
+BENCHMARK(GlobalReplace_Dense_16MB);
+BENCHMARK(GlobalReplace_Sparse_1KB);
+BENCHMARK(GlobalReplace_Sparse_1MB);
+BENCHMARK(GlobalReplace_Sparse_16MB);
+
+BENCHMARK(Extract_Dense_1KB);
+BENCHMARK(Extract_Dense_1MB);
+BENCHMARK(Extract_Dense_16MB);
+BENCHMARK(Extract_Sparse_1KB);
+BENCHMARK(Extract_Sparse_1MB);
+BENCHMARK(Extract_Sparse_16MB);
+
+// Rewrite of the submatches of one match, with a short rewrite and with
+// one that references every group many times; it does not depend on the
+// input size.
+static void RewriteSubmatches(benchmark::State& state, const char* rewrite) {
+  StopBenchmarkTiming();
+  RE2 re("(\\w+)@(\\w+)\\.(\\w+)");
+  std::string text = "mail: someone@example.com";
+  StringPiece vec[4];
+  CHECK(re.Match(text, 0, text.size(), RE2::UNANCHORED, vec, 4));
+  std::string out;
+  std::string label = CallMemoryLabel(
+      std::string("Rewrite/") + rewrite, text, [&](std::string*) {
+        out.clear();
+        re.Rewrite(&out, rewrite, vec, 4);
+      });
+  StartBenchmarkTiming();
+  for (auto _ : state) {
+    out.clear();
+    CHECK(re.Rewrite(&out, rewrite, vec, 4));
+  }
+  state.SetLabel(label);
+}
+
+void Rewrite_Short(benchmark::State& state)  { RewriteSubmatches(state, "\\2/\\1"); }
+void Rewrite_Long(benchmark::State& state)  { RewriteSubmatches(state, "user=\\1 host=\\2 tld=\\3 addr=\\1@\\2.\\3 match=\\0 user=\\1 host=\\2 tld=\\3 addr=\\1@\\2.\\3 match=\\0"); }
+BENCHMARK(Rewrite_Short);
+BENCHMARK(Rewrite_Long);
+
+// QuoteMeta of the inputs above: the sample has no metacharacters, the
+// corpus has punctuation and UTF-8 symbols to quote.
+static void QuoteMetaText(benchmark::State& state, int64_t nbytes) {
+  StopBenchmarkTiming();
+  std::string text = RewriteText(nbytes);
+  std::string label = CallMemoryLabel(
+      "QuoteMeta/" + std::to_string(nbytes), text,
+      [](std::string* s) { RE2::QuoteMeta(*s); });
+  StartBenchmarkTiming();
+  for (auto _ : state)
+    RE2::QuoteMeta(text);
+  state.SetBytesProcessed(state.iterations() * text.size());
+  state.SetLabel(label);
+}
+
+void QuoteMeta_1KB(benchmark::State& state)  { QuoteMetaText(state, 1 << 10); }
+void QuoteMeta_1MB(benchmark::State& state)  { QuoteMetaText(state, 1 << 20); }
+void QuoteMeta_16MB(benchmark::State& state)  { QuoteMetaText(state, 16 << 20); }
+BENCHMARK(QuoteMeta_1KB);
+BENCHMARK(QuoteMeta_1MB);
+BENCHMARK(QuoteMeta_16MB);
+
+// The Arg parsers: FullMatch of one field parsed into each kind of
+// argument, and no argument for comparison.
+template <typename A>
+static void ParseArg(benchmark::State& state, const char* regexp,
+                     const char* text, const A& arg) {
+  StopBenchmarkTiming();
+  RE2 re(regexp);
+  CHECK(re.ok());
+  std::string label = CallMemoryLabel(
+      std::string("Arg/") + regexp + "/" + text, text,
+      [&](std::string* s) { RE2::FullMatch(*s, re, arg); });
+  StartBenchmarkTiming();
+  for (auto _ : state)
+    CHECK(RE2::FullMatch(text, re, arg));
+  state.SetLabel(label);
+}
+
+void Arg_None(benchmark::State& state) {
+  StopBenchmarkTiming();
+  RE2 re("-?\\d+");
+  StartBenchmarkTiming();
+  for (auto _ : state)
+    CHECK(RE2::FullMatch("-1234567", re));
+}
+void Arg_Int(benchmark::State& state) {
+  int v;
+  ParseArg(state, "(-?\\d+)", "-1234567", &v);
+}
+void Arg_Int64(benchmark::State& state) {
+  int64_t v;
+  ParseArg(state, "(-?\\d+)", "-1234567890123", &v);
+}
+void Arg_Double(benchmark::State& state) {
+  double v;
+  ParseArg(state, "([-+.\\de]+)", "-3.14159e10", &v);
+}
+void Arg_Hex(benchmark::State& state) {
+  uint32_t v;
+  ParseArg(state, "([0-9a-f]+)", "deadbeef", RE2::Hex(&v));
+}
+void Arg_CRadix(benchmark::State& state) {
+  uint32_t v;
+  ParseArg(state, "(0x[0-9a-f]+)", "0x1f2e3d", RE2::CRadix(&v));
+}
+void Arg_String(benchmark::State& state) {
+  std::string v;
+  ParseArg(state, "(\\w+)", "some_identifier", &v);
+}
+void Arg_StringPiece(benchmark::State& state) {
+  StringPiece v;
+  ParseArg(state, "(\\w+)", "some_identifier", &v);
+}
+BENCHMARK(Arg_None);
+BENCHMARK(Arg_Int);
+BENCHMARK(Arg_Int64);
+BENCHMARK(Arg_Double);
+BENCHMARK(Arg_Hex);
+BENCHMARK(Arg_CRadix);
+BENCHMARK(Arg_String);
+BENCHMARK(Arg_StringPiece);
+
+// An extractor's loop: FindAndConsume of every key=value pair in 1MB and
+// 16MB of them, parsing each value as an int.
+static void ArgScan(benchmark::State& state, int64_t nbytes) {
+  StopBenchmarkTiming();
+  std::string text;
+  text.reserve(nbytes + 32);
+  for (int i = 0; static_cast<int64_t>(text.size()) < nbytes; i++)
+    text += "k" + std::to_string(i % 100) + "=" + std::to_string(i * 7919 % 1000000) +
+            " ";
+  RE2 re("=(\\d+)");
+  StartBenchmarkTiming();
+  int64_t sum = 0;
+  for (auto _ : state) {
+    StringPiece input(text);
+    int v;
+    while (RE2::FindAndConsume(&input, re, &v))
+      sum += v;
+  }
+  CHECK_NE(sum, 0);
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void Arg_Int_Scan_1MB(benchmark::State& state)  { ArgScan(state, 1 << 20); }
+void Arg_Int_Scan_16MB(benchmark::State& state)  { ArgScan(state, 16 << 20); }
+BENCHMARK(Arg_Int_Scan_1MB);
+BENCHMARK(Arg_Int_Scan_16MB);
+
+void MemoryUsage() {
+  testing::SetMallocCounting(true);
+  HeapSnapshot start = TakeHeapSnapshot();
+  if (!start.has_rust)
+    printf("# regex-capi was built without count-alloc: no Rust columns\n");
+
+  printf("# object\tbytes\trust_bytes\tallocs\n");
+  ReportObjectMemory("RE2 literal", BuildLiteralRE2);
+  ReportObjectMemory("RE2 http", BuildHTTPRE2);
+  ReportObjectMemory("RE2 unicode_class", BuildUnicodeRE2);
+  ReportObjectMemory("RE2 alternation_1k", BuildAlternationRE2);
+  ReportObjectMemory("RE2::Set routes_1k", BuildRouteSet);
+  ReportObjectMemory("FilteredRE2 rules_1k", BuildFilteredRE2);
+
+  printf("# call\tallocs_per_call\tbytes_per_call\trust_allocs_per_call\n");
+  std::unique_ptr<RE2> http(BuildHTTPRE2());
+  std::string request = http_text;
+  ReportCallMemory("RE2::FullMatch", [&](int) {
+    RE2::FullMatch(request, *http);
+  });
+  ReportCallMemory("RE2::PartialMatch", [&](int) {
+    CHECK(RE2::PartialMatch(request, *http));
+  });
+  ReportCallMemory("RE2::PartialMatch 1 capture", [&](int) {
+    StringPiece path;
+    CHECK(RE2::PartialMatch(request, *http, &path));
+  });
+  ReportCallMemory("RE2::FindAndConsume", [&](int) {
+    StringPiece input(request);
+    StringPiece path;
+    CHECK(RE2::FindAndConsume(&input, *http, &path));
+  });
+
+  std::unique_ptr<RE2::Set> set(BuildRouteSet());
+  std::vector<std::string> routes;
+  for (int i = 0; i < 100; i++)
+    routes.push_back("/api/v1/svc" + std::to_string(i * 7) + "/gen0/42");
+  std::vector<int> v;
+  ReportCallMemory("RE2::Set::Match", [&](int i) {
+    set->Match(routes[i % routes.size()], &v);
+  });
+  ReportCallMemory("RE2::Set::MatchFirst", [&](int i) {
+    set->MatchFirst(routes[i % routes.size()]);
+  });
+
+  std::unique_ptr<FilteredRE2> f(BuildFilteredRE2());
+  std::vector<std::string> texts;
+  for (int i = 0; i < 100; i++)
+    texts.push_back("ts=1 msg=" + FilterWord(i) + " " + FilterRuleMatch(i));
+  std::vector<int> matching;
+  ReportCallMemory("FilteredRE2::Scan", [&](int i) {
+    f->Scan(texts[i % texts.size()], &matching);
+  });
+
+  RE2 dense(kDenseRegexp);
+  std::string out;
+  ReportCallMemory("RE2::Replace", [&](int) {
+    std::string s = request;
+    RE2::Replace(&s, dense, "<\\2\\1>");
+  });
+  ReportCallMemory("RE2::GlobalReplace", [&](int) {
+    std::string s = request;
+    RE2::GlobalReplace(&s, dense, "<\\2\\1>");
+  });
+  ReportCallMemory("RE2::Extract", [&](int) {
+    RE2::Extract(request, dense, "<\\2\\1>", &out);
+  });
+  ReportCallMemory("RE2::QuoteMeta", [&](int) {
+    RE2::QuoteMeta(request);
+  });
+  testing::SetMallocCounting(false);
+}
+
 }  // namespace re2
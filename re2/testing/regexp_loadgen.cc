@@ -0,0 +1,362 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// An open-loop load generator: issues calls at a fixed rate over a corpus
+// and reports the percentiles of their latencies.
+//
+//   regexp_loadgen [-mode=partial|set|filtered] [-qps=N] [-threads=N]
+//                  [-seconds=N] [-hist] RULES CORPUS
+//
+// RULES holds one regexp per line and CORPUS one text per line; empty
+// lines are skipped. Each call is one of
+//
+//   partial   RE2::PartialMatch of one rule against one text; the calls
+//             go through every pair of rule and text in turn,
+//   set       RE2::Set::Match of all the rules against one text,
+//   filtered  FilteredRE2::Scan of all the rules against one text.
+//
+// The calls are issued at -qps calls per second in all, shared evenly
+// among -threads threads, for -seconds seconds. The benchmarks in
+// regexp_benchmark are closed loops: each call starts when the one before
+// it ends, so a call that stalls also holds back the calls that would have
+// been made while it ran, and those never see the stall. Here every call
+// has a time at which it is due, fixed before the run, and its latency is
+// measured from then rather than from when it actually started. A call
+// that starts late because the ones before it ran long is charged for the
+// wait, as a client sending at a fixed rate would see it. This corrects for
+// what is known as coordinated omission. The report gives both the
+// corrected latency and the service time, measured from the actual start.
+//
+// The latencies are kept in histograms with buckets a fraction of a
+// percent wide at every magnitude, like an HdrHistogram, so percentiles
+// down to p99.99 cost no more to keep than the median. -hist prints the
+// corrected histogram as well. Lines that start with '#' are summaries and
+// column headings.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "re2/filtered_re2.h"
+#include "re2/re2.h"
+#include "re2/set.h"
+
+namespace {
+
+// A histogram of latencies in ns. Values below kSubBuckets get a bucket
+// each; above that, each power of two is split into kSubBuckets/2 buckets
+// of equal width, so that a bucket is never wider than 1/64 of the values
+// in it.
+class Histogram {
+ public:
+  static const int kSubBits = 7;
+  static const int64_t kSubBuckets = int64_t{1} << kSubBits;
+
+  Histogram() : counts_((64 - kSubBits + 1) * (kSubBuckets / 2), 0),
+                total_(0), max_(0) {}
+
+  void Add(int64_t ns) {
+    if (ns < 0)
+      ns = 0;
+    counts_[Index(ns)]++;
+    total_++;
+    max_ = std::max(max_, ns);
+  }
+
+  void Merge(const Histogram& h) {
+    for (size_t i = 0; i < counts_.size(); i++)
+      counts_[i] += h.counts_[i];
+    total_ += h.total_;
+    max_ = std::max(max_, h.max_);
+  }
+
+  int64_t total() const { return total_; }
+  int64_t max() const { return max_; }
+
+  // Returns the highest value in the bucket of the value at fraction p of
+  // the way through the recorded values, 0 <= p <= 1.
+  int64_t Percentile(double p) const {
+    if (total_ == 0)
+      return 0;
+    int64_t rank = static_cast<int64_t>(p * (total_ - 1)) + 1;
+    int64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+      seen += counts_[i];
+      if (seen >= rank)
+        return std::min(Highest(static_cast<int>(i)), max_);
+    }
+    return max_;
+  }
+
+  // Prints the non-empty buckets: the highest value in each, the fraction
+  // of the values at or below it, and the count.
+  void Print() const {
+    printf("# value_ns\tpercentile\tcount\n");
+    int64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+      if (counts_[i] == 0)
+        continue;
+      seen += counts_[i];
+      printf("%lld\t%.6f\t%lld\n",
+             static_cast<long long>(
+                 std::min(Highest(static_cast<int>(i)), max_)),
+             static_cast<double>(seen) / total_,
+             static_cast<long long>(counts_[i]));
+    }
+  }
+
+ private:
+  static int Index(int64_t v) {
+    if (v < kSubBuckets)
+      return static_cast<int>(v);
+    int msb = 63 - __builtin_clzll(static_cast<uint64_t>(v));
+    int shift = msb - kSubBits + 1;
+    // v >> shift is in [kSubBuckets/2, kSubBuckets).
+    return static_cast<int>(shift * (kSubBuckets / 2) + (v >> shift));
+  }
+
+  static int64_t Highest(int i) {
+    if (i < kSubBuckets)
+      return i;
+    int shift = static_cast<int>((i - kSubBuckets) / (kSubBuckets / 2)) + 1;
+    int64_t sub = (i - kSubBuckets) % (kSubBuckets / 2) + kSubBuckets / 2;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  std::vector<int64_t> counts_;
+  int64_t total_;
+  int64_t max_;
+};
+
+enum Mode { kPartial, kSet, kFiltered };
+
+// A thread that is early sleeps until this long before its next call is
+// due and spins the rest of the way: sleeps overshoot by tens of
+// microseconds, which would be charged to the call.
+const int64_t kSpinNs = 200 * 1000;
+
+// What one thread records.
+struct Results {
+  Histogram corrected;  // from when each call was due
+  Histogram service;    // from when each call started
+  int64_t calls = 0;
+  int64_t matches = 0;
+  int64_t late = 0;     // calls that started a period or more after due
+  int64_t end_ns = 0;   // when the last call ended
+};
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool ReadLines(const char* path, std::vector<std::string>* lines) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty())
+      lines->push_back(line);
+  }
+  return true;
+}
+
+void Usage() {
+  fprintf(stderr,
+          "usage: regexp_loadgen [-mode=partial|set|filtered] [-qps=N] "
+          "[-threads=N] [-seconds=N] [-hist] RULES CORPUS\n");
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Mode mode = kPartial;
+  double qps = 1000;
+  int threads = 1;
+  double seconds = 10;
+  bool hist = false;
+  std::vector<const char*> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-mode=partial") == 0)
+      mode = kPartial;
+    else if (strcmp(argv[i], "-mode=set") == 0)
+      mode = kSet;
+    else if (strcmp(argv[i], "-mode=filtered") == 0)
+      mode = kFiltered;
+    else if (strncmp(argv[i], "-qps=", 5) == 0)
+      qps = atof(argv[i] + 5);
+    else if (strncmp(argv[i], "-threads=", 9) == 0)
+      threads = atoi(argv[i] + 9);
+    else if (strncmp(argv[i], "-seconds=", 9) == 0)
+      seconds = atof(argv[i] + 9);
+    else if (strcmp(argv[i], "-hist") == 0)
+      hist = true;
+    else if (argv[i][0] == '-')
+      Usage();
+    else
+      paths.push_back(argv[i]);
+  }
+  if (paths.size() != 2 || qps <= 0 || threads < 1 || seconds <= 0)
+    Usage();
+
+  std::vector<std::string> rules;
+  std::vector<std::string> corpus;
+  if (!ReadLines(paths[0], &rules)) {
+    fprintf(stderr, "cannot read %s\n", paths[0]);
+    return 1;
+  }
+  if (!ReadLines(paths[1], &corpus)) {
+    fprintf(stderr, "cannot read %s\n", paths[1]);
+    return 1;
+  }
+  if (corpus.empty()) {
+    fprintf(stderr, "no texts\n");
+    return 1;
+  }
+
+  // Rules that do not compile are left out, as filtered_re2_report does.
+  RE2::Options options;
+  options.set_log_errors(false);
+  std::vector<std::unique_ptr<RE2>> res;
+  RE2::Set set(options, RE2::UNANCHORED);
+  re2::FilteredRE2 filtered;
+  for (size_t i = 0; i < rules.size(); i++) {
+    std::unique_ptr<RE2> re(new RE2(rules[i], options));
+    if (!re->ok()) {
+      fprintf(stderr, "skipping rule %zu: %s\n", i + 1, rules[i].c_str());
+      continue;
+    }
+    res.push_back(std::move(re));
+    int id;
+    if (mode == kSet && set.Add(rules[i], NULL) < 0) {
+      fprintf(stderr, "RE2::Set cannot add rule %zu\n", i + 1);
+      return 1;
+    }
+    if (mode == kFiltered &&
+        filtered.Add(rules[i], options, &id) != RE2::NoError) {
+      fprintf(stderr, "FilteredRE2 cannot add rule %zu\n", i + 1);
+      return 1;
+    }
+  }
+  if (res.empty()) {
+    fprintf(stderr, "no rules\n");
+    return 1;
+  }
+  if (mode == kSet && !set.Compile()) {
+    fprintf(stderr, "RE2::Set::Compile failed\n");
+    return 1;
+  }
+  if (mode == kFiltered) {
+    std::vector<std::string> atoms;
+    filtered.Compile(&atoms);
+  }
+
+  // Call k is due at start + k * interval and is made by thread
+  // k % threads, so that each thread is due a call every period.
+  const int64_t interval =
+      std::max<int64_t>(1, static_cast<int64_t>(1e9 / qps));
+  const int64_t period = interval * threads;
+  const int64_t ncalls = static_cast<int64_t>(seconds * qps);
+  const int64_t nrules = static_cast<int64_t>(res.size());
+  const int64_t ntexts = static_cast<int64_t>(corpus.size());
+  // Give the threads time to start before the first call is due.
+  const int64_t start = NowNs() + 10 * 1000 * 1000;
+
+  std::vector<Results> results(threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      Results* r = &results[t];
+      std::vector<int> matching;
+      for (int64_t k = t; k < ncalls; k += threads) {
+        int64_t due = start + k * interval;
+        int64_t now = NowNs();
+        if (due - now > kSpinNs) {
+          std::this_thread::sleep_for(
+              std::chrono::nanoseconds(due - now - kSpinNs));
+          now = NowNs();
+        }
+        while (now < due) {
+          std::this_thread::yield();
+          now = NowNs();
+        }
+        if (now - due >= period)
+          r->late++;
+        bool matched = false;
+        switch (mode) {
+          case kPartial: {
+            const RE2& re = *res[k % nrules];
+            const std::string& text = corpus[(k / nrules) % ntexts];
+            matched = RE2::PartialMatch(text, re);
+            break;
+          }
+          case kSet:
+            matched = set.Match(corpus[k % ntexts], &matching);
+            break;
+          case kFiltered:
+            matched = filtered.Scan(corpus[k % ntexts], &matching) &&
+                      !matching.empty();
+            break;
+        }
+        int64_t end = NowNs();
+        r->corrected.Add(end - due);
+        r->service.Add(end - now);
+        r->calls++;
+        r->matches += matched;
+        r->end_ns = end;
+      }
+    });
+  }
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+
+  Results all;
+  for (int t = 0; t < threads; t++) {
+    all.corrected.Merge(results[t].corrected);
+    all.service.Merge(results[t].service);
+    all.calls += results[t].calls;
+    all.matches += results[t].matches;
+    all.late += results[t].late;
+    all.end_ns = std::max(all.end_ns, results[t].end_ns);
+  }
+
+  static const char* const kModeNames[] = {"partial", "set", "filtered"};
+  double elapsed = static_cast<double>(all.end_ns - start) / 1e9;
+  printf("# mode %s, %zu rules, %zu texts, %d threads, %.0f qps for %.1f s\n",
+         kModeNames[mode], res.size(), corpus.size(), threads, qps, seconds);
+  printf("# %lld calls, %lld matched, %.0f qps achieved, "
+         "%lld started a period or more late\n",
+         static_cast<long long>(all.calls),
+         static_cast<long long>(all.matches),
+         elapsed > 0 ? all.calls / elapsed : 0.0,
+         static_cast<long long>(all.late));
+  if (all.late > 0 && all.corrected.Percentile(0.5) > period) {
+    printf("# the median call was late: the calls cannot keep up with "
+           "-qps, so the corrected latencies grow with -seconds\n");
+  }
+
+  static const double kPercentiles[] = {0.50, 0.90, 0.99, 0.999, 0.9999};
+  printf("# latency_ns\tp50\tp90\tp99\tp99.9\tp99.99\tmax\n");
+  const Histogram* hists[] = {&all.corrected, &all.service};
+  const char* const names[] = {"corrected", "service"};
+  for (int i = 0; i < 2; i++) {
+    printf("%s", names[i]);
+    for (double p : kPercentiles)
+      printf("\t%lld", static_cast<long long>(hists[i]->Percentile(p)));
+    printf("\t%lld\n", static_cast<long long>(hists[i]->max()));
+  }
+  if (hist)
+    all.corrected.Print();
+  return 0;
+}
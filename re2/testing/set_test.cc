@@ -3,6 +3,7 @@
 // license that can be found in the LICENSE file.
 
 #include <stddef.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <utility>
@@ -11,6 +12,7 @@
 #include "re2/testing/util/logging.h"
 #include "re2/re2.h"
 #include "re2/set.h"
+#include "re2/thread_pool.h"
 
 namespace re2 {
 
@@ -249,6 +251,224 @@ TEST(Set, MoveSemantics) {
   ASSERT_EQ(s1.Match("abc bar2 xyz", NULL), false);
 }
 
+TEST(Set, MatchFirst) {
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+
+  ASSERT_EQ(s.Add("bar", NULL), 0);
+  ASSERT_EQ(s.Add("foo", NULL), 1);
+  ASSERT_EQ(s.Add("o+", NULL), 2);
+  ASSERT_EQ(s.Add("^x", NULL), 3);
+  ASSERT_EQ(s.MatchFirst("foobar"), -1);  // not compiled yet
+  ASSERT_EQ(s.Compile(), true);
+
+  // The lowest index wins, not the leftmost match.
+  ASSERT_EQ(s.MatchFirst("foobar"), 0);
+  ASSERT_EQ(s.MatchFirst("xfoo"), 1);
+  ASSERT_EQ(s.MatchFirst("xoo"), 2);
+  ASSERT_EQ(s.MatchFirst("x"), 3);
+  ASSERT_EQ(s.MatchFirst("yx"), -1);
+  ASSERT_EQ(s.MatchFirst(""), -1);
+}
+
+TEST(Set, MatchFirstAnchorBoth) {
+  RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+
+  ASSERT_EQ(s.Add("/users/[0-9]+", NULL), 0);
+  ASSERT_EQ(s.Add("/users/[^/]+", NULL), 1);
+  ASSERT_EQ(s.Add("/users/.*", NULL), 2);
+  ASSERT_EQ(s.Add("", NULL), 3);
+  ASSERT_EQ(s.Compile(), true);
+
+  ASSERT_EQ(s.MatchFirst("/users/42"), 0);
+  ASSERT_EQ(s.MatchFirst("/users/bob"), 1);
+  ASSERT_EQ(s.MatchFirst("/users/bob/posts"), 2);
+  ASSERT_EQ(s.MatchFirst("/users/42/"), 2);
+  ASSERT_EQ(s.MatchFirst(""), 3);
+  ASSERT_EQ(s.MatchFirst("/groups/42"), -1);
+
+  // MatchFirst() agrees with the smallest index reported by Match().
+  std::vector<int> v;
+  ASSERT_EQ(s.Match("/users/42", &v), true);
+  ASSERT_EQ(v.size(), 3);
+  ASSERT_EQ(v[0], 0);
+}
+
+TEST(Set, Literals) {
+  RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+
+  ASSERT_EQ(s.Add("example\\.com", NULL), 0);
+  ASSERT_EQ(s.Add("www\\.example\\.com", NULL), 1);
+  ASSERT_EQ(s.Add("^mail\\.example\\.org$", NULL), 2);
+  ASSERT_EQ(s.Add("", NULL), 3);
+  ASSERT_EQ(s.Add("www\\x2Eexample[.]com", NULL), 4);
+  ASSERT_EQ(s.Compile(), true);
+
+  std::vector<int> v;
+  ASSERT_EQ(s.Match("example.com", &v), true);
+  ASSERT_EQ(v.size(), 1);
+  ASSERT_EQ(v[0], 0);
+
+  // Equal literals are all reported; the first one has priority.
+  ASSERT_EQ(s.Match("www.example.com", &v), true);
+  ASSERT_EQ(v.size(), 2);
+  ASSERT_EQ(s.MatchFirst("www.example.com"), 1);
+
+  ASSERT_EQ(s.MatchFirst("mail.example.org"), 2);
+  ASSERT_EQ(s.MatchFirst(""), 3);
+
+  ASSERT_EQ(s.Match("examplexcom", &v), false);
+  ASSERT_EQ(v.size(), 0);
+  ASSERT_EQ(s.Match("example.comx", NULL), false);
+  ASSERT_EQ(s.Match("xexample.com", NULL), false);
+  ASSERT_EQ(s.MatchFirst("example.co"), -1);
+}
+
+TEST(Set, LiteralsDuplicated) {
+  // Many copies of one literal, among others; each is added to the end of
+  // the chain of its equals, which has to stay in order.
+  RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+  const int kCopies = 10000;
+  for (int i = 0; i < 2 * kCopies; i++) {
+    std::string pattern = i % 2 == 0 ? "dup" : "x" + std::to_string(i);
+    ASSERT_EQ(s.Add(pattern, NULL), i);
+  }
+  ASSERT_EQ(s.Compile(), true);
+
+  std::vector<int> v;
+  ASSERT_EQ(s.Match("dup", &v), true);
+  ASSERT_EQ(v.size(), kCopies);
+  std::sort(v.begin(), v.end());
+  for (int i = 0; i < kCopies; i++)
+    ASSERT_EQ(v[i], 2 * i);
+  ASSERT_EQ(s.MatchFirst("dup"), 0);
+  ASSERT_EQ(s.MatchFirst("x7"), 7);
+  ASSERT_EQ(s.MatchFirst("x8"), -1);
+}
+
+TEST(Set, LiteralsMixed) {
+  RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+
+  ASSERT_EQ(s.Add("abc", NULL), 0);
+  ASSERT_EQ(s.Add("a.c", NULL), 1);
+  ASSERT_EQ(s.Add("(?i)ABC", NULL), 2);
+  ASSERT_EQ(s.Compile(), true);
+
+  std::vector<int> v;
+  ASSERT_EQ(s.Match("abc", &v), true);
+  ASSERT_EQ(v.size(), 3);
+  ASSERT_EQ(s.MatchFirst("aXc"), 1);
+  ASSERT_EQ(s.MatchFirst("Abc"), 2);
+}
+
+TEST(Set, MatchMany) {
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  ASSERT_EQ(s.Add("foo", NULL), 0);
+  ASSERT_EQ(s.Add("bar", NULL), 1);
+  ASSERT_EQ(s.Add("[0-9]+", NULL), 2);
+
+  std::vector<std::string> texts;
+  for (int i = 0; i < 1000; i++)
+    texts.push_back((i % 2 ? "foo" : "") + std::to_string(i) +
+                    (i % 3 ? "" : "bar"));
+  std::vector<StringPiece> pieces(texts.begin(), texts.end());
+  pieces.push_back(StringPiece());
+
+  RE2::Set::MatchManyResults r;
+  ASSERT_EQ(s.MatchMany(pieces.data(), pieces.size(), &r), false);  // not compiled yet
+  ASSERT_EQ(s.Compile(), true);
+
+  ThreadPool pool(3);
+  ASSERT_EQ(s.MatchMany(pieces.data(), pieces.size(), &r, &pool), true);
+  ASSERT_EQ(r.offsets.size(), pieces.size() + 1);
+  for (size_t i = 0; i < pieces.size(); i++) {
+    std::vector<int> v;
+    s.Match(pieces[i], &v);
+    std::sort(v.begin(), v.end());
+    std::vector<int> many(r.indices.begin() + r.offsets[i],
+                          r.indices.begin() + r.offsets[i + 1]);
+    ASSERT_TRUE(v == many);
+  }
+  ASSERT_EQ(r.offsets[pieces.size()], r.indices.size());
+
+  // The default pool gives the same results.
+  RE2::Set::MatchManyResults d;
+  ASSERT_EQ(s.MatchMany(pieces.data(), pieces.size(), &d), true);
+  ASSERT_TRUE(d.offsets == r.offsets);
+  ASSERT_TRUE(d.indices == r.indices);
+}
+
+TEST(Set, MatchManyLiterals) {
+  RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+  ASSERT_EQ(s.Add("a", NULL), 0);
+  ASSERT_EQ(s.Add("b", NULL), 1);
+  ASSERT_EQ(s.Add("a", NULL), 2);
+  ASSERT_EQ(s.Compile(), true);
+
+  StringPiece texts[] = {"a", "ab", "b"};
+  RE2::Set::MatchManyResults r;
+  ASSERT_EQ(s.MatchMany(texts, 3, &r), true);
+  ASSERT_EQ(r.offsets.size(), 4);
+  ASSERT_EQ(r.offsets[1], 2);
+  ASSERT_EQ(r.offsets[2], 2);
+  ASSERT_EQ(r.offsets[3], 3);
+  ASSERT_EQ(r.indices[0], 0);
+  ASSERT_EQ(r.indices[1], 2);
+  ASSERT_EQ(r.indices[2], 1);
+}
+
+TEST(Set, Stats) {
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  ASSERT_EQ(s.Add("foo[0-9]+", NULL), 0);
+  ASSERT_EQ(s.Add("bar", NULL), 1);
+
+  RE2::Set::Stats stats;
+  ASSERT_EQ(s.GetStats(&stats), false);  // not compiled yet
+  ASSERT_EQ(stats.searches, 0);
+  ASSERT_EQ(s.Compile(), true);
+
+  std::vector<int> v;
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(s.Match("xfoo" + std::to_string(i), &v), true);
+    ASSERT_EQ(s.Match("xyz", NULL), false);
+  }
+  ASSERT_EQ(s.MatchFirst("bar"), 1);
+
+  ASSERT_EQ(s.GetStats(&stats), true);
+  ASSERT_EQ(stats.searches, 21);
+  ASSERT_EQ(stats.dfa_fallbacks, 0);
+  ASSERT_EQ(stats.cache_clears, 0);
+  ASSERT_GE(stats.caches, 2);  // Match() and MatchFirst() keep their own
+  ASSERT_GT(stats.cache_bytes, 0);
+}
+
+TEST(Set, OutOfMemory) {
+  // Too little memory for the lazy DFA: the NFA runs every search.
+  RE2::Options opt;
+  opt.set_max_mem(64);
+  RE2::Set s(opt, RE2::UNANCHORED);
+  ASSERT_EQ(s.Add("foo[0-9]+", NULL), 0);
+  ASSERT_EQ(s.Add("bar", NULL), 1);
+  ASSERT_EQ(s.Compile(), true);
+
+  std::vector<int> v;
+  RE2::Set::ErrorInfo info;
+  ASSERT_EQ(s.Match("xyz", &v, &info), false);
+  ASSERT_EQ(info.kind, RE2::Set::kOutOfMemory);
+  ASSERT_EQ(s.Match("foo1bar", &v, &info), true);
+  ASSERT_EQ(v.size(), 2);
+  ASSERT_EQ(s.Match("xfoo1", NULL), true);
+
+  RE2::Set::Stats stats;
+  ASSERT_EQ(s.GetStats(&stats), true);
+  ASSERT_EQ(stats.dfa_fallbacks, 3);
+
+  RE2::Set ok(RE2::DefaultOptions, RE2::UNANCHORED);
+  ASSERT_EQ(ok.Add("foo", NULL), 0);
+  ASSERT_EQ(ok.Compile(), true);
+  ASSERT_EQ(ok.Match("xyz", &v, &info), false);
+  ASSERT_EQ(info.kind, RE2::Set::kNoError);
+}
+
 TEST(Set, FailCompile) {
   RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_START);
   ASSERT_EQ(s.Add("foo", NULL), 0);
@@ -258,6 +478,28 @@ TEST(Set, FailCompile) {
   ASSERT_EQ(s.Compile(), false);  // RE2::Set::Compile() called more than once
 }
 
+// Compile accepts every pattern that Add does, Unicode classes included.
+TEST(Set, UnicodeClasses) {
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  ASSERT_EQ(s.Add("\\p{Greek}+", NULL), 0);
+  ASSERT_EQ(s.Add("[\\p{Lu}\\p{Nd}]{2}", NULL), 1);
+  ASSERT_EQ(s.Add("^\\w$", NULL), 2);
+  ASSERT_EQ(s.Compile(), true);
+
+  std::vector<int> v;
+  ASSERT_EQ(s.Match("\xce\xb1\xce\xb2", &v), true);  // αβ
+  ASSERT_EQ(v.size(), 1);
+  ASSERT_EQ(v[0], 0);
+
+  ASSERT_EQ(s.Match("\xd0\x96", &v), true);  // Ж
+  ASSERT_EQ(v.size(), 1);
+  ASSERT_EQ(v[0], 2);
+
+  ASSERT_EQ(s.Match("x\xc3\x89" "7", &v), true);  // xÉ7
+  ASSERT_EQ(v.size(), 1);
+  ASSERT_EQ(v[0], 1);
+}
+
 TEST(Set, FailMatch) {  
   RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_START);
   ASSERT_EQ(s.Add("foo", NULL), 0);
@@ -268,6 +510,39 @@ TEST(Set, FailMatch) {
   ASSERT_EQ(s.Match("foobar", &v, &error), false);  // RE2::Set::Match() called before compiling
 }
 
+TEST(Set, AddBatch) {
+  std::vector<std::string> storage;
+  for (int i = 0; i < 100; i++)
+    storage.push_back(i % 10 == 3 ? "(" : "foo" + std::to_string(i) + "$");
+  std::vector<StringPiece> patterns(storage.begin(), storage.end());
+
+  RE2::Set one(RE2::DefaultOptions, RE2::UNANCHORED);
+  std::vector<int> want;
+  for (size_t i = 0; i < patterns.size(); i++)
+    want.push_back(one.Add(patterns[i], NULL));
+
+  ThreadPool pool(4);
+  RE2::Set batch(RE2::DefaultOptions, RE2::UNANCHORED);
+  std::vector<int> indices;
+  std::vector<std::string> errors;
+  ASSERT_FALSE(batch.AddBatch(patterns, &indices, &errors, &pool));
+  ASSERT_EQ(indices, want);
+  for (size_t i = 0; i < patterns.size(); i++)
+    ASSERT_EQ(errors[i].empty(), want[i] != -1);
+
+  ASSERT_TRUE(one.Compile());
+  ASSERT_TRUE(batch.Compile());
+  std::vector<int> v;
+  ASSERT_TRUE(batch.Match("foo57", &v));
+  ASSERT_EQ(v.size(), 1);
+  ASSERT_EQ(v[0], want[57]);
+  ASSERT_EQ(batch.MatchFirst("xfoo99"), one.MatchFirst("xfoo99"));
+
+  RE2::Set empty(RE2::DefaultOptions, RE2::UNANCHORED);
+  ASSERT_TRUE(empty.AddBatch(std::vector<StringPiece>(), &indices, NULL));
+  ASSERT_TRUE(indices.empty());
+}
+
 TEST(Set, FailAdd) {  
   RE2::Set s(RE2::DefaultOptions, RE2::ANCHOR_START);
   ASSERT_EQ(s.Add("foo", NULL), 0);
@@ -0,0 +1,67 @@
+// Copyright 2010 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "re2/testing/util/test.h"
+#include "re2/testing/util/logging.h"
+#include "re2/thread_pool.h"
+
+namespace re2 {
+
+TEST(ThreadPool, RunsEveryTaskOnce) {
+  for (int threads = 1; threads <= 4; threads++) {
+    ThreadPool pool(threads);
+    ASSERT_EQ(pool.num_threads(), threads);
+    for (int n = 0; n < 50; n++) {
+      std::vector<std::atomic<int>> calls(n);
+      for (int i = 0; i < n; i++)
+        calls[i] = 0;
+      pool.Run(n, [&calls](int i) { calls[i]++; });
+      for (int i = 0; i < n; i++)
+        ASSERT_EQ(calls[i].load(), 1);
+    }
+  }
+}
+
+TEST(ThreadPool, ConcurrentRuns) {
+  ThreadPool pool(3);
+  std::atomic<int> total(0);
+  std::vector<std::thread> callers;
+  for (int t = 0; t < 4; t++) {
+    callers.emplace_back([&pool, &total]() {
+      for (int i = 0; i < 100; i++)
+        pool.Run(10, [&total](int) { total++; });
+    });
+  }
+  for (size_t i = 0; i < callers.size(); i++)
+    callers[i].join();
+  ASSERT_EQ(total.load(), 4 * 100 * 10);
+}
+
+TEST(ThreadPool, TryRun) {
+  ThreadPool pool(3);
+  std::atomic<int> total(0);
+  ASSERT_EQ(pool.TryRun(10, [&total](int) { total++; }), true);
+  ASSERT_EQ(total.load(), 10);
+
+  // A task of the pool cannot start another job on it, nor can a caller
+  // while the pool runs someone else's job.
+  std::atomic<int> refused(0);
+  pool.Run(4, [&pool, &refused](int) {
+    if (!pool.TryRun(2, [](int) {}))
+      refused++;
+  });
+  ASSERT_EQ(refused.load(), 4);
+}
+
+TEST(ThreadPool, Default) {
+  ThreadPool* pool = ThreadPool::Default();
+  ASSERT_EQ(pool, ThreadPool::Default());
+  ASSERT_GE(pool->num_threads(), 1);
+}
+
+}  // namespace re2
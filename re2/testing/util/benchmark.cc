@@ -2,11 +2,55 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+// The benchmark harness. Usage:
+//
+//   regexp_benchmark [--repetitions=N] [--json=FILE] [--csv=FILE]
+//                    [--baseline=FILE] [--counters] [REGEXP...]
+//   regexp_benchmark --memory
+//
+// runs the benchmarks whose names match any of the REGEXPs, or all of
+// them. Each benchmark is run N times (default 1) at the iteration count
+// that the first run settles on; with N > 1 the mean, median, standard
+// deviation and minimum of the runs follow them. --json and --csv also
+// write every run, and the summaries, to FILE. --baseline reads a CSV
+// file written by an earlier --csv and compares the median ns/op of each
+// benchmark with it. --counters also reads the hardware counters of the
+// timed code with perf_event_open (cycles, instructions, L1d and LLC
+// misses, branch misses) and reports them per op, and per byte for the
+// benchmarks that process bytes; where perf events are not allowed or not
+// supported it says so once and the counters are left out. --memory
+// prints the memory report of the binary, re2::MemoryUsage(), instead of
+// running benchmarks.
+//
+// A benchmark with a range of sizes that processes bytes is a size sweep:
+// after its sizes, a NAME_fit line splits its time into a fixed overhead
+// per call and a steady MB/s (see FitSweep), which --json and --csv write
+// as the aggregate "fit".
+
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 #include "re2/testing/util/benchmark.h"
 #include "re2/re2.h"
@@ -17,6 +61,10 @@
 
 using ::testing::Benchmark;
 
+namespace re2 {
+void MemoryUsage();
+}  // namespace re2
+
 static Benchmark* benchmarks[10000];
 static int nbenchmarks;
 
@@ -32,20 +80,161 @@ static int64_t nsec() {
       .count();
 }
 
-static int64_t t0;
-static int64_t ns;
-static int64_t bytes;
-static int64_t items;
+// The CPU time used by this thread.
+static int64_t cpu_nsec() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// The hardware counters that --counters reads. Each thread running the
+// benchmark function counts its own, but not those of threads that it
+// hands work to; a counter that this machine does not have is left out.
+enum {
+  kCycles,
+  kInstructions,
+  kL1DMisses,
+  kLLCMisses,
+  kBranchMisses,
+  kNumCounters,
+};
+static const char* const kCounterNames[] = {
+    "cycles", "instructions", "L1d-misses", "LLC-misses", "branch-misses"};
+static const char* const kCounterColumns[] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+static std::atomic<bool> use_counters(false);
+static thread_local bool counting;  // whether this thread's are open
+static thread_local int counter_fds[kNumCounters];
+
+#ifdef __linux__
+static int OpenCounter(int counter) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof attr);
+  attr.size = sizeof attr;
+  attr.type = PERF_TYPE_HARDWARE;
+  switch (counter) {
+    case kCycles:
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case kInstructions:
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case kL1DMisses:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case kLLCMisses:
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case kBranchMisses:
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+  }
+  attr.disabled = 1;
+  // Only user space, which an unprivileged process may count at the
+  // default perf_event_paranoid of 2.
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+// Opens the counters of this thread. If none of them can be opened, says
+// why once and turns --counters off.
+static void OpenCounters() {
+  counting = true;
+  static std::once_flag warned;
+  int opened = 0;
+  int error = 0;
+  for (int i = 0; i < kNumCounters; i++) {
+#ifdef __linux__
+    counter_fds[i] = OpenCounter(i);
+    if (counter_fds[i] < 0 && error == 0)
+      error = errno;
+#else
+    counter_fds[i] = -1;
+#endif
+    if (counter_fds[i] >= 0)
+      opened++;
+  }
+  if (opened > 0)
+    return;
+  std::call_once(warned, [error]() {
+    if (error == EACCES || error == EPERM)
+      fprintf(stderr,
+              "regexp_benchmark: perf events not allowed: %s "
+              "(see /proc/sys/kernel/perf_event_paranoid); no counters\n",
+              strerror(error));
+    else
+      fprintf(stderr, "regexp_benchmark: no hardware counters: %s\n",
+              error != 0 ? strerror(error) : "no perf_event_open");
+  });
+  use_counters = false;
+}
+
+static void CloseCounters() {
+  for (int i = 0; i < kNumCounters; i++) {
+    if (counter_fds[i] >= 0)
+      close(counter_fds[i]);
+    counter_fds[i] = -1;
+  }
+  counting = false;
+}
+
+static void EnableCounters(bool on) {
+#ifdef __linux__
+  for (int i = 0; i < kNumCounters; i++) {
+    if (counter_fds[i] >= 0)
+      ioctl(counter_fds[i], on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE,
+            0);
+  }
+#endif
+}
+
+// Reads counter i of this thread, scaled up if the kernel had to share
+// the hardware between more counters than it has; -1 if it is not open.
+static double ReadCounter(int i) {
+  uint64_t values[3];  // value, time enabled, time running
+  if (counter_fds[i] < 0 ||
+      read(counter_fds[i], values, sizeof values) != sizeof values)
+    return -1;
+  if (values[2] == 0)
+    return values[1] == 0 ? 0 : -1;
+  return (double)values[0] * ((double)values[1] / (double)values[2]);
+}
+
+// The timing of the benchmark function running on this thread; each
+// thread of a multi-threaded run keeps its own.
+static thread_local int64_t t0;
+static thread_local int64_t ns;
+static thread_local int64_t cpu_t0;
+static thread_local int64_t cpu_ns;
+static thread_local int64_t bytes;
+static thread_local int64_t items;
+static thread_local std::string label;
+static thread_local std::vector<int64_t> latencies;
 
 void StartBenchmarkTiming() {
   if (t0 == 0) {
     t0 = nsec();
+    cpu_t0 = cpu_nsec();
+    if (counting)
+      EnableCounters(true);
   }
 }
 
 void StopBenchmarkTiming() {
   if (t0 != 0) {
+    if (counting)
+      EnableCounters(false);
     ns += nsec() - t0;
+    cpu_ns += cpu_nsec() - cpu_t0;
     t0 = 0;
   }
 }
@@ -54,15 +243,101 @@ void SetBenchmarkBytesProcessed(int64_t b) { bytes = b; }
 
 void SetBenchmarkItemsProcessed(int64_t i) { items = i; }
 
-static void RunFunc(Benchmark* b, int iters, int arg) {
-  t0 = nsec();
+void SetBenchmarkLabel(const std::string& l) { label = l; }
+
+void AddBenchmarkLatency(int64_t l) { latencies.push_back(l); }
+
+// What a run of the benchmark function measured: the timed wall and CPU
+// nanoseconds, averaged over the threads, and the bytes and items
+// processed, latencies recorded and hardware counters (-1 for one not
+// read), gathered from all of them. The label is that of the first
+// thread.
+struct Result {
+  int64_t ns;
+  int64_t cpu_ns;
+  int64_t bytes;
+  int64_t items;
+  std::string label;
+  std::vector<int64_t> latencies;
+  double counters[kNumCounters];
+};
+
+static void RunOnThisThread(Benchmark* b, int iters, int arg,
+                            int thread_index, int threads) {
+  t0 = 0;
   ns = 0;
+  cpu_ns = 0;
   bytes = 0;
   items = 0;
-  b->func()(iters, arg);
+  label.clear();
+  latencies.clear();
+  StartBenchmarkTiming();
+  b->func()(iters, arg, thread_index, threads);
   StopBenchmarkTiming();
 }
 
+static void RunOnThisThread(Benchmark* b, int iters, int arg,
+                            int thread_index, int threads, Result* r) {
+  if (use_counters)
+    OpenCounters();
+  RunOnThisThread(b, iters, arg, thread_index, threads);
+  r->ns = ns;
+  r->cpu_ns = cpu_ns;
+  r->bytes = bytes;
+  r->items = items;
+  r->label = label;
+  r->latencies.swap(latencies);
+  for (int i = 0; i < kNumCounters; i++)
+    r->counters[i] = counting ? ReadCounter(i) : -1;
+  if (counting)
+    CloseCounters();
+}
+
+static Result RunFunc(Benchmark* b, int iters, int arg, int threads) {
+  std::vector<Result> results(threads);
+  // The threads wait for each other so that their timed loops overlap.
+  std::mutex mu;
+  std::condition_variable all_ready;
+  int ready = 0;
+  auto run = [&](int i) {
+    {
+      std::unique_lock<std::mutex> l(mu);
+      if (++ready == threads)
+        all_ready.notify_all();
+      else
+        all_ready.wait(l, [&]() { return ready == threads; });
+    }
+    RunOnThisThread(b, iters, arg, i, threads, &results[i]);
+  };
+  std::vector<std::thread> others;
+  for (int i = 1; i < threads; i++)
+    others.emplace_back(run, i);
+  run(0);
+  for (size_t i = 0; i < others.size(); i++)
+    others[i].join();
+
+  Result r = {0, 0, 0, 0, results[0].label, {}, {}};
+  for (int j = 0; j < kNumCounters; j++)
+    r.counters[j] = 0;
+  for (int i = 0; i < threads; i++) {
+    r.ns += results[i].ns;
+    r.cpu_ns += results[i].cpu_ns;
+    r.bytes += results[i].bytes;
+    r.items += results[i].items;
+    r.latencies.insert(r.latencies.end(), results[i].latencies.begin(),
+                       results[i].latencies.end());
+    for (int j = 0; j < kNumCounters; j++) {
+      if (r.counters[j] < 0 || results[i].counters[j] < 0)
+        r.counters[j] = -1;
+      else
+        r.counters[j] += results[i].counters[j];
+    }
+  }
+  r.ns /= threads;
+  r.cpu_ns /= threads;
+  return r;
+}
+
 static int round(int n) {
   int base = 1;
   while (base * 10 < n) base *= 10;
@@ -71,31 +346,211 @@ static int round(int n) {
   return 10 * base;
 }
 
-static void RunBench(Benchmark* b, int arg) {
+// Settings from the command line.
+static int repetitions = 1;
+static const char* json_path = NULL;
+static const char* csv_path = NULL;
+static std::map<std::string, double> baseline;  // name -> median ns/op
+
+// The latency percentiles of a run that recorded latencies.
+static const double kPercentiles[] = {0.50, 0.90, 0.99, 0.999};
+static const char* const kPercentileNames[] = {"p50", "p90", "p99", "p99.9"};
+static const int kNumPercentiles = 4;
+
+// One run of a benchmark, or a summary of its runs.
+struct Record {
+  std::string name;
+  std::string aggregate;  // "mean", "median", "stddev", "min" or empty
+  int repetition;
+  int iters;
+  int threads;
+  double ns_per_op;
+  double cpu_ns_per_op;
+  double mb_per_s;   // 0 if no bytes were processed
+  double ops_per_s;  // of all threads; 0 without a thread range
+  bool has_latencies;
+  double percentiles[kNumPercentiles];
+  double max_latency;
+  // The hardware counters per op on one thread and per byte, -1 where
+  // not read; per_byte is -1 too if no bytes were processed.
+  double counters_per_op[kNumCounters];
+  double counters_per_byte[kNumCounters];
+  std::string label;
+};
+
+static std::vector<Record> records;
+
+static Record MakeRecord(Benchmark* b, const std::string& name, int rep,
+                         int iters, int threads, Result* r) {
+  Record rec;
+  rec.name = name;
+  rec.repetition = rep;
+  rec.iters = iters;
+  rec.threads = threads;
+  rec.ns_per_op = (double)r->ns / iters;
+  rec.cpu_ns_per_op = (double)r->cpu_ns / iters;
+  rec.mb_per_s = 0;
+  if (r->ns > 0 && r->bytes > 0)
+    rec.mb_per_s = ((double)r->bytes / 1e6) / ((double)r->ns / 1e9);
+  rec.ops_per_s = 0;
+  if (b->has_thread_range() && r->ns > 0)
+    rec.ops_per_s = (double)iters * threads / ((double)r->ns / 1e9);
+  rec.has_latencies = !r->latencies.empty();
+  rec.max_latency = 0;
+  if (rec.has_latencies) {
+    std::vector<int64_t>& l = r->latencies;
+    std::sort(l.begin(), l.end());
+    for (int i = 0; i < kNumPercentiles; i++)
+      rec.percentiles[i] =
+          (double)l[static_cast<size_t>(kPercentiles[i] * (l.size() - 1))];
+    rec.max_latency = (double)l.back();
+  }
+  for (int i = 0; i < kNumCounters; i++) {
+    double c = r->counters[i];
+    rec.counters_per_op[i] = c < 0 ? -1 : c / ((double)iters * threads);
+    rec.counters_per_byte[i] =
+        c < 0 || r->bytes <= 0 ? -1 : c / (double)r->bytes;
+  }
+  rec.label = r->label;
+  return rec;
+}
+
+static void PrintRecord(const Record& rec) {
+  char line[1000];
+  int n = snprintf(line, sizeof line, "%s\t%8d\t%10lld ns/op",
+                   rec.name.c_str(), rec.iters, (long long)rec.ns_per_op);
+  std::string s(line, std::min<size_t>(n, sizeof line - 1));
+  if (rec.mb_per_s > 0) {
+    snprintf(line, sizeof line, "\t%7.2f MB/s", rec.mb_per_s);
+    s += line;
+  }
+  if (rec.ops_per_s > 0) {
+    snprintf(line, sizeof line, "\t%10.0f ops/s", rec.ops_per_s);
+    s += line;
+  }
+  if (rec.has_latencies) {
+    for (int i = 0; i < kNumPercentiles; i++) {
+      snprintf(line, sizeof line, "\t%s %lld ns", kPercentileNames[i],
+               (long long)rec.percentiles[i]);
+      s += line;
+    }
+    snprintf(line, sizeof line, "\tmax %lld ns", (long long)rec.max_latency);
+    s += line;
+  }
+  for (int i = 0; i < kNumCounters; i++) {
+    if (rec.counters_per_op[i] < 0)
+      continue;
+    snprintf(line, sizeof line, "\t%s %.1f/op", kCounterNames[i],
+             rec.counters_per_op[i]);
+    s += line;
+    if (rec.counters_per_byte[i] >= 0) {
+      snprintf(line, sizeof line, " %.3f/B", rec.counters_per_byte[i]);
+      s += line;
+    }
+  }
+  if (!rec.label.empty())
+    s += "\t" + rec.label;
+  printf("%s\n", s.c_str());
+}
+
+static double Median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 == 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Appends the mean, median, standard deviation and minimum of the wall
+// and CPU times of runs to records, and prints them.
+static void Summarize(const std::vector<Record>& runs) {
+  std::vector<double> wall, cpu;
+  for (size_t i = 0; i < runs.size(); i++) {
+    wall.push_back(runs[i].ns_per_op);
+    cpu.push_back(runs[i].cpu_ns_per_op);
+  }
+  auto mean = [](const std::vector<double>& v) {
+    double sum = 0;
+    for (size_t i = 0; i < v.size(); i++)
+      sum += v[i];
+    return sum / v.size();
+  };
+  auto stddev = [&mean](const std::vector<double>& v) {
+    double m = mean(v);
+    double sum = 0;
+    for (size_t i = 0; i < v.size(); i++)
+      sum += (v[i] - m) * (v[i] - m);
+    return std::sqrt(sum / (v.size() - 1));
+  };
+  auto min = [](const std::vector<double>& v) {
+    return *std::min_element(v.begin(), v.end());
+  };
+  const char* const names[] = {"mean", "median", "stddev", "min"};
+  double values[][2] = {{mean(wall), mean(cpu)},
+                        {Median(wall), Median(cpu)},
+                        {stddev(wall), stddev(cpu)},
+                        {min(wall), min(cpu)}};
+  for (int i = 0; i < 4; i++) {
+    Record rec = runs[0];
+    rec.aggregate = names[i];
+    rec.repetition = 0;
+    rec.ns_per_op = values[i][0];
+    rec.cpu_ns_per_op = values[i][1];
+    rec.mb_per_s = 0;
+    rec.ops_per_s = 0;
+    rec.has_latencies = false;
+    for (int j = 0; j < kNumCounters; j++)
+      rec.counters_per_op[j] = rec.counters_per_byte[j] = -1;
+    rec.label.clear();
+    records.push_back(rec);
+    printf("%s_%s\t%8d\t%10.0f ns/op\t%10.0f cpu ns/op", rec.name.c_str(),
+           names[i], rec.iters, rec.ns_per_op, rec.cpu_ns_per_op);
+    // The percent that the runs vary by.
+    if (i == 2 && values[0][0] > 0)
+      printf("\t%5.1f%%", 100 * values[2][0] / values[0][0]);
+    printf("\n");
+  }
+}
+
+static void CompareWithBaseline(const std::vector<Record>& runs) {
+  auto it = baseline.find(runs[0].name);
+  if (it == baseline.end() || it->second <= 0)
+    return;
+  std::vector<double> wall;
+  for (size_t i = 0; i < runs.size(); i++)
+    wall.push_back(runs[i].ns_per_op);
+  double now = Median(wall);
+  printf("%s_vs_baseline\t%10.0f -> %10.0f ns/op\t%+6.1f%%\n",
+         runs[0].name.c_str(), it->second, now,
+         100 * (now - it->second) / it->second);
+}
+
+// A point of a size sweep: the bytes that one operation processed and
+// the median time of one operation, at one size.
+struct SweepPoint {
+  double bytes_per_op;
+  double ns_per_op;
+};
+
+// Runs benchmark b at arg on threads threads and returns its point.
+static SweepPoint RunBench(Benchmark* b, int arg, int threads) {
   int iters, last;
 
   // Run once just in case it's expensive.
   iters = 1;
-  RunFunc(b, iters, arg);
-  while (ns < (int)1e9 && iters < (int)1e9) {
+  Result r = RunFunc(b, iters, arg, threads);
+  while (r.ns < (int)1e9 && iters < (int)1e9) {
     last = iters;
-    if (ns / iters == 0) {
+    if (r.ns / iters == 0) {
       iters = (int)1e9;
     } else {
-      iters = (int)1e9 / static_cast<int>(ns / iters);
+      iters = (int)1e9 / static_cast<int>(r.ns / iters);
     }
     iters = std::max(last + 1, std::min(iters + iters / 2, 100 * last));
     iters = round(iters);
-    RunFunc(b, iters, arg);
+    r = RunFunc(b, iters, arg, threads);
   }
 
-  char mb[100];
   char suf[100];
-  mb[0] = '\0';
   suf[0] = '\0';
-  if (ns > 0 && bytes > 0)
-    snprintf(mb, sizeof mb, "\t%7.2f MB/s",
-             ((double)bytes / 1e6) / ((double)ns / 1e9));
   if (b->has_arg()) {
     if (arg >= (1 << 20)) {
       snprintf(suf, sizeof suf, "/%dM", arg / (1 << 20));
@@ -105,26 +560,315 @@ static void RunBench(Benchmark* b, int arg) {
       snprintf(suf, sizeof suf, "/%d", arg);
     }
   }
-  printf("%s%s\t%8d\t%10lld ns/op%s\n", b->name(), suf, iters,
-         (long long)ns / iters, mb);
+  std::string name = std::string(b->name()) + suf;
+  if (b->has_thread_range())
+    name += "/threads:" + std::to_string(threads);
+
+  // ns/op is the time of an operation on one thread. MB/s, and ops/s for
+  // a benchmark with a thread range, are for all of the threads together.
+  // The run that settled the iteration count is the first repetition.
+  std::vector<Record> runs;
+  for (int rep = 1; rep <= repetitions; rep++) {
+    if (rep > 1)
+      r = RunFunc(b, iters, arg, threads);
+    runs.push_back(MakeRecord(b, name, rep, iters, threads, &r));
+    records.push_back(runs.back());
+    PrintRecord(runs.back());
+    fflush(stdout);
+  }
+  if (repetitions > 1)
+    Summarize(runs);
+  CompareWithBaseline(runs);
   fflush(stdout);
+
+  std::vector<double> wall;
+  for (size_t i = 0; i < runs.size(); i++)
+    wall.push_back(runs[i].ns_per_op);
+  SweepPoint p;
+  p.ns_per_op = Median(wall);
+  p.bytes_per_op = runs[0].mb_per_s * runs[0].ns_per_op / 1e3 / threads;
+  return p;
 }
 
-static bool WantBench(const char* name, int argc, const char** argv) {
-  if (argc == 1) return true;
-  for (int i = 1; i < argc; i++) {
-    if (RE2::PartialMatch(name, argv[i]))
+// Splits the time of a benchmark swept over sizes into a fixed cost per
+// call and a steady scan speed. The speed is fitted by least squares to
+// the sizes within 64x of the largest, where the fixed cost is lost in
+// the scan; the overhead is the time at the smallest size, which is
+// almost all fixed cost. The "half" size is where the two take equal
+// time, below which a call is mostly overhead. If the time hardly grows
+// with the size, there is no scan to speak of and no speed is given. The
+// fit is appended to records as an aggregate "fit" whose ns/op is the
+// overhead and whose MB/s is the speed, or 0.
+static void FitSweep(Benchmark* b, const std::vector<SweepPoint>& points) {
+  if (points.size() < 3)
+    return;
+  double max_bytes = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    if (points[i].bytes_per_op <= 0)
+      return;
+    max_bytes = std::max(max_bytes, points[i].bytes_per_op);
+  }
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    double x = points[i].bytes_per_op;
+    double y = points[i].ns_per_op;
+    if (x * 64 < max_bytes)
+      continue;
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  if (n < 2 || n * sxx - sx * sx <= 0)
+    return;
+  double ns_per_byte = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+  double overhead = points[0].ns_per_op;
+  bool scans = ns_per_byte > 0 && overhead < max_bytes * ns_per_byte;
+
+  Record rec;
+  rec.name = b->name();
+  rec.aggregate = "fit";
+  rec.repetition = 0;
+  rec.iters = 0;
+  rec.threads = 1;
+  rec.ns_per_op = overhead;
+  rec.cpu_ns_per_op = 0;
+  rec.mb_per_s = scans ? 1e3 / ns_per_byte : 0;
+  rec.ops_per_s = 0;
+  rec.has_latencies = false;
+  rec.max_latency = 0;
+  for (int j = 0; j < kNumCounters; j++)
+    rec.counters_per_op[j] = rec.counters_per_byte[j] = -1;
+  records.push_back(rec);
+  if (scans)
+    printf("%s_fit\t%10.0f ns/call overhead\t%7.2f MB/s steady\t"
+           "half at %.0f bytes\n",
+           rec.name.c_str(), overhead, rec.mb_per_s, overhead / ns_per_byte);
+  else
+    printf("%s_fit\t%10.0f ns/call overhead\tno scan\n", rec.name.c_str(),
+           overhead);
+  fflush(stdout);
+}
+
+static bool WantBench(const char* name,
+                      const std::vector<const char*>& patterns) {
+  if (patterns.empty()) return true;
+  for (size_t i = 0; i < patterns.size(); i++) {
+    if (RE2::PartialMatch(name, patterns[i]))
       return true;
   }
   return false;
 }
 
+// Quotes s as a JSON string.
+static std::string JSONString(const std::string& s) {
+  std::string out = "\"";
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof buf, "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// Quotes s as a CSV field.
+static std::string CSVString(const std::string& s) {
+  std::string out = "\"";
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '"')
+      out += '"';
+    out += s[i];
+  }
+  return out + "\"";
+}
+
+static bool WriteJSON(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL)
+    return false;
+  char host[256] = "";
+  gethostname(host, sizeof host - 1);
+  char date[64] = "";
+  time_t now = time(NULL);
+  strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+  fprintf(f, "{\n  \"context\": {\n    \"date\": %s,\n    \"host_name\": %s,\n"
+             "    \"repetitions\": %d\n  },\n  \"benchmarks\": [",
+          JSONString(date).c_str(), JSONString(host).c_str(), repetitions);
+  for (size_t i = 0; i < records.size(); i++) {
+    const Record& rec = records[i];
+    fprintf(f, "%s\n    {\"name\": %s, ", i == 0 ? "" : ",",
+            JSONString(rec.name).c_str());
+    if (rec.aggregate.empty())
+      fprintf(f, "\"run_type\": \"iteration\", \"repetition\": %d, ",
+              rec.repetition);
+    else
+      fprintf(f, "\"run_type\": \"aggregate\", \"aggregate_name\": %s, ",
+              JSONString(rec.aggregate).c_str());
+    fprintf(f, "\"iterations\": %d, \"threads\": %d, \"real_time_ns\": %.1f, "
+               "\"cpu_time_ns\": %.1f",
+            rec.iters, rec.threads, rec.ns_per_op, rec.cpu_ns_per_op);
+    if (rec.mb_per_s > 0)
+      fprintf(f, ", \"mb_per_second\": %.2f", rec.mb_per_s);
+    if (rec.ops_per_s > 0)
+      fprintf(f, ", \"ops_per_second\": %.0f", rec.ops_per_s);
+    if (rec.has_latencies) {
+      fprintf(f, ", \"latency_ns\": {");
+      for (int j = 0; j < kNumPercentiles; j++)
+        fprintf(f, "\"%s\": %.0f, ", kPercentileNames[j], rec.percentiles[j]);
+      fprintf(f, "\"max\": %.0f}", rec.max_latency);
+    }
+    for (int j = 0; j < kNumCounters; j++) {
+      if (rec.counters_per_op[j] >= 0)
+        fprintf(f, ", \"%s_per_op\": %.2f", kCounterColumns[j],
+                rec.counters_per_op[j]);
+      if (rec.counters_per_byte[j] >= 0)
+        fprintf(f, ", \"%s_per_byte\": %.4f", kCounterColumns[j],
+                rec.counters_per_byte[j]);
+    }
+    if (!rec.label.empty())
+      fprintf(f, ", \"label\": %s", JSONString(rec.label).c_str());
+    fprintf(f, "}");
+  }
+  fprintf(f, "\n  ]\n}\n");
+  return fclose(f) == 0;
+}
+
+static bool WriteCSV(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL)
+    return false;
+  fprintf(f, "name,aggregate,repetition,iterations,threads,real_time_ns,"
+             "cpu_time_ns,mb_per_second,ops_per_second,p50_ns,p90_ns,p99_ns,"
+             "p999_ns,max_ns");
+  for (int j = 0; j < kNumCounters; j++)
+    fprintf(f, ",%s_per_op", kCounterColumns[j]);
+  fprintf(f, ",label\n");
+  for (size_t i = 0; i < records.size(); i++) {
+    const Record& rec = records[i];
+    fprintf(f, "%s,%s,%d,%d,%d,%.1f,%.1f,%.2f,%.0f", rec.name.c_str(),
+            rec.aggregate.c_str(), rec.repetition, rec.iters, rec.threads,
+            rec.ns_per_op, rec.cpu_ns_per_op, rec.mb_per_s, rec.ops_per_s);
+    for (int j = 0; j < kNumPercentiles; j++) {
+      if (rec.has_latencies)
+        fprintf(f, ",%.0f", rec.percentiles[j]);
+      else
+        fprintf(f, ",");
+    }
+    if (rec.has_latencies)
+      fprintf(f, ",%.0f", rec.max_latency);
+    else
+      fprintf(f, ",");
+    for (int j = 0; j < kNumCounters; j++) {
+      if (rec.counters_per_op[j] >= 0)
+        fprintf(f, ",%.2f", rec.counters_per_op[j]);
+      else
+        fprintf(f, ",");
+    }
+    fprintf(f, ",%s\n", CSVString(rec.label).c_str());
+  }
+  return fclose(f) == 0;
+}
+
+// Reads the median ns/op of each benchmark from a file written by
+// WriteCSV. The names have no commas, and the fields that are read come
+// before the label, which may.
+static bool ReadBaseline(const char* path) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::map<std::string, std::vector<double>> runs;
+  std::string line;
+  std::getline(in, line);  // the column headings
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    for (int i = 0; i < 6; i++) {
+      size_t comma = line.find(',', pos);
+      if (comma == std::string::npos)
+        break;
+      fields.push_back(line.substr(pos, comma - pos));
+      pos = comma + 1;
+    }
+    // Only the runs, not the summaries of them.
+    if (fields.size() == 6 && fields[1].empty())
+      runs[fields[0]].push_back(atof(fields[5].c_str()));
+  }
+  for (auto it = runs.begin(); it != runs.end(); ++it)
+    baseline[it->first] = Median(it->second);
+  return true;
+}
+
+static void Usage() {
+  fprintf(stderr,
+          "usage: regexp_benchmark [--repetitions=N] [--json=FILE] "
+          "[--csv=FILE] [--baseline=FILE] [--counters] [REGEXP...]\n"
+          "       regexp_benchmark --memory\n");
+  exit(2);
+}
+
 int main(int argc, const char** argv) {
+  std::vector<const char*> patterns;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+      repetitions = atoi(argv[i] + 14);
+      if (repetitions < 1)
+        Usage();
+    } else if (strncmp(argv[i], "--json=", 7) == 0) {
+      json_path = argv[i] + 7;
+    } else if (strncmp(argv[i], "--csv=", 6) == 0) {
+      csv_path = argv[i] + 6;
+    } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+      if (!ReadBaseline(argv[i] + 11)) {
+        fprintf(stderr, "cannot read %s\n", argv[i] + 11);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--counters") == 0) {
+      use_counters = true;
+    } else if (strcmp(argv[i], "--memory") == 0) {
+      re2::MemoryUsage();
+      return 0;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      Usage();
+    } else {
+      patterns.push_back(argv[i]);
+    }
+  }
+
   for (int i = 0; i < nbenchmarks; i++) {
     Benchmark* b = benchmarks[i];
-    if (!WantBench(b->name(), argc, argv))
+    if (!WantBench(b->name(), patterns))
       continue;
-    for (int arg = b->lo(); arg <= b->hi(); arg <<= 1)
-      RunBench(b, arg);
+    std::vector<SweepPoint> points;
+    for (int64_t arg = b->lo(); arg <= b->hi(); arg *= b->multiplier()) {
+      for (int threads = b->thread_lo();; threads *= 2) {
+        threads = std::min(threads, b->thread_hi());
+        points.push_back(RunBench(b, static_cast<int>(arg), threads));
+        if (threads == b->thread_hi())
+          break;
+      }
+    }
+    // A benchmark that processes bytes over a range of sizes on one
+    // thread is a size sweep.
+    if (b->has_arg() && !b->has_thread_range())
+      FitSweep(b, points);
+  }
+
+  if (json_path != NULL && !WriteJSON(json_path)) {
+    fprintf(stderr, "cannot write %s\n", json_path);
+    return 1;
+  }
+  if (csv_path != NULL && !WriteCSV(csv_path)) {
+    fprintf(stderr, "cannot write %s\n", csv_path);
+    return 1;
   }
+  return 0;
 }
@@ -5,7 +5,9 @@
 #pragma once
 
 #include <stdint.h>
+#include <algorithm>
 #include <functional>
+#include <string>
 
 #include "re2/testing/util/logging.h"
 #include "re2/testing/util/util.h"
@@ -15,6 +17,8 @@ void StartBenchmarkTiming();
 void StopBenchmarkTiming();
 void SetBenchmarkBytesProcessed(int64_t b);
 void SetBenchmarkItemsProcessed(int64_t i);
+void SetBenchmarkLabel(const std::string& label);
+void AddBenchmarkLatency(int64_t ns);
 
 namespace benchmark {
 
@@ -60,10 +64,18 @@ class State {
 
  public:
   explicit State(int64_t iters)
-      : iters_(iters), arg_(0), has_arg_(false) {}
+      : iters_(iters), arg_(0), has_arg_(false),
+        thread_index_(0), threads_(1) {}
 
   State(int64_t iters, int64_t arg)
-      : iters_(iters), arg_(arg), has_arg_(true) {}
+      : iters_(iters), arg_(arg), has_arg_(true),
+        thread_index_(0), threads_(1) {}
+
+  // One of threads states, each run on its own thread at the same time.
+  State(int64_t iters, int64_t arg, bool has_arg, int thread_index,
+        int threads)
+      : iters_(iters), arg_(arg), has_arg_(has_arg),
+        thread_index_(thread_index), threads_(threads) {}
 
   Iterator begin() {
     // We are about to start the loop, so start timing.
@@ -77,14 +89,24 @@ class State {
 
   void SetBytesProcessed(int64_t b) { SetBenchmarkBytesProcessed(b); }
   void SetItemsProcessed(int64_t i) { SetBenchmarkItemsProcessed(i); }
+  void SetLabel(const std::string& label) { SetBenchmarkLabel(label); }
+  // Records the latency of one operation. The harness reports the
+  // percentiles of the latencies recorded in a run.
+  void AddLatency(int64_t ns) { AddBenchmarkLatency(ns); }
   int64_t iterations() const { return iters_; }
   // Pretend to support multiple arguments.
   int64_t range(int pos) const { CHECK(has_arg_); return arg_; }
+  // Which of the threads running the benchmark this is, from 0, and how
+  // many of them there are.
+  int thread_index() const { return thread_index_; }
+  int threads() const { return threads_; }
 
  private:
   int64_t iters_;
   int64_t arg_;
   bool has_arg_;
+  int thread_index_;
+  int threads_;
 
   State(const State&) = delete;
   State& operator=(const State&) = delete;
@@ -96,47 +118,81 @@ namespace testing {
 
 class Benchmark {
  public:
+  // The arguments of a run of the benchmark function.
+  typedef std::function<void(int iters, int arg, int thread_index,
+                             int threads)> Func;
+
   Benchmark(const char* name, void (*func)(benchmark::State&))
       : name_(name),
-        func_([func](int iters, int arg) {
-          benchmark::State state(iters);
+        func_([func](int iters, int arg, int thread_index, int threads) {
+          benchmark::State state(iters, 0, false, thread_index, threads);
           func(state);
         }),
         lo_(0),
         hi_(0),
-        has_arg_(false) {
+        multiplier_(2),
+        has_arg_(false),
+        thread_lo_(1),
+        thread_hi_(1),
+        has_thread_range_(false) {
     Register();
   }
 
   Benchmark(const char* name, void (*func)(benchmark::State&), int lo, int hi)
       : name_(name),
-        func_([func](int iters, int arg) {
-          benchmark::State state(iters, arg);
+        func_([func](int iters, int arg, int thread_index, int threads) {
+          benchmark::State state(iters, arg, true, thread_index, threads);
           func(state);
         }),
         lo_(lo),
         hi_(hi),
-        has_arg_(true) {
+        multiplier_(2),
+        has_arg_(true),
+        thread_lo_(1),
+        thread_hi_(1),
+        has_thread_range_(false) {
     Register();
   }
 
-  // Pretend to support multiple threads.
-  Benchmark* ThreadRange(int lo, int hi) { return this; }
+  // Runs the benchmark on lo threads, then on twice as many, and so on up
+  // to hi threads, all calling the benchmark function at the same time.
+  // Each thread runs the iterations that a run on one thread would.
+  Benchmark* ThreadRange(int lo, int hi) {
+    thread_lo_ = std::max(1, lo);
+    thread_hi_ = std::max(thread_lo_, hi);
+    has_thread_range_ = true;
+    return this;
+  }
+
+  // Runs a benchmark with a range on lo, then on m times lo, and so on up
+  // to hi, instead of on every power of two in between.
+  Benchmark* RangeMultiplier(int m) {
+    multiplier_ = std::max(2, m);
+    return this;
+  }
 
   const char* name() const { return name_; }
-  const std::function<void(int, int)>& func() const { return func_; }
+  const Func& func() const { return func_; }
   int lo() const { return lo_; }
   int hi() const { return hi_; }
+  int multiplier() const { return multiplier_; }
   bool has_arg() const { return has_arg_; }
+  int thread_lo() const { return thread_lo_; }
+  int thread_hi() const { return thread_hi_; }
+  bool has_thread_range() const { return has_thread_range_; }
 
  private:
   void Register();
 
   const char* name_;
-  std::function<void(int, int)> func_;
+  Func func_;
   int lo_;
   int hi_;
+  int multiplier_;
   bool has_arg_;
+  int thread_lo_;
+  int thread_hi_;
+  bool has_thread_range_;
 
   Benchmark(const Benchmark&) = delete;
   Benchmark& operator=(const Benchmark&) = delete;
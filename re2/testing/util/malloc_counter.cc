@@ -0,0 +1,121 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Replaces the C allocation functions, as glibc allows a program to, with
+// ones that count and then call glibc's own. Block sizes are those that
+// malloc_usable_size reports, which can be a little more than was asked
+// for.
+
+#include <errno.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "re2/testing/util/malloc_counter.h"
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* p);
+}
+
+namespace {
+
+std::atomic<bool> counting(false);
+std::atomic<int64_t> allocs(0);
+std::atomic<int64_t> frees(0);
+std::atomic<int64_t> bytes_allocated(0);
+std::atomic<int64_t> bytes_in_use(0);
+
+void CountAlloc(void* p) {
+  if (p == NULL || !counting.load(std::memory_order_relaxed))
+    return;
+  int64_t size = static_cast<int64_t>(malloc_usable_size(p));
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+  bytes_in_use.fetch_add(size, std::memory_order_relaxed);
+}
+
+void CountFree(void* p) {
+  if (p == NULL || !counting.load(std::memory_order_relaxed))
+    return;
+  int64_t size = static_cast<int64_t>(malloc_usable_size(p));
+  frees.fetch_add(1, std::memory_order_relaxed);
+  bytes_in_use.fetch_sub(size, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+namespace testing {
+
+void SetMallocCounting(bool on) {
+  counting.store(on);
+}
+
+MallocCounts GetMallocCounts() {
+  MallocCounts c;
+  c.allocs = allocs.load();
+  c.frees = frees.load();
+  c.bytes_allocated = bytes_allocated.load();
+  c.bytes_in_use = bytes_in_use.load();
+  return c;
+}
+
+}  // namespace testing
+
+extern "C" {
+
+void* malloc(size_t size) {
+  void* p = __libc_malloc(size);
+  CountAlloc(p);
+  return p;
+}
+
+void* calloc(size_t n, size_t size) {
+  void* p = __libc_calloc(n, size);
+  CountAlloc(p);
+  return p;
+}
+
+// A realloc counts as freeing the old block and allocating the new one.
+void* realloc(void* p, size_t size) {
+  if (p == NULL)
+    return malloc(size);
+  CountFree(p);
+  void* q = __libc_realloc(p, size);
+  // If that failed, p is still allocated.
+  CountAlloc(q != NULL || size == 0 ? q : p);
+  return q;
+}
+
+void free(void* p) {
+  CountFree(p);
+  __libc_free(p);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  void* p = __libc_memalign(alignment, size);
+  CountAlloc(p);
+  return p;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size) {
+  if (alignment % sizeof(void*) != 0 ||
+      (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  void* p = memalign(alignment, size);
+  if (p == NULL)
+    return ENOMEM;
+  *result = p;
+  return 0;
+}
+
+}  // extern "C"
@@ -0,0 +1,33 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+// A binary linked with malloc_counter.o has malloc, free and the rest of
+// the C allocation functions replaced by ones that count the calls and
+// the bytes, and then call those of glibc. That covers operator new and
+// the Rust code of regex-capi, which allocates with malloc too; see
+// rure_get_alloc_counts for how much of it is Rust's. The counts cover only
+// the time that counting is on, in every thread, so the difference of two
+// snapshots is what was allocated between them. Freeing a block that was
+// allocated while counting was off still counts.
+
+#include <stdint.h>
+
+namespace testing {
+
+struct MallocCounts {
+  int64_t allocs;           // blocks allocated
+  int64_t frees;            // blocks freed
+  int64_t bytes_allocated;  // bytes in the blocks allocated
+  int64_t bytes_in_use;     // bytes_allocated less the bytes freed
+};
+
+// Turns counting on or off. It starts off.
+void SetMallocCounting(bool on);
+
+// Returns the counts so far.
+MallocCounts GetMallocCounts();
+
+}  // namespace testing
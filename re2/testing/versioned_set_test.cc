@@ -0,0 +1,109 @@
+// Copyright 2010 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "re2/testing/util/test.h"
+#include "re2/testing/util/logging.h"
+#include "re2/re2.h"
+#include "re2/versioned_set.h"
+
+namespace re2 {
+
+TEST(VersionedSet, Empty) {
+  VersionedSet s(RE2::DefaultOptions, RE2::UNANCHORED);
+  std::vector<int> v;
+  ASSERT_EQ(s.version(), 0);
+  ASSERT_EQ(s.Match("foo", &v), false);
+  ASSERT_EQ(v.size(), 0);
+  ASSERT_EQ(s.MatchFirst("foo"), -1);
+}
+
+TEST(VersionedSet, Update) {
+  VersionedSet s(RE2::DefaultOptions, RE2::UNANCHORED);
+
+  std::vector<std::string> first = {"foo", "bar"};
+  ASSERT_EQ(s.Update(first, NULL), true);
+  ASSERT_EQ(s.version(), 1);
+
+  std::vector<int> v;
+  ASSERT_EQ(s.Match("foobar", &v), true);
+  ASSERT_EQ(v.size(), 2);
+  ASSERT_EQ(s.MatchFirst("xbar"), 1);
+  ASSERT_EQ(s.Match("baz", NULL), false);
+
+  std::vector<std::string> second = {"baz"};
+  ASSERT_EQ(s.Update(second, NULL), true);
+  ASSERT_EQ(s.version(), 2);
+  ASSERT_EQ(s.Match("foobar", NULL), false);
+  ASSERT_EQ(s.MatchFirst("baz"), 0);
+}
+
+TEST(VersionedSet, BadUpdateKeepsVersion) {
+  VersionedSet s(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
+
+  std::vector<std::string> good = {"a+", "b+"};
+  ASSERT_EQ(s.Update(good, NULL), true);
+
+  std::vector<std::string> bad = {"c+", "("};
+  std::string error;
+  ASSERT_EQ(s.Update(bad, &error), false);
+  ASSERT_NE(error, "");
+  ASSERT_EQ(s.version(), 1);
+  ASSERT_EQ(s.MatchFirst("bbb"), 1);
+  ASSERT_EQ(s.MatchFirst("ccc"), -1);
+}
+
+// Each pattern fits in the size limit on its own, so Add() takes them,
+// but together they do not, so Compile() fails; the error says so.
+TEST(VersionedSet, UpdateTooBig) {
+  VersionedSet s(RE2::DefaultOptions, RE2::UNANCHORED);
+
+  std::vector<std::string> big;
+  for (int i = 0; i < 64; i++)
+    big.push_back("\\w{100}" + std::to_string(i));
+  std::string error;
+  ASSERT_EQ(s.Update(big, &error), false);
+  ASSERT_NE(error.find("exceeded limit"), std::string::npos);
+  ASSERT_EQ(s.version(), 0);
+}
+
+// Matchers keep running while the set is replaced underneath them.
+// Every version holds the same patterns in a different order, so each
+// MatchFirst() must return one of the two valid answers.
+TEST(VersionedSet, ConcurrentUpdates) {
+  VersionedSet s(RE2::DefaultOptions, RE2::UNANCHORED);
+  std::vector<std::string> ab = {"a", "b"};
+  std::vector<std::string> ba = {"b", "a"};
+  ASSERT_EQ(s.Update(ab, NULL), true);
+
+  std::atomic<bool> done(false);
+  std::atomic<int> bad(0);
+  std::vector<std::thread> matchers;
+  for (int i = 0; i < 4; i++) {
+    matchers.emplace_back([&s, &done, &bad]() {
+      while (!done.load()) {
+        int n = s.MatchFirst("xay");
+        int m = s.MatchFirst("xby");
+        if ((n != 0 && n != 1) || (m != 0 && m != 1))
+          bad++;
+      }
+    });
+  }
+  for (int i = 0; i < 200; i++)
+    ASSERT_EQ(s.Update(i % 2 == 0 ? ba : ab, NULL), true);
+  done = true;
+  for (size_t i = 0; i < matchers.size(); i++)
+    matchers[i].join();
+
+  ASSERT_EQ(bad.load(), 0);
+  ASSERT_EQ(s.version(), 201);
+  ASSERT_EQ(s.MatchFirst("xay"), 0);  // the last update installed ab
+}
+
+}  // namespace re2
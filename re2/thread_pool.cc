@@ -0,0 +1,149 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: Interface implementation in thread_pool.h.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "re2/thread_pool.h"
+
+namespace re2
+{
+  // One call to Run(). Threads claim task indices from next until they run
+  // out; a thread that wakes up after the job is over finds nothing left to
+  // claim, so it never touches fn.
+  struct ThreadPool::Job
+  {
+    Job(const std::function<void(int)> *fn, int n)
+        : fn(fn), n(n), next(0), done(0) {}
+
+    const std::function<void(int)> *fn;
+    const int n;
+    std::atomic<int> next;
+    std::atomic<int> done;
+  };
+
+  ThreadPool::ThreadPool(int num_threads)
+      : stop_(false)
+  {
+    for (int i = 1; i < num_threads; i++)
+      threads_.emplace_back(&ThreadPool::Work, this);
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      stop_ = true;
+    }
+    work_.notify_all();
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+  }
+
+  ThreadPool *ThreadPool::Default()
+  {
+    static ThreadPool *const pool =
+        new ThreadPool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+  }
+
+  // The pool whose task this thread is running, if any.
+  static thread_local const ThreadPool *running_pool = NULL;
+
+  void ThreadPool::Run(int n, const std::function<void(int)> &fn)
+  {
+    if (n <= 0)
+      return;
+    std::lock_guard<std::mutex> run(run_mutex_);
+    RunLocked(n, fn);
+  }
+
+  bool ThreadPool::TryRun(int n, const std::function<void(int)> &fn)
+  {
+    if (n <= 0)
+      return true;
+    // The thread that called Run() holds run_mutex_ while it runs tasks,
+    // and try_lock on a mutex that the thread holds is undefined.
+    if (running_pool == this)
+      return false;
+    std::unique_lock<std::mutex> run(run_mutex_, std::try_to_lock);
+    if (!run.owns_lock())
+      return false;
+    RunLocked(n, fn);
+    return true;
+  }
+
+  void ThreadPool::RunLocked(int n, const std::function<void(int)> &fn)
+  {
+    std::shared_ptr<Job> job = std::make_shared<Job>(&fn, n);
+    if (n > 1)
+    {
+      {
+        std::lock_guard<std::mutex> l(mutex_);
+        job_ = job;
+      }
+      work_.notify_all();
+    }
+    RunTasks(job.get());
+
+    std::unique_lock<std::mutex> l(mutex_);
+    done_.wait(l, [&job]() { return job->done.load() == job->n; });
+    job_.reset();
+  }
+
+  void ThreadPool::RunTasks(Job *job)
+  {
+    const ThreadPool *outer = running_pool;
+    running_pool = this;
+    for (int i; (i = job->next.fetch_add(1)) < job->n;)
+    {
+      (*job->fn)(i);
+      job->done.fetch_add(1);
+    }
+    running_pool = outer;
+  }
+
+  void ThreadPool::Work()
+  {
+    std::shared_ptr<Job> last;
+    for (;;)
+    {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> l(mutex_);
+        work_.wait(l, [this, &last]() {
+          return stop_ || (job_ != nullptr && job_ != last);
+        });
+        if (stop_)
+          return;
+        job = job_;
+      }
+      RunTasks(job.get());
+      {
+        // Run() checks done under the same mutex, so it cannot miss this.
+        std::lock_guard<std::mutex> l(mutex_);
+        if (job->done.load() == job->n)
+          done_.notify_all();
+      }
+      last = job;
+    }
+  }
+} // namespace re2
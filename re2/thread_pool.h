@@ -0,0 +1,75 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: Fixed-size pool of threads for the batch matching APIs.
+ ******************************************************************************/
+
+#pragma once
+
+// A ThreadPool runs the independent pieces of one batch operation, such as
+// RE2::Set::MatchMany(), on a fixed set of threads that are started once and
+// then reused, so a batch does not pay for creating threads.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace re2 {
+
+class ThreadPool {
+ public:
+  // Starts num_threads - 1 threads; the thread that calls Run() is the last
+  // one. num_threads is at least 1.
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int num_threads() const { return static_cast<int>(threads_.size()) + 1; }
+
+  // Calls fn(0), fn(1), ..., fn(n - 1), each exactly once and in no
+  // particular order, on the threads of the pool, and returns when all of
+  // the calls have returned. Concurrent calls to Run() are serialized, and
+  // fn must not call Run() on the same pool.
+  void Run(int n, const std::function<void(int)>& fn);
+
+  // Like Run(), but only if no other call to Run() or TryRun() is under way
+  // and this is not one of the calls fn of a job of this pool; otherwise
+  // returns false at once without calling fn, so that the caller can do the
+  // work itself rather than wait for the pool.
+  bool TryRun(int n, const std::function<void(int)>& fn);
+
+  // Returns a pool with one thread per CPU, created on first use.
+  static ThreadPool* Default();
+
+ private:
+  struct Job;
+
+  void Work();
+  void RunLocked(int n, const std::function<void(int)>& fn);
+  void RunTasks(Job* job);
+
+  std::vector<std::thread> threads_;
+  std::mutex run_mutex_;  // serializes Run() and TryRun()
+  std::mutex mutex_;      // guards the fields below
+  std::condition_variable work_;
+  std::condition_variable done_;
+  std::shared_ptr<Job> job_;
+  bool stop_;
+};
+
+}  // namespace re2
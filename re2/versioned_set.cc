@@ -0,0 +1,177 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: Interface implementation in versioned_set.h.
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "re2/testing/util/logging.h"
+#include "re2/re2.h"
+#include "re2/set.h"
+#include "re2/versioned_set.h"
+
+namespace re2
+{
+  struct VersionedSet::Snapshot
+  {
+    Snapshot(const RE2::Options &options, RE2::Anchor anchor, uint64_t version)
+        : set(options, anchor), version(version) {}
+
+    RE2::Set set;
+    uint64_t version;
+  };
+
+  // Each thread sticks to one stripe, picked round-robin on first use.
+  static int ThisThreadStripe(int nstripes)
+  {
+    static std::atomic<int> next(0);
+    thread_local int stripe = next.fetch_add(1, std::memory_order_relaxed);
+    return stripe % nstripes;
+  }
+
+  // Marks the calling thread as a matcher for its lifetime and hands out the
+  // snapshot that was current when it started.
+  //
+  // The reader bumps the counter of the current epoch parity before loading
+  // the snapshot pointer. Synchronize() flips the parity after a new pointer
+  // has been published and waits for the old parity to drain, so a reader it
+  // does not wait for is guaranteed to load the new pointer. All operations
+  // are sequentially consistent; that total order is what the argument above
+  // relies on.
+  class VersionedSet::ReadLock
+  {
+  public:
+    explicit ReadLock(const VersionedSet *vs)
+        : counter_(&vs->stripes_[ThisThreadStripe(kStripes)]
+                        .readers[vs->epoch_.load() & 1])
+    {
+      counter_->fetch_add(1);
+      snapshot_ = vs->current_.load();
+    }
+
+    ~ReadLock()
+    {
+      counter_->fetch_sub(1);
+    }
+
+    const Snapshot *snapshot() const { return snapshot_; }
+
+  private:
+    std::atomic<int64_t> *counter_;
+    const Snapshot *snapshot_;
+
+    ReadLock(const ReadLock &) = delete;
+    ReadLock &operator=(const ReadLock &) = delete;
+  };
+
+  VersionedSet::VersionedSet(const RE2::Options &options, RE2::Anchor anchor)
+      : options_(options),
+        anchor_(anchor),
+        current_(nullptr),
+        epoch_(0)
+  {
+    for (int i = 0; i < kStripes; i++)
+    {
+      stripes_[i].readers[0].store(0);
+      stripes_[i].readers[1].store(0);
+    }
+  }
+
+  VersionedSet::~VersionedSet()
+  {
+    // No matcher may be running at this point.
+    delete current_.load();
+  }
+
+  bool VersionedSet::Update(const std::vector<std::string> &patterns,
+                            std::string *error)
+  {
+    std::lock_guard<std::mutex> l(update_mutex_);
+
+    Snapshot *old = current_.load();
+    Snapshot *next = new Snapshot(options_, anchor_,
+                                  old == nullptr ? 1 : old->version + 1);
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+      if (next->set.Add(patterns[i], error) != static_cast<int>(i))
+      {
+        delete next;
+        return false;
+      }
+    }
+    if (!next->set.Compile(error))
+    {
+      delete next;
+      return false;
+    }
+
+    // Build the lazily constructed parts of the set here, so that the first
+    // matcher to use the new version does not pay for them.
+    next->set.MatchFirst("");
+
+    current_.store(next);
+    Synchronize();
+    delete old;
+    return true;
+  }
+
+  void VersionedSet::Synchronize()
+  {
+    // A reader that sampled the parity just before a flip may still bump the
+    // old counter after we have seen it drain. It will then load the new
+    // pointer, but a later Synchronize() that flips back to that parity
+    // would not wait for it. Draining both parities in turn, as SRCU does,
+    // covers that reader as well.
+    for (int round = 0; round < 2; round++)
+    {
+      unsigned old_parity = epoch_.fetch_add(1) & 1;
+      for (int i = 0; i < kStripes; i++)
+      {
+        while (stripes_[i].readers[old_parity].load() != 0)
+          std::this_thread::yield();
+      }
+    }
+  }
+
+  bool VersionedSet::Match(const StringPiece &text, std::vector<int> *v) const
+  {
+    ReadLock l(this);
+    if (l.snapshot() == nullptr)
+    {
+      if (v != NULL)
+        v->clear();
+      return false;
+    }
+    return l.snapshot()->set.Match(text, v);
+  }
+
+  int VersionedSet::MatchFirst(const StringPiece &text) const
+  {
+    ReadLock l(this);
+    if (l.snapshot() == nullptr)
+      return -1;
+    return l.snapshot()->set.MatchFirst(text);
+  }
+
+  uint64_t VersionedSet::version() const
+  {
+    ReadLock l(this);
+    return l.snapshot() == nullptr ? 0 : l.snapshot()->version;
+  }
+} // namespace re2
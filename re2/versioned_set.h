@@ -0,0 +1,97 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-18
+ * Description: RE2::Set wrapper that can be updated while it is being matched.
+ ******************************************************************************/
+
+#pragma once
+
+// A VersionedSet is an RE2::Set whose patterns can be replaced while other
+// threads keep matching against it.
+//
+// RE2::Set does not allow Add() after Compile(), so changing the rules means
+// building a new Set and swapping it in. Doing that under a lock stalls every
+// matcher for as long as the swap (and the destruction of the old Set) takes.
+// VersionedSet instead compiles the new Set on the updating thread and then
+// publishes it with a single atomic pointer exchange. Matchers load the
+// current snapshot without taking a lock; the old snapshot is deleted once
+// every matcher that could still be using it has finished (a read-copy-update
+// scheme with two reader epochs, in the style of SRCU).
+//
+// Update() may block for as long as it takes the in-flight matches to drain;
+// Match() and MatchFirst() never block.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "re2/re2.h"
+#include "re2/set.h"
+
+namespace re2 {
+
+class VersionedSet {
+ public:
+  VersionedSet(const RE2::Options& options, RE2::Anchor anchor);
+  ~VersionedSet();
+
+  // Not copyable or movable: matchers hold pointers into it.
+  VersionedSet(const VersionedSet&) = delete;
+  VersionedSet& operator=(const VersionedSet&) = delete;
+
+  // Compiles patterns into a new set and makes it the current version.
+  // Index i in the output of Match() refers to patterns[i].
+  // Returns false, leaving the current version in place, if any of the
+  // patterns cannot be parsed or the set cannot be compiled; if error is
+  // not NULL, *error will hold the reason.
+  // Calls are serialized; concurrent Match() calls are never blocked.
+  bool Update(const std::vector<std::string>& patterns, std::string* error);
+
+  // As RE2::Set::Match() and RE2::Set::MatchFirst(), against the version
+  // that is current when the call starts. Before the first successful
+  // Update(), nothing matches.
+  bool Match(const StringPiece& text, std::vector<int>* v) const;
+  int MatchFirst(const StringPiece& text) const;
+
+  // Returns the number of successful Update() calls so far.
+  uint64_t version() const;
+
+ private:
+  struct Snapshot;
+  class ReadLock;
+
+  // Waits until no matcher can still hold a snapshot that was current
+  // before the call.
+  void Synchronize();
+
+  // Number of reader counter stripes. Readers are spread over the stripes
+  // so they do not all bounce the same cache line.
+  static const int kStripes = 16;
+
+  // In-flight matchers per epoch parity, padded out to a cache line.
+  struct Stripe {
+    std::atomic<int64_t> readers[2];
+    char pad[64 - 2 * sizeof(std::atomic<int64_t>)];
+  };
+
+  RE2::Options options_;
+  RE2::Anchor anchor_;
+  std::atomic<Snapshot*> current_;
+  std::atomic<unsigned> epoch_;
+  mutable Stripe stripes_[kStripes];
+  std::mutex update_mutex_;  // serializes Update(); never taken by readers
+};
+
+}  // namespace re2
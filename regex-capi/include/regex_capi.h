@@ -22,6 +22,30 @@ typedef struct rure rure;
  */
 typedef struct rure_set rure_set;
 
+/*
+ * rure_set_cache is the search state of a rure_set, for use by one thread at
+ * a time. See rure_set_cache_acquire.
+ */
+typedef struct rure_set_cache rure_set_cache;
+
+/*
+ * rure_set_stats holds the counters of the searches run on a rure_set. See
+ * rure_set_get_stats.
+ */
+typedef struct rure_set_stats {
+  /* The number of automaton searches run. */
+  uint64_t searches;
+  /* The number of searches that the lazy DFA gave up on (or could not run,
+     because it did not fit in its cache) and that the NFA ran instead. */
+  uint64_t dfa_fallbacks;
+  /* The number of times a lazy DFA cache filled up and was cleared. */
+  uint64_t cache_clears;
+  /* The memory, in bytes, held by the search caches right now. */
+  uint64_t cache_bytes;
+  /* The number of search caches right now, one per concurrent searcher. */
+  uint64_t caches;
+} rure_set_stats;
+
 /*
  * rure_options is the set of non-flag configuration options for compiling
  * a regular expression. Currently, only two options are available: setting
@@ -116,17 +140,35 @@ typedef struct rure_iter_capture_names rure_iter_capture_names;
  */
 typedef struct rure_error rure_error;
 
-typedef struct 
-{
-    char *atom;
-} Atoms;
+/*
+ * rure_prefilter is the prefilter of a pattern: a tree of AND and OR nodes
+ * over literal strings (atoms), such that the text of every match of the
+ * pattern satisfies the tree. A text satisfies an atom if it contains it.
+ */
+typedef struct rure_prefilter rure_prefilter;
 
+/*
+ * The operations of the nodes of a rure_prefilter. They have the same values
+ * as re2::Prefilter::Op.
+ */
+/* Any text satisfies the node. */
+#define RURE_PREFILTER_ALL 0
+/* No text satisfies the node. */
+#define RURE_PREFILTER_NONE 1
+/* The text must contain the atom of the node. */
+#define RURE_PREFILTER_ATOM 2
+/* The text must satisfy every child of the node. */
+#define RURE_PREFILTER_AND 3
+/* The text must satisfy at least one child of the node. */
+#define RURE_PREFILTER_OR 4
 
-typedef struct 
-{
-    Atoms *data;
-    int32_t len;
-} MyVec;
+/*
+ * rure_atoms finds which of a list of lowercased strings (atoms) occur in a
+ * text, ignoring case. It is used by re2::FilteredRE2.
+ *
+ * It is safe to use from multiple threads simultaneously.
+ */
+typedef struct rure_atoms rure_atoms;
 
 /*
  * rure_compile_must compiles the given pattern into a regular expression. If
@@ -321,6 +363,49 @@ bool rure_captures_at(rure_captures *captures, size_t i, rure_match *match);
  */
 size_t rure_captures_len(rure_captures *captures);
 
+/*
+ * rure_options_new allocates space for options.
+ *
+ * Options may be freed immediately after a call to rure_compile, but otherwise
+ * may be freely used in multiple calls to rure_compile.
+ *
+ * It is not safe to set options from multiple threads simultaneously. It is
+ * safe to call rure_compile from multiple threads simultaneously using the
+ * same options pointer.
+ */
+rure_options *rure_options_new(void);
+
+/*
+ * rure_options_free frees the given options.
+ *
+ * This must be called at most once.
+ */
+void rure_options_free(rure_options *options);
+
+/*
+ * rure_options_size_limit sets the approximate size limit of the compiled
+ * regular expression.
+ *
+ * This size limit roughly corresponds to the number of bytes occupied by a
+ * single compiled program. If the program would exceed this number, then a
+ * compilation error will be returned from rure_compile.
+ */
+void rure_options_size_limit(rure_options *options, size_t limit);
+
+/*
+ * rure_options_dfa_size_limit sets the approximate size of the cache used by
+ * the DFA during search.
+ *
+ * This roughly corresponds to the number of bytes that the DFA will use while
+ * searching.
+ *
+ * Note that this is a *per thread* limit. There is no way to set a global
+ * limit. In particular, if a regular expression is used from multiple threads
+ * simultaneously, then each thread may use up to the number of bytes
+ * specified here.
+ */
+void rure_options_dfa_size_limit(rure_options *options, size_t limit);
+
 
 
 /*
@@ -341,6 +426,10 @@ size_t rure_captures_len(rure_captures *captures);
  *
  * error is set if there was a problem compiling the pattern.
  *
+ * If every pattern is a literal string anchored at both ends (`^literal$`),
+ * the set is a literal set: it is matched by a hash lookup of the whole
+ * haystack, and no automaton is built.
+ *
  * The compiled expression set returned may be used from multiple threads.
  */
 rure_set *rure_compile_set(const uint8_t **patterns,
@@ -402,6 +491,75 @@ bool rure_set_is_match(rure_set *re, const uint8_t *haystack, size_t length,
 bool rure_set_matches(rure_set *re, const uint8_t *haystack, size_t length,
                       size_t start, bool *matches);
 
+/*
+ * rure_set_match_first returns the index of the first pattern (in the order
+ * passed to `rure_compile_set`) that matches anywhere in the haystack, or -1
+ * if none of them match.
+ *
+ * Unlike rure_set_matches, the search stops as soon as a pattern has matched
+ * and no pattern with a smaller index can still match, so it is the cheaper
+ * call when the set is an ordered list of rules and only the winner matters.
+ * The automaton behind it is built on the first call.
+ *
+ * haystack, length and start are interpreted as in rure_set_matches.
+ */
+int32_t rure_set_match_first(rure_set *re, const uint8_t *haystack,
+                             size_t length, size_t start);
+
+/*
+ * rure_set_cache_acquire returns a search cache for re, for use with
+ * rure_set_matches_ids. Caches released with rure_set_cache_release are
+ * reused, so a thread that matches many haystacks keeps the states its
+ * searches have already built.
+ *
+ * A cache must be used by one thread at a time, and must be released before
+ * re is freed.
+ */
+rure_set_cache *rure_set_cache_acquire(rure_set *re);
+
+/*
+ * rure_set_cache_release gives cache back to the set it was acquired from.
+ */
+void rure_set_cache_release(rure_set *re, rure_set_cache *cache);
+
+/*
+ * rure_set_matches_ids is rure_set_matches with the results in compact form:
+ * it returns the number of patterns that match, and points *ids at their
+ * indices in increasing order. The indices are owned by cache and remain
+ * valid until its next use.
+ *
+ * The search uses cache instead of the state shared by all threads, and does
+ * not allocate once the cache has grown to fit the results.
+ */
+size_t rure_set_matches_ids(rure_set *re, rure_set_cache *cache,
+                            const uint8_t *haystack, size_t length,
+                            size_t start, const uint32_t **ids);
+
+/*
+ * rure_set_matches_into is rure_set_matches with the results in compact form.
+ * It writes the indices of the patterns that match, in increasing order, to
+ * ids, stopping after capacity of them, and returns the number of patterns
+ * that match. If that is more than capacity, the call can be repeated with a
+ * larger ids. ids may be NULL if capacity is 0.
+ *
+ * If gave_up is not NULL, *gave_up is set to whether the lazy DFA gave up on
+ * the search, so that the slower NFA had to finish it. That happens when the
+ * DFA cache is too small for the set and the haystacks it sees.
+ */
+size_t rure_set_matches_into(rure_set *re, const uint8_t *haystack,
+                             size_t length, size_t start, int32_t *ids,
+                             size_t capacity, bool *gave_up);
+
+/*
+ * rure_set_get_stats fills *stats with the counters of the searches run on re
+ * so far, by all threads. Searches keep running while the counters are read,
+ * so they are not all read at the same instant.
+ *
+ * Literal sets (see rure_compile_set) are matched without an automaton and
+ * have no counters.
+ */
+void rure_set_get_stats(rure_set *re, rure_set_stats *stats);
+
 /*
  * rure_set_len returns the number of patterns rure_set was compiled with.
  */
@@ -512,7 +670,100 @@ const char *rure_rewrite(const uint8_t *rewrite, size_t len, const uint8_t **vec
 */
 size_t rure_replace_count(rure *re, const char *haystack);
 
-MyVec rure_filter_compile(const uint8_t *regex_str, size_t regex_len, size_t min_atoms_len);
+/*
+ * rure_prefilter_new computes the prefilter of the given pattern, parsed with
+ * the given RURE_FLAG_* flags, except that RURE_FLAG_CASEI and (?i) are
+ * ignored: atoms are lowercased and meant to be searched for in lowercased
+ * text. If latin1 is true, the pattern is Latin-1 text that was converted to
+ * UTF-8; only ASCII letters are lowercased and atoms are converted back to
+ * Latin-1.
+ *
+ * Returns NULL if the pattern does not parse. The prefilter must be freed
+ * with rure_prefilter_free.
+ */
+rure_prefilter *rure_prefilter_new(const uint8_t *pattern, size_t length,
+                                   uint32_t flags, bool latin1);
+
+/*
+ * rure_prefilter_free frees the given prefilter.
+ */
+void rure_prefilter_free(rure_prefilter *pf);
+
+/*
+ * rure_prefilter_len returns the number of nodes of the given prefilter.
+ * Nodes are numbered children first; the root is node len - 1.
+ */
+size_t rure_prefilter_len(const rure_prefilter *pf);
+
+/*
+ * rure_prefilter_op returns the RURE_PREFILTER_* operation of the given node.
+ */
+int rure_prefilter_op(const rure_prefilter *pf, size_t node);
+
+/*
+ * rure_prefilter_atom sets *atom to the atom of the given RURE_PREFILTER_ATOM
+ * node and returns its length. The atom is not NUL terminated and lives as
+ * long as the prefilter.
+ */
+size_t rure_prefilter_atom(const rure_prefilter *pf, size_t node,
+                           const uint8_t **atom);
+
+/*
+ * rure_prefilter_children sets *children to the node numbers of the children
+ * of the given RURE_PREFILTER_AND or RURE_PREFILTER_OR node and returns how
+ * many there are. The array lives as long as the prefilter.
+ */
+size_t rure_prefilter_children(const rure_prefilter *pf, size_t node,
+                               const size_t **children);
+
+/*
+ * rure_atoms_new builds a matcher for the given atoms, which are lowercased
+ * as rure_prefilter_atom returns them. Atom i is atoms[i], which is
+ * lengths[i] bytes long. Text is matched against the atoms as is: ASCII
+ * letters match in either case, and so do the other letters of atoms that
+ * are UTF-8. An atom that is empty or has too many spellings in different
+ * cases is reported as occurring in every text.
+ *
+ * Returns NULL if the matcher could not be built. The matcher must be freed
+ * with rure_atoms_free.
+ */
+rure_atoms *rure_atoms_new(const uint8_t **atoms, const size_t *lengths,
+                           size_t count);
+
+/*
+ * rure_atoms_free frees the given atom matcher.
+ */
+void rure_atoms_free(rure_atoms *m);
+
+/*
+ * rure_atoms_match writes the indices of the atoms that occur in haystack, in
+ * increasing order, to ids, stopping after capacity of them, and returns the
+ * number of atoms that occur. If that is more than capacity, the call can be
+ * repeated with a larger ids. ids may be NULL if capacity is 0.
+ */
+size_t rure_atoms_match(const rure_atoms *m, const uint8_t *haystack,
+                        size_t length, int32_t *ids, size_t capacity);
+
+/*
+ * rure_alloc_counts holds the counters of the heap allocations made by the
+ * Rust code of this library. See rure_get_alloc_counts.
+ */
+typedef struct rure_alloc_counts {
+  /* The number of blocks allocated and freed so far. */
+  uint64_t allocs;
+  uint64_t frees;
+  /* The bytes allocated so far, and those allocated but not yet freed. */
+  uint64_t bytes_allocated;
+  int64_t bytes_in_use;
+} rure_alloc_counts;
+
+/*
+ * rure_get_alloc_counts fills *counts with the allocation counters, which are
+ * kept only if the library was built with the "count-alloc" feature of
+ * regex-capi. Returns false, with the counters all zero, if it was not.
+ * Reallocating a block counts as freeing it and allocating a new one.
+ */
+bool rure_get_alloc_counts(rure_alloc_counts *counts);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,99 @@
+/******************************************************************************
+ * Copyright (c) USTC(Suzhou) & Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * re2-rust licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: mengning<mengning@ustc.edu.cn>, liuzhitao<freekeeper@mail.ustc.edu.cn>, yangwentong<ywt0821@163.com>
+ * Create: 2026-10-19
+ * Description: Counting the heap allocations made on the Rust side.
+ ******************************************************************************/
+
+// With the "count-alloc" feature, every allocation made by Rust code in the
+// library goes through CountingAlloc, which counts it and hands it on to
+// the system allocator. rure_get_alloc_counts reads the counters; without the
+// feature it returns false and the allocator is the default one.
+
+use std::sync::atomic::{AtomicI64, AtomicU64, Ordering};
+
+#[repr(C)]
+pub struct rure_alloc_counts {
+    pub allocs: u64,
+    pub frees: u64,
+    pub bytes_allocated: u64,
+    pub bytes_in_use: i64,
+}
+
+static ALLOCS: AtomicU64 = AtomicU64::new(0);
+static FREES: AtomicU64 = AtomicU64::new(0);
+static BYTES_ALLOCATED: AtomicU64 = AtomicU64::new(0);
+static BYTES_IN_USE: AtomicI64 = AtomicI64::new(0);
+
+#[cfg(feature = "count-alloc")]
+mod counting {
+    use super::*;
+    use std::alloc::{GlobalAlloc, Layout, System};
+
+    pub struct CountingAlloc;
+
+    fn count_alloc(size: usize) {
+        ALLOCS.fetch_add(1, Ordering::Relaxed);
+        BYTES_ALLOCATED.fetch_add(size as u64, Ordering::Relaxed);
+        BYTES_IN_USE.fetch_add(size as i64, Ordering::Relaxed);
+    }
+
+    fn count_free(size: usize) {
+        FREES.fetch_add(1, Ordering::Relaxed);
+        BYTES_IN_USE.fetch_sub(size as i64, Ordering::Relaxed);
+    }
+
+    unsafe impl GlobalAlloc for CountingAlloc {
+        unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+            let p = System.alloc(layout);
+            if !p.is_null() {
+                count_alloc(layout.size());
+            }
+            p
+        }
+
+        unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+            let p = System.alloc_zeroed(layout);
+            if !p.is_null() {
+                count_alloc(layout.size());
+            }
+            p
+        }
+
+        unsafe fn dealloc(&self, p: *mut u8, layout: Layout) {
+            System.dealloc(p, layout);
+            count_free(layout.size());
+        }
+
+        // A realloc counts as freeing the old block and allocating the new.
+        unsafe fn realloc(&self, p: *mut u8, layout: Layout, size: usize) -> *mut u8 {
+            let q = System.realloc(p, layout, size);
+            if !q.is_null() {
+                count_free(layout.size());
+                count_alloc(size);
+            }
+            q
+        }
+    }
+
+    #[global_allocator]
+    static ALLOC: CountingAlloc = CountingAlloc;
+}
+
+#[no_mangle]
+extern "C" fn rure_get_alloc_counts(counts: *mut rure_alloc_counts) -> bool {
+    let counts = unsafe { &mut *counts };
+    counts.allocs = ALLOCS.load(Ordering::Relaxed);
+    counts.frees = FREES.load(Ordering::Relaxed);
+    counts.bytes_allocated = BYTES_ALLOCATED.load(Ordering::Relaxed);
+    counts.bytes_in_use = BYTES_IN_USE.load(Ordering::Relaxed);
+    cfg!(feature = "count-alloc")
+}
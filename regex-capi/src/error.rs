@@ -16,6 +16,7 @@ pub enum ErrorKind {
     None,
     Str(str::Utf8Error),
     Regex(regex::Error),
+    Build(Box<dyn std::error::Error + Send + Sync>),
     Nul(ffi::NulError),
 }
 
@@ -30,7 +31,9 @@ impl Error {
     pub fn is_err(&self) -> bool {
         match self.kind {
             ErrorKind::None => false,
-            ErrorKind::Str(_) | ErrorKind::Regex(_) | ErrorKind::Nul(_) => true,
+            ErrorKind::Str(_) | ErrorKind::Regex(_) | ErrorKind::Build(_) | ErrorKind::Nul(_) => {
+                true
+            }
         }
     }
 }
@@ -41,6 +44,7 @@ impl fmt::Display for Error {
             ErrorKind::None => write!(f, "no error"),
             ErrorKind::Str(ref e) => e.fmt(f),
             ErrorKind::Regex(ref e) => e.fmt(f),
+            ErrorKind::Build(ref e) => e.fmt(f),
             ErrorKind::Nul(ref e) => e.fmt(f),
         }
     }
@@ -15,16 +15,25 @@
 #[macro_use]
 mod error;
 pub use crate::error::*;
+mod alloc_count;
 
+use std::collections::BTreeSet;
 use std::ffi::{CStr, CString};
 use std::ops::Deref;
 use std::ptr;
 use std::slice;
 use std::str;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, OnceLock};
 
-use libc::{c_char, size_t};
+use aho_corasick::{AhoCorasick, AhoCorasickBuilder};
+use libc::{c_char, c_int, size_t};
 
 use regex::{bytes, Regex};
+use regex_automata::hybrid;
+use regex_automata::nfa::thompson::pikevm::{self, PikeVM};
+use regex_automata::util::pool::Pool;
+use regex_automata::PatternSet;
 
 use crate::error::{Error, ErrorKind};
 use std::io;
@@ -40,6 +49,12 @@ const RURE_FLAG_SPACE: u32 = 1 << 4;
 const RURE_FLAG_UNICODE: u32 = 1 << 5;
 const RURE_DEFAULT_FLAGS: u32 = RURE_FLAG_UNICODE;
 
+const RURE_PREFILTER_ALL: c_int = 0;
+const RURE_PREFILTER_NONE: c_int = 1;
+const RURE_PREFILTER_ATOM: c_int = 2;
+const RURE_PREFILTER_AND: c_int = 3;
+const RURE_PREFILTER_OR: c_int = 4;
+
 pub struct RegexBytes {
     re: bytes::Regex,
     // capture_names: HashMap<String, i32>,
@@ -49,6 +64,7 @@ pub struct RegexUnicode {
     re: Regex,
 }
 
+#[derive(Clone, Copy)]
 pub struct Options {
     size_limit: usize,
     dfa_size_limit: usize,
@@ -58,7 +74,113 @@ pub struct Options {
 // arbitrary position with a crate just yet. To circumvent this, we use
 // the `Exec` structure directly.
 pub struct RegexSet {
-    re: bytes::RegexSet,
+    engine: SetEngine,
+    pats: Vec<String>,
+    flags: u32,
+    options: Options,
+    // Built on first use by rure_set_match_first. None if the priority
+    // automaton could not be built; callers then fall back to `engine`.
+    first: OnceLock<Option<FirstMatcher>>,
+    // Caches handed back by rure_set_cache_release, kept warm for the next
+    // rure_set_cache_acquire.
+    caches: Mutex<Vec<Box<SetCache>>>,
+    // The counters of every search cache of the set, for rure_set_get_stats.
+    counters: Arc<Mutex<CounterList>>,
+}
+
+// How a RegexSet is matched. A set whose patterns are all anchored literals
+// (`^literal$`) is only a dictionary, so it is answered by a hash lookup and
+// no automaton is built for it.
+pub enum SetEngine {
+    Automaton(SetAutomaton),
+    Literal(LiteralSet),
+}
+
+// The automaton of a RegexSet: a lazy DFA that reports every pattern that
+// matches, and a PikeVM over the same NFA for the searches the DFA gives up
+// on (or for every search, if the DFA could not be built at all).
+pub struct SetAutomaton {
+    dfa: Option<hybrid::dfa::DFA>,
+    pikevm: PikeVM,
+    pool: Pool<SetCache, Box<dyn Fn() -> SetCache + Send + Sync>>,
+}
+
+// Search state owned by one thread at a time. The engine caches are None for
+// a SetEngine::Literal, which needs none.
+pub struct SetCache {
+    dfa: Option<hybrid::dfa::Cache>,
+    pikevm: Option<pikevm::Cache>,
+    patset: PatternSet,
+    ids: Vec<u32>,
+    // Whether the last search had to run without the lazy DFA.
+    gave_up: bool,
+    stats: CacheStats,
+}
+
+// A leftmost-first automaton over the patterns of a RegexSet, used to find
+// the lowest-index pattern that matches. The lazy DFA does the work; the
+// PikeVM runs the same NFA when the DFA gives up.
+pub struct FirstMatcher {
+    dfa: hybrid::dfa::DFA,
+    pikevm: PikeVM,
+    pool: Pool<FirstCache, Box<dyn Fn() -> FirstCache + Send + Sync>>,
+}
+
+pub struct FirstCache {
+    dfa: hybrid::dfa::Cache,
+    pikevm: pikevm::Cache,
+    stats: CacheStats,
+}
+
+// The counters of one search cache. Only the thread using the cache writes
+// them, and each sits on its own cache line, so searches on different
+// threads never contend; rure_set_get_stats reads them all.
+#[repr(align(64))]
+#[derive(Default)]
+pub struct CacheCounters {
+    searches: AtomicU64,
+    dfa_fallbacks: AtomicU64,
+    cache_clears: AtomicU64,
+    cache_bytes: AtomicU64,
+}
+
+// The counters of the live caches of a set, and the totals of the caches
+// that have been dropped.
+#[derive(Default)]
+pub struct CounterList {
+    live: Vec<Arc<CacheCounters>>,
+    searches: u64,
+    dfa_fallbacks: u64,
+    cache_clears: u64,
+}
+
+// A cache's handle on its counters.
+pub struct CacheStats {
+    counters: Arc<CacheCounters>,
+    // The lazy DFA's clear count when it was last recorded.
+    clears: usize,
+}
+
+#[repr(C)]
+pub struct rure_set_stats {
+    pub searches: u64,
+    pub dfa_fallbacks: u64,
+    pub cache_clears: u64,
+    pub cache_bytes: u64,
+    pub caches: u64,
+}
+
+// An open-addressing hash table over the literals of a SetEngine::Literal.
+// The literals are stored back to back in `bytes`; literal i spans
+// `ends[i - 1]..ends[i]`. Each slot holds the lowest pattern ID with a given
+// literal (or NO_PATTERN), and `next` chains the other IDs that share it in
+// increasing order.
+pub struct LiteralSet {
+    bytes: Vec<u8>,
+    ends: Vec<u32>,
+    next: Vec<u32>,
+    slots: Vec<u32>,
+    shift: u32,
 }
 
 #[repr(C)]
@@ -74,15 +196,45 @@ pub struct IterCaptureNames {
     name_ptrs: Vec<*mut c_char>,
 }
 
-#[repr(C)]
-pub struct Atoms {
-    atom: *mut c_char,
+// The prefilter of a pattern: an AND/OR tree over literal strings (atoms),
+// at least one combination of which every match of the pattern contains.
+// The nodes are stored children first, so the root is the last node.
+pub struct Prefilter {
+    nodes: Vec<PrefilterNode>,
 }
 
-#[repr(C)]
-pub struct MyVec {
-    data: *mut Atoms,
-    len: i32,
+struct PrefilterNode {
+    op: c_int,
+    atom: Vec<u8>,
+    children: Vec<size_t>,
+}
+
+// A prefilter while it is being built from the HIR of a pattern.
+#[derive(Clone)]
+enum PrefilterExpr {
+    All,
+    None,
+    Atom(Vec<u8>),
+    And(Vec<PrefilterExpr>),
+    Or(Vec<PrefilterExpr>),
+}
+
+// What is known about a piece of a pattern: the exact set of (lowercased)
+// strings it matches if that set is small, else an expression that every
+// match of it satisfies.
+#[derive(Clone)]
+struct PrefilterInfo {
+    exact: Option<BTreeSet<Vec<u8>>>,
+    expr: PrefilterExpr,
+}
+
+// A case-insensitive matcher for the atoms of a FilteredRE2. Pattern i of
+// `ac` is one spelling of atom `ids[i]`. The atoms in `always` are not
+// searched for and are reported for every haystack.
+pub struct AtomMatcher {
+    ac: AhoCorasick,
+    ids: Vec<u32>,
+    always: Vec<u32>,
 }
 
 impl Deref for RegexBytes {
@@ -99,13 +251,6 @@ impl Deref for RegexUnicode {
     }
 }
 
-impl Deref for RegexSet {
-    type Target = bytes::RegexSet;
-    fn deref(&self) -> &bytes::RegexSet {
-        &self.re
-    }
-}
-
 impl Default for Options {
     fn default() -> Options {
         Options {
@@ -171,7 +316,7 @@ extern "C" fn rure_compile(
 #[no_mangle]
 extern "C" fn rure_free(re: *const RegexBytes) {
     unsafe {
-        drop(Box::from_raw(re as *mut Regex));
+        drop(Box::from_raw(re as *mut RegexBytes));
     }
 }
 
@@ -180,11 +325,11 @@ extern "C" fn rure_is_match(
     re: *const RegexBytes,
     haystack: *const u8,
     len: size_t,
-    _start: size_t,
+    start: size_t,
 ) -> bool {
     let re = unsafe { &*re };
     let haystack = unsafe { slice::from_raw_parts(haystack, len) };
-    re.is_match(haystack)
+    re.is_match_at(haystack, start)
 }
 
 #[no_mangle]
@@ -313,6 +458,30 @@ extern "C" fn rure_captures_len(captures: *const Captures) -> size_t {
     unsafe { (*captures).0.len() }
 }
 
+#[no_mangle]
+extern "C" fn rure_options_new() -> *mut Options {
+    Box::into_raw(Box::new(Options::default()))
+}
+
+#[no_mangle]
+extern "C" fn rure_options_free(options: *mut Options) {
+    unsafe {
+        drop(Box::from_raw(options));
+    }
+}
+
+#[no_mangle]
+extern "C" fn rure_options_size_limit(options: *mut Options, limit: size_t) {
+    let options = unsafe { &mut *options };
+    options.size_limit = limit;
+}
+
+#[no_mangle]
+extern "C" fn rure_options_dfa_size_limit(options: *mut Options, limit: size_t) {
+    let options = unsafe { &mut *options };
+    options.dfa_size_limit = limit;
+}
+
 #[no_mangle]
 extern "C" fn rure_compile_set(
     patterns: *const *const u8,
@@ -342,17 +511,36 @@ extern "C" fn rure_compile_set(
         });
     }
 
-    let mut builder = rure_compile_set_internal(pats, flags);
+    let mut opts = Options::default();
     if !options.is_null() {
-        let options = unsafe { &*options };
-        builder.size_limit(options.size_limit);
-        builder.dfa_size_limit(options.dfa_size_limit);
+        opts = unsafe { *options };
     }
-    match builder.build() {
-        Ok(re) => Box::into_raw(Box::new(RegexSet { re })),
+    if let Some(literals) = rure_set_literals(&pats, flags) {
+        return Box::into_raw(Box::new(RegexSet {
+            engine: SetEngine::Literal(literals),
+            pats: Vec::new(),
+            flags,
+            options: opts,
+            first: OnceLock::new(),
+            caches: Mutex::new(Vec::new()),
+            counters: Arc::new(Mutex::new(CounterList::default())),
+        }));
+    }
+
+    let counters = Arc::new(Mutex::new(CounterList::default()));
+    match rure_compile_set_internal(&pats, flags, &opts, &counters) {
+        Ok(re) => Box::into_raw(Box::new(RegexSet {
+            engine: SetEngine::Automaton(re),
+            pats: pats.iter().map(|p| p.to_string()).collect(),
+            flags,
+            options: opts,
+            first: OnceLock::new(),
+            caches: Mutex::new(Vec::new()),
+            counters,
+        })),
         Err(err) => unsafe {
             if !error.is_null() {
-                *error = Error::new(ErrorKind::Regex(err))
+                *error = Error::new(ErrorKind::Build(err))
             }
             ptr::null()
         },
@@ -393,6 +581,84 @@ extern "C" fn rure_set_matches(
     rure_set_matches_internal(re, matches, haystack, start)
 }
 
+#[no_mangle]
+extern "C" fn rure_set_match_first(
+    re: *const RegexSet,
+    haystack: *const u8,
+    len: size_t,
+    start: size_t,
+) -> i32 {
+    let re = unsafe { &*re };
+    let haystack = unsafe { slice::from_raw_parts(haystack, len) };
+    rure_set_match_first_internal(re, haystack, start)
+}
+
+#[no_mangle]
+extern "C" fn rure_set_cache_acquire(re: *const RegexSet) -> *mut SetCache {
+    let re = unsafe { &*re };
+    Box::into_raw(rure_set_cache_acquire_internal(re))
+}
+
+#[no_mangle]
+extern "C" fn rure_set_cache_release(re: *const RegexSet, cache: *mut SetCache) {
+    let re = unsafe { &*re };
+    let cache = unsafe { Box::from_raw(cache) };
+    re.caches.lock().unwrap().push(cache);
+}
+
+#[no_mangle]
+extern "C" fn rure_set_matches_ids(
+    re: *const RegexSet,
+    cache: *mut SetCache,
+    haystack: *const u8,
+    len: size_t,
+    start: size_t,
+    ids: *mut *const u32,
+) -> size_t {
+    let re = unsafe { &*re };
+    let cache = unsafe { &mut *cache };
+    let haystack = unsafe { slice::from_raw_parts(haystack, len) };
+    rure_set_matches_ids_internal(re, cache, haystack, start);
+    unsafe {
+        *ids = cache.ids.as_ptr();
+    }
+    cache.ids.len()
+}
+
+#[no_mangle]
+extern "C" fn rure_set_matches_into(
+    re: *const RegexSet,
+    haystack: *const u8,
+    len: size_t,
+    start: size_t,
+    ids: *mut i32,
+    capacity: size_t,
+    gave_up: *mut bool,
+) -> size_t {
+    let re = unsafe { &*re };
+    let haystack = unsafe { slice::from_raw_parts(haystack, len) };
+    let ids: &mut [i32] = if ids.is_null() {
+        &mut []
+    } else {
+        unsafe { slice::from_raw_parts_mut(ids, capacity) }
+    };
+    let (n, dfa_gave_up) = rure_set_matches_into_internal(re, haystack, start, ids);
+    if !gave_up.is_null() {
+        unsafe {
+            *gave_up = dfa_gave_up;
+        }
+    }
+    n
+}
+
+#[no_mangle]
+extern "C" fn rure_set_get_stats(re: *const RegexSet, stats: *mut rure_set_stats) {
+    let re = unsafe { &*re };
+    unsafe {
+        *stats = rure_set_stats_internal(re);
+    }
+}
+
 #[no_mangle]
 extern "C" fn rure_set_len(re: *const RegexSet) -> size_t {
     unsafe { (*re).len() }
@@ -571,12 +837,114 @@ extern "C" fn rure_replace_count(re: *const RegexUnicode, haystack: *const c_cha
 }
 
 #[no_mangle]
-extern "C" fn rure_filter_compile(
-    regex_str: *const u8,
-    regex_len: size_t,
-    min_atoms_len: size_t,
-) -> MyVec {
-    let r = unsafe { slice::from_raw_parts(regex_str, regex_len) };
-    let regex_str = str::from_utf8(r).unwrap();
-    my_compile(regex_str, min_atoms_len as i32)
+extern "C" fn rure_prefilter_new(
+    pattern: *const u8,
+    length: size_t,
+    flags: u32,
+    latin1: bool,
+) -> *mut Prefilter {
+    let pat = unsafe { slice::from_raw_parts(pattern, length) };
+    let pat = match str::from_utf8(pat) {
+        Ok(pat) => pat,
+        Err(_) => return ptr::null_mut(),
+    };
+    match rure_prefilter_internal(pat, flags, latin1) {
+        Some(pf) => Box::into_raw(Box::new(pf)),
+        None => ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+extern "C" fn rure_prefilter_free(pf: *mut Prefilter) {
+    unsafe {
+        drop(Box::from_raw(pf));
+    }
+}
+
+#[no_mangle]
+extern "C" fn rure_prefilter_len(pf: *const Prefilter) -> size_t {
+    let pf = unsafe { &*pf };
+    pf.nodes.len()
+}
+
+#[no_mangle]
+extern "C" fn rure_prefilter_op(pf: *const Prefilter, node: size_t) -> c_int {
+    let pf = unsafe { &*pf };
+    pf.nodes[node].op
+}
+
+#[no_mangle]
+extern "C" fn rure_prefilter_atom(
+    pf: *const Prefilter,
+    node: size_t,
+    atom: *mut *const u8,
+) -> size_t {
+    let pf = unsafe { &*pf };
+    let node = &pf.nodes[node];
+    unsafe {
+        *atom = node.atom.as_ptr();
+    }
+    node.atom.len()
+}
+
+#[no_mangle]
+extern "C" fn rure_prefilter_children(
+    pf: *const Prefilter,
+    node: size_t,
+    children: *mut *const size_t,
+) -> size_t {
+    let pf = unsafe { &*pf };
+    let node = &pf.nodes[node];
+    unsafe {
+        *children = node.children.as_ptr();
+    }
+    node.children.len()
+}
+
+#[no_mangle]
+extern "C" fn rure_atoms_new(
+    atoms: *const *const u8,
+    lengths: *const size_t,
+    count: size_t,
+) -> *mut AtomMatcher {
+    let (raw_atoms, raw_lengths) = unsafe {
+        (
+            slice::from_raw_parts(atoms, count),
+            slice::from_raw_parts(lengths, count),
+        )
+    };
+    let atoms: Vec<&[u8]> = raw_atoms
+        .iter()
+        .zip(raw_lengths)
+        .map(|(&atom, &len)| unsafe { slice::from_raw_parts(atom, len) })
+        .collect();
+    match rure_atoms_internal(&atoms) {
+        Some(m) => Box::into_raw(Box::new(m)),
+        None => ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+extern "C" fn rure_atoms_free(m: *mut AtomMatcher) {
+    unsafe {
+        drop(Box::from_raw(m));
+    }
+}
+
+#[no_mangle]
+extern "C" fn rure_atoms_match(
+    m: *const AtomMatcher,
+    haystack: *const u8,
+    len: size_t,
+    ids: *mut i32,
+    capacity: size_t,
+) -> size_t {
+    let m = unsafe { &*m };
+    let haystack = unsafe { slice::from_raw_parts(haystack, len) };
+    let ids: &mut [i32] = if ids.is_null() {
+        &mut []
+    } else {
+        unsafe { slice::from_raw_parts_mut(ids, capacity) }
+    };
+    rure_atoms_match_internal(m, haystack, ids)
 }
@@ -13,7 +13,6 @@
  * Description: The business logic implementation layer uses pure rust.
  ******************************************************************************/
 use regex::bytes::RegexBuilder;
-use regex::bytes::RegexSetBuilder;
 fn rure_compile_internal(pat: &str, flags: u32) -> RegexBuilder {
     let mut builder = bytes::RegexBuilder::new(pat);
     builder.case_insensitive(flags & RURE_FLAG_CASEI > 0);
@@ -25,16 +24,127 @@ fn rure_compile_internal(pat: &str, flags: u32) -> RegexBuilder {
     builder
 }
 
-fn rure_compile_set_internal(pats: Vec<&str>, flags: u32) -> RegexSetBuilder {
-    let mut builder = bytes::RegexSetBuilder::new(pats);
+// The syntax of the patterns of a set compiled with `flags`.
+fn rure_set_syntax(flags: u32) -> regex_automata::util::syntax::Config {
+    regex_automata::util::syntax::Config::new()
+        .case_insensitive(flags & RURE_FLAG_CASEI > 0)
+        .multi_line(flags & RURE_FLAG_MULTI > 0)
+        .dot_matches_new_line(flags & RURE_FLAG_DOTNL > 0)
+        .swap_greed(flags & RURE_FLAG_SWAP_GREED > 0)
+        .ignore_whitespace(flags & RURE_FLAG_SPACE > 0)
+        .unicode(flags & RURE_FLAG_UNICODE > 0)
+        .utf8(false)
+}
 
-    builder.case_insensitive(flags & RURE_FLAG_CASEI > 0);
-    builder.multi_line(flags & RURE_FLAG_MULTI > 0);
-    builder.dot_matches_new_line(flags & RURE_FLAG_DOTNL > 0);
-    builder.swap_greed(flags & RURE_FLAG_SWAP_GREED > 0);
-    builder.ignore_whitespace(flags & RURE_FLAG_SPACE > 0);
-    builder.unicode(flags & RURE_FLAG_UNICODE > 0);
-    builder
+// Builds the automaton of a set from the same parts, and with the same
+// configuration, that regex::bytes::RegexSetBuilder would use. Owning the
+// parts lets searches bring their own caches and lets the set count what
+// its lazy DFA does.
+fn rure_compile_set_internal(
+    pats: &[&str],
+    flags: u32,
+    options: &Options,
+    counters: &Arc<Mutex<CounterList>>,
+) -> Result<SetAutomaton, Box<dyn std::error::Error + Send + Sync>> {
+    use regex_automata::nfa::thompson;
+    use regex_automata::util::prefilter::Prefilter;
+    use regex_automata::MatchKind;
+
+    let hirs = regex_automata::util::syntax::parse_many_with(pats, &rure_set_syntax(flags))?;
+    let nfa = thompson::Compiler::new()
+        .configure(
+            thompson::Config::new()
+                .utf8(false)
+                .nfa_size_limit(Some(options.size_limit))
+                .which_captures(thompson::WhichCaptures::None),
+        )
+        .build_many_from_hir(&hirs)?;
+    // As in regex, a prefilter is only worth it if some pattern can match
+    // away from the start of the haystack.
+    let pre = if hirs.iter().all(|h| {
+        h.properties()
+            .look_set_prefix()
+            .contains(regex_syntax::hir::Look::Start)
+    }) {
+        None
+    } else {
+        Prefilter::from_hirs_prefix(MatchKind::All, &hirs)
+    };
+    // Building the lazy DFA only fails if the cache capacity is too small;
+    // then the PikeVM runs every search.
+    let dfa = hybrid::dfa::Builder::new()
+        .configure(
+            hybrid::dfa::Config::new()
+                .match_kind(MatchKind::All)
+                .prefilter(pre.clone())
+                .unicode_word_boundary(true)
+                .cache_capacity(options.dfa_size_limit)
+                .minimum_cache_clear_count(Some(3))
+                .minimum_bytes_per_state(Some(10)),
+        )
+        .build_from_nfa(nfa.clone())
+        .ok();
+    let pikevm = PikeVM::builder()
+        .configure(PikeVM::config().match_kind(MatchKind::All).prefilter(pre))
+        .build_from_nfa(nfa)?;
+
+    let (d, p, c) = (dfa.clone(), pikevm.clone(), counters.clone());
+    let create: Box<dyn Fn() -> SetCache + Send + Sync> =
+        Box::new(move || rure_set_new_cache(d.as_ref(), Some(&p), &c));
+    Ok(SetAutomaton {
+        dfa,
+        pikevm,
+        pool: Pool::new(create),
+    })
+}
+
+fn rure_set_new_cache(
+    dfa: Option<&hybrid::dfa::DFA>,
+    pikevm: Option<&PikeVM>,
+    counters: &Mutex<CounterList>,
+) -> SetCache {
+    let len = match pikevm {
+        Some(p) => p.pattern_len(),
+        None => 0,
+    };
+    SetCache {
+        dfa: dfa.map(|d| d.create_cache()),
+        pikevm: pikevm.map(|p| p.create_cache()),
+        patset: PatternSet::new(len),
+        ids: Vec::new(),
+        gave_up: false,
+        stats: CacheStats::new(counters),
+    }
+}
+
+// Reports every pattern of `a` that matches in `input` in `cache.patset`, or
+// only the first one found if `earliest` is set. Returns whether any did.
+fn rure_set_search(
+    a: &SetAutomaton,
+    cache: &mut SetCache,
+    input: &regex_automata::Input<'_>,
+    earliest: bool,
+) -> bool {
+    let input = input.clone().earliest(earliest);
+    cache.patset.clear();
+    let mut gave_up = true;
+    if let (Some(dfa), Some(dc)) = (a.dfa.as_ref(), cache.dfa.as_mut()) {
+        match dfa.try_which_overlapping_matches(dc, &input, &mut cache.patset) {
+            Ok(()) => gave_up = false,
+            Err(_) => cache.patset.clear(),
+        }
+    }
+    let pikevm = cache.pikevm.as_mut().unwrap();
+    if gave_up {
+        // The PikeVM's overlapping search stops after the first byte when
+        // `earliest` is set, matched or not, so it always runs to the end.
+        let input = input.earliest(false);
+        a.pikevm
+            .which_overlapping_matches(pikevm, &input, &mut cache.patset);
+    }
+    cache.gave_up = gave_up;
+    cache.stats.record(cache.dfa.as_ref(), pikevm, gave_up);
+    !cache.patset.is_empty()
 }
 
 fn rure_set_matches_internal(
@@ -50,6 +160,484 @@ fn rure_set_matches_internal(
     re.read_matches_at(matches, haystack, start)
 }
 
+impl RegexSet {
+    fn len(&self) -> usize {
+        match self.engine {
+            SetEngine::Automaton(ref a) => a.pikevm.pattern_len(),
+            SetEngine::Literal(ref lits) => lits.ends.len(),
+        }
+    }
+
+    fn is_match_at(&self, haystack: &[u8], start: usize) -> bool {
+        match self.engine {
+            SetEngine::Automaton(ref a) => {
+                let input = regex_automata::Input::new(haystack).span(start..haystack.len());
+                rure_set_search(a, &mut a.pool.get(), &input, true)
+            }
+            SetEngine::Literal(ref lits) => start == 0 && lits.find(haystack).is_some(),
+        }
+    }
+
+    fn read_matches_at(&self, matches: &mut [bool], haystack: &[u8], start: usize) -> bool {
+        match self.engine {
+            SetEngine::Automaton(ref a) => {
+                let input = regex_automata::Input::new(haystack).span(start..haystack.len());
+                let mut cache = a.pool.get();
+                let matched = rure_set_search(a, &mut cache, &input, false);
+                for pid in cache.patset.iter() {
+                    matches[pid] = true;
+                }
+                matched
+            }
+            SetEngine::Literal(ref lits) => {
+                if start != 0 {
+                    return false;
+                }
+                let mut id = match lits.find(haystack) {
+                    Some(id) => id,
+                    None => return false,
+                };
+                while id != NO_PATTERN {
+                    matches[id as usize] = true;
+                    id = lits.next[id as usize];
+                }
+                true
+            }
+        }
+    }
+}
+
+fn rure_set_cache_acquire_internal(re: &RegexSet) -> Box<SetCache> {
+    if let Some(cache) = re.caches.lock().unwrap().pop() {
+        return cache;
+    }
+    Box::new(match re.engine {
+        SetEngine::Automaton(ref a) => {
+            rure_set_new_cache(a.dfa.as_ref(), Some(&a.pikevm), &re.counters)
+        }
+        SetEngine::Literal(_) => rure_set_new_cache(None, None, &re.counters),
+    })
+}
+
+// As rure_set_matches_internal, but leaves the IDs of the matching patterns
+// in increasing order in `cache.ids` and allocates nothing once the cache has
+// grown to fit the largest result.
+fn rure_set_matches_ids_internal(
+    re: &RegexSet,
+    cache: &mut SetCache,
+    haystack: &[u8],
+    start: size_t,
+) {
+    cache.ids.clear();
+    match re.engine {
+        SetEngine::Automaton(ref a) => {
+            let input = regex_automata::Input::new(haystack).span(start..haystack.len());
+            rure_set_search(a, cache, &input, false);
+            cache
+                .ids
+                .extend(cache.patset.iter().map(|pid| pid.as_u32()));
+        }
+        SetEngine::Literal(ref lits) => {
+            if start != 0 {
+                return;
+            }
+            let mut id = match lits.find(haystack) {
+                Some(id) => id,
+                None => return,
+            };
+            while id != NO_PATTERN {
+                cache.ids.push(id);
+                id = lits.next[id as usize];
+            }
+        }
+    }
+}
+
+// Writes the IDs of the patterns that match, in increasing order, to as
+// much of `ids` as they fit in. Returns how many patterns match, and whether
+// the lazy DFA gave up on the search. Uses the set's shared caches.
+fn rure_set_matches_into_internal(
+    re: &RegexSet,
+    haystack: &[u8],
+    start: size_t,
+    ids: &mut [i32],
+) -> (usize, bool) {
+    let mut n = 0;
+    let mut push = |id: u32| {
+        if n < ids.len() {
+            ids[n] = id as i32;
+        }
+        n += 1;
+    };
+    match re.engine {
+        SetEngine::Automaton(ref a) => {
+            let input = regex_automata::Input::new(haystack).span(start..haystack.len());
+            let mut cache = a.pool.get();
+            rure_set_search(a, &mut cache, &input, false);
+            for pid in cache.patset.iter() {
+                push(pid.as_u32());
+            }
+            (n, cache.gave_up)
+        }
+        SetEngine::Literal(ref lits) => {
+            if start == 0 {
+                let mut id = lits.find(haystack).unwrap_or(NO_PATTERN);
+                while id != NO_PATTERN {
+                    push(id);
+                    id = lits.next[id as usize];
+                }
+            }
+            (n, false)
+        }
+    }
+}
+
+impl CacheStats {
+    fn new(list: &Mutex<CounterList>) -> CacheStats {
+        let counters = Arc::new(CacheCounters::default());
+        let mut list = list.lock().unwrap();
+        // Fold the counters of dropped caches into the totals, so that a
+        // set whose caches come and go does not keep them all.
+        let mut i = 0;
+        while i < list.live.len() {
+            if Arc::strong_count(&list.live[i]) == 1 {
+                let dead = list.live.swap_remove(i);
+                list.searches += dead.searches.load(Ordering::Relaxed);
+                list.dfa_fallbacks += dead.dfa_fallbacks.load(Ordering::Relaxed);
+                list.cache_clears += dead.cache_clears.load(Ordering::Relaxed);
+            } else {
+                i += 1;
+            }
+        }
+        list.live.push(counters.clone());
+        CacheStats {
+            counters,
+            clears: 0,
+        }
+    }
+
+    // Records a search made with the engine caches this belongs to. Only
+    // the owner of the caches writes the counters, so a load and a store
+    // are enough to update them.
+    fn record(&mut self, dfa: Option<&hybrid::dfa::Cache>, pikevm: &pikevm::Cache, gave_up: bool) {
+        fn add(counter: &AtomicU64, n: u64) {
+            counter.store(counter.load(Ordering::Relaxed) + n, Ordering::Relaxed);
+        }
+        let c = &*self.counters;
+        add(&c.searches, 1);
+        if gave_up {
+            add(&c.dfa_fallbacks, 1);
+        }
+        let mut bytes = pikevm.memory_usage();
+        if let Some(dfa) = dfa {
+            let clears = dfa.clear_count();
+            if clears != self.clears {
+                add(&c.cache_clears, (clears - self.clears) as u64);
+                self.clears = clears;
+            }
+            bytes += dfa.memory_usage();
+        }
+        c.cache_bytes.store(bytes as u64, Ordering::Relaxed);
+    }
+}
+
+impl Drop for CacheStats {
+    fn drop(&mut self) {
+        self.counters.cache_bytes.store(0, Ordering::Relaxed);
+    }
+}
+
+fn rure_set_stats_internal(re: &RegexSet) -> rure_set_stats {
+    let list = re.counters.lock().unwrap();
+    let mut stats = rure_set_stats {
+        searches: list.searches,
+        dfa_fallbacks: list.dfa_fallbacks,
+        cache_clears: list.cache_clears,
+        cache_bytes: 0,
+        caches: 0,
+    };
+    for c in list.live.iter() {
+        stats.searches += c.searches.load(Ordering::Relaxed);
+        stats.dfa_fallbacks += c.dfa_fallbacks.load(Ordering::Relaxed);
+        stats.cache_clears += c.cache_clears.load(Ordering::Relaxed);
+        if Arc::strong_count(c) > 1 {
+            stats.cache_bytes += c.cache_bytes.load(Ordering::Relaxed);
+            stats.caches += 1;
+        }
+    }
+    stats
+}
+
+const NO_PATTERN: u32 = u32::MAX;
+
+// Returns the literal that `pat` matches, if `^` and `$` around a literal
+// string are all it consists of. `^` and `$` must match only at the ends of
+// the haystack, so multi-line patterns never qualify.
+fn rure_set_literal(pat: &str, flags: u32) -> Option<Vec<u8>> {
+    use regex_syntax::hir::{HirKind, Look};
+
+    let hir = rure_set_parser(flags).parse(pat).ok()?;
+    let subs = match *hir.kind() {
+        HirKind::Concat(ref subs) => &subs[..],
+        _ => return None,
+    };
+    // Repeated anchors, as in `^^a$$`, are redundant.
+    let is_look = |h: &regex_syntax::hir::Hir, want: Look| match *h.kind() {
+        HirKind::Look(look) => look == want,
+        _ => false,
+    };
+    let first = subs.iter().position(|h| !is_look(h, Look::Start))?;
+    let last = subs
+        .iter()
+        .rposition(|h| !is_look(h, Look::End))
+        .map_or(first, |i| i + 1);
+    if first == 0 || last == subs.len() {
+        return None;
+    }
+    match subs[first..last] {
+        [] => Some(Vec::new()),
+        [ref h] => match *h.kind() {
+            HirKind::Literal(ref lit) => Some(lit.0.to_vec()),
+            _ => None,
+        },
+        _ => None,
+    }
+}
+
+// Builds the hash table for a set of anchored literals, or returns None if
+// any pattern is something else (or the set is empty or too large for the
+// table's 32-bit offsets), in which case the set needs an automaton.
+fn rure_set_literals(pats: &[&str], flags: u32) -> Option<LiteralSet> {
+    if pats.is_empty() || pats.len() >= NO_PATTERN as usize {
+        return None;
+    }
+    let mut bytes = Vec::new();
+    let mut ends = Vec::with_capacity(pats.len());
+    for pat in pats {
+        bytes.extend_from_slice(&rure_set_literal(pat, flags)?);
+        if bytes.len() > u32::MAX as usize {
+            return None;
+        }
+        ends.push(bytes.len() as u32);
+    }
+    bytes.shrink_to_fit();
+
+    // Keep the load factor at or below one half.
+    let bits = (2 * pats.len()).next_power_of_two().trailing_zeros().max(1);
+    let mut lits = LiteralSet {
+        bytes,
+        ends,
+        next: vec![NO_PATTERN; pats.len()],
+        slots: vec![NO_PATTERN; 1 << bits],
+        shift: 64 - bits,
+    };
+    // The last ID in the chain of each slot. IDs are added in increasing
+    // order, so appending each one to its chain keeps the lowest ID at the
+    // head, and n copies of a literal cost O(n) rather than O(n^2).
+    let mut tails = vec![NO_PATTERN; lits.slots.len()];
+    for id in 0..pats.len() as u32 {
+        let mut slot = lits.slot(lits.literal(id));
+        loop {
+            let head = lits.slots[slot];
+            if head == NO_PATTERN {
+                lits.slots[slot] = id;
+                tails[slot] = id;
+                break;
+            }
+            if lits.literal(head) == lits.literal(id) {
+                lits.next[tails[slot] as usize] = id;
+                tails[slot] = id;
+                break;
+            }
+            slot = (slot + 1) & (lits.slots.len() - 1);
+        }
+    }
+    Some(lits)
+}
+
+impl LiteralSet {
+    fn literal(&self, id: u32) -> &[u8] {
+        let id = id as usize;
+        let start = if id == 0 {
+            0
+        } else {
+            self.ends[id - 1] as usize
+        };
+        &self.bytes[start..self.ends[id] as usize]
+    }
+
+    // The first slot to probe for `lit`.
+    fn slot(&self, lit: &[u8]) -> usize {
+        const K: u64 = 0x9e37_79b9_7f4a_7c15;
+        let mut h = lit.len() as u64;
+        let mut chunks = lit.chunks_exact(8);
+        for c in &mut chunks {
+            let mut w = [0u8; 8];
+            w.copy_from_slice(c);
+            h = (h.rotate_left(23) ^ u64::from_le_bytes(w)).wrapping_mul(K);
+        }
+        let rest = chunks.remainder();
+        if !rest.is_empty() {
+            let mut w = [0u8; 8];
+            w[..rest.len()].copy_from_slice(rest);
+            h = (h.rotate_left(23) ^ u64::from_le_bytes(w)).wrapping_mul(K);
+        }
+        // The multiplications push entropy into the high bits; use those.
+        ((h ^ (h >> 29)).wrapping_mul(K) >> self.shift) as usize
+    }
+
+    // Returns the lowest ID of a pattern whose literal is `haystack`.
+    fn find(&self, haystack: &[u8]) -> Option<u32> {
+        let mut slot = self.slot(haystack);
+        loop {
+            let id = self.slots[slot];
+            if id == NO_PATTERN {
+                return None;
+            }
+            if self.literal(id) == haystack {
+                return Some(id);
+            }
+            slot = (slot + 1) & (self.slots.len() - 1);
+        }
+    }
+}
+
+// A parser for the patterns of a set compiled with `flags`.
+fn rure_set_parser(flags: u32) -> regex_syntax::Parser {
+    regex_syntax::ParserBuilder::new()
+        .case_insensitive(flags & RURE_FLAG_CASEI > 0)
+        .multi_line(flags & RURE_FLAG_MULTI > 0)
+        .dot_matches_new_line(flags & RURE_FLAG_DOTNL > 0)
+        .swap_greed(flags & RURE_FLAG_SWAP_GREED > 0)
+        .ignore_whitespace(flags & RURE_FLAG_SPACE > 0)
+        .unicode(flags & RURE_FLAG_UNICODE > 0)
+        .utf8(false)
+        .build()
+}
+
+// Reports whether `pat` can only match at the start of the haystack, in which
+// case rure_set_first_matcher does not need to give it an unanchored prefix.
+fn rure_set_anchored_start(pat: &str, flags: u32) -> bool {
+    match rure_set_parser(flags).parse(pat) {
+        Ok(hir) => hir
+            .properties()
+            .look_set_prefix()
+            .contains(regex_syntax::hir::Look::Start),
+        Err(_) => false,
+    }
+}
+
+// Builds the automaton used by rure_set_match_first. Every pattern is run
+// from the search start (unanchored ones behind a lazy `.*?`), so all of them
+// compete for the same leftmost position and leftmost-first semantics pick
+// the lowest index. As soon as a pattern matches, the threads of every
+// higher-index pattern are discarded, and the search ends once no lower-index
+// pattern is still alive.
+//
+// The NFA carries no capture slots: only the pattern ID is reported, and
+// slots for every pattern would make the PikeVM cache quadratic in the size
+// of the set.
+fn rure_set_first_matcher(re: &RegexSet) -> Option<FirstMatcher> {
+    use regex_automata::nfa::thompson;
+
+    let close = if re.flags & RURE_FLAG_SPACE > 0 {
+        "\n)"
+    } else {
+        ")"
+    };
+    let pats: Vec<String> = re
+        .pats
+        .iter()
+        .map(|p| {
+            if rure_set_anchored_start(p, re.flags) {
+                format!("(?:{}{}", p, close)
+            } else {
+                format!("(?s-u:.)*?(?:{}{}", p, close)
+            }
+        })
+        .collect();
+    let syntax = rure_set_syntax(re.flags);
+    let nfa = thompson::Compiler::new()
+        .syntax(syntax)
+        .configure(
+            thompson::Config::new()
+                .utf8(false)
+                .nfa_size_limit(Some(re.options.size_limit))
+                .which_captures(thompson::WhichCaptures::None),
+        )
+        .build_many(&pats)
+        .ok()?;
+    let dfa = hybrid::dfa::Builder::new()
+        .configure(
+            hybrid::dfa::Config::new()
+                .match_kind(regex_automata::MatchKind::LeftmostFirst)
+                .cache_capacity(re.options.dfa_size_limit)
+                .skip_cache_capacity_check(true)
+                .minimum_cache_clear_count(Some(3))
+                .minimum_bytes_per_state(Some(10)),
+        )
+        .build_from_nfa(nfa.clone())
+        .ok()?;
+    let pikevm = PikeVM::builder()
+        .configure(PikeVM::config().match_kind(regex_automata::MatchKind::LeftmostFirst))
+        .build_from_nfa(nfa)
+        .ok()?;
+    let (d, p, c) = (dfa.clone(), pikevm.clone(), re.counters.clone());
+    let create: Box<dyn Fn() -> FirstCache + Send + Sync> = Box::new(move || FirstCache {
+        dfa: d.create_cache(),
+        pikevm: p.create_cache(),
+        stats: CacheStats::new(&c),
+    });
+    Some(FirstMatcher {
+        dfa,
+        pikevm,
+        pool: Pool::new(create),
+    })
+}
+
+fn rure_set_match_first_internal(re: &RegexSet, haystack: &[u8], start: size_t) -> i32 {
+    if start > haystack.len() {
+        return -1;
+    }
+    if let SetEngine::Literal(ref lits) = re.engine {
+        return match lits.find(haystack) {
+            Some(id) if start == 0 => id as i32,
+            _ => -1,
+        };
+    }
+    match re.first.get_or_init(|| rure_set_first_matcher(re)) {
+        Some(first) => {
+            let input = regex_automata::Input::new(haystack)
+                .range(start..)
+                .anchored(regex_automata::Anchored::Yes);
+            let mut guard = first.pool.get();
+            let cache = &mut *guard;
+            let (pid, gave_up) = match first.dfa.try_search_fwd(&mut cache.dfa, &input) {
+                Ok(hm) => (hm.map(|hm| hm.pattern()), false),
+                Err(_) => (
+                    first
+                        .pikevm
+                        .search_slots(&mut cache.pikevm, &input, &mut []),
+                    true,
+                ),
+            };
+            cache.stats.record(Some(&cache.dfa), &cache.pikevm, gave_up);
+            match pid {
+                Some(pid) => pid.as_i32(),
+                None => -1,
+            }
+        }
+        None => {
+            let mut matches = vec![false; re.len()];
+            rure_set_matches_internal(re, &mut matches, haystack, start);
+            match matches.iter().position(|&m| m) {
+                Some(i) => i as i32,
+                None => -1,
+            }
+        }
+    }
+}
+
 fn rure_replace_internal(re: &RegexUnicode, haystack: &[u8], rewrite: &[u8]) -> *const u8 {
     let haystack = match str::from_utf8(haystack) {
         Ok(haystack) => haystack,
@@ -106,7 +694,7 @@ fn rure_new_internal(pat: &[u8]) -> *const RegexBytes {
         }
     };
     let exp = match bytes::Regex::new(pat) {
-        Ok(val) => Box::into_raw(Box::new(val)),
+        Ok(re) => Box::into_raw(Box::new(RegexBytes { re })),
         Err(_) => ptr::null(),
     };
     exp as *const RegexBytes
@@ -271,258 +859,459 @@ fn rure_replace_count_internal(haystack: &[u8], re: &RegexUnicode) -> size_t {
     count
 }
 
-/**
- * 负责对字符集进行连接操作
- *
- */
-fn connection(str: &str, vec1: Vec<String>, vec2: Vec<char>) -> Vec<String> {
-    let mut vec_tmp = Vec::new();
-    if !str.is_empty() {
-        for chars in vec2 {
-            let s = format!("{}{}", str, chars);
-            vec_tmp.push(s);
+// Computes the prefilter of a pattern the way RE2's prefilter.cc does, over
+// the HIR that regex-syntax produces for it. Atoms are lowercased: the caller
+// looks for them in lowercased text. Case-insensitive flags are removed
+// before translation so that the atoms keep the case folding of the pattern
+// as written, as in RE2. Returns None if the pattern does not parse.
+fn rure_prefilter_internal(pat: &str, flags: u32, latin1: bool) -> Option<Prefilter> {
+    use regex_syntax::ast::parse::ParserBuilder;
+    use regex_syntax::hir::translate::TranslatorBuilder;
+
+    let mut ast = ParserBuilder::new()
+        .ignore_whitespace(flags & RURE_FLAG_SPACE > 0)
+        .build()
+        .parse(pat)
+        .ok()?;
+    rure_prefilter_strip_casei(&mut ast);
+    let hir = TranslatorBuilder::new()
+        .multi_line(flags & RURE_FLAG_MULTI > 0)
+        .dot_matches_new_line(flags & RURE_FLAG_DOTNL > 0)
+        .swap_greed(flags & RURE_FLAG_SWAP_GREED > 0)
+        .unicode(flags & RURE_FLAG_UNICODE > 0)
+        .utf8(false)
+        .build()
+        .translate(pat, &ast)
+        .ok()?;
+    let expr = rure_prefilter_info(&hir, latin1).take_expr();
+    let mut pf = Prefilter { nodes: Vec::new() };
+    rure_prefilter_flatten(&expr, latin1, &mut pf.nodes);
+    Some(pf)
+}
+
+fn rure_prefilter_strip_casei(ast: &mut regex_syntax::ast::Ast) {
+    use regex_syntax::ast::{Ast, Flag, Flags, FlagsItemKind, GroupKind};
+
+    fn strip(flags: &mut Flags) {
+        flags
+            .items
+            .retain(|item| item.kind != FlagsItemKind::Flag(Flag::CaseInsensitive));
+    }
+    match *ast {
+        Ast::Flags(ref mut set) => strip(&mut set.flags),
+        Ast::Group(ref mut group) => {
+            if let GroupKind::NonCapturing(ref mut flags) = group.kind {
+                strip(flags);
+            }
+            rure_prefilter_strip_casei(&mut group.ast);
         }
-    } else if vec1.is_empty() {
-        for elem in vec2 {
-            vec_tmp.push(elem.to_string())
+        Ast::Repetition(ref mut rep) => rure_prefilter_strip_casei(&mut rep.ast),
+        Ast::Concat(ref mut concat) => {
+            for ast in concat.asts.iter_mut() {
+                rure_prefilter_strip_casei(ast);
+            }
         }
-    } else {
-        for chars_i in vec1 {
-            for chars_j in vec2.clone() {
-                let s = format!("{}{}", chars_i, chars_j);
-                vec_tmp.push(s);
+        Ast::Alternation(ref mut alt) => {
+            for ast in alt.asts.iter_mut() {
+                rure_prefilter_strip_casei(ast);
             }
         }
+        _ => {}
     }
-    vec_tmp
 }
 
-/**
-*  (abc123|abc|ghi789|abc1234)
- 3-abc
- 6-abc123
- 6-ghi789
- 7-abc1234
-* abc  abc123  ghi789  abc1234
-*/
-fn group_multiple_selection(str: &str, min_atoms_len: i32) -> Vec<String> {
-    let mut str_tmp = String::new(); // 暂存atoms
-    let mut atoms_tmp = Vec::new(); // 最终的atoms
-    for elem in str.chars() {
-        if elem == '(' {
-            continue;
-        }
-        if elem == '|' || elem == ')' {
-            if str_tmp.len() as i32 >= min_atoms_len {
-                atoms_tmp.push(str_tmp.clone());
+// Exact sets bigger than this are given up on, as in RE2.
+const PREFILTER_MAX_EXACT: usize = 16;
+
+// Lowercases c as RE2 does: only ASCII for Latin-1, else the simple
+// (single character) Unicode lowercase mapping.
+fn rure_prefilter_lower(c: char, latin1: bool) -> char {
+    if latin1 || c.is_ascii() {
+        return c.to_ascii_lowercase();
+    }
+    let mut lower = c.to_lowercase();
+    match (lower.next(), lower.next()) {
+        (Some(l), None) => l,
+        _ => c,
+    }
+}
+
+fn rure_prefilter_lower_bytes(bytes: &[u8], latin1: bool) -> Vec<u8> {
+    match str::from_utf8(bytes) {
+        Ok(s) => s
+            .chars()
+            .map(|c| rure_prefilter_lower(c, latin1))
+            .collect::<String>()
+            .into_bytes(),
+        Err(_) => bytes.to_ascii_lowercase(),
+    }
+}
+
+impl PrefilterExpr {
+    // Builds `a AND b` or `a OR b`, folding away ALL and NONE and merging
+    // nodes of the same operation.
+    fn and_or(is_and: bool, a: PrefilterExpr, b: PrefilterExpr) -> PrefilterExpr {
+        use PrefilterExpr::*;
+
+        match (is_and, a.simplify(), b.simplify()) {
+            (true, All, x) | (true, x, All) => x,
+            (true, None, _) | (true, _, None) => None,
+            (false, None, x) | (false, x, None) => x,
+            (false, All, _) | (false, _, All) => All,
+            (true, And(mut a), And(b)) => {
+                a.extend(b);
+                And(a)
             }
-            str_tmp.clear();
-            continue;
-        } else {
-            str_tmp.push(elem);
+            (true, And(mut a), x) | (true, x, And(mut a)) => {
+                a.push(x);
+                And(a)
+            }
+            (true, a, b) => And(vec![a, b]),
+            (false, Or(mut a), Or(b)) => {
+                a.extend(b);
+                Or(a)
+            }
+            (false, Or(mut a), x) | (false, x, Or(mut a)) => {
+                a.push(x);
+                Or(a)
+            }
+            (false, a, b) => Or(vec![a, b]),
         }
     }
-    atoms_tmp.sort_by_key(|a| a.len());
 
-    for i in 0..atoms_tmp.len() {
-        let mut j = i + 1;
-        while j < atoms_tmp.len() {
-            if atoms_tmp[j].contains(atoms_tmp[i].as_str()) && !atoms_tmp[i].is_empty() {
-                atoms_tmp.remove(j);
-            } else {
-                j += 1;
+    fn simplify(self) -> PrefilterExpr {
+        use PrefilterExpr::*;
+
+        match self {
+            And(ref subs) if subs.is_empty() => All,
+            Or(ref subs) if subs.is_empty() => None,
+            And(mut subs) | Or(mut subs) if subs.len() == 1 => subs.pop().unwrap(),
+            x => x,
+        }
+    }
+
+    // The OR of a set of strings. A string that contains another (non-empty)
+    // string of the set adds nothing, since the shorter one must be found
+    // whenever the longer one is.
+    fn or_strings(set: BTreeSet<Vec<u8>>) -> PrefilterExpr {
+        let mut strings: Vec<Vec<u8>> = set.into_iter().collect();
+        strings.sort_by(|a, b| a.len().cmp(&b.len()).then(a.cmp(b)));
+        let mut kept: Vec<Vec<u8>> = Vec::new();
+        for s in strings {
+            let redundant = kept
+                .iter()
+                .any(|k| !k.is_empty() && s.windows(k.len()).any(|w| w == &k[..]));
+            if !redundant {
+                kept.push(s);
             }
         }
+        kept.into_iter().fold(PrefilterExpr::None, |or, s| {
+            PrefilterExpr::and_or(false, or, PrefilterExpr::Atom(s))
+        })
     }
-    atoms_tmp
 }
 
-/**
- * 处理
- * a[a-c]a[zv]
- * [abc]
- * [a-c]+
- */
+impl PrefilterInfo {
+    fn exact(set: BTreeSet<Vec<u8>>) -> PrefilterInfo {
+        PrefilterInfo {
+            exact: Some(set),
+            expr: PrefilterExpr::All,
+        }
+    }
+
+    fn expr(expr: PrefilterExpr) -> PrefilterInfo {
+        PrefilterInfo { exact: None, expr }
+    }
 
-fn char_class_expansion(str: &str) -> Vec<char> {
-    let mut flag_connect = 0;
-    let mut atoms_chars = Vec::new();
-    let mut vec_char = Vec::new();
-    for elem in str.chars() {
-        if elem == '[' || elem == ']' {
-            continue;
-        } else if elem.is_ascii_alphabetic() || elem.is_ascii_digit() {
-            vec_char.push(elem);
-        } else if elem == '-' {
-            flag_connect = 1;
+    fn empty_string() -> PrefilterInfo {
+        PrefilterInfo::exact(std::iter::once(Vec::new()).collect())
+    }
+
+    fn take_expr(self) -> PrefilterExpr {
+        match self.exact {
+            Some(set) => PrefilterExpr::or_strings(set),
+            None => self.expr,
         }
     }
-    if flag_connect == 1 {
-        let x = vec_char[0];
-        let y = vec_char[1];
-        for elem in x..=y {
-            atoms_chars.push(elem);
+
+    fn and(a: Option<PrefilterInfo>, b: Option<PrefilterInfo>) -> Option<PrefilterInfo> {
+        match (a, b) {
+            (None, x) | (x, None) => x,
+            (Some(a), Some(b)) => Some(PrefilterInfo::expr(PrefilterExpr::and_or(
+                true,
+                a.take_expr(),
+                b.take_expr(),
+            ))),
         }
-    } else {
-        atoms_chars = vec_char;
     }
 
-    atoms_chars
-}
+    fn alt(a: PrefilterInfo, b: PrefilterInfo) -> PrefilterInfo {
+        match (a.exact, b.exact) {
+            (Some(mut a), Some(b)) => {
+                a.extend(b);
+                PrefilterInfo::exact(a)
+            }
+            (a_exact, b_exact) => {
+                let a = PrefilterInfo {
+                    exact: a_exact,
+                    expr: a.expr,
+                };
+                let b = PrefilterInfo {
+                    exact: b_exact,
+                    expr: b.expr,
+                };
+                PrefilterInfo::expr(PrefilterExpr::and_or(false, a.take_expr(), b.take_expr()))
+            }
+        }
+    }
 
-fn my_compile(str: &str, min_atoms_len: i32) -> MyVec {
-    let mut my_atoms = Vec::new(); // 所有的的原子
-    let mut atoms_tmp_string = String::new(); // 暂时存储的字符串
-    let mut vec_chars_con: Vec<String> = Vec::new();
-    // 将所有的大写字符转换为小写
-    let str = str.to_lowercase();
-    let chars = str.chars().collect::<Vec<char>>();
-    let mut i = 0;
-    while i < chars.len() {
-        // 处理分组括号
-        if chars[i] == '(' {
-            let group_start_post = i;
-            while chars[i] != ')' {
-                i += 1;
+    // Concatenates pieces: runs of exact pieces become the cross product of
+    // their sets for as long as that stays small; everything else is ANDed.
+    fn concat(pieces: impl Iterator<Item = PrefilterInfo>) -> PrefilterInfo {
+        let mut info: Option<PrefilterInfo> = None;
+        let mut exact: Option<BTreeSet<Vec<u8>>> = None;
+        for piece in pieces {
+            let fits = match (&piece.exact, &exact) {
+                (Some(p), Some(e)) => p.len() * e.len() <= PREFILTER_MAX_EXACT,
+                (Some(_), None) => true,
+                (None, _) => false,
+            };
+            if !fits {
+                info = PrefilterInfo::and(info, exact.take().map(PrefilterInfo::exact));
+                info = PrefilterInfo::and(info, Some(piece));
+                continue;
             }
-            let group_end_post = i;
-            let str_group = &str[group_start_post..group_end_post + 1];
-            let vec = group_multiple_selection(str_group, min_atoms_len);
-
-            let mut tmp_post_group = i;
-            tmp_post_group += 1;
-            if tmp_post_group >= chars.len() {
-                if !vec.is_empty() {
-                    // 右括号为自后一个字符的情况
-                    for elem in vec {
-                        my_atoms.push(Atoms {
-                            atom: CString::new(elem).unwrap().into_raw(),
-                        });
+            let piece = piece.exact.unwrap();
+            exact = Some(match exact.take() {
+                None => piece,
+                Some(e) => {
+                    let mut product = BTreeSet::new();
+                    for a in e.iter() {
+                        for b in piece.iter() {
+                            let mut ab = a.clone();
+                            ab.extend_from_slice(b);
+                            product.insert(ab);
+                        }
                     }
+                    product
                 }
-                i += 1;
-                continue;
-            }
-            if chars[tmp_post_group] == '.' && !vec.is_empty() {
-                i += 1;
-                for elem in vec {
-                    my_atoms.push(Atoms {
-                        atom: CString::new(elem).unwrap().into_raw(),
-                    });
+            });
+        }
+        PrefilterInfo::and(info, exact.map(PrefilterInfo::exact))
+            .unwrap_or_else(PrefilterInfo::empty_string)
+    }
+}
+
+fn rure_prefilter_info(hir: &regex_syntax::hir::Hir, latin1: bool) -> PrefilterInfo {
+    use regex_syntax::hir::{Class, HirKind};
+
+    match *hir.kind() {
+        HirKind::Empty | HirKind::Look(_) => PrefilterInfo::empty_string(),
+        HirKind::Literal(ref lit) => {
+            let lower = rure_prefilter_lower_bytes(&lit.0, latin1);
+            PrefilterInfo::exact(std::iter::once(lower).collect())
+        }
+        HirKind::Class(ref class) => {
+            // Small classes are expanded; large ones could be anything.
+            let mut set = BTreeSet::new();
+            match *class {
+                Class::Unicode(ref cls) => {
+                    let mut n = 0;
+                    for r in cls.iter() {
+                        n += r.end() as u32 - r.start() as u32 + 1;
+                        if n as usize > 4 {
+                            return PrefilterInfo::expr(PrefilterExpr::All);
+                        }
+                        for c in r.start()..=r.end() {
+                            let c = rure_prefilter_lower(c, latin1);
+                            set.insert(c.to_string().into_bytes());
+                        }
+                    }
                 }
-            } else if chars[tmp_post_group] == '{' && !vec.is_empty() {
-                for elem in vec {
-                    my_atoms.push(Atoms {
-                        atom: CString::new(elem).unwrap().into_raw(),
-                    });
+                Class::Bytes(ref cls) => {
+                    let mut n = 0;
+                    for r in cls.iter() {
+                        n += r.end() as u32 - r.start() as u32 + 1;
+                        if n as usize > 4 {
+                            return PrefilterInfo::expr(PrefilterExpr::All);
+                        }
+                        for b in r.start()..=r.end() {
+                            set.insert(vec![b.to_ascii_lowercase()]);
+                        }
+                    }
                 }
             }
-            i += 1;
-            continue;
+            if set.is_empty() {
+                return PrefilterInfo::expr(PrefilterExpr::None);
+            }
+            PrefilterInfo::exact(set)
         }
-        if chars[i] == '.' {
-            if atoms_tmp_string.len() as i32 >= min_atoms_len && vec_chars_con.is_empty() {
-                my_atoms.push(Atoms {
-                    atom: CString::new(atoms_tmp_string.clone()).unwrap().into_raw(),
-                });
-            }
-            if !vec_chars_con.is_empty() && !atoms_tmp_string.is_empty() {
-                for elems in vec_chars_con.clone() {
-                    my_atoms.push(Atoms {
-                        atom: CString::new(format!("{}{}", elems.clone(), atoms_tmp_string))
-                            .unwrap()
-                            .into_raw(),
-                    });
-                }
-                vec_chars_con.clear();
+        HirKind::Repetition(ref rep) => {
+            if rep.min == 0 {
+                return PrefilterInfo::expr(PrefilterExpr::All);
             }
-            atoms_tmp_string.clear();
-            i += 1;
-            continue;
+            // x{n,m} requires n copies of x in a row. Beyond a few copies the
+            // atoms only get longer, so the run is cut short and treated as
+            // inexact, as is any optional tail.
+            let sub = rure_prefilter_info(&rep.sub, latin1);
+            let copies = rep.min.min(PREFILTER_MAX_EXACT as u32);
+            let tail = if rep.max == Some(copies) {
+                None
+            } else {
+                Some(PrefilterInfo::expr(PrefilterExpr::All))
+            };
+            PrefilterInfo::concat(
+                std::iter::repeat(sub)
+                    .take(copies as usize)
+                    .chain(tail.into_iter()),
+            )
         }
-
-        if chars[i] == '*' || chars[i] == '+' {
-            i += 1;
-            continue;
+        HirKind::Capture(ref cap) => rure_prefilter_info(&cap.sub, latin1),
+        HirKind::Concat(ref subs) => {
+            PrefilterInfo::concat(subs.iter().map(|sub| rure_prefilter_info(sub, latin1)))
+        }
+        HirKind::Alternation(ref subs) => {
+            let mut infos = subs.iter().map(|sub| rure_prefilter_info(sub, latin1));
+            let first = infos.next().unwrap_or_else(PrefilterInfo::empty_string);
+            infos.fold(first, PrefilterInfo::alt)
         }
+    }
+}
 
-        // 处理多个字符集
-        if chars[i] == '[' {
-            let start_post = i;
-            while chars[i] != ']' {
-                i += 1;
-            }
-            let mut plus_tmp = i;
-            plus_tmp += 1;
-            if plus_tmp < chars.len()
-                && chars[plus_tmp] == '+'
-                && atoms_tmp_string.len() as i32 >= min_atoms_len
-            {
-                my_atoms.push(Atoms {
-                    atom: CString::new(atoms_tmp_string.clone()).unwrap().into_raw(),
-                });
-                atoms_tmp_string.clear();
-                i += 2;
-                continue;
-            }
-            let str_char_set = &str[start_post..plus_tmp];
-            if !atoms_tmp_string.is_empty() && !vec_chars_con.is_empty() {
-                for elem in vec_chars_con.clone() {
-                    vec_chars_con.push(format!("{}{}", elem, atoms_tmp_string));
-                }
-                atoms_tmp_string.clear();
-            }
-            let atoms_tmp = char_class_expansion(str_char_set);
-            vec_chars_con = connection(atoms_tmp_string.as_str(), vec_chars_con, atoms_tmp);
-            atoms_tmp_string.clear();
-
-            if i == chars.len() - 1 && !vec_chars_con.is_empty() {
-                for elem in vec_chars_con.clone() {
-                    if elem.len() as i32 >= min_atoms_len {
-                        my_atoms.push(Atoms {
-                            atom: CString::new(elem).unwrap().into_raw(),
-                        });
-                    }
+// Appends the nodes of expr, children first, and returns the index of its
+// root. For Latin-1 patterns, atoms are converted back to Latin-1.
+fn rure_prefilter_flatten(
+    expr: &PrefilterExpr,
+    latin1: bool,
+    nodes: &mut Vec<PrefilterNode>,
+) -> size_t {
+    let node = match *expr {
+        PrefilterExpr::All => PrefilterNode {
+            op: RURE_PREFILTER_ALL,
+            atom: Vec::new(),
+            children: Vec::new(),
+        },
+        PrefilterExpr::None => PrefilterNode {
+            op: RURE_PREFILTER_NONE,
+            atom: Vec::new(),
+            children: Vec::new(),
+        },
+        PrefilterExpr::Atom(ref atom) => {
+            let atom = if latin1 {
+                match str::from_utf8(atom) {
+                    Ok(s) => s.chars().map(|c| c as u32 as u8).collect(),
+                    Err(_) => atom.clone(),
                 }
+            } else {
+                atom.clone()
+            };
+            PrefilterNode {
+                op: RURE_PREFILTER_ATOM,
+                atom,
+                children: Vec::new(),
             }
-            i += 1;
-            continue;
         }
-
-        if chars[i] == '{' {
-            while chars[i] != '}' {
-                i += 1;
+        PrefilterExpr::And(ref subs) | PrefilterExpr::Or(ref subs) => {
+            let children = subs
+                .iter()
+                .map(|sub| rure_prefilter_flatten(sub, latin1, nodes))
+                .collect();
+            let op = match *expr {
+                PrefilterExpr::And(_) => RURE_PREFILTER_AND,
+                _ => RURE_PREFILTER_OR,
+            };
+            PrefilterNode {
+                op,
+                atom: Vec::new(),
+                children,
             }
-            i += 1;
-            continue;
         }
+    };
+    nodes.push(node);
+    nodes.len() - 1
+}
 
-        if chars[i] == '\\' {
-            if atoms_tmp_string.len() as i32 >= min_atoms_len {
-                my_atoms.push(Atoms {
-                    atom: CString::new(atoms_tmp_string.clone()).unwrap().into_raw(),
-                });
-                atoms_tmp_string.clear();
+// Atoms with more case-insensitive spellings than this are not searched for;
+// they are reported as occurring in every haystack instead.
+const ATOM_MAX_SPELLINGS: usize = 16;
+
+fn rure_atoms_internal(atoms: &[&[u8]]) -> Option<AtomMatcher> {
+    let mut patterns = Vec::new();
+    let mut ids = Vec::new();
+    let mut always = Vec::new();
+    for (i, atom) in atoms.iter().enumerate() {
+        // An empty atom would match at every position.
+        let spellings = if atom.is_empty() {
+            None
+        } else {
+            rure_atom_spellings(atom)
+        };
+        match spellings {
+            Some(spellings) => {
+                for spelling in spellings {
+                    patterns.push(spelling);
+                    ids.push(i as u32);
+                }
             }
-            i += 2;
-            continue;
+            None => always.push(i as u32),
         }
+    }
+    let ac = AhoCorasickBuilder::new()
+        .ascii_case_insensitive(true)
+        .build(&patterns)
+        .ok()?;
+    Some(AtomMatcher { ac, ids, always })
+}
 
-        if chars[i] != '+' {
-            atoms_tmp_string.push(chars[i]);
-        }
+// Returns the spellings of a lowercased atom that the matcher has to look
+// for, or None if there are too many of them. ASCII letters are left to
+// the matcher's ASCII case insensitivity, so only the other characters of
+// UTF-8 atoms are spelled out in every case (simple case folding). Atoms
+// that are not UTF-8 come from Latin-1 patterns, whose prefilters already
+// spell out non-ASCII letters in both cases.
+fn rure_atom_spellings(atom: &[u8]) -> Option<Vec<Vec<u8>>> {
+    use regex_syntax::hir::{ClassUnicode, ClassUnicodeRange};
 
-        if i == chars.len() - 1 && atoms_tmp_string.len() as i32 >= min_atoms_len {
-            my_atoms.push(Atoms {
-                atom: CString::new(atoms_tmp_string.clone()).unwrap().into_raw(),
-            });
-            atoms_tmp_string.clear();
+    let atom = match str::from_utf8(atom) {
+        Ok(atom) if !atom.is_ascii() => atom,
+        _ => return Some(vec![atom.to_vec()]),
+    };
+    let mut spellings = vec![Vec::new()];
+    for c in atom.chars() {
+        let mut class = ClassUnicode::new([ClassUnicodeRange::new(c, c)]);
+        if !c.is_ascii() {
+            class.case_fold_simple();
         }
-        i += 1;
+        let chars: Vec<char> = class.iter().flat_map(|r| r.start()..=r.end()).collect();
+        if spellings.len() * chars.len() > ATOM_MAX_SPELLINGS {
+            return None;
+        }
+        let mut next = Vec::with_capacity(spellings.len() * chars.len());
+        for spelling in &spellings {
+            for &c in &chars {
+                let mut s: Vec<u8> = spelling.clone();
+                s.extend_from_slice(c.encode_utf8(&mut [0; 4]).as_bytes());
+                next.push(s);
+            }
+        }
+        spellings = next;
+    }
+    Some(spellings)
+}
+
+// Writes the indices of the atoms that occur in haystack to ids, in
+// increasing order and stopping when ids is full, and returns how many
+// there are.
+fn rure_atoms_match_internal(m: &AtomMatcher, haystack: &[u8], ids: &mut [i32]) -> usize {
+    let mut found: Vec<u32> =
+        m.ac.find_overlapping_iter(haystack)
+            .map(|mat| m.ids[mat.pattern().as_usize()])
+            .collect();
+    found.extend_from_slice(&m.always);
+    found.sort_unstable();
+    found.dedup();
+    for (dst, &id) in ids.iter_mut().zip(&found) {
+        *dst = id as i32;
     }
-    let mut a = my_atoms.into_boxed_slice();
-    let data = a.as_mut_ptr();
-    let len = a.len() as i32;
-    std::mem::forget(a);
-    MyVec { data, len }
+    found.len()
 }